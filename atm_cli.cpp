@@ -0,0 +1,308 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <ctime>
+
+#include "core/atm.h"
+#include "core/metrics.h"
+
+using namespace std;
+
+// Command line front end for the same engine the window uses.
+// Reads one command per line from stdin, so it can be driven by hand or
+// from a script:  atm_cli [-d datadir] [-i iterations] [-m metrics.json] [-v] < commands.txt
+// The data directory must already exist. With -m the metrics are written
+// to that file every METRICS_INTERVAL seconds while commands arrive. With
+// -v every data file is checked (and what can be repaired, repaired)
+// before the first command.
+
+// Rows shown by one "users" page
+const size_t USERS_PAGE = 20;
+
+const int METRICS_INTERVAL = 10;
+
+// The engine formats text for the Windows edit control
+string toConsole(string text) {
+    size_t pos;
+    while ((pos = text.find("\r\n")) != string::npos) text.erase(pos, 1);
+    return text;
+}
+
+void printText(const string& text) {
+    string line = toConsole(text);
+    if (line.empty() || line.back() != '\n') line += '\n';
+    cout << line;
+}
+
+void printHelp() {
+    cout << "Commands:\n"
+         << "  register <user> <password>      login <user> <password>      logout\n"
+         << "  deposit <amount>                withdraw <amount>            balance\n"
+         << "  transfer <user> <amount>        history\n"
+         << "  balance-at <time> [user]        flow <from> <to> [user]\n"
+         << "    (times are YYYY-MM-DD, the end of that day, or YYYY-MM-DDThh:mm[:ss], local time)\n"
+         << "    (deposits, withdrawals and transfers, the admin's too, take an optional last word, a key:\n"
+         << "     sent again with the same key, a request gets the first answer and is not run twice)\n"
+         << "Admin:\n"
+         << "  users [page]                    sort name|balance|status     filter [text]\n"
+         << "  find <text>                     (usernames starting with it, then close ones)\n"
+         << "  history <user>                  freeze <user>\n"
+         << "  reset <user> <new password>     admin-deposit <user> <amount>\n"
+         << "  admin-withdraw <user> <amount>  export <file>                import <file>\n"
+         << "  admin-transfer <from> <to> <amount>\n"
+         << "  batch <file>                    (lines of \"username amount D|W\")\n"
+         << "  limits <user> [<daily> <single> <per hour>]   (show or set withdrawal limits, 0 = none)\n"
+         << "  verify [repair]                 (check snapshots, journal, logs, indexes and archives)\n"
+         << "  report [<from> <to>]            (totals, days and top accounts; default all time)\n"
+         << "  archive [days]                  (compress history older than this, default 90 days)\n"
+         << "  stats                           metrics [file]               (timings and I/O counts)\n"
+         << "  help                            quit\n";
+}
+
+// Positive amount from the command line, as the window accepts them
+bool readAmount(istringstream& in, Money& amount) {
+    string text;
+    if (!(in >> text) || !Money::parse(text, amount) || amount <= Money()) {
+        cout << "Please enter a valid amount\n";
+        return false;
+    }
+    return true;
+}
+
+// Optional idempotency key after a money command
+bool readKey(istringstream& in, string& key) {
+    key.clear();
+    if (!(in >> key) || DedupCache::validKey(key)) return true;
+    cout << "A key is 1 to " << DedupCache::MAX_KEY_LENGTH << " letters, digits or -_.:\n";
+    return false;
+}
+
+// YYYY-MM-DD or YYYY-MM-DDThh:mm[:ss] in local time. A bare date is the
+// start of the day, or its last second if endOfDay is set.
+bool readTime(istringstream& in, bool endOfDay, long long& when) {
+    string text;
+    struct tm parts = {};
+    int seconds = 0;
+    int fields = 0;
+    if (in >> text) {
+        fields = sscanf(text.c_str(), "%d-%d-%dT%d:%d:%d", &parts.tm_year, &parts.tm_mon, &parts.tm_mday,
+                        &parts.tm_hour, &parts.tm_min, &seconds);
+    }
+    if (fields != 3 && fields < 5) {
+        cout << "Please enter a time as YYYY-MM-DD or YYYY-MM-DDThh:mm[:ss]\n";
+        return false;
+    }
+    parts.tm_year -= 1900;
+    parts.tm_mon -= 1;
+    parts.tm_sec = seconds;
+    if (fields == 3 && endOfDay) {
+        parts.tm_hour = 23;
+        parts.tm_min = 59;
+        parts.tm_sec = 59;
+    }
+    parts.tm_isdst = -1;
+    when = (long long)mktime(&parts);
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    string dataDir = ".";
+    unsigned long iterations = Bank::DEFAULT_PASSWORD_ITERATIONS;
+    bool verifyFirst = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            dataDir = argv[++i];
+        } else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            iterations = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            metrics::setDumpFile(argv[++i], METRICS_INTERVAL);
+        } else if (strcmp(argv[i], "-v") == 0) {
+            verifyFirst = true;
+        } else {
+            cerr << "Usage: " << argv[0] << " [-d datadir] [-i password hash iterations] [-m metrics file] [-v]\n";
+            return 1;
+        }
+    }
+
+    Bank bank(dataDir);
+    bank.setPasswordIterations((unsigned int)iterations);
+    string problems = bank.describeStartupProblems();
+    if (!problems.empty()) cerr << toConsole(problems) << "\n";
+    if (verifyFirst) cerr << toConsole(bank.verify(true).describe()) << "\n";
+    ATM atm(bank);
+    AdminUserView userView(bank);
+
+    string line;
+    while (getline(cin, line)) {
+        istringstream in(line);
+        string command;
+        if (!(in >> command)) continue;
+
+        // Group commit deadlines are driven by the window timer in the GUI
+        atm.tick();
+
+        string user, password, path, key;
+        Money amount;
+        if (command == "quit" || command == "exit") {
+            break;
+        } else if (command == "help") {
+            printHelp();
+        } else if (command == "register") {
+            if (!(in >> user >> password)) { cout << "Usage: register <user> <password>\n"; continue; }
+            if (!Bank::validUsername(user)) {
+                cout << "Usernames are 1 to " << Bank::MAX_USERNAME_LENGTH
+                     << " letters, digits, '_', '.' or '-' (and not \"admin\")\n";
+                continue;
+            }
+            cout << (atm.registerUser(user, password) ? "Registration successful!" : "Username already exists!") << "\n";
+        } else if (command == "login") {
+            if (!(in >> user >> password)) { cout << "Usage: login <user> <password>\n"; continue; }
+            if (atm.login(user, password)) {
+                cout << "Welcome, " << user << (atm.isUserAdmin() ? " (admin)" : "") << "\n";
+            } else {
+                cout << "Invalid username or password, or account is frozen.\n";
+            }
+        } else if (command == "logout") {
+            atm.logout();
+            cout << "Logged out\n";
+        } else if (command == "deposit") {
+            if (!readAmount(in, amount) || !readKey(in, key)) continue;
+            if (atm.deposit(amount, nullptr, key)) cout << "Deposit successful!\n";
+            else cout << (atm.isUserLoggedIn() ? "Deposit failed!" : "Not logged in (or session ended)") << "\n";
+        } else if (command == "withdraw") {
+            if (!readAmount(in, amount) || !readKey(in, key)) continue;
+            if (atm.withdraw(amount, nullptr, key)) cout << "Withdrawal successful!\n";
+            else if (!atm.isUserLoggedIn()) cout << "Not logged in (or session ended)\n";
+            else if (atm.getLastLimitCheck() != LIMIT_OK) cout << "Refused: " << limitCheckText(atm.getLastLimitCheck()) << "\n";
+            else cout << "Insufficient funds!\n";
+        } else if (command == "transfer") {
+            if (!(in >> user)) { cout << "Usage: transfer <user> <amount>\n"; continue; }
+            if (!readAmount(in, amount) || !readKey(in, key)) continue;
+            if (atm.transfer(user, amount, key)) cout << "Transferred Rs" << amount.toString() << " to " << user << "\n";
+            else if (!atm.isUserLoggedIn()) cout << "Not logged in (or session ended)\n";
+            else if (atm.getLastLimitCheck() != LIMIT_OK) cout << "Refused: " << limitCheckText(atm.getLastLimitCheck()) << "\n";
+            else cout << "Transfer failed: unknown account or insufficient funds\n";
+        } else if (command == "balance") {
+            cout << atm.getBalance() << "\n";
+        } else if (command == "history") {
+            printText(in >> user ? atm.getUserTransactionHistory(user) : atm.getTransactionHistory());
+        } else if (command == "balance-at") {
+            long long when;
+            if (!readTime(in, true, when)) continue;
+            bool other = static_cast<bool>(in >> user);
+            if (other && !atm.isUserAdmin()) { cout << "Access denied\n"; continue; }
+            bool ok = other ? atm.getUserBalanceAt(user, when, amount) : atm.getBalanceAt(when, amount);
+            if (ok) cout << "Balance then: Rs" << amount.toString() << "\n";
+            else cout << (atm.isUserLoggedIn() ? "No transactions by then" : "Not logged in (or session ended)") << "\n";
+        } else if (command == "flow") {
+            long long from, to;
+            Money out;
+            if (!readTime(in, false, from) || !readTime(in, true, to)) continue;
+            bool other = static_cast<bool>(in >> user);
+            if (other && !atm.isUserAdmin()) { cout << "Access denied\n"; continue; }
+            bool ok = other ? atm.getUserFlowBetween(user, from, to, amount, out)
+                            : atm.getFlowBetween(from, to, amount, out);
+            if (!ok) { cout << (atm.isUserLoggedIn() ? "No such user" : "Not logged in (or session ended)") << "\n"; continue; }
+            cout << "In: Rs" << amount.toString() << "  Out: Rs" << out.toString()
+                 << "  Net: Rs" << (amount - out).toString() << "\n";
+        } else if (command == "users") {
+            size_t page = 1;
+            if (!(in >> page) || page == 0) page = 1;
+            if (!atm.isUserAdmin()) { cout << "Access denied\n"; continue; }
+            atm.refreshUserView(userView);
+            size_t pages = (userView.count() + USERS_PAGE - 1) / USERS_PAGE;
+            if (page > pages) { cout << "No users on page " << page << " (" << pages << " pages)\n"; continue; }
+            cout << "Users " << (page - 1) * USERS_PAGE + 1 << "-"
+                 << min(page * USERS_PAGE, userView.count()) << " of " << userView.count()
+                 << " (page " << page << " of " << pages << ")\n";
+            cout << toConsole(userView.page((page - 1) * USERS_PAGE, USERS_PAGE));
+        } else if (command == "sort") {
+            string order;
+            in >> order;
+            if (order == "name") userView.sortBy(AdminUserView::BY_NAME);
+            else if (order == "balance") userView.sortBy(AdminUserView::BY_BALANCE);
+            else if (order == "status") userView.sortBy(AdminUserView::BY_STATUS);
+            else { cout << "Usage: sort name|balance|status\n"; continue; }
+            cout << "Sorted by " << order << (userView.isDescending() ? " (descending)" : "") << "\n";
+        } else if (command == "filter") {
+            string text;
+            in >> text;
+            userView.setFilter(text);
+            cout << (text.empty() ? "Filter cleared" : "Showing users containing \"" + text + "\"") << "\n";
+        } else if (command == "find") {
+            string text;
+            if (!(in >> text)) { cout << "Usage: find <text>\n"; continue; }
+            vector<string> names;
+            if (!atm.searchUsers(text, USERS_PAGE, names)) { cout << "Access denied\n"; continue; }
+            if (names.empty()) { cout << "No users match \"" << text << "\"\n"; continue; }
+            for (const auto& name : names) cout << "  " << name << "\n";
+        } else if (command == "reset") {
+            if (!(in >> user >> password)) { cout << "Usage: reset <user> <new password>\n"; continue; }
+            cout << (atm.resetPassword(user, password) ? "Password reset successful" : "Password reset failed") << "\n";
+        } else if (command == "freeze") {
+            if (!(in >> user)) { cout << "Usage: freeze <user>\n"; continue; }
+            if (atm.toggleFreezeAccount(user)) {
+                cout << "Account " << (atm.isUserFrozen(user) ? "frozen" : "unfrozen") << "\n";
+            } else {
+                cout << "Operation failed\n";
+            }
+        } else if (command == "admin-deposit" || command == "admin-withdraw") {
+            if (!(in >> user) || !readAmount(in, amount) || !readKey(in, key)) continue;
+            bool ok = command == "admin-deposit" ? atm.adminDeposit(user, amount, key)
+                                                 : atm.adminWithdraw(user, amount, key);
+            cout << (ok ? "Balance updated" : "Operation failed") << "\n";
+        } else if (command == "admin-transfer") {
+            string to;
+            if (!(in >> user >> to)) { cout << "Usage: admin-transfer <from> <to> <amount>\n"; continue; }
+            if (!readAmount(in, amount) || !readKey(in, key)) continue;
+            cout << (atm.adminTransfer(user, to, amount, key) ? "Balances updated" : "Operation failed") << "\n";
+        } else if (command == "export" || command == "import") {
+            if (!(in >> path)) { cout << "Usage: " << command << " <file>\n"; continue; }
+            string problem;
+            bool ok = command == "export" ? atm.exportText(path) : atm.importText(path, &problem);
+            cout << (ok ? "Done" : "Failed") << (problem.empty() ? "" : ": " + path + " " + problem) << "\n";
+        } else if (command == "batch") {
+            if (!(in >> path)) { cout << "Usage: batch <file>\n"; continue; }
+            printText(atm.runBatchFile(path));
+        } else if (command == "limits") {
+            string daily, single, perHour;
+            WithdrawalLimits limits;
+            if (!(in >> user)) { cout << "Usage: limits <user> [<daily> <single> <per hour>]\n"; continue; }
+            if (in >> daily) {
+                if (!(in >> single >> perHour) || !WithdrawalLimits::parse(daily, single, perHour, limits)) {
+                    cout << "Usage: limits <user> <daily amount> <single amount> <withdrawals per hour>\n";
+                    continue;
+                }
+                if (!atm.setUserLimits(user, limits)) { cout << "Operation failed\n"; continue; }
+            }
+            if (atm.getUserLimits(user, limits)) cout << "Limits for " << user << ": " << limits.describe() << "\n";
+            else cout << "Operation failed\n";
+        } else if (command == "verify") {
+            string mode;
+            in >> mode;
+            if (!mode.empty() && mode != "repair") { cout << "Usage: verify [repair]\n"; continue; }
+            printText(atm.verifyData(mode == "repair"));
+        } else if (command == "report") {
+            long long from = 0, to = (long long)time(0);
+            in >> ws;
+            if (!in.eof() && (!readTime(in, false, from) || !readTime(in, true, to))) continue;
+            printText(atm.bankReport(from, to));
+        } else if (command == "archive") {
+            int days = 90;
+            in >> ws;
+            if (!in.eof() && (!(in >> days) || days < 0)) { cout << "Usage: archive [days]\n"; continue; }
+            printText(atm.archiveHistory(days));
+        } else if (command == "stats") {
+            printText(atm.describeLogStats());
+        } else if (command == "metrics") {
+            if (!(in >> path)) printText(metrics::dumpText());
+            else cout << (metrics::writeFile(path) ? "Metrics written to " + path : "Failed") << "\n";
+        } else {
+            cout << "Unknown command, type help\n";
+        }
+    }
+    return 0;
+}
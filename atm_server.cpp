@@ -0,0 +1,481 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "core/atm.h"
+#include "core/metrics.h"
+#include "core/protocol.h"
+
+using namespace std;
+
+// Socket front end for the same engine: serves many ATM terminals from
+// one process over the binary protocol in core/protocol.h, on a TCP port
+// or a Unix-domain socket. Linux only (epoll).
+//   atm_server [-d datadir] [-i iterations] [-p port | -u socket] [-t workers] [-m metrics.json]
+// The data directory must already exist. Stop it with Ctrl+C (SIGINT) or
+// SIGTERM; what is running finishes and the data is saved.
+//
+// One thread waits on every socket with epoll and does all the reading
+// and writing. Requests run on a pool of workers, since a login takes a
+// deliberately slow password check and any request may wait for a disk
+// flush. Each connection is one terminal with its own ATM session, and
+// has at most one job on the workers at a time: everything it has sent
+// by then is run in order as that job, so a client that pipelines its
+// requests pays for one job and one write per batch instead of per
+// request.
+
+const int DEFAULT_PORT = 7878;
+const int TICK_MILLIS = 1000;                 // Bank::tick(), as the window timer does
+const size_t MAX_BATCH = 256;                 // requests run by one job
+const size_t MAX_UNSENT = 1024 * 1024;        // stop reading a client that does not read
+const int METRICS_INTERVAL = 10;
+
+struct Connection {
+    int fd;
+    ATM atm;
+    string in;          // received, not yet run
+    string out;         // responses not yet sent
+    size_t sent;        // of 'out'
+    unsigned int events;
+    bool busy;          // a job of its requests is on the workers
+    bool closing;       // the peer is done sending, or broke the protocol
+    bool hungUp;        // nothing more can be sent to it either
+
+    // Owned by the worker while busy
+    vector<pair<size_t, size_t>> frames;   // offset and size in 'batch'
+    string batch;
+    string results;
+
+    Connection(int socket, Bank& bank)
+        : fd(socket), atm(bank), sent(0), events(0), busy(false), closing(false), hungUp(false) {}
+};
+
+// Runs connections' batches of requests and the bank's housekeeping on a
+// fixed set of threads, handing finished connections back to the loop.
+class WorkerPool {
+private:
+    Bank& bank;
+    int wakeFd;                       // eventfd the loop waits on
+    deque<Connection*> jobs;          // nullptr is a tick
+    deque<Connection*> finished;
+    bool tickQueued;
+    bool stopping;
+    mutex lock;
+    condition_variable wake;
+    vector<thread> threads;
+
+    void run() {
+        for (;;) {
+            Connection* connection;
+            {
+                unique_lock<mutex> guard(lock);
+                wake.wait(guard, [this] { return stopping || !jobs.empty(); });
+                if (jobs.empty()) return;
+                connection = jobs.front();
+                jobs.pop_front();
+            }
+            if (!connection) {
+                bank.tick();
+                lock_guard<mutex> guard(lock);
+                tickQueued = false;
+                continue;
+            }
+            for (const auto& frame : connection->frames) {
+                serveRequest(connection->atm, connection->batch.data() + frame.first, frame.second,
+                             connection->results);
+            }
+            {
+                lock_guard<mutex> guard(lock);
+                finished.push_back(connection);
+            }
+            unsigned long long one = 1;
+            if (write(wakeFd, &one, sizeof(one)) < 0) {}
+        }
+    }
+
+public:
+    WorkerPool(Bank& b, int wakeEvent, size_t count)
+        : bank(b), wakeFd(wakeEvent), tickQueued(false), stopping(false) {
+        for (size_t i = 0; i < count; i++) threads.emplace_back([this] { run(); });
+    }
+
+    ~WorkerPool() { stop(); }
+
+    // Finish the queued jobs and stop the threads
+    void stop() {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : threads) worker.join();
+        threads.clear();
+    }
+
+    void submit(Connection* connection) {
+        {
+            lock_guard<mutex> guard(lock);
+            jobs.push_back(connection);
+        }
+        wake.notify_one();
+    }
+
+    // Queue a Bank::tick() unless one is already waiting
+    void tick() {
+        {
+            lock_guard<mutex> guard(lock);
+            if (tickQueued) return;
+            tickQueued = true;
+            jobs.push_back(nullptr);
+        }
+        wake.notify_one();
+    }
+
+    void takeFinished(vector<Connection*>& out) {
+        lock_guard<mutex> guard(lock);
+        out.assign(finished.begin(), finished.end());
+        finished.clear();
+    }
+};
+
+static int stopFd = -1;
+
+static void onStopSignal(int) {
+    unsigned long long one = 1;
+    if (write(stopFd, &one, sizeof(one)) < 0) {}
+}
+
+static bool setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+static int listenOn(int port, const string& socketPath) {
+    int fd;
+    if (!socketPath.empty()) {
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if (socketPath.size() >= sizeof(address.sun_path)) return -1;
+        strcpy(address.sun_path, socketPath.c_str());
+        unlink(socketPath.c_str());
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0 || bind(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+            if (fd >= 0) close(fd);
+            return -1;
+        }
+    } else {
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons((unsigned short)port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int on = 1;
+        if (fd >= 0) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (fd < 0 || bind(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+            if (fd >= 0) close(fd);
+            return -1;
+        }
+    }
+    if (listen(fd, SOMAXCONN) != 0 || !setNonBlocking(fd)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+class Server {
+private:
+    Bank& bank;
+    int epollFd, listenFd, wakeFd;
+    bool tcp;
+    WorkerPool workers;
+    unordered_map<int, unique_ptr<Connection>> connections;
+    unsigned long long accepted, requests;
+
+    // Epoll interest: input unless too much output is waiting, output
+    // while some is
+    void updateEvents(Connection& connection) {
+        unsigned int events = 0;
+        size_t unsent = connection.out.size() - connection.sent;
+        if (!connection.closing && unsent < MAX_UNSENT && connection.in.size() < MAX_UNSENT) events |= EPOLLIN;
+        if (unsent > 0) events |= EPOLLOUT;
+        if (events == connection.events) return;
+        epoll_event event = {};
+        event.events = events;
+        event.data.fd = connection.fd;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, connection.fd, &event);
+        connection.events = events;
+    }
+
+    void acceptAll() {
+        for (;;) {
+            int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) return;
+            if (tcp) {
+                int on = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            }
+            unique_ptr<Connection> connection(new Connection(fd, bank));
+            epoll_event event = {};
+            event.events = connection->events = EPOLLIN;
+            event.data.fd = fd;
+            if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+                close(fd);
+                continue;
+            }
+            connections[fd] = move(connection);
+            accepted++;
+        }
+    }
+
+    // Close a connection that has nothing running. Its session stays
+    // open for a RESUME from the terminal's next connection.
+    void drop(Connection& connection) {
+        connection.atm.detach();
+        if (!connection.hungUp) epoll_ctl(epollFd, EPOLL_CTL_DEL, connection.fd, nullptr);
+        close(connection.fd);
+        connections.erase(connection.fd);
+    }
+
+    // Hand the complete requests received so far to the workers
+    void dispatch(Connection& connection) {
+        if (connection.busy) return;
+        size_t used = 0;
+        connection.frames.clear();
+        while (connection.frames.size() < MAX_BATCH) {
+            long size = wireFrameSize(connection.in.data() + used, connection.in.size() - used);
+            if (size < 0) {
+                connection.closing = true;   // not the protocol; answer what came before
+                break;
+            }
+            if (size == 0) break;
+            connection.frames.push_back(make_pair(used, (size_t)size));
+            used += (size_t)size;
+        }
+        if (connection.frames.empty()) return;
+        connection.batch.assign(connection.in, 0, used);
+        connection.in.erase(0, used);
+        connection.results.clear();
+        connection.busy = true;
+        requests += connection.frames.size();
+        workers.submit(&connection);
+    }
+
+    void readFrom(Connection& connection) {
+        char buffer[64 * 1024];
+        for (;;) {
+            ssize_t got = recv(connection.fd, buffer, sizeof(buffer), 0);
+            if (got > 0) {
+                connection.in.append(buffer, (size_t)got);
+                if (connection.in.size() >= MAX_UNSENT) break;
+                continue;
+            }
+            if (got == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+                connection.closing = true;
+            }
+            if (got < 0 && errno == EINTR) continue;
+            break;
+        }
+        dispatch(connection);
+    }
+
+    // False if the connection is gone
+    bool writeTo(Connection& connection) {
+        while (connection.sent < connection.out.size()) {
+            ssize_t put = send(connection.fd, connection.out.data() + connection.sent,
+                               connection.out.size() - connection.sent, MSG_NOSIGNAL);
+            if (put > 0) {
+                connection.sent += (size_t)put;
+                continue;
+            }
+            if (put < 0 && errno == EINTR) continue;
+            if (put < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            connection.closing = true;
+            connection.out.clear();
+            connection.sent = 0;
+            break;
+        }
+        if (connection.sent == connection.out.size()) {
+            connection.out.clear();
+            connection.sent = 0;
+        }
+        return settle(connection);
+    }
+
+    // After any change: close a finished connection, or wait for more
+    bool settle(Connection& connection) {
+        if (connection.closing && !connection.busy && connection.out.empty()) {
+            drop(connection);
+            return false;
+        }
+        if (!connection.hungUp) updateEvents(connection);
+        return true;
+    }
+
+    void collectFinished() {
+        vector<Connection*> done;
+        workers.takeFinished(done);
+        for (Connection* connection : done) {
+            connection->busy = false;
+            if (!connection->hungUp) {
+                connection->out += connection->results;
+                dispatch(*connection);
+            }
+            connection->results.clear();
+            writeTo(*connection);
+        }
+    }
+
+public:
+    Server(Bank& b, int listener, bool overTcp, size_t workerCount)
+        : bank(b), epollFd(epoll_create1(EPOLL_CLOEXEC)), listenFd(listener),
+          wakeFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)), tcp(overTcp), workers(b, wakeFd, workerCount),
+          accepted(0), requests(0) {}
+
+    ~Server() {
+        workers.stop();
+        for (auto& entry : connections) {
+            entry.second->atm.detach();
+            close(entry.first);
+        }
+        close(wakeFd);
+        close(epollFd);
+    }
+
+    bool ready() const { return epollFd >= 0 && wakeFd >= 0; }
+
+    // Serve until 'stop' (an eventfd) is written
+    void run(int stop) {
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = listenFd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event);
+        event.data.fd = wakeFd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+        event.data.fd = stop;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, stop, &event);
+
+        auto nextTick = chrono::steady_clock::now() + chrono::milliseconds(TICK_MILLIS);
+        epoll_event events[256];
+        for (;;) {
+            int wait = (int)max<long long>(0, chrono::duration_cast<chrono::milliseconds>(
+                                                  nextTick - chrono::steady_clock::now()).count());
+            int n = epoll_wait(epollFd, events, 256, wait);
+            for (int i = 0; i < n; i++) {
+                int fd = events[i].data.fd;
+                if (fd == stop) return;
+                if (fd == listenFd) {
+                    acceptAll();
+                } else if (fd == wakeFd) {
+                    unsigned long long count;
+                    if (read(wakeFd, &count, sizeof(count)) < 0) {}
+                    collectFinished();
+                } else {
+                    auto it = connections.find(fd);
+                    if (it == connections.end()) continue;
+                    Connection& connection = *it->second;
+                    if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                        // Stop watching it (a hung up socket is always
+                        // ready) and wait only for a job still running
+                        connection.closing = connection.hungUp = true;
+                        connection.out.clear();
+                        connection.sent = 0;
+                        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+                        connection.events = 0;
+                        settle(connection);
+                        continue;
+                    }
+                    if (events[i].events & EPOLLIN) readFrom(connection);
+                    writeTo(connection);
+                }
+            }
+            if (chrono::steady_clock::now() >= nextTick) {
+                // Through the workers, so the loop never waits on the disk
+                workers.tick();
+                nextTick = chrono::steady_clock::now() + chrono::milliseconds(TICK_MILLIS);
+            }
+        }
+    }
+
+    unsigned long long acceptedCount() const { return accepted; }
+    unsigned long long requestCount() const { return requests; }
+};
+
+int main(int argc, char* argv[]) {
+    string dataDir = ".";
+    string socketPath;
+    unsigned long iterations = Bank::DEFAULT_PASSWORD_ITERATIONS;
+    int port = DEFAULT_PORT;
+    size_t workerCount = max(2u, thread::hardware_concurrency());
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            dataDir = argv[++i];
+        } else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            iterations = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-u") == 0 && i + 1 < argc) {
+            socketPath = argv[++i];
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            workerCount = max(1ul, strtoul(argv[++i], nullptr, 10));
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            metrics::setDumpFile(argv[++i], METRICS_INTERVAL);
+        } else {
+            cerr << "Usage: " << argv[0] << " [-d datadir] [-i password hash iterations]"
+                 << " [-p port | -u socket path] [-t workers] [-m metrics file]\n";
+            return 1;
+        }
+    }
+
+    int listenFd = listenOn(port, socketPath);
+    if (listenFd < 0) {
+        cerr << "Cannot listen on " << (socketPath.empty() ? "port " + to_string(port) : socketPath) << ": "
+             << strerror(errno) << "\n";
+        return 1;
+    }
+    stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    signal(SIGINT, onStopSignal);
+    signal(SIGTERM, onStopSignal);
+
+    Bank bank(dataDir);
+    bank.setPasswordIterations((unsigned int)iterations);
+    string problems = bank.describeStartupProblems();
+    if (!problems.empty()) cerr << problems << "\n";
+    {
+        Server server(bank, listenFd, socketPath.empty(), workerCount);
+        if (!server.ready()) {
+            cerr << "Cannot start the event loop: " << strerror(errno) << "\n";
+            return 1;
+        }
+        cerr << "Serving " << (socketPath.empty() ? "127.0.0.1:" + to_string(port) : socketPath) << " with "
+             << workerCount << " workers\n";
+        server.run(stopFd);
+        cerr << "Stopping after " << server.acceptedCount() << " connections and " << server.requestCount()
+             << " requests\n";
+    }
+    close(listenFd);
+    if (!socketPath.empty()) unlink(socketPath.c_str());
+    return 0;
+}
@@ -0,0 +1,233 @@
+// Archiving old transaction records (Bank::archiveLogs, core/tx_archive.h)
+// over a generated bank: 'accounts' accounts with 'records' log records
+// each, spread over the last 'days' days, of which everything older than
+// 'keep' days is archived. The logs and users.dat are written directly,
+// as in report_bench.
+// Before and after archiving it measures the history files on disk and
+// how fast TransactionReader reads
+//   scan     every record of every account
+//   range    one day in the middle of the archived period, per account
+//   recent   the last 50 records, per account (the history view)
+// and checks that both times every read returns the same records.
+//
+//   g++ -std=c++17 -O2 -I. bench/archive_bench.cpp core/*.cpp -o archive_bench -pthread
+//   ./archive_bench -d <empty folder> [-n accounts] [-r records] [-D days] [-k keep days] [-s seed]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "core/bank.h"
+#include "core/platform.h"
+#include "core/shard.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static double secondsSince(Clock::time_point start) {
+    return chrono::duration<double>(Clock::now() - start).count();
+}
+
+static bool writeLog(const string& path, const vector<TxRecord>& records) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+    char header[TX_HEADER_SIZE];
+    unsigned int recordSize = sizeof(TxRecord);
+    memcpy(header, TX_MAGIC, 8);
+    memcpy(header + 8, &TX_VERSION, 4);
+    memcpy(header + 12, &recordSize, 4);
+    bool ok = fwrite(header, 1, TX_HEADER_SIZE, file) == (size_t)TX_HEADER_SIZE;
+    ok = fwrite(records.data(), sizeof(TxRecord), records.size(), file) == records.size() && ok;
+    return fclose(file) == 0 && ok;
+}
+
+// One account's records in time order. Most amounts are whole rupees
+// (notes at the machine), the rest any number of paise.
+static vector<TxRecord> makeRecords(mt19937& random, size_t count, long long start, long long span) {
+    vector<long long> times(count);
+    for (auto& t : times) t = start + (long long)(random() % (unsigned long long)span);
+    sort(times.begin(), times.end());
+    vector<TxRecord> records(count);
+    long long balance = 0;
+    for (size_t i = 0; i < count; i++) {
+        TxRecord& record = records[i];
+        memset(&record, 0, sizeof(record));
+        record.timestamp = times[i];
+        unsigned int pick = random() % 100;
+        long long amount = pick < 80 ? 100 * (100 + (long long)(random() % 200) * 100)
+                                     : 100 + (long long)(random() % 5000000);
+        if (pick % 2 == 0 || balance < amount) {
+            record.type = pick % 7 == 0 ? TX_TRANSFER_IN : TX_DEPOSIT;
+            record.amount = amount;
+        } else {
+            record.type = pick % 7 == 0 ? TX_TRANSFER_OUT : TX_WITHDRAWAL;
+            record.amount = -amount;
+        }
+        balance += record.amount;
+        record.balance = balance;
+        record.checksum = txRecordChecksum(record);
+    }
+    return records;
+}
+
+// Bytes of the history files in every shard folder
+static unsigned long long historyBytes(const string& dataDir, const vector<string>& names) {
+    unsigned long long total = 0;
+    for (const auto& name : names) {
+        for (const string& path : {txLogPath(dataDir, name), txIndexPath(dataDir, name), txArchivePath(dataDir, name)}) {
+            FILE* file = fopen(path.c_str(), "rb");
+            if (!file) continue;
+            fseek(file, 0, SEEK_END);
+            total += (unsigned long long)ftell(file);
+            fclose(file);
+        }
+    }
+    return total;
+}
+
+static void mix(unsigned long long& hash, const vector<TxRecord>& records) {
+    for (const auto& record : records) hash = (hash ^ txRecordChecksum(record)) * 1099511628211ULL;
+}
+
+struct Reads {
+    double scan, range, recent;        // seconds
+    unsigned long long scanned, ranged, recents;
+    unsigned long long hash;           // of everything read, in order
+};
+
+static Reads readAll(const string& dataDir, const vector<string>& names, long long dayStart) {
+    Reads reads = {0, 0, 0, 0, 0, 0, 14695981039346656037ULL};
+    vector<TxRecord> records;
+
+    auto start = Clock::now();
+    for (const auto& name : names) {
+        TransactionReader reader(dataDir, name);
+        records.clear();
+        reader.read(0, (size_t)reader.size(), records);
+        reads.scanned += records.size();
+        mix(reads.hash, records);
+    }
+    reads.scan = secondsSince(start);
+
+    start = Clock::now();
+    for (const auto& name : names) {
+        TransactionReader reader(dataDir, name);
+        records.clear();
+        reader.readRange(dayStart, dayStart + 86399, 0, (size_t)-1, records);
+        reads.ranged += records.size();
+        mix(reads.hash, records);
+        Money balance, in, out;
+        if (reader.balanceAt(dayStart, balance)) reads.hash ^= (unsigned long long)balance.getPaise();
+        reader.flowBetween(dayStart, dayStart + 7 * 86400, in, out);
+        reads.hash = (reads.hash ^ (unsigned long long)(in.getPaise() * 31 + out.getPaise())) * 1099511628211ULL;
+    }
+    reads.range = secondsSince(start);
+
+    start = Clock::now();
+    for (const auto& name : names) {
+        TransactionReader reader(dataDir, name);
+        records.clear();
+        reader.readLast(50, records);
+        reads.recents += records.size();
+        mix(reads.hash, records);
+    }
+    reads.recent = secondsSince(start);
+    return reads;
+}
+
+int main(int argc, char* argv[]) {
+    string dataDir;
+    size_t accounts = 10000, perAccount = 500, days = 365, keepDays = 30;
+    unsigned int seed = 1;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "-d") == 0 && hasValue) {
+            dataDir = argv[++i];
+        } else if (strcmp(argv[i], "-n") == 0 && hasValue) {
+            accounts = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "-r") == 0 && hasValue) {
+            perAccount = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "-D") == 0 && hasValue) {
+            days = max<size_t>(1, strtoul(argv[++i], nullptr, 10));
+        } else if (strcmp(argv[i], "-k") == 0 && hasValue) {
+            keepDays = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "-s") == 0 && hasValue) {
+            seed = (unsigned int)strtoul(argv[++i], nullptr, 10);
+        } else {
+            dataDir.clear();
+            break;
+        }
+    }
+    if (dataDir.empty() || accounts == 0) {
+        fprintf(stderr, "Usage: %s -d <empty folder> [-n accounts] [-r records per account] [-D days]"
+                        " [-k days kept in the log] [-s seed]\n", argv[0]);
+        return 1;
+    }
+
+    auto start = Clock::now();
+    if (!makeShardDirs(dataDir)) {
+        fprintf(stderr, "Cannot create the shard folders in %s\n", dataDir.c_str());
+        return 1;
+    }
+    long long now = (long long)time(0);
+    long long span = (long long)days * 86400;
+    mt19937 random(seed);
+    ofstream users(joinPath(dataDir, "users.dat"));
+    vector<string> names;
+    unsigned long long total = 0;
+    for (size_t i = 0; i < accounts; i++) {
+        string name = "archive" + to_string(i);
+        vector<TxRecord> records = makeRecords(random, perAccount, now - span, span);
+        if (!records.empty() && !writeLog(txLogPath(dataDir, name), records)) {
+            fprintf(stderr, "Cannot write %s\n", txLogPath(dataDir, name).c_str());
+            return 1;
+        }
+        total += records.size();
+        users << name << " pw " << Money::fromPaise(records.empty() ? 0 : records.back().balance).toString() << "\n";
+        names.push_back(name);
+    }
+    users.close();
+    printf("Generated %zu accounts, %llu records over %zu days in %.2f s\n\n", accounts, total, days,
+           secondsSince(start));
+
+    // A day in the middle of what gets archived
+    long long dayStart = now - span + (span - (long long)keepDays * 86400) / 2;
+    dayStart -= dayStart % 86400;
+
+    unsigned long long bytesBefore = historyBytes(dataDir, names);
+    Reads before = readAll(dataDir, names, dayStart);
+
+    ArchiveReport report;
+    {
+        Bank bank(dataDir);
+        report = bank.archiveLogs(now - (long long)keepDays * 86400);
+    }
+    printf("%s\n\n", report.describe().c_str());
+
+    unsigned long long bytesAfter = historyBytes(dataDir, names);
+    Reads after = readAll(dataDir, names, dayStart);
+
+    printf("History files: %.1f MB before, %.1f MB after (%.2fx smaller, %.1f bytes per archived record)\n",
+           bytesBefore / 1e6, bytesAfter / 1e6, (double)bytesBefore / max<unsigned long long>(1, bytesAfter),
+           report.records ? (double)(bytesAfter - (bytesBefore - report.records * sizeof(TxRecord))) / report.records
+                          : 0.0);
+    printf("%-9s %10s %14s %16s %16s\n", "", "scan s", "records/s", "day range us", "last 50 us");
+    for (int i = 0; i < 2; i++) {
+        const Reads& reads = i == 0 ? before : after;
+        printf("%-9s %10.3f %14.0f %16.1f %16.1f\n", i == 0 ? "log only" : "archived", reads.scan,
+               reads.scanned / reads.scan, reads.range * 1e6 / accounts, reads.recent * 1e6 / accounts);
+    }
+    bool ok = before.hash == after.hash && before.scanned == after.scanned && before.ranged == after.ranged
+              && before.recents == after.recents && report.failed == 0;
+    printf("\n%llu records, %llu in the day range; reads %s\n", after.scanned, after.ranged,
+           ok ? "match" : "DIFFER");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,333 @@
+// End-to-end benchmark of the ATM engine, driven headlessly through the
+// same ATM sessions the front ends use.
+//
+//   g++ -std=c++17 -O2 -I. bench/atm_bench.cpp bench/workload.cpp core/*.cpp -o atm_bench -pthread
+//   ./atm_bench -d <empty folder> [options]
+//
+// Phases: register the accounts, fund them with one batch, run the mixed
+// workload (Zipf skewed accounts, 70% balance / 20% withdraw / 10% deposit
+// by default) with 1, 2, 4 ... threads, then history reads, admin list
+// refreshes, checkpoints and finally a restart from the files written.
+// Each operation kind reports p50/p99/max latency and ops/s; compare runs
+// with the same seed (or the same -r workload file) to catch regressions.
+// After each mixed run every balance must be what the deposits and
+// withdrawals that went through add up to, or the run is marked MISMATCH
+// (an update lost between threads) and the bench fails.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "core/atm.h"
+#include "workload.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+// Latencies of one kind of operation
+struct Timings {
+    string name;
+    vector<long long> nanos;
+    size_t failed;
+
+    explicit Timings(const string& n = "") : name(n), failed(0) {}
+
+    template <class F> bool run(F operation) {
+        auto start = Clock::now();
+        bool ok = operation();
+        nanos.push_back(chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count());
+        if (!ok) failed++;
+        return ok;
+    }
+
+    void merge(const Timings& other) {
+        nanos.insert(nanos.end(), other.nanos.begin(), other.nanos.end());
+        failed += other.failed;
+    }
+};
+
+static bool csvOutput = false;
+
+static void printHeader() {
+    if (csvOutput) {
+        printf("operation,count,failed,p50_us,p99_us,max_us,ops_per_s\n");
+    } else {
+        printf("%-14s %9s %7s %10s %10s %10s %12s\n", "operation", "count", "failed", "p50 us", "p99 us", "max us", "ops/s");
+    }
+}
+
+static void report(Timings& timings) {
+    if (timings.nanos.empty()) return;
+    vector<long long>& v = timings.nanos;
+    sort(v.begin(), v.end());
+    double total = 0;
+    for (long long n : v) total += n;
+    double p50 = v[(v.size() - 1) * 50 / 100] / 1000.0;
+    double p99 = v[(v.size() - 1) * 99 / 100] / 1000.0;
+    double max = v.back() / 1000.0;
+    double rate = total > 0 ? v.size() / (total / 1e9) : 0;
+    if (csvOutput) {
+        printf("%s,%zu,%zu,%.2f,%.2f,%.2f,%.0f\n", timings.name.c_str(), v.size(), timings.failed, p50, p99, max, rate);
+    } else {
+        printf("%-14s %9zu %7zu %10.2f %10.2f %10.2f %12.0f\n", timings.name.c_str(), v.size(), timings.failed,
+               p50, p99, max, rate);
+    }
+}
+
+static void usage(const char* program) {
+    fprintf(stderr,
+            "Usage: %s -d <empty folder> [options]\n"
+            "  -n <accounts>      accounts to create (default 10000)\n"
+            "  -o <operations>    operations in the mixed workload (default 200000)\n"
+            "  -z <theta>         Zipf skew of account choice, 0 = uniform (default 0.99)\n"
+            "  -m <b,w,d>         percent balance,withdraw,deposit (default 70,20,10)\n"
+            "  -s <seed>          workload seed (default 1)\n"
+            "  -t <a,b,...>       terminals running the workload at once, one run each\n"
+            "                     (default 1, 2, 4 ... up to the cores, at least 4)\n"
+            "  -i <iterations>    password hash iterations (default 10; see login_bench)\n"
+            "  -w <file>          save the generated workload\n"
+            "  -r <file>          replay a saved workload instead of generating one\n"
+            "  --csv              machine readable output\n",
+            program);
+}
+
+// One terminal: an ATM per account it has touched, logged in on first use,
+// and the paise its deposits and withdrawals moved, per account
+struct Terminal {
+    Bank& bank;
+    unordered_map<int, unique_ptr<ATM>> sessions;
+    Timings timings[OP_TYPES];
+    Timings logins;
+    vector<long long> applied;
+
+    Terminal(Bank& b, size_t accounts) : bank(b), logins("login"), applied(accounts, 0) {
+        for (int t = 0; t < OP_TYPES; t++) timings[t].name = benchOpName((BenchOpType)t);
+    }
+
+    ATM* session(int account) {
+        auto it = sessions.find(account);
+        if (it != sessions.end()) return it->second.get();
+        unique_ptr<ATM> atm(new ATM(bank));
+        string name = benchAccountName(account);
+        if (!logins.run([&] { return atm->login(name, "pw" + name); })) return nullptr;
+        return (sessions[account] = move(atm)).get();
+    }
+
+    void run(const BenchOp& op) {
+        ATM* atm = session(op.account);
+        if (!atm) return;
+        bool ok = timings[op.type].run([&] {
+            switch (op.type) {
+                case OP_BALANCE: return atm->getBalanceAmount() >= Money();
+                case OP_WITHDRAW: return atm->withdraw(op.amount);
+                default: return atm->deposit(op.amount);
+            }
+        });
+        if (ok && op.type == OP_WITHDRAW) applied[op.account] -= op.amount.getPaise();
+        if (ok && op.type == OP_DEPOSIT) applied[op.account] += op.amount.getPaise();
+    }
+};
+
+int main(int argc, char* argv[]) {
+    WorkloadSpec spec;
+    string dataDir, saveTo, replayFrom;
+    vector<int> threadCounts;
+    unsigned int iterations = 10;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--csv") csvOutput = true;
+        else if (arg == "-d" && hasValue) dataDir = argv[++i];
+        else if (arg == "-n" && hasValue) spec.accounts = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "-o" && hasValue) spec.operations = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "-z" && hasValue) spec.skew = atof(argv[++i]);
+        else if (arg == "-s" && hasValue) spec.seed = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "-i" && hasValue) iterations = (unsigned int)strtoul(argv[++i], nullptr, 10);
+        else if (arg == "-w" && hasValue) saveTo = argv[++i];
+        else if (arg == "-r" && hasValue) replayFrom = argv[++i];
+        else if (arg == "-m" && hasValue) {
+            if (sscanf(argv[++i], "%d,%d,%d", &spec.percent[0], &spec.percent[1], &spec.percent[2]) != 3) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "-t" && hasValue) {
+            for (char* p = argv[++i]; *p;) {
+                threadCounts.push_back(max(1, (int)strtol(p, &p, 10)));
+                if (*p == ',') p++;
+                else if (*p) break;
+            }
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (dataDir.empty() || spec.accounts == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (threadCounts.empty()) {
+        int cores = max(4, (int)thread::hardware_concurrency());
+        for (int t = 1; t < cores; t *= 2) threadCounts.push_back(t);
+        threadCounts.push_back(cores);
+    }
+
+    vector<BenchOp> ops;
+    if (!replayFrom.empty()) {
+        if (!loadWorkload(replayFrom, ops)) {
+            fprintf(stderr, "Cannot read workload %s\n", replayFrom.c_str());
+            return 1;
+        }
+        for (const auto& op : ops) spec.accounts = max(spec.accounts, (size_t)op.account + 1);
+    } else {
+        generateWorkload(spec, ops);
+    }
+    if (!saveTo.empty() && !saveWorkload(saveTo, ops)) {
+        fprintf(stderr, "Cannot write workload %s\n", saveTo.c_str());
+        return 1;
+    }
+
+    if (!csvOutput) {
+        string counts;
+        for (int t : threadCounts) counts += (counts.empty() ? "" : ",") + to_string(t);
+        printf("%zu accounts, %zu operations, %s threads, skew %.2f, mix %d/%d/%d, seed %llu\n\n",
+               spec.accounts, ops.size(), counts.c_str(), spec.skew,
+               spec.percent[0], spec.percent[1], spec.percent[2], spec.seed);
+    }
+    printHeader();
+
+    unique_ptr<Bank> bank(new Bank(dataDir));
+    bank->setPasswordIterations(iterations);
+
+    // Population
+    Timings registers("register");
+    for (size_t i = 0; i < spec.accounts; i++) {
+        string name = benchAccountName(i);
+        registers.run([&] { return bank->registerUser(name, "pw" + name); });
+    }
+    report(registers);
+
+    Timings funding("fund-batch");
+    {
+        vector<BatchOp> batch;
+        for (size_t i = 0; i < spec.accounts; i++) {
+            batch.push_back({benchAccountName(i), Money::fromPaise(1000000), TX_DEPOSIT});
+        }
+        BatchReport result;
+        funding.run([&] { return bank->applyBatch(batch, result); });
+    }
+    report(funding);
+
+    // Mixed workload at each thread count, operation i on terminal
+    // i % threads. Rows are named with the thread count ("deposit-t4").
+    vector<int> ids(spec.accounts);
+    for (size_t a = 0; a < spec.accounts; a++) ids[a] = bank->findAccount(benchAccountName(a));
+    vector<unique_ptr<Terminal>> terminals;
+    vector<double> walls;
+    vector<size_t> mismatches;
+    int threads = 1;
+    for (int count : threadCounts) {
+        threads = count;
+        vector<Money> before(spec.accounts);
+        for (size_t a = 0; a < spec.accounts; a++) before[a] = bank->getBalance(ids[a]);
+        terminals.clear();
+        for (int t = 0; t < threads; t++) terminals.emplace_back(new Terminal(*bank, spec.accounts));
+        auto start = Clock::now();
+        vector<thread> workers;
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back([&, t] {
+                for (size_t i = t; i < ops.size(); i += threads) terminals[t]->run(ops[i]);
+            });
+        }
+        for (auto& worker : workers) worker.join();
+        walls.push_back(chrono::duration<double>(Clock::now() - start).count());
+
+        string suffix = "-t" + to_string(threads);
+        Timings logins("login" + suffix);
+        Timings mixed[OP_TYPES];
+        for (int t = 0; t < OP_TYPES; t++) mixed[t].name = benchOpName((BenchOpType)t) + suffix;
+        for (auto& terminal : terminals) {
+            logins.merge(terminal->logins);
+            for (int t = 0; t < OP_TYPES; t++) mixed[t].merge(terminal->timings[t]);
+        }
+        report(logins);
+        for (int t = 0; t < OP_TYPES; t++) report(mixed[t]);
+
+        // Every balance against what the terminals applied to it
+        size_t wrong = 0;
+        for (size_t a = 0; a < spec.accounts; a++) {
+            long long expected = before[a].getPaise();
+            for (const auto& terminal : terminals) expected += terminal->applied[a];
+            Money balance = bank->getBalance(ids[a]);
+            if (balance.getPaise() == expected) continue;
+            if (wrong++ < 5) {
+                fprintf(stderr, "MISMATCH with %d threads: %s has %s, expected %s\n", threads,
+                        benchAccountName(a).c_str(), balance.toString().c_str(),
+                        Money::fromPaise(expected).toString().c_str());
+            }
+        }
+        mismatches.push_back(wrong);
+    }
+
+    // History of the accounts the workload used first (hot ones included)
+    Timings history("history");
+    Terminal& first = *terminals[0];
+    for (size_t i = 0; i < ops.size() && history.nanos.size() < 1000; i += threads) {
+        ATM* atm = first.session(ops[i].account);
+        if (atm) history.run([&] { return !atm->getTransactionHistory().empty(); });
+    }
+    report(history);
+
+    // Admin listing: one full build, then refreshes after a few changes
+    Timings listFull("list-full"), listRefresh("list-refresh");
+    {
+        ATM admin(*bank);
+        admin.login("admin", Bank::DEFAULT_ADMIN_PASSWORD);   // the bank made it
+        AdminUserView view(*bank);
+        listFull.run([&] { return admin.refreshUserView(view); });
+        for (int round = 0; round < 200; round++) {
+            for (int k = 0; k < 10; k++) {
+                admin.adminDeposit(benchAccountName((round * 10 + k) % spec.accounts), Money::fromPaise(100));
+            }
+            listRefresh.run([&] { return admin.refreshUserView(view); });
+        }
+    }
+    report(listFull);
+    report(listRefresh);
+
+    Timings checkpoints("checkpoint");
+    for (int i = 0; i < 3; i++) checkpoints.run([&] { bank->checkpointNow(); return true; });
+    report(checkpoints);
+
+    string logStats = bank->getTransactionLog().describeStats();
+
+    // Restart from the files just written
+    terminals.clear();
+    bank.reset();
+    Timings startup("startup");
+    startup.run([&] {
+        bank.reset(new Bank(dataDir));
+        return bank->size() == spec.accounts + 1;
+    });
+    report(startup);
+
+    size_t wrong = 0;
+    for (size_t m : mismatches) wrong += m;
+    if (!csvOutput) {
+        printf("\n%-8s %10s %12s %8s  %s\n", "threads", "wall s", "ops/s", "speedup", "balances");
+        for (size_t r = 0; r < threadCounts.size(); r++) {
+            printf("%-8d %10.2f %12.0f %7.2fx  %s\n", threadCounts[r], walls[r], ops.size() / walls[r],
+                   walls[0] / walls[r], mismatches[r] == 0 ? "ok" : "MISMATCH");
+        }
+        printf("\n%s\n", logStats.c_str());
+    }
+    return wrong == 0 ? 0 : 1;
+}
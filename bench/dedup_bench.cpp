@@ -0,0 +1,230 @@
+// Cost of idempotency keys (core/dedup_cache.h) on the deposit and
+// withdraw path. First the cache alone:
+//   remember   a new key, with the cache full (each one drops the oldest)
+//   hit        looking up a key that is there
+//   miss       looking up a key that is not
+// then a Bank, with threads doing deposits and withdrawals on accounts of
+// their own, three ways:
+//   none       no key, as before
+//   unique     a new key on every request
+//   retry      a new key, and every tenth request sent a second time with
+//              the same key (a terminal that timed out)
+// After each run every balance must be what the requests that were not
+// retries add up to, or the run is marked MISMATCH. Last, the Bank is
+// closed and opened again, and retries of keys from before the restart
+// must not move any money.
+//
+//   g++ -std=c++17 -O2 -I. bench/dedup_bench.cpp core/*.cpp -o dedup_bench -pthread
+//   ./dedup_bench -d <empty folder> [options]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "core/bank.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+enum Mode { NONE, UNIQUE, RETRY, MODES };
+static const char* MODE_NAMES[MODES] = {"none", "unique", "retry"};
+
+static void usage(const char* program) {
+    fprintf(stderr,
+            "Usage: %s -d <empty folder> [options]\n"
+            "  -n <accounts>      accounts to create (default 1000)\n"
+            "  -o <requests>      requests per thread (default 50000)\n"
+            "  -c <keys>          keys for the cache alone (default 1000000)\n"
+            "  -t <a,b,...>       thread counts to run (default 1,2,4)\n"
+            "  -s <seed>          random seed (default 1)\n",
+            program);
+}
+
+static double nanosPer(Clock::time_point start, size_t count) {
+    return chrono::duration<double, nano>(Clock::now() - start).count() / count;
+}
+
+// The cache on its own, from one thread
+static void benchCache(size_t count) {
+    DedupCache cache;
+    vector<string> keys(count);
+    for (size_t i = 0; i < count; i++) keys[i] = "term7-" + to_string(i);
+    DedupResult result{true, LIMIT_OK, Money::fromPaise(100)};
+    long long now = time(nullptr);
+
+    auto start = Clock::now();
+    for (size_t i = 0; i < count; i++) cache.remember((int)(i % 1000), keys[i], now, result);
+    double remember = nanosPer(start, count);
+
+    // The newest keys are the ones still there
+    size_t kept = cache.size(), hits = 0;
+    start = Clock::now();
+    for (size_t i = count - kept; i < count; i++) hits += cache.find((int)(i % 1000), keys[i], now, result);
+    double hit = nanosPer(start, kept);
+    start = Clock::now();
+    for (size_t i = 0; i < kept; i++) hits += cache.find((int)(i % 1000), "other", now, result);
+    double miss = nanosPer(start, kept);
+
+    printf("cache: %zu keys remembered, %zu kept (%zu found)\n", count, kept, hits);
+    printf("  remember %.0f ns, hit %.0f ns, miss %.0f ns\n\n", remember, hit, miss);
+}
+
+int main(int argc, char* argv[]) {
+    string dataDir;
+    size_t accounts = 1000, requests = 50000, cacheKeys = 1000000;
+    unsigned int seed = 1;
+    vector<int> threadCounts;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "-d") == 0 && hasValue) {
+            dataDir = argv[++i];
+        } else if (strcmp(argv[i], "-n") == 0 && hasValue) {
+            accounts = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "-o") == 0 && hasValue) {
+            requests = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "-c") == 0 && hasValue) {
+            cacheKeys = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "-s") == 0 && hasValue) {
+            seed = (unsigned int)strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "-t") == 0 && hasValue) {
+            for (char* p = argv[++i]; *p;) {
+                threadCounts.push_back((int)strtol(p, &p, 10));
+                if (*p == ',') p++;
+                else if (*p) break;
+            }
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (dataDir.empty() || accounts < 1 || requests == 0 || cacheKeys == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (threadCounts.empty()) threadCounts = {1, 2, 4};
+    int mostThreads = *max_element(threadCounts.begin(), threadCounts.end());
+    if (mostThreads < 1 || (size_t)mostThreads > accounts) {
+        fprintf(stderr, "Need between 1 and %zu threads\n", accounts);
+        return 1;
+    }
+
+    benchCache(cacheKeys);
+
+    unique_ptr<Bank> bank(new Bank(dataDir));
+    bank->setPasswordIterations(1);
+    bank->getTransactionLog().setDurability(TransactionLog::TIMED, 0, 1000);
+    vector<int> ids;
+    vector<string> names;
+    vector<BatchOp> funding;
+    for (size_t i = 0; i < accounts; i++) {
+        names.push_back("dedup" + to_string(i));
+        bank->registerUser(names.back(), "pw");
+        ids.push_back(bank->findAccount(names.back()));
+        funding.push_back({names.back(), Money::fromPaise(100000000), TX_DEPOSIT});
+    }
+    BatchReport funded;
+    bank->applyBatch(funding, funded);
+
+    // The last run's keys, to retry after the restart: account (its place
+    // in ids), key
+    vector<pair<int, string>> lastKeys;
+
+    printf("%-7s %7s %9s %8s %10s %10s %11s  %s\n", "keys", "threads", "requests", "retries", "p50 us", "p99 us",
+           "requests/s", "balances");
+    int run = 0;
+    for (int m = 0; m < MODES; m++) {
+        for (int threads : threadCounts) {
+            run++;
+            vector<Money> before(accounts);
+            for (size_t a = 0; a < accounts; a++) before[a] = bank->getBalance(ids[a]);
+            // What each account should gain; thread t only touches accounts
+            // a with a % threads == t, so no two threads write one entry
+            vector<long long> gained(accounts, 0);
+            vector<vector<long long>> nanos(threads);
+            vector<size_t> retries(threads, 0), failed(threads, 0);
+            vector<vector<pair<int, string>>> keys(threads);
+            vector<thread> workers;
+            auto start = Clock::now();
+            for (int t = 0; t < threads; t++) {
+                workers.emplace_back([&, t] {
+                    mt19937 random(seed * 7919 + m * 131 + t);
+                    size_t mine = (accounts - t + threads - 1) / threads;
+                    nanos[t].reserve(requests);
+                    string key;
+                    size_t a = t;
+                    Money amount;
+                    bool deposit = true;
+                    for (size_t i = 0; i < requests; i++) {
+                        bool again = m == RETRY && i > 0 && random() % 10 == 0;
+                        if (again) {
+                            retries[t]++;
+                        } else {
+                            a = t + (random() % mine) * threads;
+                            amount = Money::fromPaise(100 + random() % 1000);
+                            deposit = random() & 1;
+                            if (m != NONE) key = "r" + to_string(run) + "-t" + to_string(t) + "-" + to_string(i);
+                        }
+                        auto begin = Clock::now();
+                        bool ok = deposit ? bank->deposit(ids[a], amount, nullptr, key)
+                                          : bank->withdraw(ids[a], amount, nullptr, nullptr, key);
+                        nanos[t].push_back(chrono::duration_cast<chrono::nanoseconds>(Clock::now() - begin).count());
+                        if (!ok) {
+                            failed[t]++;
+                        } else if (!again) {
+                            gained[a] += deposit ? amount.getPaise() : -amount.getPaise();
+                            if (m == RETRY && keys[t].size() < 1000) keys[t].push_back(make_pair((int)a, key));
+                        }
+                    }
+                });
+            }
+            for (auto& worker : workers) worker.join();
+            double seconds = chrono::duration<double>(Clock::now() - start).count();
+
+            vector<long long> all;
+            size_t retried = 0, failures = 0;
+            lastKeys.clear();
+            for (int t = 0; t < threads; t++) {
+                all.insert(all.end(), nanos[t].begin(), nanos[t].end());
+                retried += retries[t];
+                failures += failed[t];
+                lastKeys.insert(lastKeys.end(), keys[t].begin(), keys[t].end());
+            }
+            sort(all.begin(), all.end());
+            bool balanced = failures == 0;
+            for (size_t a = 0; a < accounts; a++) {
+                if (bank->getBalance(ids[a]).getPaise() != before[a].getPaise() + gained[a]) balanced = false;
+            }
+            printf("%-7s %7d %9zu %8zu %10.2f %10.2f %11.0f  %s\n", MODE_NAMES[m], threads, all.size(), retried,
+                   all[(all.size() - 1) * 50 / 100] / 1000.0, all[(all.size() - 1) * 99 / 100] / 1000.0,
+                   seconds > 0 ? all.size() / seconds : 0.0, balanced ? "ok" : "MISMATCH");
+        }
+    }
+
+    // Keys kept by the checkpoint at shutdown still answer after a restart.
+    // Ids are given out again on loading, so everything goes by name.
+    vector<Money> before(accounts);
+    for (size_t a = 0; a < accounts; a++) before[a] = bank->getBalance(ids[a]);
+    bank.reset();
+    auto start = Clock::now();
+    bank.reset(new Bank(dataDir));
+    double openSeconds = chrono::duration<double>(Clock::now() - start).count();
+    for (size_t a = 0; a < accounts; a++) ids[a] = bank->findAccount(names[a]);
+    size_t moved = 0;
+    for (const auto& retry : lastKeys) {
+        bank->deposit(ids[retry.first], Money::fromPaise(1), nullptr, retry.second);
+    }
+    for (size_t a = 0; a < accounts; a++) {
+        if (bank->getBalance(ids[a]) != before[a]) moved++;
+    }
+    printf("\nrestart (%.2f s): %zu keys retried, %s\n", openSeconds, lastKeys.size(),
+           moved == 0 ? "no money moved" : "MISMATCH, money moved");
+    return moved == 0 ? 0 : 1;
+}
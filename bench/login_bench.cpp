@@ -0,0 +1,65 @@
+// Login throughput at different password hash costs, and the cost of
+// resuming a session from the session cache instead.
+//
+//   g++ -std=c++17 -O2 -I. bench/login_bench.cpp core/*.cpp -o login_bench -pthread
+//   ./login_bench [datadir] [iterations...]
+//
+// The data directory must exist and should be empty: accounts are added
+// to it.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "core/bank.h"
+
+using namespace std;
+
+static double secondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char* argv[]) {
+    string dataDir = argc > 1 ? argv[1] : ".";
+    vector<unsigned int> costs;
+    for (int i = 2; i < argc; i++) costs.push_back((unsigned int)strtoul(argv[i], nullptr, 10));
+    if (costs.empty()) costs = {1000, 10000, 100000, 300000};
+
+    Bank bank(dataDir);
+    printf("%10s %12s %12s %14s\n", "iterations", "ms/login", "logins/s", "resumes/s");
+
+    for (unsigned int cost : costs) {
+        bank.setPasswordIterations(cost);
+        string username = "bench" + to_string(cost);
+        if (!bank.registerUser(username, "secret")) bank.setPassword(bank.findAccount(username), "secret");
+
+        // Enough logins for about a second of work, at least 3
+        int logins = 0;
+        string token;
+        auto start = chrono::steady_clock::now();
+        while (logins < 3 || secondsSince(start) < 1.0) {
+            if (bank.authenticate(username, "secret", &token) == -1) {
+                printf("login failed at cost %u\n", cost);
+                return 1;
+            }
+            bank.endSession(token);
+            logins++;
+        }
+        double loginSeconds = secondsSince(start);
+
+        bank.authenticate(username, "secret", &token);
+        const int resumes = 1000000;
+        start = chrono::steady_clock::now();
+        for (int i = 0; i < resumes; i++) {
+            if (bank.resumeSession(token) == -1) return 1;
+        }
+        double resumeSeconds = secondsSince(start);
+        bank.endSession(token);
+
+        printf("%10u %12.3f %12.1f %14.0f\n", cost, loginSeconds * 1000 / logins,
+               logins / loginSeconds, resumes / resumeSeconds);
+    }
+    return 0;
+}
@@ -0,0 +1,168 @@
+// Account lookup and login latency as the number of accounts grows
+// (1k, 10k, 100k and 1M by default). At each size it measures
+//   scan      finding a name by walking every account, as
+//             ATM::findUser did before the index (fewer probes)
+//   hit       AccountIndex::find of an account that exists
+//   miss      AccountIndex::find of a name that does not
+//   login     Bank::authenticate of a random account, on a Bank
+//             opened over that many accounts
+// Lookups are timed over the whole run of probes and given per lookup;
+// logins one by one, as p50 and p99. The password hash runs with
+// 'iterations' rounds (1 by default), so a login's time is mostly the
+// lookup and locking around it; pass -i 100000 to see the real cost.
+//
+//   g++ -std=c++17 -O2 -I. bench/lookup_bench.cpp core/*.cpp -o lookup_bench -pthread
+//   ./lookup_bench -d <empty folder> [-n 1000,10000,...] [-p probes] [-i iterations] [-s seed]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "core/account_index.h"
+#include "core/bank.h"
+#include "core/crypto.h"
+#include "core/name_arena.h"
+#include "core/platform.h"
+#include "core/snapshot.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static void usage(const char* program) {
+    fprintf(stderr,
+            "Usage: %s -d <empty folder> [options]\n"
+            "  -n <a,b,...>       account counts to run (default 1000,10000,100000,1000000)\n"
+            "  -p <probes>        lookups and logins at each size (default 200000 and 20000)\n"
+            "  -i <iterations>    password hash cost (default 1)\n"
+            "  -s <seed>          random seed (default 1)\n",
+            program);
+}
+
+static double nanosPer(Clock::time_point start, size_t count) {
+    return chrono::duration<double, nano>(Clock::now() - start).count() / count;
+}
+
+// Keeps results alive so the lookups are not optimised away
+static volatile long long sink;
+
+static string nameOf(size_t i) { return "user" + to_string(i); }
+
+int main(int argc, char* argv[]) {
+    string dataDir;
+    vector<size_t> sizes;
+    size_t probes = 200000;
+    unsigned int iterations = 1, seed = 1;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "-d") == 0 && hasValue) {
+            dataDir = argv[++i];
+        } else if (strcmp(argv[i], "-n") == 0 && hasValue) {
+            for (char* p = argv[++i]; *p;) {
+                sizes.push_back(strtoul(p, &p, 10));
+                if (*p == ',') p++;
+                else if (*p) break;
+            }
+        } else if (strcmp(argv[i], "-p") == 0 && hasValue) {
+            probes = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "-i") == 0 && hasValue) {
+            iterations = (unsigned int)strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "-s") == 0 && hasValue) {
+            seed = (unsigned int)strtoul(argv[++i], nullptr, 10);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (sizes.empty()) sizes = {1000, 10000, 100000, 1000000};
+    if (dataDir.empty() || probes == 0 || iterations == 0
+        || find(sizes.begin(), sizes.end(), (size_t)0) != sizes.end()) {
+        usage(argv[0]);
+        return 1;
+    }
+    size_t logins = max<size_t>(1, probes / 10), scans = max<size_t>(1, probes / 1000);
+
+    // One credential for every account: the cost of checking it is the
+    // same, and hashing a million of them would only slow the setup
+    string credential = hashPassword("secret", iterations);
+
+    printf("password hash iterations %u; %zu lookups, %zu scans, %zu logins per size\n\n", iterations, probes,
+           scans, logins);
+    printf("%9s %10s %10s %10s %10s %10s  %s\n", "accounts", "scan ns", "hit ns", "miss ns", "login p50",
+           "login p99", "found");
+    bool allFound = true;
+    for (size_t n : sizes) {
+        mt19937 random(seed + (unsigned int)n);
+        vector<User> users;
+        users.reserve(n);
+        NameArena names;
+        AccountIndex index;
+        index.reserve(n);
+        for (size_t i = 0; i < n; i++) {
+            users.emplace_back(nameOf(i), credential, Money::fromPaise(100000));
+            string_view name = users.back().getUsername();
+            index.insert(name, (int)names.add(name), names);
+        }
+        vector<string> hits(probes), misses(probes);
+        for (size_t i = 0; i < probes; i++) {
+            hits[i] = nameOf(random() % n);
+            misses[i] = "none" + to_string(random() % n);
+        }
+
+        // The linear scan, on a few probes: it costs n per lookup
+        long long found = 0;
+        auto start = Clock::now();
+        for (size_t i = 0; i < scans; i++) {
+            for (size_t u = 0; u < users.size(); u++) {
+                if (users[u].getUsername() == hits[i]) {
+                    found += (long long)u;
+                    break;
+                }
+            }
+        }
+        double scan = nanosPer(start, scans);
+
+        size_t hitCount = 0;
+        start = Clock::now();
+        for (const auto& probe : hits) hitCount += index.find(probe, names) != -1;
+        double hit = nanosPer(start, probes);
+        start = Clock::now();
+        for (const auto& probe : misses) found += index.find(probe, names);
+        double miss = nanosPer(start, probes);
+        sink = found;
+
+        // A Bank over the same accounts, started from users.dat in a
+        // folder of its own
+        string bankDir = joinPath(dataDir, "n" + to_string(n));
+        if (!makeDirectory(bankDir) || !SnapshotFile::writeText(users, joinPath(bankDir, "users.dat"))) {
+            fprintf(stderr, "Cannot write to %s\n", bankDir.c_str());
+            return 1;
+        }
+        users.clear();
+        users.shrink_to_fit();
+        Bank bank(bankDir);
+        bank.setPasswordIterations(iterations);
+        vector<long long> nanos;
+        nanos.reserve(logins);
+        size_t loggedIn = 0;
+        for (size_t i = 0; i < logins; i++) {
+            const string& username = hits[i];
+            auto begin = Clock::now();
+            loggedIn += bank.authenticate(username, "secret") != -1;
+            nanos.push_back(chrono::duration_cast<chrono::nanoseconds>(Clock::now() - begin).count());
+        }
+        sort(nanos.begin(), nanos.end());
+
+        bool ok = hitCount == probes && loggedIn == logins;
+        allFound = allFound && ok;
+        printf("%9zu %10.0f %10.1f %10.1f %8.2fus %8.2fus  %s\n", n, scan, hit, miss,
+               nanos[(nanos.size() - 1) * 50 / 100] / 1000.0, nanos[(nanos.size() - 1) * 99 / 100] / 1000.0,
+               ok ? "ok" : "MISSING");
+    }
+    return allFound ? 0 : 1;
+}
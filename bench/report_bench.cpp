@@ -0,0 +1,190 @@
+// Bank-wide report (Bank::report) over a generated bank: 'accounts'
+// accounts with 'records' log records each, spread over the last 'days'
+// days. The logs and users.dat are written directly, so millions of
+// records take seconds to set up rather than an fsync each.
+// The report is compared with what was generated, and timed against
+// reading every account's log with TransactionReader on one thread (the
+// way the per-user history views read them).
+//
+//   g++ -std=c++17 -O2 -I. bench/report_bench.cpp core/*.cpp -o report_bench -pthread
+//   ./report_bench -d <empty folder> [-n accounts] [-r records] [-D days] [-s seed]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "core/bank.h"
+#include "core/platform.h"
+#include "core/shard.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static double secondsSince(Clock::time_point start) {
+    return chrono::duration<double>(Clock::now() - start).count();
+}
+
+// What was generated, to check the report against
+struct Expected {
+    long long deposits, withdrawals, transfers, balances, frozenBalances;
+    unsigned long long records;
+    size_t frozen;
+};
+
+static bool writeLog(const string& path, const vector<TxRecord>& records) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+    char header[TX_HEADER_SIZE];
+    unsigned int recordSize = sizeof(TxRecord);
+    memcpy(header, TX_MAGIC, 8);
+    memcpy(header + 8, &TX_VERSION, 4);
+    memcpy(header + 12, &recordSize, 4);
+    bool ok = fwrite(header, 1, TX_HEADER_SIZE, file) == (size_t)TX_HEADER_SIZE;
+    ok = fwrite(records.data(), sizeof(TxRecord), records.size(), file) == records.size() && ok;
+    return fclose(file) == 0 && ok;
+}
+
+// One account's records: deposits, withdrawals within the balance and
+// transfers both ways, in time order
+static vector<TxRecord> makeRecords(mt19937& random, size_t count, long long start, long long span,
+                                    Expected& expected) {
+    vector<long long> times(count);
+    for (auto& t : times) t = start + (long long)(random() % (unsigned long long)span);
+    sort(times.begin(), times.end());
+    vector<TxRecord> records(count);
+    long long balance = 0;
+    for (size_t i = 0; i < count; i++) {
+        TxRecord& record = records[i];
+        memset(&record, 0, sizeof(record));
+        record.timestamp = times[i];
+        long long amount = 100 + (long long)(random() % 500000);
+        unsigned int pick = random() % 100;
+        if (pick < 50 || balance < amount) {
+            record.type = pick % 7 == 0 ? TX_TRANSFER_IN : TX_DEPOSIT;
+            record.amount = amount;
+            if (record.type == TX_DEPOSIT) expected.deposits += amount;
+        } else {
+            record.type = pick < 85 ? TX_WITHDRAWAL : TX_TRANSFER_OUT;
+            record.amount = -amount;
+            if (record.type == TX_WITHDRAWAL) expected.withdrawals += amount;
+            else expected.transfers += amount;
+        }
+        balance += record.amount;
+        record.balance = balance;
+        record.checksum = txRecordChecksum(record);
+    }
+    expected.records += count;
+    return records;
+}
+
+int main(int argc, char* argv[]) {
+    string dataDir;
+    size_t accounts = 100000, perAccount = 50, days = 90;
+    unsigned int seed = 1;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "-d") == 0 && hasValue) {
+            dataDir = argv[++i];
+        } else if (strcmp(argv[i], "-n") == 0 && hasValue) {
+            accounts = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "-r") == 0 && hasValue) {
+            perAccount = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "-D") == 0 && hasValue) {
+            days = max<size_t>(1, strtoul(argv[++i], nullptr, 10));
+        } else if (strcmp(argv[i], "-s") == 0 && hasValue) {
+            seed = (unsigned int)strtoul(argv[++i], nullptr, 10);
+        } else {
+            dataDir.clear();
+            break;
+        }
+    }
+    if (dataDir.empty() || accounts == 0) {
+        fprintf(stderr, "Usage: %s -d <empty folder> [-n accounts] [-r records per account] [-D days] [-s seed]\n",
+                argv[0]);
+        return 1;
+    }
+
+    // users.dat with each account's last logged balance, then the logs
+    auto start = Clock::now();
+    if (!makeShardDirs(dataDir)) {
+        fprintf(stderr, "Cannot create the shard folders in %s\n", dataDir.c_str());
+        return 1;
+    }
+    long long now = (long long)time(0);
+    long long span = (long long)days * 86400;
+    Expected expected = {};
+    mt19937 random(seed);
+    ofstream users(joinPath(dataDir, "users.dat"));
+    vector<string> names;
+    for (size_t i = 0; i < accounts; i++) {
+        string name = "report" + to_string(i);
+        vector<TxRecord> records = makeRecords(random, perAccount, now - span, span, expected);
+        long long balance = records.empty() ? 0 : records.back().balance;
+        expected.balances += balance;
+        if (!records.empty() && !writeLog(txLogPath(dataDir, name), records)) {
+            fprintf(stderr, "Cannot write %s\n", txLogPath(dataDir, name).c_str());
+            return 1;
+        }
+        users << name << " pw " << Money::fromPaise(balance).toString() << "\n";
+        names.push_back(name);
+    }
+    users.close();
+    printf("Generated %zu accounts, %llu records over %zu days in %.2f s\n", accounts, expected.records, days,
+           secondsSince(start));
+
+    Bank bank(dataDir);
+    bank.setPasswordIterations(1);
+    // Freeze every 50th account
+    for (size_t i = 0; i < accounts; i += 50) {
+        int id = bank.findAccount(names[i]);
+        expected.frozen++;
+        expected.frozenBalances += bank.getBalance(id).getPaise();
+        bank.toggleFrozen(id);
+    }
+
+    printf("%u hardware threads, %u shards\n\n", thread::hardware_concurrency(), SHARD_COUNT);
+    printf("%-34s %10s %14s %10s\n", "", "seconds", "records/s", "MB/s");
+    BankReport report;
+    for (int run = 0; run < 2; run++) {
+        report = bank.report(0, now);
+        printf("%-34s %10.3f %14.0f %10.1f\n", run == 0 ? "report (first run)" : "report (files cached)",
+               report.seconds, report.records / report.seconds, report.bytes / 1e6 / report.seconds);
+    }
+
+    // The same sums from TransactionReader, one account after another
+    start = Clock::now();
+    long long deposits = 0;
+    unsigned long long read = 0;
+    vector<TxRecord> records;
+    for (const auto& name : names) {
+        TransactionReader reader(dataDir, name);
+        records.clear();
+        reader.read(0, (size_t)reader.size(), records);
+        for (const auto& record : records) {
+            if (record.type == TX_DEPOSIT) deposits += record.amount;
+        }
+        read += records.size();
+    }
+    double serial = secondsSince(start);
+    printf("%-34s %10.3f %14.0f\n", "TransactionReader, one thread", serial, read / serial);
+
+    bool ok = report.records == expected.records && report.deposits.getPaise() == expected.deposits
+              && report.withdrawals.getPaise() == expected.withdrawals
+              && report.transfers.getPaise() == expected.transfers
+              && report.liabilities.getPaise() == expected.balances
+              && report.frozenAccounts == expected.frozen
+              && report.frozenExposure.getPaise() == expected.frozenBalances
+              && (report.days.empty() || report.days.back().liabilities.getPaise() == expected.balances)
+              && deposits == expected.deposits;
+    printf("\n%zu days in the report; totals %s\n", report.days.size(), ok ? "match" : "MISMATCH");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,233 @@
+// Username search (core/name_search.h) over a generated customer base of
+// names like "jsmith42", "mary.jones" or "stan_lee7": building the index,
+// adding names one at a time (as registerUser does), and the latency of
+//   prefix   the names starting with 1, 2, 3 or 5 letters of a name
+//   typo     a name with one edit (two from 7 letters), and the names
+//            close to it
+//   box      the admin's search box: prefix matches, then close names
+// with a linear scan over every name (what a lookup without the index
+// costs) for comparison. For a sample of typo queries, every close name
+// is also found by brute force, with its own edit distance, and the two
+// must agree.
+//
+//   g++ -std=c++17 -O2 -I. bench/search_bench.cpp core/*.cpp -o search_bench -pthread
+//   ./search_bench [-n accounts] [-q queries] [-s seed]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "core/name_search.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static const char* FIRST[] = {
+    "james", "mary", "john", "patricia", "robert", "jennifer", "michael", "linda", "william", "elizabeth",
+    "david", "barbara", "richard", "susan", "joseph", "jessica", "thomas", "sarah", "charles", "karen",
+    "ravi", "priya", "amit", "sneha", "arjun", "ananya", "vikram", "kavya", "rahul", "pooja", "stan",
+    "stella", "stephen", "asha", "mohan", "lakshmi", "suresh", "deepa", "arun", "meena", "kiran", "nisha",
+    "wei", "mei", "hiro", "yuki", "omar", "fatima", "ali", "zara", "ivan", "olga", "lars", "ingrid"};
+static const char* LAST[] = {
+    "smith", "johnson", "williams", "brown", "jones", "garcia", "miller", "davis", "rodriguez", "martinez",
+    "sharma", "verma", "gupta", "patel", "singh", "kumar", "reddy", "iyer", "nair", "menon", "rao", "das",
+    "chen", "wang", "li", "zhang", "tanaka", "sato", "khan", "ahmed", "ivanov", "petrov", "larsen",
+    "hansen", "lee", "kim", "park", "nguyen", "tran", "lopez", "gonzalez", "wilson", "anderson", "taylor",
+    "thomas", "moore", "jackson", "martin", "white", "harris", "clark", "lewis", "walker", "young"};
+
+static string makeName(mt19937& random) {
+    string first = FIRST[random() % (sizeof(FIRST) / sizeof(FIRST[0]))];
+    string last = LAST[random() % (sizeof(LAST) / sizeof(LAST[0]))];
+    string name;
+    switch (random() % 5) {
+        case 0: name = first + last; break;
+        case 1: name = first.substr(0, 1) + last; break;
+        case 2: name = first + "." + last; break;
+        case 3: name = first + "_" + last; break;
+        default: name = first + last.substr(0, 1);
+    }
+    if (random() % 4 != 0) name += to_string(random() % 1000);
+    return name;
+}
+
+// One random change, insertion, deletion or swap of neighbours
+static string typo(mt19937& random, string name) {
+    size_t at = random() % name.size();
+    char letter = (char)('a' + random() % 26);
+    switch (random() % 4) {
+        case 0: name[at] = letter; break;
+        case 1: name.insert(name.begin() + at, letter); break;
+        case 2: if (name.size() > 1) name.erase(at, 1); break;
+        default:
+            if (at + 1 < name.size()) swap(name[at], name[at + 1]);
+            else name[at] = letter;
+    }
+    return name;
+}
+
+// Full table, no shortcuts, as a check on the index
+static int bruteDistance(const string& a, const string& b) {
+    vector<vector<int>> d(a.size() + 1, vector<int>(b.size() + 1));
+    for (size_t i = 0; i <= a.size(); i++) d[i][0] = (int)i;
+    for (size_t j = 0; j <= b.size(); j++) d[0][j] = (int)j;
+    for (size_t i = 1; i <= a.size(); i++) {
+        for (size_t j = 1; j <= b.size(); j++) {
+            int cost = tolower(a[i - 1]) == tolower(b[j - 1]) ? 0 : 1;
+            d[i][j] = min(min(d[i - 1][j] + 1, d[i][j - 1] + 1), d[i - 1][j - 1] + cost);
+            if (i > 1 && j > 1 && tolower(a[i - 1]) == tolower(b[j - 2]) && tolower(a[i - 2]) == tolower(b[j - 1])) {
+                d[i][j] = min(d[i][j], d[i - 2][j - 2] + 1);
+            }
+        }
+    }
+    return d[a.size()][b.size()];
+}
+
+static double microsSince(Clock::time_point start) {
+    return chrono::duration<double, micro>(Clock::now() - start).count();
+}
+
+static void printLatency(const char* name, vector<double>& micros, double results) {
+    sort(micros.begin(), micros.end());
+    double total = 0;
+    for (double m : micros) total += m;
+    printf("%-12s %8zu %10.2f %10.2f %10.2f %10.2f %9.1f\n", name, micros.size(), total / micros.size(),
+           micros[(micros.size() - 1) / 2], micros[(micros.size() - 1) * 99 / 100], micros.back(),
+           results / micros.size());
+}
+
+int main(int argc, char* argv[]) {
+    size_t accounts = 1000000, queries = 10000;
+    unsigned int seed = 1;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "-n") == 0 && hasValue) {
+            accounts = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "-q") == 0 && hasValue) {
+            queries = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "-s") == 0 && hasValue) {
+            seed = (unsigned int)strtoul(argv[++i], nullptr, 10);
+        } else {
+            fprintf(stderr, "Usage: %s [-n accounts] [-q queries per kind] [-s seed]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (accounts < 2 || queries == 0) {
+        fprintf(stderr, "Need at least 2 accounts and 1 query\n");
+        return 1;
+    }
+
+    // Unique names, the last ADDED of them added one at a time
+    const size_t ADDED = min<size_t>(10000, accounts / 2);
+    mt19937 random(seed);
+    unordered_set<string> seen;
+    NameArena names;
+    while (names.size() < accounts) {
+        string name = makeName(random);
+        while (!seen.insert(name).second) name += to_string(random() % 10);
+        names.add(name);
+    }
+    NameArena first;
+    for (size_t id = 0; id < accounts - ADDED; id++) first.add(names.get(id));
+
+    NameSearch search;
+    auto start = Clock::now();
+    search.rebuild(first);
+    double buildSeconds = microsSince(start) / 1e6;
+    start = Clock::now();
+    for (size_t id = accounts - ADDED; id < accounts; id++) {
+        first.add(names.get(id));
+        search.add((int)id, first);
+    }
+    double addMicros = microsSince(start) / ADDED;
+    size_t nameBytes = 0;
+    for (size_t id = 0; id < accounts; id++) nameBytes += names.get(id).size();
+    printf("%zu names (%.1f MB): index built in %.2f s, then %.1f us per name added, %.1f MB (%.1f bytes per name)\n\n",
+           accounts, nameBytes / 1e6, buildSeconds, addMicros, search.memoryBytes() / 1e6,
+           (double)search.memoryBytes() / accounts);
+
+    const size_t LIMIT = 10;
+    printf("%-12s %8s %10s %10s %10s %10s %9s\n", "query", "count", "mean us", "p50 us", "p99 us", "max us",
+           "results");
+    vector<int> ids;
+    vector<NameSearch::Match> matches;
+    for (size_t length : {1, 2, 3, 5}) {
+        vector<double> micros;
+        double results = 0;
+        for (size_t q = 0; q < queries; q++) {
+            string prefix(names.get(random() % accounts).substr(0, length));
+            ids.clear();
+            start = Clock::now();
+            search.withPrefix(prefix, names, LIMIT, ids);
+            micros.push_back(microsSince(start));
+            results += ids.size();
+        }
+        string label = "prefix " + to_string(length);
+        printLatency(label.c_str(), micros, results);
+    }
+
+    vector<string> typos;
+    for (size_t q = 0; q < queries; q++) {
+        string name(names.get(random() % accounts));
+        name = typo(random, name);
+        if (name.size() >= 7) name = typo(random, name);
+        typos.push_back(name);
+    }
+    for (int kind = 0; kind < 2; kind++) {
+        vector<double> micros;
+        double results = 0;
+        for (const string& text : typos) {
+            matches.clear();
+            start = Clock::now();
+            if (kind == 0) search.similar(text, names, LIMIT, matches);
+            else search.search(text, names, LIMIT, matches);
+            micros.push_back(microsSince(start));
+            results += matches.size();
+        }
+        printLatency(kind == 0 ? "typo" : "box", micros, results);
+    }
+
+    // Without the index: every name looked at
+    vector<double> micros;
+    double results = 0;
+    for (size_t q = 0; q < min<size_t>(queries, 100); q++) {
+        string prefix(names.get(random() % accounts).substr(0, 3));
+        start = Clock::now();
+        size_t found = 0;
+        for (size_t id = 0; id < accounts; id++) {
+            string_view name = names.get(id);
+            if (name.size() >= prefix.size() && name.compare(0, prefix.size(), prefix) == 0) found++;
+        }
+        micros.push_back(microsSince(start));
+        results += min(found, LIMIT);
+    }
+    printLatency("scan 3", micros, results);
+
+    // Every close name the index finds, brute force finds, and the other way
+    size_t checked = min<size_t>(queries, 20), missed = 0, extra = 0;
+    for (size_t q = 0; q < checked; q++) {
+        const string& text = typos[q];
+        int distance = NameSearch::maxDistance(text);
+        matches.clear();
+        search.similar(text, names, accounts, matches);
+        unordered_set<int> found;
+        for (const auto& match : matches) found.insert(match.id);
+        size_t expected = 0;
+        for (size_t id = 0; id < accounts; id++) {
+            string name(names.get(id));
+            if (abs((int)name.size() - (int)text.size()) > distance || bruteDistance(name, text) > distance) continue;
+            expected++;
+            if (!found.count((int)id)) missed++;
+        }
+        if (found.size() > expected) extra += found.size() - expected;
+    }
+    printf("\n%zu typo queries checked against every name: %s (%zu missed, %zu extra)\n", checked,
+           missed == 0 && extra == 0 ? "all close names found" : "MISMATCH", missed, extra);
+    return missed == 0 && extra == 0 ? 0 : 1;
+}
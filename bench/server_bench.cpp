@@ -0,0 +1,348 @@
+// Load generator for atm_server over loopback. Each connection is one
+// terminal with its own account (registered and logged in first), on its
+// own thread, sending a mix of requests
+//   45% balance, 25% deposit, 25% withdraw, 5% history (last 10)
+// 'depth' at a time: all of them are written at once, then the responses
+// are read (depth 1 is one request per round trip). Latency is from the
+// write of a request's batch to the arrival of its response.
+// Every response must carry its request's tag, in order, and each
+// account's closing balance must be what the deposit and withdraw
+// responses added up to, or the run is marked MISMATCH.
+// Before the runs, usernames the bank must not take (empty, too long, "." and "..",
+// path separators, spaces and other characters, "admin") are sent as
+// registrations, and every one must be refused.
+//
+//   g++ -std=c++17 -O2 -I. bench/server_bench.cpp core/*.cpp -o server_bench -pthread
+//   ./atm_server -d <empty folder> -i 1000 -u /tmp/atm.sock &
+//   ./server_bench -u /tmp/atm.sock [options]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "core/protocol.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static void usage(const char* program) {
+    fprintf(stderr,
+            "Usage: %s [-u <socket> | -p <port>] [options]\n"
+            "  -u <path>          Unix-domain socket of the server\n"
+            "  -p <port>          TCP port on 127.0.0.1 (default 7878)\n"
+            "  -c <connections>   terminals at once (default 16)\n"
+            "  -o <requests>      requests per connection and depth (default 20000)\n"
+            "  -P <a,b,...>       pipeline depths to run (default 1,16)\n"
+            "  -s <seed>          random seed (default 1)\n",
+            program);
+}
+
+static int connectTo(const string& socketPath, int port) {
+    int fd;
+    if (!socketPath.empty()) {
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+            close(fd);
+            return -1;
+        }
+    } else {
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons((unsigned short)port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+            close(fd);
+            return -1;
+        }
+        int on = 1;
+        if (fd >= 0) setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+    return fd;
+}
+
+// One terminal's connection, with blocking reads and writes
+class Terminal {
+private:
+    int fd;
+    string received;
+    size_t used;
+
+public:
+    explicit Terminal(int socket) : fd(socket), used(0) {}
+    ~Terminal() {
+        if (fd >= 0) close(fd);
+    }
+
+    bool send(const string& frames) {
+        size_t done = 0;
+        while (done < frames.size()) {
+            ssize_t put = ::send(fd, frames.data() + done, frames.size() - done, MSG_NOSIGNAL);
+            if (put <= 0) return false;
+            done += (size_t)put;
+        }
+        return true;
+    }
+
+    // The next response frame; false if the connection ended
+    bool next(string& frame) {
+        for (;;) {
+            long size = wireFrameSize(received.data() + used, received.size() - used);
+            if (size < 0) return false;
+            if (size > 0) {
+                frame.assign(received, used, (size_t)size);
+                used += (size_t)size;
+                if (used == received.size()) {
+                    received.clear();
+                    used = 0;
+                }
+                return true;
+            }
+            char buffer[64 * 1024];
+            ssize_t got = recv(fd, buffer, sizeof(buffer), 0);
+            if (got <= 0) return false;
+            received.append(buffer, (size_t)got);
+        }
+    }
+
+    // Send one request and wait for its response's status
+    WireStatus call(const string& request, string& response) {
+        if (!send(request) || !next(response)) return WIRE_BAD_REQUEST;
+        return (WireStatus)wireCode(response.data());
+    }
+};
+
+static string request(unsigned int tag, WireOp op) {
+    string out;
+    WireWriter(out, tag, (unsigned char)op).finish();
+    return out;
+}
+
+static string loginRequest(WireOp op, const string& username, const string& password) {
+    string out;
+    WireWriter frame(out, 0, (unsigned char)op);
+    frame.str(username);
+    frame.str(password);
+    frame.finish();
+    return out;
+}
+
+// Names that would escape the data folder, break a journal line or take
+// the admin's account
+static const char* BAD_USERNAMES[] = {
+    "", "abcdefghijklmnopqrstuvwxyz0123456", ".", "..", "../../escaped", "a/b", "a\\b", "C:x", "a b", "a\tb",
+    "a\nb", "a#b", "admin", "Admin", "ADMIN"};
+
+// Every bad name refused, on a connection of its own
+static bool refusesBadNames(const string& socketPath, int port) {
+    int fd = connectTo(socketPath, port);
+    if (fd < 0) return false;
+    Terminal terminal(fd);
+    string response;
+    size_t refused = 0, count = sizeof(BAD_USERNAMES) / sizeof(BAD_USERNAMES[0]);
+    for (const char* name : BAD_USERNAMES) {
+        if (terminal.call(loginRequest(OP_REGISTER, name, "bad"), response) == WIRE_REFUSED) {
+            refused++;
+        } else {
+            fprintf(stderr, "Registration of \"%s\" was not refused\n", name);
+        }
+    }
+    printf("%zu of %zu bad usernames refused\n", refused, count);
+    return refused == count;
+}
+
+struct Run {
+    vector<long long> nanos;
+    size_t failed;      // responses that were neither OK nor a refused withdrawal
+    bool balanced;
+};
+
+// 'count' requests 'depth' at a time on one connection, logged in to an
+// account holding 'balance'
+static void drive(Terminal& terminal, size_t count, size_t depth, unsigned int seed, long long balance, Run& run) {
+    mt19937 random(seed);
+    vector<WireOp> ops;
+    string batch, response;
+    run.nanos.reserve(count);
+    unsigned int tag = 0;
+    for (size_t done = 0; done < count;) {
+        size_t n = min(depth, count - done);
+        batch.clear();
+        ops.clear();
+        for (size_t i = 0; i < n; i++) {
+            unsigned int pick = random() % 100;
+            WireOp op = pick < 45 ? OP_BALANCE : pick < 70 ? OP_DEPOSIT : pick < 95 ? OP_WITHDRAW : OP_HISTORY;
+            WireWriter frame(batch, tag + (unsigned int)i, (unsigned char)op);
+            if (op == OP_DEPOSIT || op == OP_WITHDRAW) frame.i64(100 * (1 + random() % 50));
+            if (op == OP_HISTORY) frame.u16(10);
+            frame.finish();
+            ops.push_back(op);
+        }
+        auto start = Clock::now();
+        if (!terminal.send(batch)) {
+            run.failed += count - done;
+            return;
+        }
+        for (size_t i = 0; i < n; i++) {
+            if (!terminal.next(response)) {
+                run.failed += count - done - i;
+                return;
+            }
+            run.nanos.push_back(chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count());
+            WireStatus status = (WireStatus)wireCode(response.data());
+            bool withdraw = ops[i] == OP_WITHDRAW;
+            if (wireTag(response.data()) != tag + i || (status != WIRE_OK && !(withdraw && status == WIRE_REFUSED))) {
+                run.failed++;
+            } else if (status == WIRE_OK && (withdraw || ops[i] == OP_DEPOSIT)) {
+                WireReader in(response.data() + WIRE_HEADER_SIZE, response.size() - WIRE_HEADER_SIZE);
+                balance = in.i64();
+            }
+        }
+        tag += (unsigned int)n;
+        done += n;
+    }
+    // The account is this terminal's alone, so its last reported balance
+    // must still be the balance now
+    string answer;
+    if (terminal.call(request(tag, OP_BALANCE), answer) != WIRE_OK) {
+        run.balanced = false;
+        return;
+    }
+    WireReader in(answer.data() + WIRE_HEADER_SIZE, answer.size() - WIRE_HEADER_SIZE);
+    run.balanced = in.i64() == balance;
+}
+
+int main(int argc, char* argv[]) {
+    string socketPath;
+    int port = 7878;
+    size_t connections = 16, requests = 20000;
+    unsigned int seed = 1;
+    vector<size_t> depths;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "-u") == 0 && hasValue) {
+            socketPath = argv[++i];
+        } else if (strcmp(argv[i], "-p") == 0 && hasValue) {
+            port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-c") == 0 && hasValue) {
+            connections = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "-o") == 0 && hasValue) {
+            requests = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "-s") == 0 && hasValue) {
+            seed = (unsigned int)strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "-P") == 0 && hasValue) {
+            for (char* p = argv[++i]; *p;) {
+                depths.push_back(strtoul(p, &p, 10));
+                if (*p == ',') p++;
+                else if (*p) break;
+            }
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (connections == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (depths.empty()) depths = {1, 16};
+
+    // Connect and log every terminal in to its own account, funded so
+    // that most withdrawals go through
+    vector<unique_ptr<Terminal>> terminals;
+    vector<long long> balances;
+    auto start = Clock::now();
+    for (size_t i = 0; i < connections; i++) {
+        int fd = connectTo(socketPath, port);
+        if (fd < 0) {
+            fprintf(stderr, "Cannot connect to %s\n",
+                    socketPath.empty() ? ("127.0.0.1:" + to_string(port)).c_str() : socketPath.c_str());
+            return 1;
+        }
+        terminals.emplace_back(new Terminal(fd));
+        Terminal& terminal = *terminals.back();
+        string name = "load" + to_string(i), response;
+        terminal.call(loginRequest(OP_REGISTER, name, "load"), response);
+        if (terminal.call(loginRequest(OP_LOGIN, name, "load"), response) != WIRE_OK) {
+            fprintf(stderr, "Cannot log in as %s\n", name.c_str());
+            return 1;
+        }
+        string deposit;
+        WireWriter frame(deposit, 0, OP_DEPOSIT);
+        frame.i64(10000000);
+        frame.finish();
+        if (terminal.call(deposit, response) != WIRE_OK) {
+            fprintf(stderr, "Cannot deposit for %s\n", name.c_str());
+            return 1;
+        }
+        WireReader in(response.data() + WIRE_HEADER_SIZE, response.size() - WIRE_HEADER_SIZE);
+        balances.push_back(in.i64());
+    }
+    printf("Logged in %zu terminals in %.2f s\n", connections,
+           chrono::duration<double>(Clock::now() - start).count());
+    if (!refusesBadNames(socketPath, port)) {
+        fprintf(stderr, "MISMATCH: the server took a bad username\n");
+        return 1;
+    }
+    printf("\n");
+
+    printf("%5s %10s %7s %10s %10s %10s %10s %12s  %s\n", "depth", "requests", "failed", "p50 us", "p99 us",
+           "p99.9 us", "max us", "requests/s", "balances");
+    for (size_t depth : depths) {
+        if (depth < 1) continue;
+        vector<Run> runs(connections, Run{vector<long long>(), 0, true});
+        vector<thread> threads;
+        start = Clock::now();
+        for (size_t c = 0; c < connections; c++) {
+            threads.emplace_back([&, c] {
+                drive(*terminals[c], requests, depth, seed * 7919 + (unsigned int)(depth * 131 + c), balances[c],
+                      runs[c]);
+            });
+        }
+        for (auto& worker : threads) worker.join();
+        double seconds = chrono::duration<double>(Clock::now() - start).count();
+
+        vector<long long> all;
+        size_t failures = 0;
+        bool balanced = true;
+        for (size_t c = 0; c < connections; c++) {
+            all.insert(all.end(), runs[c].nanos.begin(), runs[c].nanos.end());
+            failures += runs[c].failed;
+            balanced = balanced && runs[c].balanced;
+        }
+        // The next depth starts from where this one left the balances
+        for (size_t c = 0; c < connections; c++) {
+            string response;
+            if (terminals[c]->call(request(0, OP_BALANCE), response) == WIRE_OK) {
+                WireReader in(response.data() + WIRE_HEADER_SIZE, response.size() - WIRE_HEADER_SIZE);
+                balances[c] = in.i64();
+            }
+        }
+        sort(all.begin(), all.end());
+        auto percentile = [&](size_t per1000) {
+            return all.empty() ? 0.0 : all[(all.size() - 1) * per1000 / 1000] / 1000.0;
+        };
+        printf("%5zu %10zu %7zu %10.1f %10.1f %10.1f %10.1f %12.0f  %s\n", depth, all.size(), failures,
+               percentile(500), percentile(990), percentile(999), all.empty() ? 0.0 : all.back() / 1000.0,
+               seconds > 0 ? all.size() / seconds : 0.0, balanced && failures == 0 ? "ok" : "MISMATCH");
+    }
+    return 0;
+}
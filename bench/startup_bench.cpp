@@ -0,0 +1,182 @@
+// Startup cost of the two account file formats (core/snapshot.h): the
+// original users.dat text, parsed a line at a time, against the binary
+// snapshot, mapped and read in place. For each it measures
+//   read      SnapshotFile::readText / SnapshotFile::read into accounts
+//   build     adding those accounts to an AccountTable
+// and then a whole Bank start:
+//   users.dat     first start on a folder holding only users.dat (this
+//                 includes writing the shard snapshots it converts to)
+//   snapshots     the next start, from those shard snapshots
+// The accounts read back must match the ones written, or the run is
+// marked MISMATCH.
+//
+//   g++ -std=c++17 -O2 -I. bench/startup_bench.cpp core/*.cpp -o startup_bench -pthread
+//   ./startup_bench -d <empty folder> [-n accounts] [-r repeats] [-s seed]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "core/account_table.h"
+#include "core/bank.h"
+#include "core/platform.h"
+#include "core/snapshot.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static void usage(const char* program) {
+    fprintf(stderr, "Usage: %s -d <empty folder> [-n accounts] [-r repeats] [-s seed]\n", program);
+}
+
+static double secondsSince(Clock::time_point start) {
+    return chrono::duration<double>(Clock::now() - start).count();
+}
+
+static long long fileSize(const string& path) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) return -1;
+    fseek(f, 0, SEEK_END);
+    long long size = ftell(f);
+    fclose(f);
+    return size;
+}
+
+// Accounts with credentials the size of real PBKDF2 ones
+static vector<User> makeUsers(size_t n, unsigned int seed) {
+    mt19937 random(seed);
+    vector<User> users;
+    users.reserve(n);
+    string credential = "pbkdf2$100000$" + string(32, 'a') + "$" + string(64, 'b');
+    for (size_t i = 0; i < n; i++) {
+        users.emplace_back("user" + to_string(i), credential, Money::fromPaise(random() % 10000000));
+    }
+    return users;
+}
+
+static bool sameUsers(const vector<User>& a, const vector<User>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].getUsername() != b[i].getUsername() || a[i].getPassword() != b[i].getPassword()
+            || a[i].getBalance() != b[i].getBalance()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+struct Load {
+    double readSeconds, buildSeconds;
+    bool ok;
+};
+
+// Best of 'repeats' reads of one format, each followed by a table build
+template <class Read>
+static Load measure(int repeats, const vector<User>& expected, Read read) {
+    Load best{1e30, 1e30, true};
+    for (int r = 0; r < repeats; r++) {
+        vector<User> loaded;
+        auto start = Clock::now();
+        bool ok = read(loaded);
+        best.readSeconds = min(best.readSeconds, secondsSince(start));
+
+        start = Clock::now();
+        AccountTable table;
+        size_t nameBytes = 0;
+        for (const auto& user : loaded) nameBytes += user.getUsername().size();
+        table.reserve(loaded.size(), nameBytes);
+        for (const auto& user : loaded) table.add(user);
+        best.buildSeconds = min(best.buildSeconds, secondsSince(start));
+
+        if (!ok || !sameUsers(loaded, expected) || table.size() != expected.size()) best.ok = false;
+    }
+    return best;
+}
+
+static void printLoad(const char* format, long long bytes, size_t n, const Load& load) {
+    double total = load.readSeconds + load.buildSeconds;
+    printf("%-9s %12lld %10.1f %10.1f %10.1f %10.0f  %s\n", format, bytes, load.readSeconds * 1e3,
+           load.buildSeconds * 1e3, total * 1e3, total * 1e9 / n, load.ok ? "ok" : "MISMATCH");
+}
+
+int main(int argc, char* argv[]) {
+    string dataDir;
+    size_t n = 1000000;
+    int repeats = 3;
+    unsigned int seed = 1;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "-d") == 0 && hasValue) {
+            dataDir = argv[++i];
+        } else if (strcmp(argv[i], "-n") == 0 && hasValue) {
+            n = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "-r") == 0 && hasValue) {
+            repeats = max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "-s") == 0 && hasValue) {
+            seed = (unsigned int)strtoul(argv[++i], nullptr, 10);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (dataDir.empty() || n == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    vector<User> users = makeUsers(n, seed);
+    string textPath = joinPath(dataDir, "users.dat"), snapshotPath = joinPath(dataDir, "users.snap");
+    if (!SnapshotFile::writeText(users, textPath) || !SnapshotFile::write(users, snapshotPath)) {
+        fprintf(stderr, "Cannot write to %s\n", dataDir.c_str());
+        return 1;
+    }
+
+    printf("%zu accounts, best of %d\n\n", n, repeats);
+    printf("%-9s %12s %10s %10s %10s %10s  %s\n", "format", "bytes", "read ms", "build ms", "total ms",
+           "ns/acct", "accounts");
+    Load text = measure(repeats, users, [&](vector<User>& out) { return SnapshotFile::readText(textPath, out); });
+    printLoad("users.dat", fileSize(textPath), n, text);
+    Load binary = measure(repeats, users, [&](vector<User>& out) { return SnapshotFile::read(snapshotPath, out); });
+    printLoad("snapshot", fileSize(snapshotPath), n, binary);
+    printf("snapshot loads %.1fx faster\n\n", (text.readSeconds + text.buildSeconds)
+                                                 / (binary.readSeconds + binary.buildSeconds));
+
+    // A Bank on its own folder, started from users.dat and then again
+    // from the shard snapshots the first start wrote
+    string bankDir = joinPath(dataDir, "bank");
+    if (!makeDirectory(bankDir) || !SnapshotFile::writeText(users, joinPath(bankDir, "users.dat"))) {
+        fprintf(stderr, "Cannot write to %s\n", bankDir.c_str());
+        return 1;
+    }
+    // Every account plus the admin the bank adds
+    unique_ptr<Bank> bank;
+    auto start = Clock::now();
+    bank.reset(new Bank(bankDir));
+    double fromText = secondsSince(start);
+    bool textOk = bank->size() == n + 1;
+    bank.reset();
+
+    double fromSnapshots = 1e30;
+    bool snapshotsOk = true;
+    for (int r = 0; r < repeats; r++) {
+        start = Clock::now();
+        bank.reset(new Bank(bankDir));
+        fromSnapshots = min(fromSnapshots, secondsSince(start));
+        if (bank->size() != n + 1 || bank->getBalance(bank->findAccount(users[n / 2].getUsername()))
+                                         != users[n / 2].getBalance()) {
+            snapshotsOk = false;
+        }
+        bank.reset();
+    }
+    printf("%-9s %10s  %s\n", "bank open", "ms", "accounts");
+    printf("%-9s %10.1f  %s\n", "users.dat", fromText * 1e3, textOk ? "ok" : "MISMATCH");
+    printf("%-9s %10.1f  %s\n", "snapshots", fromSnapshots * 1e3, snapshotsOk ? "ok" : "MISMATCH");
+    return text.ok && binary.ok && textOk && snapshotsOk ? 0 : 1;
+}
@@ -0,0 +1,330 @@
+// The account table (core/account_table.h) against the layout it
+// replaced: a vector<User> with a hash index keeping its own copy of
+// every username. For each layout it measures
+//   build     adding every account (as loading a snapshot does)
+//   copy      copying the whole store (as a checkpoint does)
+//   balances  summing every balance
+//   frozen    counting frozen accounts
+//   names     counting usernames containing a digit string (the admin filter)
+//   lookup    finding random accounts by name
+// with the heap allocations and bytes each one asks for (counted by
+// replacing operator new), its time, and for scans the rate over the
+// memory they walk.
+//
+//   g++ -std=c++17 -O2 -I. bench/table_bench.cpp core/*.cpp -o table_bench -pthread
+//   ./table_bench [-n accounts] [-l username length] [-r repeats] [-s seed]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "core/account_table.h"
+#include "core/user.h"
+
+using namespace std;
+
+// ---- Allocation counting ----
+
+static atomic<unsigned long long> allocations(0), allocatedBytes(0);
+
+// GCC cannot see that these two replace each other, and warns about
+// every container that frees what it allocated
+#if defined(__GNUC__) && __GNUC__ >= 11 && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(size_t size) {
+    allocations++;
+    allocatedBytes += size;
+    void* p = malloc(size ? size : 1);
+    if (!p) throw bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { operator delete(p); }
+
+struct AllocCount {
+    unsigned long long count, bytes;
+    AllocCount() : count(allocations), bytes(allocatedBytes) {}
+    AllocCount since() const {
+        AllocCount now;
+        now.count -= count;
+        now.bytes -= bytes;
+        return now;
+    }
+};
+
+typedef chrono::steady_clock Clock;
+
+static double secondsSince(Clock::time_point start) {
+    return chrono::duration<double>(Clock::now() - start).count();
+}
+
+// ---- The previous layout ----
+
+// Open addressing like AccountIndex, but each slot holds a copy of its
+// username, as the index did before the names moved into an arena
+class StringIndex {
+private:
+    struct Slot {
+        unsigned int hash;
+        int index;
+        string key;
+    };
+    vector<Slot> slots;
+    size_t count;
+
+    static unsigned int hashName(const string& name) {
+        unsigned int h = 2166136261u;
+        for (char c : name) {
+            h ^= (unsigned char)c;
+            h *= 16777619u;
+        }
+        return h;
+    }
+
+public:
+    StringIndex() : count(0) { slots.resize(16, Slot{0, -1, string()}); }
+
+    void reserve(size_t n) {
+        size_t capacity = slots.size();
+        while (n * 10 >= capacity * 7) capacity *= 2;
+        if (capacity == slots.size()) return;
+        vector<Slot> old;
+        old.swap(slots);
+        slots.resize(capacity, Slot{0, -1, string()});
+        for (auto& slot : old) {
+            if (slot.index == -1) continue;
+            size_t pos = slot.hash & (capacity - 1);
+            while (slots[pos].index != -1) pos = (pos + 1) & (capacity - 1);
+            slots[pos] = move(slot);
+        }
+    }
+
+    int find(const string& name) const {
+        unsigned int h = hashName(name);
+        size_t mask = slots.size() - 1;
+        for (size_t pos = h & mask; slots[pos].index != -1; pos = (pos + 1) & mask) {
+            if (slots[pos].hash == h && slots[pos].key == name) return slots[pos].index;
+        }
+        return -1;
+    }
+
+    bool insert(const string& name, int index) {
+        if (find(name) != -1) return false;
+        reserve(count + 1);
+        unsigned int h = hashName(name);
+        size_t mask = slots.size() - 1;
+        size_t pos = h & mask;
+        while (slots[pos].index != -1) pos = (pos + 1) & mask;
+        slots[pos] = Slot{h, index, name};
+        count++;
+        return true;
+    }
+};
+
+struct UserStore {
+    vector<User> users;
+    StringIndex index;
+};
+
+// ---- Workload ----
+
+struct Account {
+    string name;
+    string credential;
+    Money balance;
+    bool frozen;
+};
+
+// Usernames padded with letters to 'length' (at least the digits)
+static vector<Account> makeAccounts(size_t n, size_t length, unsigned int seed) {
+    mt19937 random(seed);
+    vector<Account> accounts(n);
+    string credential = "pbkdf2$100000$" + string(32, 'a') + "$" + string(64, 'b');  // the size of a real one
+    for (size_t i = 0; i < n; i++) {
+        string digits = to_string(i);
+        accounts[i].name = string(length > digits.size() ? length - digits.size() : 0, 'u') + digits;
+        accounts[i].credential = credential;
+        accounts[i].balance = Money::fromPaise(random() % 10000000);
+        accounts[i].frozen = random() % 50 == 0;
+    }
+    return accounts;
+}
+
+// Keeps results alive so the scans are not optimised away
+static volatile long long sink;
+
+struct Result {
+    double seconds;
+    AllocCount allocs;
+    double bytesWalked;   // 0 if not a scan
+};
+
+template <class Task>
+static Result measure(int repeats, double bytesWalked, Task task) {
+    Result best{1e30, AllocCount(), bytesWalked};
+    for (int r = 0; r < repeats; r++) {
+        AllocCount before;
+        auto start = Clock::now();
+        task();
+        double seconds = secondsSince(start);
+        AllocCount allocs = before.since();
+        if (seconds < best.seconds) best.seconds = seconds;
+        best.allocs = allocs;
+    }
+    return best;
+}
+
+static void printRow(const char* layout, const char* step, size_t items, const Result& result) {
+    char rate[32] = "";
+    if (result.bytesWalked > 0) snprintf(rate, sizeof(rate), "%.2f", result.bytesWalked / result.seconds / 1e9);
+    printf("%-8s %-9s %12llu %12llu %10.3f %10.2f %9s\n", layout, step, result.allocs.count,
+           result.allocs.bytes, result.seconds * 1e3, result.seconds * 1e9 / items, rate);
+}
+
+int main(int argc, char* argv[]) {
+    size_t n = 1000000, length = 10;
+    int repeats = 5;
+    unsigned int seed = 1;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "-n") == 0 && hasValue) {
+            n = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "-l") == 0 && hasValue) {
+            length = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "-r") == 0 && hasValue) {
+            repeats = max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "-s") == 0 && hasValue) {
+            seed = (unsigned int)strtoul(argv[++i], nullptr, 10);
+        } else {
+            fprintf(stderr, "Usage: %s [-n accounts] [-l username length] [-r repeats] [-s seed]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (n == 0) n = 1;
+
+    vector<Account> accounts = makeAccounts(n, length, seed);
+    // Names too long for a string's own buffer (15 characters in
+    // libstdc++) are on the heap, which the old scans walk as well
+    size_t nameBytes = 0, heapNameBytes = 0;
+    for (const auto& account : accounts) {
+        nameBytes += account.name.size();
+        if (account.name.size() > 15) heapNameBytes += account.name.size() + 1;
+    }
+    mt19937 random(seed + 1);
+    vector<string> probes(min<size_t>(n, 200000));
+    for (auto& probe : probes) probe = accounts[random() % n].name;
+    const char* needle = "77";
+
+    printf("%zu accounts, %zu character usernames, best of %d\n", n, length, repeats);
+    printf("sizeof(User) = %zu bytes; the table keeps %zu bytes of hot columns per account\n\n", sizeof(User),
+           sizeof(Money) + 1);
+    printf("%-8s %-9s %12s %12s %10s %10s %9s\n", "layout", "step", "allocations", "bytes", "ms",
+           "ns/item", "GB/s");
+
+    // vector<User>
+    {
+        UserStore store;
+        Result build = measure(repeats, 0, [&] {
+            store = UserStore();
+            store.users.reserve(n);
+            store.index.reserve(n);
+            for (const auto& account : accounts) {
+                if (!store.index.insert(account.name, (int)store.users.size())) continue;
+                store.users.emplace_back(account.name, account.credential, account.balance);
+                store.users.back().setFrozen(account.frozen);
+            }
+        });
+        printRow("users", "build", n, build);
+
+        Result copy = measure(repeats, 0, [&] {
+            vector<User> copied = store.users;
+            sink = (long long)copied.size();
+        });
+        printRow("users", "copy", n, copy);
+
+        double walked = (double)n * sizeof(User);
+        Result balances = measure(repeats, walked, [&] {
+            Money total;
+            for (const auto& user : store.users) total += user.getBalance();
+            sink = total.getPaise();
+        });
+        printRow("users", "balances", n, balances);
+
+        Result frozen = measure(repeats, walked, [&] {
+            long long count = 0;
+            for (const auto& user : store.users) count += user.isFrozen();
+            sink = count;
+        });
+        printRow("users", "frozen", n, frozen);
+
+        Result names = measure(repeats, walked + heapNameBytes, [&] {
+            long long count = 0;
+            for (const auto& user : store.users) count += user.getUsername().find(needle) != string::npos;
+            sink = count;
+        });
+        printRow("users", "names", n, names);
+
+        Result lookup = measure(repeats, 0, [&] {
+            long long found = 0;
+            for (const auto& probe : probes) found += store.index.find(probe);
+            sink = found;
+        });
+        printRow("users", "lookup", probes.size(), lookup);
+    }
+    printf("\n");
+
+    // AccountTable
+    {
+        AccountTable table;
+        Result build = measure(repeats, 0, [&] {
+            table = AccountTable();
+            table.reserve(n, nameBytes);
+            for (const auto& account : accounts) {
+                int id = table.add(account.name, account.credential, account.balance);
+                if (id != -1) table.setFrozen(id, account.frozen);
+            }
+        });
+        printRow("table", "build", n, build);
+
+        Result copy = measure(repeats, 0, [&] {
+            AccountTable copied = table;
+            sink = (long long)copied.size();
+        });
+        printRow("table", "copy", n, copy);
+
+        Result balances = measure(repeats, (double)n * sizeof(Money), [&] {
+            sink = table.totalBalance().getPaise();
+        });
+        printRow("table", "balances", n, balances);
+
+        Result frozen = measure(repeats, (double)n, [&] {
+            sink = (long long)table.frozenCount();
+        });
+        printRow("table", "frozen", n, frozen);
+
+        Result names = measure(repeats, (double)nameBytes + n * sizeof(unsigned int), [&] {
+            long long count = 0;
+            for (size_t i = 0; i < table.size(); i++) count += table.name((int)i).find(needle) != string_view::npos;
+            sink = count;
+        });
+        printRow("table", "names", n, names);
+
+        Result lookup = measure(repeats, 0, [&] {
+            long long found = 0;
+            for (const auto& probe : probes) found += table.find(probe);
+            sink = found;
+        });
+        printRow("table", "lookup", probes.size(), lookup);
+    }
+    return 0;
+}
@@ -0,0 +1,175 @@
+// Transfers between accounts under contention. Each scenario runs with
+// 1, 2, 4 ... threads doing transfers against one Bank at once:
+//   uniform   both accounts picked at random
+//   hot       90% of transfers involve one of a few hot accounts
+//   single    every transfer is to or from one account
+//   pingpong  two accounts sending money to each other from every thread
+//             (transfers in opposite directions, the deadlock case)
+// After each run the balances of all accounts must still add up to what
+// they were, or the run is marked MISMATCH.
+//
+//   g++ -std=c++17 -O2 -I. bench/transfer_bench.cpp core/*.cpp -o transfer_bench -pthread
+//   ./transfer_bench -d <empty folder> [options]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "core/bank.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+enum Scenario { UNIFORM, HOT, SINGLE, PINGPONG, SCENARIOS };
+static const char* SCENARIO_NAMES[SCENARIOS] = {"uniform", "hot", "single", "pingpong"};
+
+static void usage(const char* program) {
+    fprintf(stderr,
+            "Usage: %s -d <empty folder> [options]\n"
+            "  -n <accounts>      accounts to create (default 1000)\n"
+            "  -o <transfers>     transfers per thread (default 20000)\n"
+            "  -t <a,b,...>       thread counts to run (default 1,2,4,8)\n"
+            "  -h <accounts>      size of the hot set (default 8)\n"
+            "  -s <seed>          random seed (default 1)\n"
+            "  -f                 fsync the transaction logs in groups, as the ATM does\n"
+            "                     (default: write them once a second, to measure the locking)\n",
+            program);
+}
+
+static Money totalBalance(Bank& bank, const vector<int>& ids) {
+    Money total;
+    for (int id : ids) total += bank.getBalance(id);
+    return total;
+}
+
+// The two accounts of the next transfer
+static void pick(Scenario scenario, mt19937& random, const vector<int>& ids, size_t hotCount, int& from, int& to) {
+    size_t n = ids.size();
+    size_t a, b;
+    switch (scenario) {
+        case HOT:
+            a = random() % hotCount;
+            b = random() % 10 < 9 ? random() % n : random() % hotCount;
+            break;
+        case SINGLE:
+            a = 0;
+            b = 1 + random() % (n - 1);
+            break;
+        case PINGPONG:
+            a = 0;
+            b = 1;
+            break;
+        default:
+            a = random() % n;
+            b = random() % n;
+    }
+    if (a == b) b = (b + 1) % n;
+    if (random() & 1) swap(a, b);
+    from = ids[a];
+    to = ids[b];
+}
+
+int main(int argc, char* argv[]) {
+    string dataDir;
+    size_t accounts = 1000, transfers = 20000, hotCount = 8;
+    unsigned int seed = 1;
+    bool fsyncLogs = false;
+    vector<int> threadCounts;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "-d") == 0 && hasValue) {
+            dataDir = argv[++i];
+        } else if (strcmp(argv[i], "-n") == 0 && hasValue) {
+            accounts = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "-o") == 0 && hasValue) {
+            transfers = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "-h") == 0 && hasValue) {
+            hotCount = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "-s") == 0 && hasValue) {
+            seed = (unsigned int)strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "-t") == 0 && hasValue) {
+            for (char* p = argv[++i]; *p;) {
+                threadCounts.push_back((int)strtol(p, &p, 10));
+                if (*p == ',') p++;
+                else if (*p) break;
+            }
+        } else if (strcmp(argv[i], "-f") == 0) {
+            fsyncLogs = true;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (dataDir.empty() || accounts < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (threadCounts.empty()) threadCounts = {1, 2, 4, 8};
+    hotCount = max<size_t>(1, min(hotCount, accounts));
+
+    Bank bank(dataDir);
+    bank.setPasswordIterations(1);
+    if (!fsyncLogs) bank.getTransactionLog().setDurability(TransactionLog::TIMED, 0, 1000);
+
+    // Accounts, funded well enough that transfers do not run dry
+    vector<int> ids;
+    vector<BatchOp> funding;
+    for (size_t i = 0; i < accounts; i++) {
+        string name = "transfer" + to_string(i);
+        bank.registerUser(name, "pw");
+        ids.push_back(bank.findAccount(name));
+        funding.push_back({name, Money::fromPaise(100000000), TX_DEPOSIT});
+    }
+    BatchReport funded;
+    bank.applyBatch(funding, funded);
+
+    printf("%-9s %7s %10s %7s %10s %10s %12s  %s\n", "scenario", "threads", "transfers", "failed", "p50 us",
+           "p99 us", "transfers/s", "balances");
+    for (int s = 0; s < SCENARIOS; s++) {
+        for (int threads : threadCounts) {
+            if (threads < 1) continue;
+            Money before = totalBalance(bank, ids);
+            vector<vector<long long>> nanos(threads);
+            vector<size_t> failed(threads, 0);
+            vector<thread> workers;
+            auto start = Clock::now();
+            for (int t = 0; t < threads; t++) {
+                workers.emplace_back([&, t] {
+                    mt19937 random(seed * 7919 + s * 131 + t);
+                    nanos[t].reserve(transfers);
+                    for (size_t i = 0; i < transfers; i++) {
+                        int from, to;
+                        pick((Scenario)s, random, ids, hotCount, from, to);
+                        auto begin = Clock::now();
+                        bool ok = bank.transfer(from, to, Money::fromPaise(100));
+                        nanos[t].push_back(chrono::duration_cast<chrono::nanoseconds>(Clock::now() - begin).count());
+                        if (!ok) failed[t]++;
+                    }
+                });
+            }
+            for (auto& worker : workers) worker.join();
+            double seconds = chrono::duration<double>(Clock::now() - start).count();
+
+            vector<long long> all;
+            size_t failures = 0;
+            for (int t = 0; t < threads; t++) {
+                all.insert(all.end(), nanos[t].begin(), nanos[t].end());
+                failures += failed[t];
+            }
+            sort(all.begin(), all.end());
+            double p50 = all.empty() ? 0 : all[(all.size() - 1) * 50 / 100] / 1000.0;
+            double p99 = all.empty() ? 0 : all[(all.size() - 1) * 99 / 100] / 1000.0;
+            bool balanced = totalBalance(bank, ids) == before;
+            printf("%-9s %7d %10zu %7zu %10.2f %10.2f %12.0f  %s\n", SCENARIO_NAMES[s], threads, all.size(),
+                   failures, p50, p99, seconds > 0 ? all.size() / seconds : 0.0, balanced ? "ok" : "MISMATCH");
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,105 @@
+#include "workload.h"
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+double ZipfGenerator::zeta(size_t n, double theta) {
+    double sum = 0;
+    for (size_t i = 1; i <= n; i++) sum += 1.0 / pow((double)i, theta);
+    return sum;
+}
+
+ZipfGenerator::ZipfGenerator(size_t items, double skew) : n(items > 0 ? items : 1), theta(skew) {
+    zetan = zeta(n, theta);
+    double zeta2 = zeta(2, theta);
+    alpha = 1.0 / (1.0 - theta);
+    eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / zetan);
+}
+
+size_t ZipfGenerator::next(mt19937_64& rng) {
+    double u = uniform_real_distribution<double>(0.0, 1.0)(rng);
+    if (theta <= 0) return (size_t)(u * n) % n;
+    double uz = u * zetan;
+    if (uz < 1.0) return 0;
+    if (uz < 1.0 + pow(0.5, theta)) return n > 1 ? 1 : 0;
+    size_t k = (size_t)(n * pow(eta * u - eta + 1.0, alpha));
+    return k < n ? k : n - 1;
+}
+
+const char* benchOpName(BenchOpType type) {
+    switch (type) {
+        case OP_BALANCE: return "balance";
+        case OP_WITHDRAW: return "withdraw";
+        case OP_DEPOSIT: return "deposit";
+        default: return "?";
+    }
+}
+
+string benchAccountName(size_t index) {
+    char name[32];
+    snprintf(name, sizeof(name), "acct%06zu", index);
+    return name;
+}
+
+void generateWorkload(const WorkloadSpec& spec, vector<BenchOp>& ops) {
+    mt19937_64 rng(spec.seed);
+    ZipfGenerator accounts(spec.accounts, spec.skew);
+    int total = spec.percent[OP_BALANCE] + spec.percent[OP_WITHDRAW] + spec.percent[OP_DEPOSIT];
+    uniform_int_distribution<int> mix(0, total > 0 ? total - 1 : 0);
+    uniform_int_distribution<long long> withdrawal(100, 50000);   // Rs1 - Rs500
+    uniform_int_distribution<long long> deposit(100, 100000);     // Rs1 - Rs1000
+
+    ops.clear();
+    ops.reserve(spec.operations);
+    for (size_t i = 0; i < spec.operations; i++) {
+        BenchOp op;
+        int pick = mix(rng);
+        op.type = pick < spec.percent[OP_BALANCE] ? OP_BALANCE
+                : pick < spec.percent[OP_BALANCE] + spec.percent[OP_WITHDRAW] ? OP_WITHDRAW
+                : OP_DEPOSIT;
+        op.account = (int)accounts.next(rng);
+        if (op.type == OP_WITHDRAW) op.amount = Money::fromPaise(withdrawal(rng));
+        if (op.type == OP_DEPOSIT) op.amount = Money::fromPaise(deposit(rng));
+        ops.push_back(op);
+    }
+}
+
+bool saveWorkload(const string& path, const vector<BenchOp>& ops) {
+    ofstream file(path);
+    if (!file) return false;
+    static const char letters[] = {'B', 'W', 'D'};
+    for (const auto& op : ops) {
+        file << letters[op.type] << ' ' << op.account;
+        if (op.type != OP_BALANCE) file << ' ' << op.amount.toString();
+        file << '\n';
+    }
+    return (bool)file;
+}
+
+bool loadWorkload(const string& path, vector<BenchOp>& ops) {
+    ifstream file(path);
+    if (!file) return false;
+    ops.clear();
+    string line;
+    while (getline(file, line)) {
+        istringstream in(line);
+        char letter;
+        BenchOp op;
+        string amount;
+        if (!(in >> letter >> op.account) || op.account < 0) return false;
+        if (letter == 'B') {
+            op.type = OP_BALANCE;
+        } else if (letter == 'W' || letter == 'D') {
+            op.type = letter == 'W' ? OP_WITHDRAW : OP_DEPOSIT;
+            if (!(in >> amount) || !Money::parse(amount, op.amount)) return false;
+        } else {
+            return false;
+        }
+        ops.push_back(op);
+    }
+    return true;
+}
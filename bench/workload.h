@@ -0,0 +1,60 @@
+#ifndef ATM_BENCH_WORKLOAD_H
+#define ATM_BENCH_WORKLOAD_H
+
+// Synthetic workloads for the benchmarks: which account each operation
+// hits (Zipf skewed, so a few accounts are hot) and what it does.
+// A workload is fully determined by its seed and settings, and can be
+// saved to a file and replayed, so two builds can be compared on exactly
+// the same operations.
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "core/money.h"
+
+// Zipf distributed integers in [0, n): value k has weight 1 / (k+1)^theta.
+// Uses the rejection-free method of Gray et al. ("Quickly generating
+// billion-record synthetic databases"), as YCSB does.
+class ZipfGenerator {
+private:
+    size_t n;
+    double theta, alpha, zetan, eta;
+
+    static double zeta(size_t n, double theta);
+
+public:
+    ZipfGenerator(size_t items, double skew);
+    size_t next(std::mt19937_64& rng);
+};
+
+enum BenchOpType { OP_BALANCE, OP_WITHDRAW, OP_DEPOSIT, OP_TYPES };
+
+struct BenchOp {
+    BenchOpType type;
+    int account;     // index into the generated accounts
+    Money amount;
+};
+
+struct WorkloadSpec {
+    size_t accounts;
+    size_t operations;
+    double skew;               // Zipf theta, 0 for uniform
+    int percent[OP_TYPES];     // balance / withdraw / deposit mix
+    unsigned long long seed;
+
+    WorkloadSpec() : accounts(10000), operations(200000), skew(0.99), percent{70, 20, 10}, seed(1) {}
+};
+
+const char* benchOpName(BenchOpType type);
+
+// Names of the generated accounts ("acct000123")
+std::string benchAccountName(size_t index);
+
+void generateWorkload(const WorkloadSpec& spec, std::vector<BenchOp>& ops);
+
+// One "B|W|D <account> [amount]" line per operation
+bool saveWorkload(const std::string& path, const std::vector<BenchOp>& ops);
+bool loadWorkload(const std::string& path, std::vector<BenchOp>& ops);
+
+#endif
@@ -0,0 +1,56 @@
+#include "account_index.h"
+
+using namespace std;
+
+AccountIndex::AccountIndex() : count(0) {
+    slots.assign(16, Slot{0, -1, 0, 0});
+}
+
+void AccountIndex::resizeTable(size_t capacity) {
+    vector<Slot> old;
+    old.swap(slots);
+    slots.assign(capacity, Slot{0, -1, 0, 0});
+    size_t mask = capacity - 1;
+    for (const auto& slot : old) {
+        if (slot.index == -1) continue;
+        size_t pos = slot.hash & mask;
+        while (slots[pos].index != -1) pos = (pos + 1) & mask;
+        slots[pos] = slot;
+    }
+}
+
+void AccountIndex::clear() {
+    slots.assign(16, Slot{0, -1, 0, 0});
+    count = 0;
+}
+
+void AccountIndex::reserve(size_t n) {
+    size_t capacity = slots.size();
+    while (n * 10 >= capacity * 7) capacity *= 2;
+    if (capacity != slots.size()) resizeTable(capacity);
+}
+
+int AccountIndex::find(string_view username, const NameArena& names) const {
+    unsigned int h = hashName(username);
+    size_t mask = slots.size() - 1;
+    size_t pos = h & mask;
+    while (slots[pos].index != -1) {
+        const Slot& slot = slots[pos];
+        if (slot.hash == h && slot.length == username.size()
+            && names.at(slot.offset, slot.length) == username) {
+            return slot.index;
+        }
+        pos = (pos + 1) & mask;
+    }
+    return -1;
+}
+
+void AccountIndex::insert(string_view username, int index, const NameArena& names) {
+    reserve(count + 1);
+    unsigned int h = hashName(username);
+    size_t mask = slots.size() - 1;
+    size_t pos = h & mask;
+    while (slots[pos].index != -1) pos = (pos + 1) & mask;
+    slots[pos] = Slot{h, index, names.offsetOf(index), (unsigned int)username.size()};
+    count++;
+}
@@ -0,0 +1,55 @@
+#ifndef ATM_ACCOUNT_INDEX_H
+#define ATM_ACCOUNT_INDEX_H
+
+#include <string_view>
+#include <vector>
+
+#include "name_arena.h"
+
+// Open-addressing hash index from username to account id (position in
+// the Bank's table). Linear probing over a power-of-two table. Accounts
+// are never removed, so there are no tombstones to deal with.
+// Slots hold no strings: a name is compared in the arena, at the place
+// its slot keeps (so a lookup reads the slot and the name, nothing else).
+class AccountIndex {
+private:
+    struct Slot {
+        unsigned int hash;
+        int index;      // -1 marks an empty slot
+        unsigned int offset;    // of the name in the arena
+        unsigned int length;
+    };
+
+    std::vector<Slot> slots;
+    size_t count;
+
+    // FNV-1a, good enough spread for usernames
+    static unsigned int hashName(std::string_view name) {
+        unsigned int h = 2166136261u;
+        for (size_t i = 0; i < name.size(); i++) {
+            h ^= (unsigned char)name[i];
+            h *= 16777619u;
+        }
+        return h;
+    }
+
+    void resizeTable(size_t capacity);
+
+public:
+    AccountIndex();
+
+    void clear();
+
+    // Make room for n accounts without rehashing (keeps load below 0.7)
+    void reserve(size_t n);
+
+    // Returns the id of username in 'names', or -1 if not present
+    int find(std::string_view username, const NameArena& names) const;
+
+    // Add a name that find() did not find, stored in 'names' as 'index'
+    void insert(std::string_view username, int index, const NameArena& names);
+
+    size_t size() const { return count; }
+};
+
+#endif
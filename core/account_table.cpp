@@ -0,0 +1,86 @@
+#include "account_table.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+int AccountTable::add(string_view username, const string& credential, Money balance) {
+    if (find(username) != -1) return -1;
+    int id = (int)names.add(username);
+    index.insert(username, id, names);
+    balances.push_back(balance);
+    frozen.push_back(0);
+    credentials.push_back(credential);
+    limits.emplace_back();
+    return id;
+}
+
+int AccountTable::add(const User& user) {
+    int id = add(user.getUsername(), user.getPassword(), user.getBalance());
+    if (id == -1) return -1;
+    setFrozen(id, user.isFrozen());
+    setLimits(id, user.getLimits());
+    return id;
+}
+
+void AccountTable::clear() {
+    names.clear();
+    index.clear();
+    balances.clear();
+    frozen.clear();
+    credentials.clear();
+    limits.clear();
+}
+
+void AccountTable::reserve(size_t accounts, size_t nameBytes) {
+    names.reserve(accounts, nameBytes);
+    index.reserve(accounts);
+    balances.reserve(accounts);
+    frozen.reserve(accounts);
+    credentials.reserve(accounts);
+    limits.reserve(accounts);
+}
+
+User AccountTable::toUser(int id) const {
+    User user(string(name(id)), credentials[id], balances[id]);
+    user.setFrozen(isFrozen(id));
+    user.setLimits(limits[id]);
+    return user;
+}
+
+// Four running sums, so the adds do not wait for each other
+Money sumBalances(const vector<Money>& balances) {
+    long long sums[4] = {0, 0, 0, 0};
+    size_t n = balances.size(), i = 0;
+    for (; i + 4 <= n; i += 4) {
+        for (int k = 0; k < 4; k++) sums[k] += balances[i + k].getPaise();
+    }
+    for (; i < n; i++) sums[0] += balances[i].getPaise();
+    return Money::fromPaise(sums[0] + sums[1] + sums[2] + sums[3]);
+}
+
+// Flags are 0 or 1, so a flag turned into a mask (0 or all ones) picks
+// the balance without a branch
+Money sumFlagged(const vector<Money>& balances, const vector<unsigned char>& flags) {
+    long long sums[4] = {0, 0, 0, 0};
+    size_t n = min(balances.size(), flags.size()), i = 0;
+    for (; i + 4 <= n; i += 4) {
+        for (int k = 0; k < 4; k++) sums[k] += balances[i + k].getPaise() & -(long long)flags[i + k];
+    }
+    for (; i < n; i++) sums[0] += balances[i].getPaise() & -(long long)flags[i];
+    return Money::fromPaise(sums[0] + sums[1] + sums[2] + sums[3]);
+}
+
+// Eight flags at a time: multiplying a word of them by 0x0101... adds all
+// eight into its top byte
+size_t countFlags(const vector<unsigned char>& flags) {
+    size_t count = 0, n = flags.size(), i = 0;
+    for (; i + 8 <= n; i += 8) {
+        unsigned long long word;
+        memcpy(&word, flags.data() + i, 8);
+        count += (size_t)((word * 0x0101010101010101ULL) >> 56);
+    }
+    for (; i < n; i++) count += flags[i];
+    return count;
+}
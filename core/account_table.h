@@ -0,0 +1,93 @@
+#ifndef ATM_ACCOUNT_TABLE_H
+#define ATM_ACCOUNT_TABLE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "account_index.h"
+#include "limits.h"
+#include "money.h"
+#include "name_arena.h"
+#include "user.h"
+
+// Scans of the hot columns, for the table or copies of its columns
+Money sumBalances(const std::vector<Money>& balances);
+Money sumFlagged(const std::vector<Money>& balances, const std::vector<unsigned char>& flags);
+size_t countFlags(const std::vector<unsigned char>& flags);
+
+// All accounts, one column per field. An account's id is its position in
+// every column, and never changes once it is added.
+//  - hot columns, read by every operation and by scans over all
+//    accounts: the balances and frozen flags, each packed in one array,
+//    and the usernames interned in one NameArena
+//  - cold columns, read at login and by the limit checks: credentials
+//    (each its own string) and withdrawal limits
+// So a scan of balances walks 8 bytes per account through one block of
+// memory, and adding an account allocates nothing but its credential
+// (and whatever the columns need to grow).
+// Not thread safe; the Bank locks around it. A name() view stays valid
+// until the next add().
+class AccountTable {
+private:
+    NameArena names;
+    AccountIndex index;
+    std::vector<Money> balances;
+    std::vector<unsigned char> frozen;
+    std::vector<std::string> credentials;
+    std::vector<WithdrawalLimits> limits;
+
+public:
+    size_t size() const { return balances.size(); }
+    bool validId(int id) const { return id >= 0 && id < (int)balances.size(); }
+
+    // Id of the account, or -1
+    int find(std::string_view username) const { return index.find(username, names); }
+
+    // New account's id, or -1 if the name is taken
+    int add(std::string_view username, const std::string& credential, Money balance);
+    int add(const User& user);
+
+    void clear();
+    void reserve(size_t accounts, size_t nameBytes);
+
+    std::string_view name(int id) const { return names.get(id); }
+
+    Money balance(int id) const { return balances[id]; }
+    void setBalance(int id, Money balance) { balances[id] = balance; }
+
+    // Same checks as User::deposit() and User::withdraw()
+    bool deposit(int id, Money amount) {
+        if (amount <= Money() || !balances[id].canAdd(amount)) return false;
+        balances[id] += amount;
+        return true;
+    }
+    bool withdraw(int id, Money amount) {
+        if (amount <= Money() || amount > balances[id]) return false;
+        balances[id] -= amount;
+        return true;
+    }
+
+    bool isFrozen(int id) const { return frozen[id] != 0; }
+    void setFrozen(int id, bool status) { frozen[id] = status ? 1 : 0; }
+
+    const std::string& credential(int id) const { return credentials[id]; }
+    void setCredential(int id, const std::string& credential) { credentials[id] = credential; }
+
+    const WithdrawalLimits& getLimits(int id) const { return limits[id]; }
+    void setLimits(int id, const WithdrawalLimits& l) { limits[id] = l; }
+
+    // The account as a User (for the text format)
+    User toUser(int id) const;
+
+    // Scans over every account
+    Money totalBalance() const { return sumBalances(balances); }
+    size_t frozenCount() const { return countFlags(frozen); }
+
+    // Whole columns, for other scans and copies
+    const NameArena& getNames() const { return names; }
+    const std::vector<Money>& getBalances() const { return balances; }
+    const std::vector<unsigned char>& getFrozenFlags() const { return frozen; }
+};
+
+#endif
@@ -0,0 +1,284 @@
+#ifndef ATM_ATM_H
+#define ATM_ATM_H
+
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include "bank.h"
+#include "user_view.h"
+
+// One terminal's session against the Bank: who is logged in and whether
+// they are the admin. A session is used by one thread at a time; run one
+// ATM per terminal (or per thread) to serve many of them concurrently.
+class ATM {
+private:
+    Bank& bank;
+    int currentId;
+    bool isAdmin;
+    bool isLoggedIn;
+    std::string sessionToken;
+    LimitCheck lastLimitCheck;
+
+    // Operations present the session token instead of re-checking the
+    // password. The Bank drops the session when the password is reset or
+    // the account frozen, which logs this terminal out.
+    bool checkSession() {
+        if (!isLoggedIn) return false;
+        if (bank.resumeSession(sessionToken) == currentId) return true;
+        logout();
+        return false;
+    }
+
+    bool adminSession() { return isAdmin && checkSession(); }
+
+public:
+    explicit ATM(Bank& b) : bank(b), currentId(-1), isAdmin(false), isLoggedIn(false), lastLimitCheck(LIMIT_OK) {}
+    ~ATM() { logout(); }
+
+    // Periodic housekeeping, called from the UI timer
+    void tick() { bank.tick(); }
+
+    std::string describeLogStats() const { return bank.getTransactionLog().describeStats(); }
+
+    // Text format import/export (the original users.dat layout)
+    bool exportText(const std::string& path) const { return bank.exportText(path); }
+
+    bool importText(const std::string& path, std::string* problem = nullptr) {
+        logout();
+        return bank.importText(path, problem);
+    }
+
+    // User management
+    bool login(const std::string& username, const std::string& password) {
+        logout();
+        int id = bank.authenticate(username, password, &sessionToken);
+        if (id == -1) return false; // Wrong password or account is frozen
+        currentId = id;
+        isLoggedIn = true;
+        isAdmin = (username == "admin");
+        return true;
+    }
+
+    // Take over a session opened by an earlier login
+    bool resume(const std::string& token) {
+        logout();
+        int id = bank.resumeSession(token);
+        if (id == -1) return false;
+        sessionToken = token;
+        currentId = id;
+        isLoggedIn = true;
+        isAdmin = (bank.getUsername(id) == "admin");
+        return true;
+    }
+
+    const std::string& getSessionToken() const { return sessionToken; }
+
+    // Let go of the session without closing it, so another terminal can
+    // resume() it (a connection that dropped and comes back)
+    void detach() {
+        sessionToken.clear();
+        logout();
+    }
+
+    void logout() {
+        if (!sessionToken.empty()) bank.endSession(sessionToken);
+        sessionToken.clear();
+        currentId = -1;
+        isLoggedIn = false;
+        isAdmin = false;
+    }
+
+    bool registerUser(const std::string& username, const std::string& password) {
+        return bank.registerUser(username, password);
+    }
+
+    // Account operations; balanceAfter, if given, is set to the new
+    // balance. With an idempotency key, a request sent again (after a
+    // timeout, say) gets the first answer instead of running twice.
+    bool deposit(Money amount, Money* balanceAfter = nullptr, const std::string& key = "") {
+        if (!checkSession()) return false;
+        return bank.deposit(currentId, amount, balanceAfter, key);
+    }
+
+    bool withdraw(Money amount, Money* balanceAfter = nullptr, const std::string& key = "") {
+        lastLimitCheck = LIMIT_OK;
+        if (!checkSession()) return false;
+        return bank.withdraw(currentId, amount, balanceAfter, &lastLimitCheck, key);
+    }
+
+    // Move money to another account, in one step (Bank::transfer)
+    bool transfer(const std::string& toUsername, Money amount, const std::string& key = "") {
+        lastLimitCheck = LIMIT_OK;
+        if (!checkSession()) return false;
+        return bank.transfer(currentId, bank.findAccount(toUsername), amount, nullptr, &lastLimitCheck, key);
+    }
+
+    // Why the last withdraw() or transfer() was refused, if one of the
+    // account's limits refused it (LIMIT_OK otherwise)
+    LimitCheck getLastLimitCheck() const { return lastLimitCheck; }
+
+    std::string getBalance() {
+        if (!checkSession()) return "Not logged in";
+        return "Current balance: Rs" + bank.getBalance(currentId).toString();
+    }
+
+    Money getBalanceAmount() {
+        return checkSession() ? bank.getBalance(currentId) : Money();
+    }
+
+    // Admin functions
+    bool resetPassword(const std::string& username, const std::string& newPassword) {
+        if (!adminSession()) return false;
+        return bank.setPassword(bank.findAccount(username), newPassword);
+    }
+
+    bool toggleFreezeAccount(const std::string& username) {
+        if (!adminSession()) return false;
+        return bank.toggleFrozen(bank.findAccount(username));
+    }
+
+    // Usernames matching what the admin typed so far (Bank::searchUsers)
+    bool searchUsers(const std::string& text, size_t limit, std::vector<std::string>& out) {
+        if (!adminSession()) return false;
+        bank.searchUsers(text, limit, out);
+        return true;
+    }
+
+    // Bring an admin account listing up to date; true if it changed
+    bool refreshUserView(AdminUserView& view) {
+        if (!adminSession()) return false;
+        return view.refresh();
+    }
+
+    // Getters
+    bool isUserLoggedIn() const { return isLoggedIn; }
+    bool isUserAdmin() const { return isAdmin; }
+    std::string getCurrentUsername() const {
+        return isLoggedIn ? bank.getUsername(currentId) : "";
+    }
+    std::string getTransactionHistory() {
+        if (!checkSession()) return "Not logged in";
+        return bank.formatHistory(currentId);
+    }
+
+    // Own last 'count' records, oldest first
+    bool getRecentTransactions(size_t count, std::vector<TxRecord>& out) {
+        if (!checkSession()) return false;
+        return bank.recentTransactions(currentId, count, out);
+    }
+
+    // Own balance at a past time (seconds since the epoch); false if the
+    // account had no transactions by then
+    bool getBalanceAt(long long when, Money& balance) {
+        if (!checkSession()) return false;
+        return bank.balanceAt(currentId, when, balance);
+    }
+
+    // Own deposits and withdrawals with from <= time <= to
+    bool getFlowBetween(long long from, long long to, Money& in, Money& out) {
+        if (!checkSession()) return false;
+        return bank.flowBetween(currentId, from, to, in, out);
+    }
+    
+    // Admin methods (the key, if any, belongs to the account the money
+    // leaves or reaches, as in Bank)
+    bool adminDeposit(const std::string& username, Money amount, const std::string& key = "") {
+        if (!adminSession()) return false;
+        return bank.deposit(bank.findAccount(username), amount, nullptr, key);
+    }
+    
+    bool adminWithdraw(const std::string& username, Money amount, const std::string& key = "") {
+        if (!adminSession()) return false;
+        return bank.adminWithdraw(bank.findAccount(username), amount, nullptr, key);
+    }
+
+    bool adminTransfer(const std::string& fromUsername, const std::string& toUsername, Money amount,
+                       const std::string& key = "") {
+        if (!adminSession()) return false;
+        return bank.adminTransfer(bank.findAccount(fromUsername), bank.findAccount(toUsername), amount, key);
+    }
+
+    // Withdrawal limits of an account (zero fields mean no limit)
+
+    bool setUserLimits(const std::string& username, const WithdrawalLimits& limits) {
+        if (!adminSession()) return false;
+        return bank.setLimits(bank.findAccount(username), limits);
+    }
+
+    bool getUserLimits(const std::string& username, WithdrawalLimits& limits) {
+        if (!adminSession()) return false;
+        return bank.getLimits(bank.findAccount(username), limits);
+    }
+    
+    // Bulk deposits and withdrawals, all or nothing (Bank::applyBatch)
+    bool adminBatch(const std::vector<BatchOp>& ops, BatchReport& report) {
+        if (!adminSession()) return false;
+        return bank.applyBatch(ops, report);
+    }
+
+    // Run a batch file (see readBatchFile) and describe the outcome
+    std::string runBatchFile(const std::string& path) {
+        if (!adminSession()) return "Access denied";
+        std::vector<BatchOp> ops;
+        size_t badLine;
+        if (!readBatchFile(path, ops, badLine)) {
+            if (badLine == 0) return "Error: cannot read " + path;
+            return "Error: line " + std::to_string(badLine) + " of " + path
+                   + " is not \"username amount D|W\"";
+        }
+        BatchReport report;
+        bank.applyBatch(ops, report);
+        return report.describe(ops);
+    }
+
+    // Check the data files, repairing what can be repaired if asked
+    // (Bank::verify), and describe what was found
+    std::string verifyData(bool repair) {
+        if (!adminSession()) return "Access denied";
+        return bank.verify(repair).describe();
+    }
+
+    // Bank-wide report over from <= time <= to (see Bank::report)
+    std::string bankReport(long long from, long long to) {
+        if (!adminSession()) return "Access denied";
+        return bank.report(from, to).describe();
+    }
+
+    // Move log records older than 'days' days into the compressed
+    // archive (see Bank::archiveLogs), and describe the space saved
+    std::string archiveHistory(int days) {
+        if (!adminSession()) return "Access denied";
+        return bank.archiveLogs((long long)time(0) - days * 86400LL).describe();
+    }
+
+    std::string getUserTransactionHistory(const std::string& username) {
+        if (!adminSession()) return "Access denied";
+        return bank.formatHistory(bank.findAccount(username));
+    }
+
+    // One page of a user's records with from <= timestamp <= to
+    bool getUserTransactionsBetween(const std::string& username, long long from, long long to,
+                                    size_t offset, size_t limit, std::vector<TxRecord>& out) {
+        if (!adminSession()) return false;
+        return bank.transactionsBetween(bank.findAccount(username), from, to, offset, limit, out);
+    }
+    
+    bool getUserBalanceAt(const std::string& username, long long when, Money& balance) {
+        if (!adminSession()) return false;
+        return bank.balanceAt(bank.findAccount(username), when, balance);
+    }
+
+    bool getUserFlowBetween(const std::string& username, long long from, long long to,
+                            Money& in, Money& out) {
+        if (!adminSession()) return false;
+        return bank.flowBetween(bank.findAccount(username), from, to, in, out);
+    }
+
+    bool isUserFrozen(const std::string& username) {
+        if (!adminSession()) return false;
+        return bank.isFrozen(bank.findAccount(username));
+    }
+};
+
+#endif
@@ -0,0 +1,1048 @@
+#include "bank.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+
+#include "crypto.h"
+#include "metrics.h"
+#include "platform.h"
+#include "shard.h"
+#include "snapshot.h"
+
+using namespace std;
+
+// ---- Shard snapshots ----
+
+static string snapshotPath(const string& dataDir, unsigned int shard) {
+    return joinPath(shardDir(dataDir, shard), "users.snap");
+}
+
+// Ids of the accounts, sorted into their shards
+static vector<vector<int>> partitionIds(const AccountTable& accounts) {
+    vector<vector<int>> shards(SHARD_COUNT);
+    for (auto& shard : shards) shard.reserve(accounts.size() / SHARD_COUNT + 1);
+    for (size_t i = 0; i < accounts.size(); i++) shards[shardOf(accounts.name((int)i))].push_back((int)i);
+    return shards;
+}
+
+static string keysPath(const string& dataDir) {
+    return joinPath(dataDir, "dedup.keys");
+}
+
+// Every shard is written, empty ones too, so no stale file is left behind.
+// Each file is swapped in on its own; until all of them are, the journal
+// (whose records are absolute values) must be kept to replay over them.
+static bool writeShards(const string& dataDir, const AccountTable& accounts, const vector<vector<int>>& shards) {
+    atomic<bool> ok(true);
+    runParallel(shards.size(), [&](size_t s) {
+        if (!SnapshotFile::write(accounts, shards[s], snapshotPath(dataDir, (unsigned int)s))) ok = false;
+    });
+    if (!ok) return false;
+    // Snapshot from before the shards, now superseded
+    remove(joinPath(dataDir, "users.snap").c_str());
+    return true;
+}
+
+// The snapshots and, beside them, the idempotency keys of the changes in
+// them (the journal records that also carry the keys are dropped next)
+static bool writeCheckpoint(const string& dataDir, const AccountTable& accounts, vector<SavedKey>& keys) {
+    for (auto& saved : keys) saved.username = accounts.name(saved.accountId);
+    return writeSavedKeys(keysPath(dataDir), keys) && writeShards(dataDir, accounts, partitionIds(accounts));
+}
+
+Bank::Bank(const string& dir)
+    : dataDir(dir), journal(joinPath(dir, "users.wal")),
+      txLog(dir), checkpointWanted(false), archiveRunning(false), archiveStop(false),
+      nextArchive(chrono::steady_clock::now() + chrono::seconds(ARCHIVE_INTERVAL)),
+      passwordIterations(DEFAULT_PASSWORD_ITERATIONS), changeRing(), changeSeq(0), resetSeq(0) {
+    makeShardDirs(dataDir);
+    loadUsers();
+}
+
+Bank::~Bank() {
+    archiveStop = true;
+    finishArchiving();
+    txLog.flushAll();
+
+    // Final checkpoint on the way out, in the foreground
+    finishCheckpoint();
+    journal.close();
+    vector<SavedKey> keys;
+    dedup.collect((long long)time(0), keys);
+    if (writeCheckpoint(dataDir, accounts, keys)) journal.discard();
+}
+
+void Bank::tick() {
+    journal.syncIfDue();
+    txLog.flushIfDue();
+    maybeArchive();
+    metrics::dumpIfDue();
+}
+
+void Bank::checkpointNow() {
+    lock_guard<mutex> checkpoint(checkpointLock);
+    startCheckpoint();
+    finishCheckpoint();
+}
+
+size_t Bank::size() const {
+    shared_lock<shared_mutex> table(tableLock);
+    return accounts.size();
+}
+
+string Bank::describeStartupProblems() const {
+    string text;
+    for (const auto& problem : startupProblems) text += (text.empty() ? "" : "\r\n") + problem;
+    return text;
+}
+
+// The table lock stops every change, but only while the journal is read.
+// Each account's files are then checked with just its log held back (the
+// writer is closed, so it picks up any repair when it reopens the file).
+// No checkpoint or archiving pass runs meanwhile.
+VerifyReport Bank::verify(bool repair) {
+    auto start = chrono::steady_clock::now();
+    lock_guard<mutex> checkpoint(checkpointLock);
+    finishCheckpoint();
+    lock_guard<mutex> archiving(archiveLock);
+    finishArchiving();
+    VerifyReport report;
+    vector<string> usernames;
+    {
+        unique_lock<shared_mutex> table(tableLock);
+        journal.sync();
+        verifyJournals(dataDir, report);
+        usernames.reserve(accounts.size());
+        for (size_t i = 0; i < accounts.size(); i++) usernames.emplace_back(accounts.name((int)i));
+    }
+    verifyAccounts(dataDir, usernames, repair, &txLog, report);
+    report.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return report;
+}
+
+BankReport Bank::report(long long from, long long to) {
+    NameArena names;
+    vector<Money> balances;
+    vector<unsigned char> frozen;
+    long long now;
+    {
+        unique_lock<shared_mutex> table(tableLock);
+        names = accounts.getNames();
+        balances = accounts.getBalances();
+        frozen = accounts.getFrozenFlags();
+        now = (long long)time(0);
+    }
+    txLog.flushAll();
+    // Records written from now on are not part of it
+    BankReport result = buildReport(dataDir, names, balances, frozen, from, min(to, now), REPORT_TOP);
+    result.to = to;
+    return result;
+}
+
+ArchiveReport Bank::archiveLogs(long long before) {
+    lock_guard<mutex> archiving(archiveLock);
+    finishArchiving();
+    return archiveAll(before);
+}
+
+ArchiveReport Bank::archiveAll(long long before) {
+    auto started = chrono::steady_clock::now();
+    NameArena names;
+    vector<vector<int>> shards;
+    {
+        shared_lock<shared_mutex> table(tableLock);
+        names = accounts.getNames();
+        shards = partitionIds(accounts);
+    }
+    ArchiveReport report;
+    mutex reportLock;
+    runParallel(SHARD_COUNT, [&](size_t s) {
+        ArchiveReport part;
+        for (int id : shards[s]) {
+            if (archiveStop) break;
+            archiveTxLog(txLog, dataDir, string(names.get(id)), before, part);
+        }
+        lock_guard<mutex> guard(reportLock);
+        report.logs += part.logs;
+        report.archived += part.archived;
+        report.records += part.records;
+        report.bytesBefore += part.bytesBefore;
+        report.bytesAfter += part.bytesAfter;
+        report.failed += part.failed;
+    });
+    report.before = before;
+    report.seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    return report;
+}
+
+// Called from tick(), so it never waits: a pass still running (or one
+// started by archiveLogs) puts the next one off
+void Bank::maybeArchive() {
+    unique_lock<mutex> archiving(archiveLock, try_to_lock);
+    if (!archiving.owns_lock() || archiveRunning || chrono::steady_clock::now() < nextArchive) return;
+    finishArchiving();
+    nextArchive = chrono::steady_clock::now() + chrono::seconds(ARCHIVE_INTERVAL);
+    archiveRunning = true;
+    archiveThread = thread([this]() {
+        archiveAll((long long)time(0) - ARCHIVE_AGE);
+        archiveRunning = false;
+    });
+}
+
+void Bank::finishArchiving() {
+    if (archiveThread.joinable()) archiveThread.join();
+}
+
+bool Bank::exportText(const string& path) const {
+    shared_lock<shared_mutex> table(tableLock);
+    vector<User> users;
+    users.reserve(accounts.size());
+    for (size_t i = 0; i < accounts.size(); i++) users.push_back(accounts.toUser((int)i));
+    return SnapshotFile::writeText(users, path);
+}
+
+bool Bank::importText(const string& path, string* problem) {
+    // A file that does not read in full leaves every account as it is
+    vector<User> loaded;
+    if (!SnapshotFile::readText(path, loaded, problem)) return false;
+    lock_guard<mutex> checkpoint(checkpointLock);
+    finishCheckpoint();
+    unique_lock<shared_mutex> table(tableLock);
+    setUsers(loaded);
+    addAdmin();
+    nameSearch.rebuild(accounts.getNames());
+    noteReset();
+    sessions.clear();
+    dedup.clear();
+    journal.close();
+    vector<SavedKey> keys;
+    if (!writeCheckpoint(dataDir, accounts, keys)) return false;
+    journal.discard();
+    return true;
+}
+
+const char* const Bank::DEFAULT_ADMIN_PASSWORD = "admin123";
+
+bool Bank::validUsername(const string& username) {
+    if (username.empty() || username.size() > MAX_USERNAME_LENGTH) return false;
+    if (username == "." || username == "..") return false;
+    for (char c : username) {
+        bool letter = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+        if (!letter && c != '_' && c != '.' && c != '-') return false;
+    }
+    // Reserved in any case, as file names may ignore it
+    string folded(username);
+    for (char& c : folded) c = (char)tolower((unsigned char)c);
+    return folded != "admin";
+}
+
+bool Bank::registerUser(const string& username, const string& password) {
+    ATM_TIME(TIME_REGISTER);
+    if (!validUsername(username)) return false;
+    // Hash before taking the lock (it is the slow part), but not for a
+    // name that is already taken
+    if (findAccount(username) != -1) return false;
+    string credential = hashPassword(password, passwordIterations);
+    {
+        unique_lock<shared_mutex> table(tableLock);
+        int id = accounts.add(username, credential, Money());
+        if (id == -1) return false; // User already exists
+        nameSearch.add(id, accounts.getNames());
+        windows.emplace_back();
+        noteChange(id);
+        logChange("R " + username + " " + credential + " " + Money().toString());
+    }
+    maybeCheckpoint();
+    return true;
+}
+
+int Bank::findAccount(const string& username) const {
+    shared_lock<shared_mutex> table(tableLock);
+    return accounts.find(username);
+}
+
+void Bank::searchUsers(const string& text, size_t limit, vector<string>& out) const {
+    shared_lock<shared_mutex> table(tableLock);
+    vector<NameSearch::Match> matches;
+    nameSearch.search(text, accounts.getNames(), limit, matches);
+    for (const auto& match : matches) out.emplace_back(accounts.name(match.id));
+}
+
+int Bank::authenticate(const string& username, const string& password, string* token) {
+    ATM_TIME(TIME_LOGIN);
+    int id = checkLogin(username, password, token);
+    if (id == -1) ATM_COUNT(COUNT_LOGIN_FAILURES, 1);
+    return id;
+}
+
+int Bank::checkLogin(const string& username, const string& password, string* token) {
+    int id;
+    string stored;
+    {
+        shared_lock<shared_mutex> table(tableLock);
+        id = accounts.find(username);
+        if (id == -1) return -1;
+        lock_guard<mutex> account(lockFor(id));
+        if (accounts.isFrozen(id)) return -1;
+        stored = accounts.credential(id);
+    }
+
+    // The expensive check runs without any lock held
+    unsigned int iterations = passwordIterations;
+    bool needsRehash;
+    if (!verifyPassword(password, stored, iterations, needsRehash)) return -1;
+    if (needsRehash) upgradeCredential(id, stored, hashPassword(password, iterations));
+
+    if (token) {
+        *token = sessions.open(id);
+        // Frozen while we were checking: toggleFrozen() may have closed
+        // the account's sessions before this one was opened
+        if (isFrozen(id)) {
+            sessions.close(*token);
+            token->clear();
+            return -1;
+        }
+    }
+    return id;
+}
+
+// Replace a credential after a login, unless it changed meanwhile
+void Bank::upgradeCredential(int id, const string& old, const string& fresh) {
+    {
+        shared_lock<shared_mutex> table(tableLock);
+        lock_guard<mutex> account(lockFor(id));
+        if (accounts.credential(id) != old) return;
+        accounts.setCredential(id, fresh);
+        logChange("P " + string(accounts.name(id)) + " " + fresh);
+    }
+    maybeCheckpoint();
+}
+
+string Bank::getUsername(int id) const {
+    shared_lock<shared_mutex> table(tableLock);
+    return validId(id) ? string(accounts.name(id)) : "";
+}
+
+bool Bank::isFrozen(int id) const {
+    shared_lock<shared_mutex> table(tableLock);
+    if (!validId(id)) return false;
+    lock_guard<mutex> account(lockFor(id));
+    return accounts.isFrozen(id);
+}
+
+bool Bank::deposit(int id, Money amount, Money* balanceAfter, const string& key) {
+    ATM_TIME(TIME_DEPOSIT);
+    if (!key.empty() && !DedupCache::validKey(key)) return false;
+    {
+        shared_lock<shared_mutex> table(tableLock);
+        if (!validId(id)) return false;
+        lock_guard<mutex> account(lockFor(id));
+        long long now = key.empty() ? 0 : (long long)time(0);
+        bool ok;
+        if (!key.empty() && repeated(id, key, now, balanceAfter, nullptr, ok)) return ok;
+        if (!accounts.deposit(id, amount)) {
+            answered(id, key, now, false, LIMIT_OK);
+            return false;
+        }
+        noteChange(id);
+        logBalance(id, key, now);
+        answered(id, key, now, true, LIMIT_OK);
+        txLog.append(string(accounts.name(id)), TX_DEPOSIT, amount, accounts.balance(id));
+        if (balanceAfter) *balanceAfter = accounts.balance(id);
+    }
+    txLog.commit();
+    maybeCheckpoint();
+    return true;
+}
+
+bool Bank::withdraw(int id, Money amount, Money* balanceAfter, LimitCheck* refused, const string& key) {
+    return withdrawFrom(id, amount, true, balanceAfter, refused, key);
+}
+
+bool Bank::adminWithdraw(int id, Money amount, Money* balanceAfter, const string& key) {
+    return withdrawFrom(id, amount, false, balanceAfter, nullptr, key);
+}
+
+bool Bank::withdrawFrom(int id, Money amount, bool customer, Money* balanceAfter, LimitCheck* refused,
+                        const string& key) {
+    ATM_TIME(TIME_WITHDRAW);
+    if (refused) *refused = LIMIT_OK;
+    if (!key.empty() && !DedupCache::validKey(key)) return false;
+    {
+        shared_lock<shared_mutex> table(tableLock);
+        if (!validId(id)) return false;
+        lock_guard<mutex> account(lockFor(id));
+        long long now = (long long)time(0);
+        bool ok;
+        if (!key.empty() && repeated(id, key, now, balanceAfter, refused, ok)) return ok;
+        const WithdrawalLimits& limits = accounts.getLimits(id);
+        if (customer && limits.any() && amount > Money()) {
+            LimitCheck check = windowFor(id, now).check(limits, now, amount);
+            if (check != LIMIT_OK) {
+                if (refused) *refused = check;
+                answered(id, key, now, false, check);
+                return false;
+            }
+        }
+        if (!accounts.withdraw(id, amount)) {
+            answered(id, key, now, false, LIMIT_OK);
+            return false;
+        }
+        noteWithdrawal(id, amount, now);
+        noteChange(id);
+        logBalance(id, key, now);
+        answered(id, key, now, true, LIMIT_OK);
+        txLog.append(string(accounts.name(id)), TX_WITHDRAWAL, -amount, accounts.balance(id));
+        if (balanceAfter) *balanceAfter = accounts.balance(id);
+    }
+    txLog.commit();
+    maybeCheckpoint();
+    return true;
+}
+
+bool Bank::transfer(int fromId, int toId, Money amount, Money* balanceAfter, LimitCheck* refused,
+                    const string& key) {
+    return transferFrom(fromId, toId, amount, true, balanceAfter, refused, key);
+}
+
+bool Bank::adminTransfer(int fromId, int toId, Money amount, const string& key) {
+    return transferFrom(fromId, toId, amount, false, nullptr, nullptr, key);
+}
+
+bool Bank::transferFrom(int fromId, int toId, Money amount, bool customer, Money* balanceAfter,
+                        LimitCheck* refused, const string& key) {
+    ATM_TIME(TIME_TRANSFER);
+    if (refused) *refused = LIMIT_OK;
+    if (!key.empty() && !DedupCache::validKey(key)) return false;
+    {
+        shared_lock<shared_mutex> table(tableLock);
+        if (!validId(fromId) || !validId(toId) || fromId == toId || amount <= Money()) return false;
+
+        // Lower stripe first; both accounts may share one
+        size_t first = (size_t)fromId % ACCOUNT_LOCKS, second = (size_t)toId % ACCOUNT_LOCKS;
+        if (first > second) swap(first, second);
+        unique_lock<mutex> firstLock(accountLocks[first]);
+        unique_lock<mutex> secondLock;
+        if (second != first) secondLock = unique_lock<mutex>(accountLocks[second]);
+
+        long long now = (long long)time(0);
+        bool ok;
+        if (!key.empty() && repeated(fromId, key, now, balanceAfter, refused, ok)) return ok;
+        const WithdrawalLimits& limits = accounts.getLimits(fromId);
+        if (customer && limits.any()) {
+            LimitCheck check = windowFor(fromId, now).check(limits, now, amount);
+            if (check != LIMIT_OK) {
+                if (refused) *refused = check;
+                answered(fromId, key, now, false, check);
+                return false;
+            }
+        }
+        // The credit is checked first, so a refused one takes nothing
+        if (!accounts.balance(toId).canAdd(amount) || !accounts.withdraw(fromId, amount)) {
+            answered(fromId, key, now, false, LIMIT_OK);
+            return false;
+        }
+        accounts.deposit(toId, amount);
+        noteWithdrawal(fromId, amount, now);
+        noteChange(fromId);
+        noteChange(toId);
+        string from(accounts.name(fromId)), to(accounts.name(toId));
+        string record = "X " + from + " " + to + " " + accounts.balance(fromId).toString() + " "
+                        + accounts.balance(toId).toString();
+        if (!key.empty()) record += " " + key + " " + to_string(now);
+        logChange(record);
+        answered(fromId, key, now, true, LIMIT_OK);
+        txLog.append(from, TX_TRANSFER_OUT, -amount, accounts.balance(fromId));
+        txLog.append(to, TX_TRANSFER_IN, amount, accounts.balance(toId));
+        if (balanceAfter) *balanceAfter = accounts.balance(fromId);
+    }
+    txLog.commit();
+    maybeCheckpoint();
+    return true;
+}
+
+bool Bank::setLimits(int id, const WithdrawalLimits& limits) {
+    {
+        shared_lock<shared_mutex> table(tableLock);
+        if (!validId(id)) return false;
+        lock_guard<mutex> account(lockFor(id));
+        accounts.setLimits(id, limits);
+        if (!limits.any()) windows[id].reset();
+        logChange("L " + string(accounts.name(id)) + " " + limits.toString());
+    }
+    maybeCheckpoint();
+    return true;
+}
+
+bool Bank::getLimits(int id, WithdrawalLimits& limits) const {
+    shared_lock<shared_mutex> table(tableLock);
+    if (!validId(id)) return false;
+    lock_guard<mutex> account(lockFor(id));
+    limits = accounts.getLimits(id);
+    return true;
+}
+
+// Called with the account locked. A new window starts from the account's
+// last day of withdrawals in its log.
+WithdrawalWindow& Bank::windowFor(int id, long long now) {
+    unique_ptr<WithdrawalWindow>& window = windows[id];
+    if (window) return *window;
+    window.reset(new WithdrawalWindow());
+    string username(accounts.name(id));
+    txLog.flush(username);
+    TransactionReader reader(dataDir, username);
+    vector<TxRecord> recent;
+    reader.readRange(now - 24 * 3600, now, 0, (size_t)-1, recent);
+    for (const auto& record : recent) {
+        if (record.amount < 0) window->add(record.timestamp, Money::fromPaise(-record.amount));
+    }
+    return *window;
+}
+
+// Every withdrawal counts once the account has a window
+void Bank::noteWithdrawal(int id, Money amount, long long now) {
+    if (windows[id]) windows[id]->add(now, amount);
+}
+
+Money Bank::getBalance(int id) const {
+    ATM_TIME(TIME_BALANCE);
+    shared_lock<shared_mutex> table(tableLock);
+    if (!validId(id)) return Money();
+    lock_guard<mutex> account(lockFor(id));
+    return accounts.balance(id);
+}
+
+bool Bank::applyBatch(const vector<BatchOp>& ops, BatchReport& report) {
+    ATM_TIME(TIME_BATCH);
+    auto start = chrono::steady_clock::now();
+    report = BatchReport();
+    report.results.assign(ops.size(), BATCH_OK);
+    {
+        // Exclusive, so no other operation sees the batch half applied
+        // and the account locks are not needed
+        unique_lock<shared_mutex> table(tableLock);
+
+        vector<int> ids(ops.size());
+        unordered_map<int, Money> after;  // balance each account would end with
+        for (size_t i = 0; i < ops.size(); i++) {
+            const BatchOp& op = ops[i];
+            int id = ids[i] = accounts.find(op.username);
+            BatchStatus& status = report.results[i];
+            if (id == -1) {
+                status = BATCH_NO_ACCOUNT;
+            } else if (op.amount <= Money() || (op.type != TX_DEPOSIT && op.type != TX_WITHDRAWAL)) {
+                status = BATCH_BAD_AMOUNT;
+            } else {
+                auto it = after.find(id);
+                Money balance = it == after.end() ? accounts.balance(id) : it->second;
+                if (op.type == TX_WITHDRAWAL && op.amount > balance) {
+                    status = BATCH_INSUFFICIENT_FUNDS;
+                } else if (op.type == TX_DEPOSIT && !balance.canAdd(op.amount)) {
+                    status = BATCH_BALANCE_TOO_LARGE;
+                } else {
+                    after[id] = op.type == TX_DEPOSIT ? balance + op.amount : balance - op.amount;
+                }
+            }
+            if (status != BATCH_OK) report.failed++;
+        }
+
+        if (report.failed == 0 && !ops.empty()) {
+            // Only the final balance of each account goes to the journal
+            vector<string> records;
+            records.reserve(after.size());
+            for (const auto& entry : after) {
+                noteChange(entry.first);
+                records.push_back("B " + string(accounts.name(entry.first)) + " " + entry.second.toString());
+            }
+            journal.appendBatch(records);
+            if (journal.size() >= CHECKPOINT_RECORDS) checkpointWanted = true;
+
+            vector<TransactionLog::Entry> history;
+            history.reserve(ops.size());
+            long long now = (long long)time(0);
+            for (size_t i = 0; i < ops.size(); i++) {
+                int id = ids[i];
+                if (ops[i].type == TX_DEPOSIT) {
+                    accounts.deposit(id, ops[i].amount);
+                    history.push_back({ops[i].username, TX_DEPOSIT, ops[i].amount, accounts.balance(id)});
+                } else {
+                    accounts.withdraw(id, ops[i].amount);
+                    noteWithdrawal(id, ops[i].amount, now);
+                    history.push_back({ops[i].username, TX_WITHDRAWAL, -ops[i].amount, accounts.balance(id)});
+                }
+            }
+            txLog.appendBatch(history);
+        }
+        report.applied = report.failed == 0;
+    }
+    maybeCheckpoint();
+    report.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return report.applied;
+}
+
+bool Bank::setPassword(int id, const string& newPassword) {
+    ATM_TIME(TIME_SET_PASSWORD);
+    if (getUsername(id).empty()) return false; // skip hashing for a bad id
+    string credential = hashPassword(newPassword, passwordIterations);
+    {
+        shared_lock<shared_mutex> table(tableLock);
+        if (!validId(id)) return false;
+        lock_guard<mutex> account(lockFor(id));
+        accounts.setCredential(id, credential);
+        logChange("P " + string(accounts.name(id)) + " " + credential);
+    }
+    sessions.closeAccount(id);
+    maybeCheckpoint();
+    return true;
+}
+
+bool Bank::toggleFrozen(int id) {
+    ATM_TIME(TIME_FREEZE);
+    {
+        shared_lock<shared_mutex> table(tableLock);
+        if (!validId(id)) return false;
+        lock_guard<mutex> account(lockFor(id));
+        bool frozen = !accounts.isFrozen(id);
+        accounts.setFrozen(id, frozen);
+        noteChange(id);
+        logChange("F " + string(accounts.name(id)) + (frozen ? " 1" : " 0"));
+        if (frozen) sessions.closeAccount(id);
+    }
+    maybeCheckpoint();
+    return true;
+}
+
+void Bank::listAccounts(vector<AccountRow>& rows) const {
+    shared_lock<shared_mutex> table(tableLock);
+    rows.resize(accounts.size());
+    for (size_t i = 0; i < accounts.size(); i++) {
+        int id = (int)i;
+        lock_guard<mutex> account(lockFor(id));
+        rows[i].username = accounts.name(id);
+        rows[i].balance = accounts.balance(id);
+        rows[i].frozen = accounts.isFrozen(id);
+    }
+}
+
+bool Bank::getAccountRow(int id, AccountRow& row) const {
+    shared_lock<shared_mutex> table(tableLock);
+    if (!validId(id)) return false;
+    lock_guard<mutex> account(lockFor(id));
+    row.username = accounts.name(id);
+    row.balance = accounts.balance(id);
+    row.frozen = accounts.isFrozen(id);
+    return true;
+}
+
+bool Bank::changesSince(unsigned long long& seq, vector<int>& ids) const {
+    lock_guard<mutex> guard(changeLock);
+    bool known = seq >= resetSeq && changeSeq - seq <= CHANGE_RING;
+    if (known) {
+        for (unsigned long long n = seq; n < changeSeq; n++) ids.push_back(changeRing[n % CHANGE_RING]);
+    }
+    seq = changeSeq;
+    return known;
+}
+
+string Bank::formatHistory(int id) {
+    ATM_TIME(TIME_HISTORY);
+    string username = getUsername(id);
+    if (username.empty()) return "User not found";
+    txLog.flush(username);
+    TransactionReader reader(dataDir, username);
+    if (reader.size() == 0) return User::getLegacyTransactionHistory(dataDir, username);
+
+    vector<TxRecord> records;
+    reader.readLast(HISTORY_PAGE, records);
+    string text;
+    if (reader.size() > (long long)records.size()) {
+        text = "(last " + to_string(records.size()) + " of " + to_string(reader.size()) + ")\r\n";
+    }
+    for (const auto& record : records) {
+        text += formatRecord(record) + "\r\n";
+    }
+    return text;
+}
+
+bool Bank::recentTransactions(int id, size_t count, vector<TxRecord>& out) {
+    ATM_TIME(TIME_HISTORY);
+    string username = getUsername(id);
+    if (username.empty()) return false;
+    txLog.flush(username);
+    TransactionReader reader(dataDir, username);
+    reader.readLast(count, out);
+    return true;
+}
+
+bool Bank::transactionsBetween(int id, long long from, long long to,
+                               size_t offset, size_t limit, vector<TxRecord>& out) {
+    string username = getUsername(id);
+    if (username.empty()) return false;
+    txLog.flush(username);
+    TransactionReader reader(dataDir, username);
+    reader.readRange(from, to, offset, limit, out);
+    return true;
+}
+
+bool Bank::balanceAt(int id, long long when, Money& balance) {
+    string username = getUsername(id);
+    if (username.empty()) return false;
+    txLog.flush(username);
+    TransactionReader reader(dataDir, username);
+    return reader.balanceAt(when, balance);
+}
+
+bool Bank::flowBetween(int id, long long from, long long to, Money& in, Money& out) {
+    string username = getUsername(id);
+    if (username.empty()) return false;
+    txLog.flush(username);
+    TransactionReader reader(dataDir, username);
+    reader.flowBetween(from, to, in, out);
+    return true;
+}
+
+string Bank::formatRecord(const TxRecord& record) {
+    char when[32] = "";
+    struct tm parts;
+    if (localTime(record.timestamp, parts)) strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &parts);
+    Money amount = Money::fromPaise(record.amount);
+    const char* type = record.type == TX_DEPOSIT ? "Deposit"
+                     : record.type == TX_TRANSFER_IN ? "Transfer in"
+                     : record.type == TX_TRANSFER_OUT ? "Transfer out" : "Withdrawal";
+    return string("[") + when + "] " + type + ": "
+           + (amount >= Money() ? "+" : "") + amount.toString()
+           + " | Balance: " + Money::fromPaise(record.balance).toString();
+}
+
+// Called with the account (or the whole table) locked, so the order of
+// change numbers matches the order of the changes
+void Bank::noteChange(int id) {
+    lock_guard<mutex> guard(changeLock);
+    changeRing[changeSeq++ % CHANGE_RING] = id;
+}
+
+void Bank::noteReset() {
+    lock_guard<mutex> guard(changeLock);
+    resetSeq = changeSeq;
+}
+
+// A retry of a keyed request (called with the account locked): the first
+// answer, if the key is known, into 'ok' and the caller's outputs
+bool Bank::repeated(int id, const string& key, long long now, Money* balanceAfter, LimitCheck* refused, bool& ok) {
+    DedupResult first;
+    if (!dedup.find(id, key, now, first)) return false;
+    ok = first.ok;
+    if (ok && balanceAfter) *balanceAfter = first.balanceAfter;
+    if (refused) *refused = first.refused;
+    return true;
+}
+
+// Remember the answer to a keyed request, with the balance it left
+void Bank::answered(int id, const string& key, long long now, bool ok, LimitCheck refused) {
+    if (!key.empty()) dedup.remember(id, key, now, DedupResult{ok, refused, accounts.balance(id)});
+}
+
+// The balance after a change, and the key of the request that made it
+void Bank::logBalance(int id, const string& key, long long now) {
+    string record = "B " + string(accounts.name(id)) + " " + accounts.balance(id).toString();
+    if (!key.empty()) record += " " + key + " " + to_string(now);
+    logChange(record);
+}
+
+// Callers hold the table lock, so the checkpoint itself is started
+// afterwards by maybeCheckpoint()
+void Bank::logChange(const string& record) {
+    journal.append(record);
+    if (journal.size() >= CHECKPOINT_RECORDS) checkpointWanted = true;
+}
+
+// Startup: read the shard snapshots (in parallel), then replay whatever
+// the journal holds on top of them (sealed file first, it is the older
+// one). Data from before the shards existed is read from the single
+// users.snap, or before that from users.dat.
+void Bank::loadUsers() {
+    vector<vector<User>> shards(SHARD_COUNT);
+    vector<char> damaged(SHARD_COUNT, 0);
+    atomic<size_t> found(0);
+    runParallel(SHARD_COUNT, [&](size_t s) {
+        string path = snapshotPath(dataDir, (unsigned int)s);
+        if (SnapshotFile::read(path, shards[s])) {
+            found++;
+        } else if (fileExists(path)) {
+            // Keep the damaged file for inspection rather than overwrite it
+            shards[s].clear();
+            replaceFile(path, path + ".bad");
+            found++;
+            damaged[s] = 1;
+        }
+    });
+    bool anyDamaged = false;
+    for (unsigned int s = 0; s < SHARD_COUNT; s++) {
+        if (!damaged[s]) continue;
+        anyDamaged = true;
+        startupProblems.push_back(snapshotPath(dataDir, s) + " is damaged; its accounts were not loaded"
+                                  " (kept as users.snap.bad)");
+    }
+
+    vector<User> loaded;
+    bool fromOldFormat = false;
+    if (found > 0) {
+        size_t total = 0;
+        for (const auto& shard : shards) total += shard.size();
+        loaded.reserve(total);
+        for (auto& shard : shards) {
+            for (auto& user : shard) loaded.push_back(move(user));
+        }
+    } else {
+        string oldSnapshot = joinPath(dataDir, "users.snap");
+        fromOldFormat = SnapshotFile::read(oldSnapshot, loaded);
+        if (!fromOldFormat) {
+            if (fileExists(oldSnapshot)) {
+                replaceFile(oldSnapshot, oldSnapshot + ".bad");
+                startupProblems.push_back(oldSnapshot + " is damaged (kept as users.snap.bad)");
+            }
+            loaded.clear();
+            string textPath = joinPath(dataDir, "users.dat"), problem;
+            fromOldFormat = SnapshotFile::readText(textPath, loaded, &problem);
+            if (!fromOldFormat && fileExists(textPath)) {
+                startupProblems.push_back(textPath + ": " + problem + "; no account was loaded from it"
+                                          " (correct it and import it)");
+            }
+        }
+    }
+    setUsers(loaded);
+
+    // Keys of the changes in the snapshots; the journal has the rest
+    vector<SavedKey> keys;
+    string keysFile = keysPath(dataDir);
+    if (!readSavedKeys(keysFile, keys)) {
+        keys.clear();
+        replaceFile(keysFile, keysFile + ".bad");
+        anyDamaged = true;
+        startupProblems.push_back(keysFile + " is damaged (kept as dedup.keys.bad); requests made before the"
+                                  " last checkpoint will run again if retried");
+    }
+    // Oldest first, as the cache expects them
+    stable_sort(keys.begin(), keys.end(), [](const SavedKey& a, const SavedKey& b) { return a.when < b.when; });
+    for (const auto& saved : keys) {
+        int id = accounts.find(saved.username);
+        if (id != -1) dedup.remember(id, saved.key, saved.when, DedupResult{true, LIMIT_OK, saved.balanceAfter});
+    }
+
+    const string journals[2] = {journal.getSealedPath(), journal.getPath()};
+    size_t replayed = 0, skipped[2] = {0, 0}, rejected[2] = {0, 0};
+    for (int j = 0; j < 2; j++) replayed += replayJournal(journals[j], skipped[j], rejected[j]);
+    // Once, rather than a name at a time during the replay
+    nameSearch.rebuild(accounts.getNames());
+
+    // Fold the replayed records into fresh snapshots, which also cuts
+    // off any half-written record a crash left at the end of the log.
+    // A journal that stopped early or had lines passed over is kept as
+    // .bad for inspection.
+    bool stopped = skipped[0] + skipped[1] + rejected[0] + rejected[1] > 0;
+    keys.clear();
+    dedup.collect((long long)time(0), keys);
+    if ((replayed > 0 || stopped || fromOldFormat || anyDamaged) && writeCheckpoint(dataDir, accounts, keys)) {
+        for (int j = 0; j < 2; j++) {
+            if (skipped[j] == 0 && rejected[j] == 0) continue;
+            replaceFile(journals[j], journals[j] + ".bad");
+            if (rejected[j] > 0) {
+                startupProblems.push_back(journals[j] + ": " + to_string(rejected[j])
+                                          + (rejected[j] == 1 ? " record that could not be applied was"
+                                                              : " records that could not be applied were")
+                                          + " passed over (kept as .bad)");
+            }
+            if (skipped[j] > 0) {
+                startupProblems.push_back(journals[j] + ": " + to_string(skipped[j])
+                                          + (skipped[j] == 1 ? " damaged or unfinished line was" : " lines from a damaged one on were")
+                                          + " not replayed (kept as .bad)");
+            }
+        }
+        journal.discard();
+    }
+    addAdmin();
+}
+
+// Callers hold the table lock, or have the Bank to themselves
+void Bank::addAdmin() {
+    if (accounts.find("admin") != -1) return;
+    int id = accounts.add("admin", hashPassword(DEFAULT_ADMIN_PASSWORD, passwordIterations), Money());
+    nameSearch.add(id, accounts.getNames());
+    windows.emplace_back();
+    logChange("R admin " + accounts.credential(id) + " " + Money().toString());
+}
+
+// Replace all accounts.
+// A repeated username keeps the first entry, as the old linear scan did.
+void Bank::setUsers(vector<User>& loaded) {
+    size_t nameBytes = 0;
+    for (const auto& user : loaded) nameBytes += user.getUsername().size();
+    accounts.clear();
+    accounts.reserve(loaded.size(), nameBytes);
+    for (const auto& user : loaded) accounts.add(user);
+    windows.clear();
+    windows.resize(accounts.size());
+}
+
+// Replay stops at the first damaged line (checksum) or unfinished batch,
+// normally a torn write at the tail. 'skipped' counts the lines from that
+// one (or the start of its batch) to the end of the file. A whole line
+// that cannot be applied cannot be a torn write: it is counted in
+// 'rejected' and passed over, and replay goes on with the next one.
+size_t Bank::replayJournal(const string& path, size_t& skipped, size_t& rejected) {
+    skipped = 0;
+    rejected = 0;
+    ifstream log(path, ios::binary);
+    if (!log) return 0;
+
+    size_t applied = 0, lines = 0, stoppedAt = 0;
+    bool checksummed = false, stopped = false;
+    string line;
+    // Next line; false at the end, or (setting 'stopped') at a damaged one
+    auto next = [&]() {
+        if (!getline(log, line)) return false;
+        lines++;
+        if (Journal::checkLine(line, checksummed)) return true;
+        stopped = true;
+        return false;
+    };
+    while (!stopped) {
+        stoppedAt = lines;
+        if (!next()) break;
+        if (line.compare(0, 2, "T ") == 0) {
+            // A batch counts only if its commit line made it to disk
+            size_t count = strtoul(line.c_str() + 2, nullptr, 10);
+            vector<string> batch;
+            while (batch.size() < count && next()) batch.push_back(line);
+            if (batch.size() < count || !next() || line != "C " + to_string(count)) {
+                stopped = true;
+                break;
+            }
+            for (const auto& record : batch) {
+                if (applyRecord(record)) applied++;
+                else rejected++;
+            }
+            continue;
+        }
+        if (applyRecord(line)) applied++;
+        else rejected++;
+    }
+    if (stopped) {
+        while (getline(log, line)) lines++;
+        skipped = lines - stoppedAt;
+    }
+    return applied;
+}
+
+// The idempotency key and time at the end of a replayed record, if any
+void Bank::rememberKey(istream& in, int id, Money balance) {
+    string key;
+    long long when;
+    if (id != -1 && in >> key >> when) dedup.remember(id, key, when, DedupResult{true, LIMIT_OK, balance});
+}
+
+bool Bank::applyRecord(const string& line) {
+    istringstream in(line);
+    string op, username;
+    if (!(in >> op >> username)) return false;
+
+    int i = accounts.find(username);
+    if (op == "R") {
+        string password, amount;
+        Money balance;
+        if (!(in >> password >> amount) || !Money::parse(amount, balance, true)) return false;
+        if (i == -1) {
+            accounts.add(username, password, balance);
+            windows.emplace_back();
+        }
+        return true;
+    }
+    if (op == "X") {
+        // Transfer: the balances of both accounts after it
+        string to, fromAmount, toAmount;
+        Money fromBalance, toBalance;
+        if (!(in >> to >> fromAmount >> toAmount) || !Money::parse(fromAmount, fromBalance, true)
+            || !Money::parse(toAmount, toBalance, true)) {
+            return false;
+        }
+        int j = accounts.find(to);
+        if (i != -1) accounts.setBalance(i, fromBalance);
+        if (j != -1) accounts.setBalance(j, toBalance);
+        rememberKey(in, i, fromBalance);
+        return true;
+    }
+    if (i == -1) return true; // change for an account the snapshot never had
+    if (op == "P") {
+        string password;
+        if (!(in >> password)) return false;
+        accounts.setCredential(i, password);
+    } else if (op == "F") {
+        int frozen;
+        if (!(in >> frozen)) return false;
+        accounts.setFrozen(i, frozen != 0);
+    } else if (op == "L") {
+        string daily, single, perHour;
+        WithdrawalLimits limits;
+        if (!(in >> daily >> single >> perHour) || !WithdrawalLimits::parse(daily, single, perHour, limits)) {
+            return false;
+        }
+        accounts.setLimits(i, limits);
+    } else if (op == "B") {
+        string amount;
+        Money balance;
+        if (!(in >> amount) || !Money::parse(amount, balance, true)) return false;
+        accounts.setBalance(i, balance);
+        rememberKey(in, i, balance);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Never waits for a verify or import holding the checkpoint lock: the
+// checkpoint is put off to a later change instead
+void Bank::maybeCheckpoint() {
+    if (!checkpointWanted.exchange(false)) return;
+    unique_lock<mutex> checkpoint(checkpointLock, try_to_lock);
+    if (!checkpoint.owns_lock()) {
+        checkpointWanted = true;
+        return;
+    }
+    startCheckpoint();
+}
+
+// Seal the journal and write a snapshot of the current state on a
+// background thread. Holding the table lock exclusively means no
+// operation is half-way through, so the copy and the sealed journal
+// describe the same state; callers only pay for copying the account
+// table (a few arrays, plus one string per credential). Callers hold
+// the checkpoint lock.
+void Bank::startCheckpoint() {
+    finishCheckpoint();
+
+    AccountTable copy;
+    vector<SavedKey> keys;
+    {
+        unique_lock<shared_mutex> table(tableLock);
+        journal.sync();
+        if (!journal.seal()) return;
+        copy = accounts;
+        dedup.collect((long long)time(0), keys);
+    }
+    string sealedPath = journal.getSealedPath();
+    string dir = dataDir;
+    checkpointThread = thread([copy = move(copy), keys = move(keys), sealedPath, dir]() mutable {
+        if (writeCheckpoint(dir, copy, keys)) {
+            remove(sealedPath.c_str());
+        }
+    });
+}
+
+void Bank::finishCheckpoint() {
+    if (checkpointThread.joinable()) checkpointThread.join();
+}
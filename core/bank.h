@@ -0,0 +1,304 @@
+#ifndef ATM_BANK_H
+#define ATM_BANK_H
+
+#include <atomic>
+#include <chrono>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "account_table.h"
+#include "batch.h"
+#include "dedup_cache.h"
+#include "journal.h"
+#include "money.h"
+#include "name_search.h"
+#include "recovery.h"
+#include "report.h"
+#include "session_cache.h"
+#include "transaction_log.h"
+#include "tx_archive.h"
+#include "user.h"
+
+// What the admin listing shows of one account
+struct AccountRow {
+    std::string username;
+    Money balance;
+    bool frozen;
+};
+
+// The shared account store. Any number of terminals (ATM sessions) can
+// work against one Bank from different threads:
+//  - tableLock guards the table itself. Registering an account or
+//    replacing all of them takes it exclusively, everything else shared.
+//  - each account is guarded by one of ACCOUNT_LOCKS striped mutexes, so
+//    operations on different accounts run in parallel. A balance change
+//    and its journal and log records are made under that lock, which
+//    keeps the records of one account in order. A transfer holds the
+//    locks of both accounts, always taking the lower numbered one first,
+//    so two transfers can never wait for each other.
+//  - the journal and the transaction log lock internally. Log records
+//    are only buffered under the account lock; their fsync runs after
+//    it is let go (TransactionLog::commit).
+// Accounts are identified by their position in the table, which never
+// changes once registered (but is not kept across restarts).
+// Files live in the data directory: the journal at the top, account
+// snapshots and transaction logs split over its shard folders (shard.h).
+class Bank {
+private:
+    static const size_t ACCOUNT_LOCKS = 1024;
+
+    std::string dataDir;
+    AccountTable accounts;
+    NameSearch nameSearch;   // over accounts' names, guarded with them
+    Journal journal;
+    TransactionLog txLog;
+    std::thread checkpointThread;
+
+    mutable std::shared_mutex tableLock;
+    mutable std::mutex accountLocks[ACCOUNT_LOCKS];
+    std::mutex checkpointLock;
+    std::atomic<bool> checkpointWanted;
+
+    // Background archiving of old log records (see archiveLogs)
+    std::thread archiveThread;
+    std::mutex archiveLock;
+    std::atomic<bool> archiveRunning;
+    std::atomic<bool> archiveStop;
+    std::chrono::steady_clock::time_point nextArchive;
+
+    // What loading found damaged and set aside
+    std::vector<std::string> startupProblems;
+
+    SessionCache sessions;
+    DedupCache dedup;   // answers by idempotency key (see deposit())
+    std::atomic<unsigned int> passwordIterations;
+
+    // Recent withdrawals of accounts that have limits, one slot per
+    // account (empty until the account's first limited withdrawal).
+    // Guarded like the account itself.
+    std::vector<std::unique_ptr<WithdrawalWindow>> windows;
+
+    // Recently changed accounts, for views that cache the account list.
+    // Change number n is kept in changeRing[n % CHANGE_RING] until it is
+    // overwritten; changes before resetSeq (last import) are never valid.
+    static const size_t CHANGE_RING = 4096;
+    mutable std::mutex changeLock;
+    int changeRing[CHANGE_RING];
+    unsigned long long changeSeq;
+    unsigned long long resetSeq;
+
+    // Compact the journal into the shard snapshots after this many records
+    static const size_t CHECKPOINT_RECORDS = 10000;
+
+    // Records shown by the history views
+    static const size_t HISTORY_PAGE = 50;
+
+    // Accounts in each top list of a report
+    static const size_t REPORT_TOP = 10;
+
+    // Every ARCHIVE_INTERVAL seconds, log records older than ARCHIVE_AGE
+    // seconds are moved to the archive in the background
+    static const int ARCHIVE_INTERVAL = 3600;
+    static const long long ARCHIVE_AGE = 90LL * 24 * 3600;
+
+    std::mutex& lockFor(int id) const { return accountLocks[(size_t)id % ACCOUNT_LOCKS]; }
+    bool validId(int id) const { return accounts.validId(id); }
+
+    void noteChange(int id);
+    void noteReset();
+    int checkLogin(const std::string& username, const std::string& password, std::string* token);
+    void upgradeCredential(int id, const std::string& old, const std::string& fresh);
+    bool withdrawFrom(int id, Money amount, bool customer, Money* balanceAfter, LimitCheck* refused,
+                      const std::string& key);
+    bool transferFrom(int fromId, int toId, Money amount, bool customer, Money* balanceAfter, LimitCheck* refused,
+                      const std::string& key);
+    WithdrawalWindow& windowFor(int id, long long now);
+    void noteWithdrawal(int id, Money amount, long long now);
+    bool repeated(int id, const std::string& key, long long now, Money* balanceAfter, LimitCheck* refused,
+                  bool& ok);
+    void answered(int id, const std::string& key, long long now, bool ok, LimitCheck refused);
+    void logBalance(int id, const std::string& key, long long now);
+    void logChange(const std::string& record);
+    void loadUsers();
+    void addAdmin();
+    void setUsers(std::vector<User>& loaded);
+    size_t replayJournal(const std::string& path, size_t& skipped, size_t& rejected);
+    bool applyRecord(const std::string& line);
+    void rememberKey(std::istream& in, int id, Money balance);
+    void maybeCheckpoint();
+    void startCheckpoint();
+    void finishCheckpoint();
+    ArchiveReport archiveAll(long long before);
+    void maybeArchive();
+    void finishArchiving();
+
+public:
+    explicit Bank(const std::string& dir = ".");
+    ~Bank();
+
+    // Periodic housekeeping (group commit deadlines, starting archiving)
+    void tick();
+
+    // Write a snapshot now and wait for it (normally this happens in the
+    // background every CHECKPOINT_RECORDS journal records)
+    void checkpointNow();
+
+    // Damage found while loading (one line each; empty if none)
+    std::string describeStartupProblems() const;
+
+    // Check the snapshots, the journal and every account's log and index
+    // (see recovery.h), repairing what can be repaired. Changes wait only
+    // while the journal is read; after that each account's files are
+    // checked while just its log is held back, and other operations
+    // carry on. This reads every file: run it when asked to, not at
+    // every start (describeStartupProblems() is the cheap check).
+    VerifyReport verify(bool repair);
+
+    // Bank-wide totals, daily figures over from <= timestamp <= to and
+    // top accounts (see report.h). The accounts are copied at the start
+    // (in one step, so no transfer is seen half done); the logs are then
+    // read on every core while other operations carry on.
+    BankReport report(long long from, long long to);
+
+    // Move every account's log records older than 'before' into its
+    // compressed archive (see tx_archive.h), one shard per thread. Only
+    // whole blocks of TX_ARCHIVE_BLOCK records are moved, so a log keeps
+    // its newest records. Other operations carry on meanwhile; history
+    // reads see every record exactly once throughout.
+    ArchiveReport archiveLogs(long long before);
+
+    TransactionLog& getTransactionLog() { return txLog; }
+    const std::string& getDataDir() const { return dataDir; }
+    size_t size() const;
+
+    // Text format import/export (the original users.dat layout).
+    // Importing replaces every account, so no session may be logged in.
+    // A file with a line that does not parse is refused as a whole (the
+    // accounts stay as they were) and 'problem' names the line.
+    bool exportText(const std::string& path) const;
+    bool importText(const std::string& path, std::string* problem = nullptr);
+
+    // Accounts. A username is 1 to MAX_USERNAME_LENGTH letters, digits and
+    // "_.-", not "." or "..", and not a reserved name: it becomes part of
+    // file names and goes into journal lines as one word. Accounts loaded
+    // from older files keep whatever name they had.
+    static const size_t MAX_USERNAME_LENGTH = 32;
+    static bool validUsername(const std::string& username);
+    bool registerUser(const std::string& username, const std::string& password);
+
+    // The "admin" account cannot be registered; the bank creates it with
+    // this password whenever it has none (first start, or an import
+    // without it)
+    static const char* const DEFAULT_ADMIN_PASSWORD;
+    int findAccount(const std::string& username) const;
+
+    // Up to 'limit' usernames for a search box: those starting with
+    // 'text' (case ignored), then those a typo or two away from it,
+    // closest first (see name_search.h)
+    void searchUsers(const std::string& text, size_t limit, std::vector<std::string>& out) const;
+
+    // Passwords are stored as salted PBKDF2 hashes (see crypto.h). The
+    // iteration count is the cost of every login; credentials made with
+    // another count, or plaintext ones from older files, are rehashed at
+    // the next successful login.
+    static const unsigned int DEFAULT_PASSWORD_ITERATIONS = 100000;
+    void setPasswordIterations(unsigned int iterations) { passwordIterations = iterations > 0 ? iterations : 1; }
+    unsigned int getPasswordIterations() const { return passwordIterations; }
+
+    // Account id for a correct password on an account that is not frozen,
+    // -1 otherwise. If token is given, a session is opened and its token
+    // stored there.
+    int authenticate(const std::string& username, const std::string& password,
+                     std::string* token = nullptr);
+
+    // Account of an open session (-1 if it was closed or dropped)
+    int resumeSession(const std::string& token) { return sessions.resolve(token); }
+    void endSession(const std::string& token) { sessions.close(token); }
+
+    std::string getUsername(int id) const;
+    bool isFrozen(int id) const;
+
+    // Money
+    // Every operation that moves money takes an optional idempotency key
+    // (DedupCache::validKey, unique per account). Sent again with the
+    // same key, a request is not run again: it gets the first answer,
+    // balance and refusal included, for DedupCache::DEFAULT_TTL. Keys of
+    // operations that went through are written with their journal record
+    // and kept by checkpoints, so this holds across restarts; refusals
+    // are only remembered until then. A key that is not valid fails the
+    // operation.
+    bool deposit(int id, Money amount, Money* balanceAfter = nullptr, const std::string& key = "");
+    Money getBalance(int id) const;
+
+    // The account holder's withdrawal: the account's limits apply, and if
+    // one of them refuses it, refused says which
+    bool withdraw(int id, Money amount, Money* balanceAfter = nullptr, LimitCheck* refused = nullptr,
+                  const std::string& key = "");
+
+    // Withdrawal by the admin: checked against the balance only (it still
+    // counts towards the account's limits, like every withdrawal)
+    bool adminWithdraw(int id, Money amount, Money* balanceAfter = nullptr, const std::string& key = "");
+
+    // Move money from one account to another as a single change: both
+    // balances, one journal record and a record in each account's log.
+    // The account holder's transfer is held to the account's withdrawal
+    // limits like a withdrawal; balanceAfter is the sender's new balance.
+    // The key belongs to the sender.
+    bool transfer(int fromId, int toId, Money amount, Money* balanceAfter = nullptr,
+                  LimitCheck* refused = nullptr, const std::string& key = "");
+
+    // Transfer by the admin: checked against the balance only
+    bool adminTransfer(int fromId, int toId, Money amount, const std::string& key = "");
+
+    // Withdrawal limits. The rolling totals behind them are kept in
+    // memory in fixed rings, so each check is O(1); after a restart they
+    // are rebuilt from the last day of the account's log when first needed.
+    bool setLimits(int id, const WithdrawalLimits& limits);
+    bool getLimits(int id, WithdrawalLimits& limits) const;
+
+    // Bulk deposits and withdrawals. Every item is validated first (in
+    // order, so a withdrawal may spend an earlier deposit of the same
+    // batch); if all pass they are applied in one pass and persisted
+    // with a single journal write and sync. Returns report.applied.
+    bool applyBatch(const std::vector<BatchOp>& ops, BatchReport& report);
+
+    // Administration
+    bool setPassword(int id, const std::string& newPassword);
+    bool toggleFrozen(int id);
+
+    // Listing of accounts for views that keep their own copy
+    void listAccounts(std::vector<AccountRow>& rows) const;
+    bool getAccountRow(int id, AccountRow& row) const;
+
+    // Accounts changed (balance, frozen flag, or newly registered) after
+    // change number 'seq', which is then advanced to the latest one.
+    // Returns false if those changes are no longer all known, in which
+    // case the caller reloads everything with listAccounts().
+    bool changesSince(unsigned long long& seq, std::vector<int>& ids) const;
+
+    // Last HISTORY_PAGE records of the account's log, oldest first
+    std::string formatHistory(int id);
+
+    // The last 'count' records of the account's log, oldest first
+    bool recentTransactions(int id, size_t count, std::vector<TxRecord>& out);
+
+    // One page of an account's records with from <= timestamp <= to
+    bool transactionsBetween(int id, long long from, long long to,
+                             size_t offset, size_t limit, std::vector<TxRecord>& out);
+
+    // Balance after the account's last record at or before 'when'. False
+    // for an unknown account or one with no records by then.
+    bool balanceAt(int id, long long when, Money& balance);
+
+    // Money deposited and withdrawn with from <= timestamp <= to
+    bool flowBetween(int id, long long from, long long to, Money& in, Money& out);
+
+    static std::string formatRecord(const TxRecord& record);
+};
+
+#endif
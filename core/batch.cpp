@@ -0,0 +1,76 @@
+#include "batch.h"
+
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+const char* batchStatusText(BatchStatus status) {
+    switch (status) {
+        case BATCH_OK: return "ok";
+        case BATCH_NO_ACCOUNT: return "no such account";
+        case BATCH_BAD_AMOUNT: return "invalid amount";
+        case BATCH_INSUFFICIENT_FUNDS: return "insufficient funds";
+        case BATCH_BALANCE_TOO_LARGE: return "balance would be too large";
+    }
+    return "unknown";
+}
+
+string BatchReport::describe(const vector<BatchOp>& ops, size_t maxListed) const {
+    char line[160];
+    if (applied) {
+        snprintf(line, sizeof(line), "Batch applied: %zu operations in %.3f s (%.0f ops/s)\r\n",
+                 results.size(), seconds, opsPerSecond());
+    } else {
+        snprintf(line, sizeof(line), "Batch rejected, nothing applied: %zu of %zu operations failed\r\n",
+                 failed, results.size());
+    }
+    string text = line;
+
+    size_t listed = 0;
+    for (size_t i = 0; i < results.size() && i < ops.size(); i++) {
+        if (results[i] == BATCH_OK) continue;
+        if (listed++ == maxListed) {
+            text += "...\r\n";
+            break;
+        }
+        snprintf(line, sizeof(line), "#%zu %s ", i + 1, ops[i].type == TX_DEPOSIT ? "deposit" : "withdraw");
+        text += line + ops[i].username + " " + ops[i].amount.toString() + ": "
+                + batchStatusText(results[i]) + "\r\n";
+    }
+    return text;
+}
+
+bool readBatchFile(const string& path, vector<BatchOp>& ops, size_t& badLine) {
+    ifstream file(path);
+    badLine = 0;
+    if (!file) return false;
+
+    string line;
+    size_t number = 0;
+    while (getline(file, line)) {
+        number++;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        size_t start = line.find_first_not_of(" \t");
+        if (start == string::npos || line[start] == '#') continue;
+
+        istringstream in(line);
+        string amount, type, extra;
+        BatchOp op;
+        if (!(in >> op.username >> amount >> type) || (in >> extra) || type.size() != 1
+            || !Money::parse(amount, op.amount)) {
+            badLine = number;
+            return false;
+        }
+        char t = (char)toupper((unsigned char)type[0]);
+        if (t != 'D' && t != 'W') {
+            badLine = number;
+            return false;
+        }
+        op.type = t == 'D' ? TX_DEPOSIT : TX_WITHDRAWAL;
+        ops.push_back(op);
+    }
+    return true;
+}
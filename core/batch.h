@@ -0,0 +1,48 @@
+#ifndef ATM_BATCH_H
+#define ATM_BATCH_H
+
+#include <string>
+#include <vector>
+
+#include "money.h"
+#include "transaction_log.h"
+
+// One item of a bulk admin deposit or withdrawal (Bank::applyBatch)
+struct BatchOp {
+    std::string username;
+    Money amount;
+    TxType type;   // TX_DEPOSIT or TX_WITHDRAWAL
+};
+
+enum BatchStatus {
+    BATCH_OK,
+    BATCH_NO_ACCOUNT,
+    BATCH_BAD_AMOUNT,          // zero or negative
+    BATCH_INSUFFICIENT_FUNDS,  // counting the earlier items of the batch
+    BATCH_BALANCE_TOO_LARGE    // likewise, past what a balance can hold
+};
+
+// Outcome of a batch. A batch is all or nothing: if any item fails
+// validation, nothing is applied and 'applied' is false.
+struct BatchReport {
+    std::vector<BatchStatus> results;  // one per operation, in order
+    size_t failed;
+    bool applied;
+    double seconds;                    // validation, apply and persist
+
+    BatchReport() : failed(0), applied(false), seconds(0) {}
+
+    double opsPerSecond() const { return seconds > 0 ? results.size() / seconds : 0.0; }
+
+    // Summary line plus the failed items (at most maxListed of them)
+    std::string describe(const std::vector<BatchOp>& ops, size_t maxListed = 20) const;
+};
+
+const char* batchStatusText(BatchStatus status);
+
+// Batch file: one "username amount D|W" per line. Blank lines and lines
+// starting with '#' are skipped. On a malformed line returns false with
+// its number in badLine.
+bool readBatchFile(const std::string& path, std::vector<BatchOp>& ops, size_t& badLine);
+
+#endif
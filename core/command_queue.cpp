@@ -0,0 +1,107 @@
+#include "command_queue.h"
+
+#include <cstdio>
+
+#include "metrics.h"
+
+using namespace std;
+
+CommandQueue::CommandQueue(function<void()> n)
+    : notify(n), nextId(0), running(false), stopping(false) {
+    worker = thread(&CommandQueue::run, this);
+}
+
+CommandQueue::~CommandQueue() {
+    stop();
+}
+
+void CommandQueue::stop() {
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    if (worker.joinable()) worker.join();
+}
+
+unsigned long long CommandQueue::submit(const string& name, Work work) {
+    unsigned long long id;
+    {
+        lock_guard<mutex> guard(lock);
+        id = ++nextId;
+        jobs.push_back({id, name, work, Clock::now()});
+    }
+    wake.notify_one();
+    return id;
+}
+
+bool CommandQueue::takeResult(Result& out) {
+    lock_guard<mutex> guard(lock);
+    if (results.empty()) return false;
+    out = move(results.front());
+    results.pop_front();
+    return true;
+}
+
+void CommandQueue::waitIdle() {
+    unique_lock<mutex> guard(lock);
+    idle.wait(guard, [this] { return jobs.empty() && !running; });
+}
+
+size_t CommandQueue::pending() const {
+    lock_guard<mutex> guard(lock);
+    return jobs.size() + (running ? 1 : 0);
+}
+
+void CommandQueue::run() {
+    unique_lock<mutex> guard(lock);
+    for (;;) {
+        wake.wait(guard, [this] { return stopping || !jobs.empty(); });
+        if (jobs.empty()) break; // stopping, and everything queued is done
+        Job job = move(jobs.front());
+        jobs.pop_front();
+        running = true;
+        guard.unlock();
+
+        Clock::time_point start = Clock::now();
+        Result result;
+        result.id = job.id;
+        result.name = job.name;
+        result.done = job.work();
+        Clock::time_point end = Clock::now();
+        result.waitMicros = chrono::duration_cast<chrono::microseconds>(start - job.queued).count();
+        result.runMicros = chrono::duration_cast<chrono::microseconds>(end - start).count();
+        metrics::recordLatency(TIME_COMMAND_WAIT, chrono::duration_cast<chrono::nanoseconds>(start - job.queued).count());
+
+        guard.lock();
+        Latency& latency = latencies[job.name];
+        latency.count++;
+        latency.totalWait += result.waitMicros;
+        latency.totalRun += result.runMicros;
+        if (result.waitMicros > latency.maxWait) latency.maxWait = result.waitMicros;
+        if (result.runMicros > latency.maxRun) latency.maxRun = result.runMicros;
+        results.push_back(move(result));
+        running = false;
+        if (jobs.empty()) idle.notify_all();
+        if (notify) {
+            guard.unlock();
+            notify();
+            guard.lock();
+        }
+    }
+    running = false;
+    idle.notify_all();
+}
+
+string CommandQueue::describeStats() const {
+    lock_guard<mutex> guard(lock);
+    string text = "Command       count   wait ms (mean/max)   run ms (mean/max)\r\n";
+    char line[128];
+    for (const auto& entry : latencies) {
+        const Latency& l = entry.second;
+        snprintf(line, sizeof(line), "%-12s %6llu   %8.2f / %-8.2f   %8.2f / %.2f\r\n", entry.first.c_str(), l.count,
+                 l.totalWait / 1000.0 / l.count, l.maxWait / 1000.0, l.totalRun / 1000.0 / l.count, l.maxRun / 1000.0);
+        text += line;
+    }
+    return text;
+}
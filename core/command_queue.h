@@ -0,0 +1,86 @@
+#ifndef ATM_COMMAND_QUEUE_H
+#define ATM_COMMAND_QUEUE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Runs commands against the engine on one worker thread, so a front end
+// never waits for the disk itself. A command's work runs on the worker
+// and returns a continuation; the front end takes the finished results
+// (after the notify callback tells it there are some, e.g. by posting a
+// window message) and runs the continuations on its own thread.
+// Commands run one at a time in the order submitted, so an ATM session
+// used only from inside commands is used by a single thread.
+class CommandQueue {
+public:
+    typedef std::function<void()> Continuation;
+    typedef std::function<Continuation()> Work;
+
+    struct Result {
+        unsigned long long id;
+        std::string name;
+        long long waitMicros;   // queued before the worker started it
+        long long runMicros;
+        Continuation done;      // may be empty
+    };
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Job {
+        unsigned long long id;
+        std::string name;
+        Work work;
+        Clock::time_point queued;
+    };
+
+    struct Latency {
+        unsigned long long count;
+        long long totalWait, totalRun, maxWait, maxRun;
+    };
+
+    std::function<void()> notify;
+    std::deque<Job> jobs;
+    std::deque<Result> results;
+    std::map<std::string, Latency> latencies;
+    unsigned long long nextId;
+    bool running;   // worker between taking a job and queuing its result
+    bool stopping;
+    mutable std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    std::thread worker;
+
+    void run();
+
+public:
+    // notify is called on the worker after each result is queued
+    explicit CommandQueue(std::function<void()> notify = nullptr);
+    ~CommandQueue();
+
+    // Finish the queued commands and stop the worker (also done by the
+    // destructor). Results not taken yet are kept.
+    void stop();
+
+    // Queue a command; returns its id
+    unsigned long long submit(const std::string& name, Work work);
+
+    // Next finished command, false if none
+    bool takeResult(Result& out);
+
+    // Block until every queued command has finished
+    void waitIdle();
+
+    size_t pending() const;
+
+    // Per command: count, mean and max queue wait and run time
+    std::string describeStats() const;
+};
+
+#endif
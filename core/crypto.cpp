@@ -0,0 +1,226 @@
+#include "crypto.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "platform.h"
+
+using namespace std;
+
+static const unsigned int K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline unsigned int rotr(unsigned int x, int n) { return (x >> n) | (x << (32 - n)); }
+
+Sha256::Sha256() : blockUsed(0), totalBytes(0) {
+    static const unsigned int initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(state, initial, sizeof(state));
+}
+
+void Sha256::compress(const unsigned char* data) {
+    unsigned int w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (unsigned int)data[i * 4] << 24 | (unsigned int)data[i * 4 + 1] << 16
+             | (unsigned int)data[i * 4 + 2] << 8 | data[i * 4 + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        unsigned int s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        unsigned int s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    unsigned int a = state[0], b = state[1], c = state[2], d = state[3];
+    unsigned int e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++) {
+        unsigned int t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+        unsigned int t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+void Sha256::update(const void* data, size_t length) {
+    const unsigned char* p = (const unsigned char*)data;
+    totalBytes += length;
+    if (blockUsed > 0) {
+        size_t take = min(length, 64 - blockUsed);
+        memcpy(block + blockUsed, p, take);
+        blockUsed += take;
+        p += take;
+        length -= take;
+        if (blockUsed < 64) return;
+        compress(block);
+        blockUsed = 0;
+    }
+    for (; length >= 64; p += 64, length -= 64) compress(p);
+    memcpy(block, p, length);
+    blockUsed = length;
+}
+
+void Sha256::final(unsigned char digest[DIGEST_SIZE]) {
+    unsigned long long bits = totalBytes * 8;
+    block[blockUsed++] = 0x80;
+    if (blockUsed > 56) {
+        memset(block + blockUsed, 0, 64 - blockUsed);
+        compress(block);
+        blockUsed = 0;
+    }
+    memset(block + blockUsed, 0, 56 - blockUsed);
+    for (int i = 0; i < 8; i++) block[56 + i] = (unsigned char)(bits >> (56 - 8 * i));
+    compress(block);
+    blockUsed = 0;
+    for (int i = 0; i < 8; i++) {
+        digest[i * 4] = (unsigned char)(state[i] >> 24);
+        digest[i * 4 + 1] = (unsigned char)(state[i] >> 16);
+        digest[i * 4 + 2] = (unsigned char)(state[i] >> 8);
+        digest[i * 4 + 3] = (unsigned char)state[i];
+    }
+}
+
+// The HMAC key pads are hashed once up front; every PBKDF2 iteration then
+// starts from copies of those two states, which halves the work per
+// iteration compared with a plain HMAC call.
+void pbkdf2Sha256(const string& password, const unsigned char* salt, size_t saltLength,
+                  unsigned int iterations, unsigned char* out, size_t length) {
+    unsigned char key[64] = {0};
+    if (password.size() > 64) {
+        Sha256 keyHash;
+        keyHash.update(password.data(), password.size());
+        keyHash.final(key);
+    } else {
+        memcpy(key, password.data(), password.size());
+    }
+    unsigned char pad[64];
+    Sha256 inner, outer;
+    for (int i = 0; i < 64; i++) pad[i] = key[i] ^ 0x36;
+    inner.update(pad, 64);
+    for (int i = 0; i < 64; i++) pad[i] = key[i] ^ 0x5c;
+    outer.update(pad, 64);
+
+    unsigned char u[Sha256::DIGEST_SIZE], t[Sha256::DIGEST_SIZE];
+    for (unsigned int blockNumber = 1; length > 0; blockNumber++) {
+        unsigned char counter[4] = {(unsigned char)(blockNumber >> 24), (unsigned char)(blockNumber >> 16),
+                                    (unsigned char)(blockNumber >> 8), (unsigned char)blockNumber};
+        Sha256 h = inner;
+        h.update(salt, saltLength);
+        h.update(counter, 4);
+        h.final(u);
+        h = outer;
+        h.update(u, sizeof(u));
+        h.final(u);
+        memcpy(t, u, sizeof(t));
+
+        for (unsigned int i = 1; i < iterations; i++) {
+            h = inner;
+            h.update(u, sizeof(u));
+            h.final(u);
+            h = outer;
+            h.update(u, sizeof(u));
+            h.final(u);
+            for (size_t k = 0; k < sizeof(t); k++) t[k] ^= u[k];
+        }
+
+        size_t take = min(length, sizeof(t));
+        memcpy(out, t, take);
+        out += take;
+        length -= take;
+    }
+}
+
+static string toHex(const unsigned char* data, size_t length) {
+    static const char digits[] = "0123456789abcdef";
+    string text(length * 2, '0');
+    for (size_t i = 0; i < length; i++) {
+        text[i * 2] = digits[data[i] >> 4];
+        text[i * 2 + 1] = digits[data[i] & 15];
+    }
+    return text;
+}
+
+static bool fromHex(const string& text, vector<unsigned char>& out) {
+    if (text.size() % 2 != 0) return false;
+    out.resize(text.size() / 2);
+    for (size_t i = 0; i < out.size(); i++) {
+        int value = 0;
+        for (int k = 0; k < 2; k++) {
+            char c = text[i * 2 + k];
+            int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+            if (digit < 0) return false;
+            value = value * 16 + digit;
+        }
+        out[i] = (unsigned char)value;
+    }
+    return true;
+}
+
+// Not std::random_device: older MinGW (the window's Windows build) gives
+// the same sequence from it on every run. Without a real random source
+// every salt and session token could be guessed, so there is no fallback.
+string randomHex(size_t length) {
+    vector<unsigned char> bytes(length);
+    if (length > 0 && !randomBytes(bytes.data(), length)) {
+        fprintf(stderr, "Cannot read the system random source\n");
+        abort();
+    }
+    return toHex(bytes.data(), length);
+}
+
+static const size_t SALT_BYTES = 16;
+static const char CREDENTIAL_PREFIX[] = "pbkdf2$";
+
+bool isHashedCredential(const string& stored) {
+    return stored.compare(0, sizeof(CREDENTIAL_PREFIX) - 1, CREDENTIAL_PREFIX) == 0;
+}
+
+string hashPassword(const string& password, unsigned int iterations) {
+    if (iterations == 0) iterations = 1;
+    string saltHex = randomHex(SALT_BYTES);
+    vector<unsigned char> salt;
+    fromHex(saltHex, salt);
+    unsigned char hash[Sha256::DIGEST_SIZE];
+    pbkdf2Sha256(password, salt.data(), salt.size(), iterations, hash, sizeof(hash));
+    return CREDENTIAL_PREFIX + to_string(iterations) + "$" + saltHex + "$" + toHex(hash, sizeof(hash));
+}
+
+bool verifyPassword(const string& password, const string& stored, unsigned int iterations, bool& needsRehash) {
+    needsRehash = false;
+    if (!isHashedCredential(stored)) {
+        if (stored != password) return false;
+        needsRehash = true;
+        return true;
+    }
+
+    // pbkdf2$<iterations>$<salt>$<hash>
+    size_t first = sizeof(CREDENTIAL_PREFIX) - 1;
+    size_t second = stored.find('$', first);
+    size_t third = second == string::npos ? string::npos : stored.find('$', second + 1);
+    if (third == string::npos) return false;
+    unsigned long storedIterations = strtoul(stored.c_str() + first, nullptr, 10);
+    vector<unsigned char> salt, expected;
+    if (storedIterations == 0 || !fromHex(stored.substr(second + 1, third - second - 1), salt)
+        || !fromHex(stored.substr(third + 1), expected) || expected.empty()) {
+        return false;
+    }
+
+    vector<unsigned char> actual(expected.size());
+    pbkdf2Sha256(password, salt.data(), salt.size(), (unsigned int)storedIterations, actual.data(), actual.size());
+    unsigned char difference = 0;  // compare in constant time
+    for (size_t i = 0; i < actual.size(); i++) difference |= actual[i] ^ expected[i];
+    if (difference != 0) return false;
+    needsRehash = storedIterations != iterations;
+    return true;
+}
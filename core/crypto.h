@@ -0,0 +1,46 @@
+#ifndef ATM_CRYPTO_H
+#define ATM_CRYPTO_H
+
+#include <cstddef>
+#include <string>
+
+// SHA-256 (FIPS 180-4), fed in pieces with update()
+class Sha256 {
+private:
+    unsigned int state[8];
+    unsigned char block[64];
+    size_t blockUsed;
+    unsigned long long totalBytes;
+
+    void compress(const unsigned char* data);
+
+public:
+    static const size_t DIGEST_SIZE = 32;
+
+    Sha256();
+    void update(const void* data, size_t length);
+    void final(unsigned char digest[DIGEST_SIZE]);
+};
+
+// PBKDF2 with HMAC-SHA256 (RFC 8018), output of 'length' bytes
+void pbkdf2Sha256(const std::string& password, const unsigned char* salt, size_t saltLength,
+                  unsigned int iterations, unsigned char* out, size_t length);
+
+// Stored password credentials: "pbkdf2$<iterations>$<salt hex>$<hash hex>".
+// Anything else in the password field is a plaintext password from
+// before hashing was added.
+std::string hashPassword(const std::string& password, unsigned int iterations);
+
+// Check a password against a stored credential. needsRehash is set when
+// it matched but the credential is plaintext or uses another iteration
+// count than 'iterations', so the caller should store a fresh hash.
+bool verifyPassword(const std::string& password, const std::string& stored,
+                    unsigned int iterations, bool& needsRehash);
+
+bool isHashedCredential(const std::string& stored);
+
+// Hex string of 'length' bytes from the system random source (randomBytes in
+// platform.h); aborts if it cannot be read
+std::string randomHex(size_t length);
+
+#endif
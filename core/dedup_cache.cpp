@@ -0,0 +1,132 @@
+#include "dedup_cache.h"
+
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <sstream>
+
+#include "metrics.h"
+#include "platform.h"
+
+using namespace std;
+
+size_t DedupCache::KeyHash::operator()(const Key& k) const {
+    return hash<string>()(k.key) ^ ((size_t)(unsigned int)k.accountId * 0x9E3779B97F4A7C15ULL);
+}
+
+DedupCache::DedupCache(size_t capacity, long long t)
+    : shardCapacity(capacity / SHARDS > 0 ? capacity / SHARDS : 1), ttl(t) {}
+
+bool DedupCache::validKey(const string& key) {
+    if (key.empty() || key.size() > MAX_KEY_LENGTH) return false;
+    for (char c : key) {
+        bool letter = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+        if (!letter && c != '-' && c != '_' && c != '.' && c != ':') return false;
+    }
+    return true;
+}
+
+bool DedupCache::find(int accountId, const string& key, long long now, DedupResult& result) {
+    Key k{accountId, key};
+    Shard& shard = shardFor(k);
+    lock_guard<mutex> guard(shard.lock);
+    auto it = shard.entries.find(k);
+    if (it == shard.entries.end() || it->second.when + ttl < now) return false;
+    ATM_COUNT(COUNT_DEDUP_HITS, 1);
+    result = it->second.result;
+    return true;
+}
+
+void DedupCache::remember(int accountId, const string& key, long long when, const DedupResult& result) {
+    Key k{accountId, key};
+    Shard& shard = shardFor(k);
+    lock_guard<mutex> guard(shard.lock);
+    // Make room: first the expired keys, then the oldest if still full.
+    // Keys arrive in time order, so the expired ones are at the front.
+    while (!shard.order.empty()) {
+        auto oldest = shard.entries.find(*shard.order.front());
+        if (oldest->second.when + ttl >= when && shard.entries.size() < shardCapacity) break;
+        shard.order.pop_front();
+        shard.entries.erase(oldest);
+    }
+    auto inserted = shard.entries.insert(make_pair(k, Entry{when, result}));
+    if (inserted.second) {
+        shard.order.push_back(&inserted.first->first);
+    } else {
+        inserted.first->second = Entry{when, result};   // replayed again after a restart
+    }
+}
+
+void DedupCache::collect(long long now, vector<SavedKey>& out) {
+    for (Shard& shard : shards) {
+        lock_guard<mutex> guard(shard.lock);
+        for (const auto& entry : shard.entries) {
+            if (!entry.second.result.ok || entry.second.when + ttl < now) continue;
+            out.push_back(SavedKey{entry.first.accountId, string(), entry.first.key, entry.second.when,
+                                   entry.second.result.balanceAfter});
+        }
+    }
+}
+
+void DedupCache::clear() {
+    for (Shard& shard : shards) {
+        lock_guard<mutex> guard(shard.lock);
+        shard.order.clear();
+        shard.entries.clear();
+    }
+}
+
+size_t DedupCache::size() {
+    size_t total = 0;
+    for (Shard& shard : shards) {
+        lock_guard<mutex> guard(shard.lock);
+        total += shard.entries.size();
+    }
+    return total;
+}
+
+bool writeSavedKeys(const string& path, const vector<SavedKey>& keys) {
+    string text;
+    for (const auto& saved : keys) {
+        text += saved.username + " " + saved.key + " " + to_string(saved.when) + " " + saved.balanceAfter.toString()
+                + "\n";
+    }
+    char end[64];
+    snprintf(end, sizeof(end), "end %zu %08x\n", keys.size(), crc32(text.data(), text.size()));
+    text += end;
+
+    string tmpPath = path + ".tmp";
+    FILE* file = fopen(tmpPath.c_str(), "wb");
+    if (!file) return false;
+    bool ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+    ok = syncFile(file) && ok;
+    fclose(file);
+    ATM_COUNT(COUNT_SNAPSHOT_BYTES, text.size());
+    ATM_COUNT(COUNT_SNAPSHOT_FSYNCS, 1);
+    return ok && replaceFile(tmpPath, path);
+}
+
+bool readSavedKeys(const string& path, vector<SavedKey>& keys) {
+    ifstream file(path, ios::binary);
+    if (!file) return true;
+    stringstream contents;
+    contents << file.rdbuf();
+    string text = contents.str();
+
+    // The "end" line last, counting and checking the lines before it
+    size_t last = text.size() >= 2 ? text.rfind('\n', text.size() - 2) : string::npos;
+    size_t endAt = last == string::npos ? 0 : last + 1;
+    size_t count;
+    unsigned int crc;
+    if (sscanf(text.c_str() + endAt, "end %zu %x", &count, &crc) != 2 || crc32(text.data(), endAt) != crc) {
+        return false;
+    }
+    istringstream lines(text.substr(0, endAt));
+    SavedKey saved{-1, string(), string(), 0, Money()};
+    string amount;
+    while (lines >> saved.username >> saved.key >> saved.when >> amount) {
+        if (!Money::parse(amount, saved.balanceAfter, true)) return false;
+        keys.push_back(saved);
+    }
+    return keys.size() == count;
+}
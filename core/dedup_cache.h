@@ -0,0 +1,106 @@
+#ifndef ATM_DEDUP_CACHE_H
+#define ATM_DEDUP_CACHE_H
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "limits.h"
+#include "money.h"
+
+// What a money operation answered
+struct DedupResult {
+    bool ok;
+    LimitCheck refused;   // which limit refused it, if one did
+    Money balanceAfter;   // the account's balance once it was done
+};
+
+// A key as a checkpoint keeps it (dedup.keys), by username
+struct SavedKey {
+    int accountId;   // only in memory
+    std::string username;
+    std::string key;
+    long long when;
+    Money balanceAfter;
+};
+
+// Answers of recent deposits, withdrawals and transfers by idempotency
+// key. A terminal that timed out waiting for an answer sends the request
+// again with the same key and gets the first answer back, instead of the
+// money moving twice.
+//  - keys belong to an account (the one the money leaves or reaches), so
+//    terminals only have to keep them unique per account
+//  - split into SHARDS parts by the hash of the key, each with its own
+//    lock, so checks of different keys seldom wait for each other
+//  - at most 'capacity' keys in all; a full part drops its oldest key
+//  - a key is forgotten 'ttl' seconds after its operation, when a retry
+//    runs as a new request
+// The Bank checks and records a key under its account's lock, so two
+// copies of one request cannot both run.
+class DedupCache {
+public:
+    static const size_t SHARDS = 64;
+    static const size_t DEFAULT_CAPACITY = 1 << 18;
+    static const long long DEFAULT_TTL = 24 * 3600;
+    static const size_t MAX_KEY_LENGTH = 64;
+
+private:
+    struct Key {
+        int accountId;
+        std::string key;
+        bool operator==(const Key& other) const { return accountId == other.accountId && key == other.key; }
+    };
+    struct KeyHash {
+        size_t operator()(const Key& k) const;
+    };
+    struct Entry {
+        long long when;
+        DedupResult result;
+    };
+    struct Shard {
+        std::mutex lock;
+        std::unordered_map<Key, Entry, KeyHash> entries;
+        std::deque<const Key*> order;   // the keys of 'entries', oldest first
+    };
+
+    Shard shards[SHARDS];
+    size_t shardCapacity;
+    long long ttl;
+
+    // By the key alone: account ids change from one start to the next,
+    // and a key must land in the same part when it is loaded again
+    Shard& shardFor(const Key& k) { return shards[std::hash<std::string>()(k.key) % SHARDS]; }
+
+public:
+    explicit DedupCache(size_t capacity = DEFAULT_CAPACITY, long long ttl = DEFAULT_TTL);
+
+    // Letters, digits and "-_.:", 1 to MAX_KEY_LENGTH of them (a key goes
+    // into journal lines as one word)
+    static bool validKey(const std::string& key);
+
+    // The answer given under this account's key, unless it expired by 'now'
+    bool find(int accountId, const std::string& key, long long now, DedupResult& result);
+
+    // Record the answer of an operation done at time 'when'
+    void remember(int accountId, const std::string& key, long long when, const DedupResult& result);
+
+    // The live keys of operations that went through (the ones a
+    // checkpoint keeps), without usernames
+    void collect(long long now, std::vector<SavedKey>& out);
+
+    void clear();
+    size_t size();
+};
+
+// dedup.keys: one "username key when balance" line per key, then
+// "end <count> <crc>" over every line before it. Written to a temporary
+// file, synced and swapped in.
+bool writeSavedKeys(const std::string& path, const std::vector<SavedKey>& keys);
+
+// False if the file is damaged; true and no keys if there is none
+bool readSavedKeys(const std::string& path, std::vector<SavedKey>& keys);
+
+#endif
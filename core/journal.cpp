@@ -0,0 +1,135 @@
+#include "journal.h"
+
+#include "metrics.h"
+#include "platform.h"
+
+using namespace std;
+
+Journal::Journal(const string& p) : path(p), file(nullptr), unsynced(0), firstUnsynced(0), records(0) {}
+
+Journal::~Journal() {
+    close();
+}
+
+bool Journal::openLocked() {
+    if (!file) file = fopen(path.c_str(), "ab");
+    return file != nullptr;
+}
+
+void Journal::writeLocked(const string& record) {
+    char checksum[16];
+    snprintf(checksum, sizeof(checksum), " #%08x\n", crc32(record.data(), record.size()));
+    fputs(record.c_str(), file);
+    fputs(checksum, file);
+    ATM_COUNT(COUNT_JOURNAL_BYTES, record.size() + 11);
+}
+
+void Journal::syncLocked() {
+    if (file && unsynced > 0) {
+        ATM_TIME(TIME_JOURNAL_SYNC);
+        syncFile(file);
+        ATM_COUNT(COUNT_JOURNAL_FSYNCS, 1);
+        unsynced = 0;
+    }
+}
+
+void Journal::closeLocked() {
+    if (!file) return;
+    syncLocked();
+    fclose(file);
+    file = nullptr;
+}
+
+size_t Journal::size() const {
+    lock_guard<mutex> guard(lock);
+    return records;
+}
+
+void Journal::close() {
+    lock_guard<mutex> guard(lock);
+    closeLocked();
+}
+
+void Journal::append(const string& record) {
+    lock_guard<mutex> guard(lock);
+    if (!openLocked()) return;
+    writeLocked(record);
+    // Out of this process's buffer at once, so a crash loses nothing;
+    // only the fsync (against a power cut) waits for the group
+    fflush(file);
+    records++;
+    ATM_COUNT(COUNT_JOURNAL_RECORDS, 1);
+    if (unsynced++ == 0) firstUnsynced = time(0);
+    if (unsynced >= GROUP_SIZE) syncLocked();
+}
+
+void Journal::appendBatch(const vector<string>& batch) {
+    lock_guard<mutex> guard(lock);
+    if (!openLocked()) return;
+    string count = to_string(batch.size());
+    writeLocked("T " + count);
+    for (const auto& record : batch) writeLocked(record);
+    ATM_COUNT(COUNT_JOURNAL_RECORDS, batch.size());
+    writeLocked("C " + count);
+    records += batch.size() + 2;
+    unsynced += (int)batch.size() + 2;
+    syncLocked();
+}
+
+void Journal::sync() {
+    lock_guard<mutex> guard(lock);
+    syncLocked();
+}
+
+void Journal::syncIfDue() {
+    lock_guard<mutex> guard(lock);
+    if (unsynced > 0 && time(0) - firstUnsynced >= MAX_DELAY_SECONDS) syncLocked();
+}
+
+bool Journal::seal() {
+    lock_guard<mutex> guard(lock);
+    closeLocked();
+    records = 0;
+    string sealed = getSealedPath();
+    if (!fileExists(sealed)) {
+        return rename(path.c_str(), sealed.c_str()) == 0 || !fileExists(path);
+    }
+    FILE* in = fopen(path.c_str(), "rb");
+    if (!in) return true;
+    FILE* out = fopen(sealed.c_str(), "ab");
+    if (!out) {
+        fclose(in);
+        return false;
+    }
+    char buffer[65536];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), in)) > 0) fwrite(buffer, 1, n, out);
+    fclose(in);
+    bool ok = syncFile(out);
+    fclose(out);
+    if (ok) remove(path.c_str());
+    return ok;
+}
+
+void Journal::discard() {
+    lock_guard<mutex> guard(lock);
+    closeLocked();
+    records = 0;
+    remove(getSealedPath().c_str());
+    remove(path.c_str());
+}
+
+bool Journal::checkLine(string& line, bool& checksummed) {
+    size_t n = line.size();
+    if (n < 10 || line[n - 10] != ' ' || line[n - 9] != '#') return !checksummed;
+    unsigned int expected = 0;
+    for (size_t i = n - 8; i < n; i++) {
+        char c = line[i];
+        int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+        if (digit < 0) return false;
+        expected = expected << 4 | (unsigned int)digit;
+    }
+    checksummed = true;
+    line.resize(n - 10);
+    return crc32(line.data(), line.size()) == expected;
+}
@@ -0,0 +1,70 @@
+#ifndef ATM_JOURNAL_H
+#define ATM_JOURNAL_H
+
+#include <cstdio>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Write-ahead journal of account changes (users.wal).
+// Each change is appended as one text line, ending in " #<crc>": the
+// CRC-32 of the rest of the line in hex, so replay can tell a torn or
+// damaged line from a real record. Each line is handed to the OS as
+// it is appended, so it survives the process dying; it is fsync'd (and
+// survives a power cut) in groups: once GROUP_SIZE records are pending,
+// or when syncIfDue() finds the oldest pending record is
+// MAX_DELAY_SECONDS old.
+// A checkpoint seals the live file into users.wal.1, so new records can
+// keep going to a fresh users.wal while the snapshot is being written.
+class Journal {
+private:
+    std::string path;
+    FILE* file;
+    int unsynced;           // records written since the last fsync
+    time_t firstUnsynced;   // when the oldest of those was written
+    size_t records;         // records in the live file
+    mutable std::mutex lock;
+
+    bool openLocked();
+    void writeLocked(const std::string& record);
+    void syncLocked();
+    void closeLocked();
+
+public:
+    static const int GROUP_SIZE = 32;
+    static const int MAX_DELAY_SECONDS = 1;
+
+    explicit Journal(const std::string& p);
+    ~Journal();
+
+    std::string getPath() const { return path; }
+    std::string getSealedPath() const { return path + ".1"; }
+
+    size_t size() const;
+    void close();
+    void append(const std::string& record);
+
+    // Append records that replay must apply together or not at all.
+    // They are framed by "T <count>" and "C <count>" lines and fsync'd
+    // once, before this returns.
+    void appendBatch(const std::vector<std::string>& batch);
+    void sync();
+    void syncIfDue();
+
+    // Move the live records into the sealed file and start an empty one.
+    // If an earlier sealed file is still around (its checkpoint failed),
+    // the live records are appended to it so nothing is dropped.
+    bool seal();
+
+    // Drop both files once a snapshot covering them is on disk
+    void discard();
+
+    // Check a line read back from a journal and strip its checksum.
+    // Lines written before checksums were added have none and pass, but
+    // once a file has shown one ('checksummed' is set), every later line
+    // needs one too. False for a damaged line.
+    static bool checkLine(std::string& line, bool& checksummed);
+};
+
+#endif
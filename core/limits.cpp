@@ -0,0 +1,41 @@
+#include "limits.h"
+
+#include <cstdlib>
+
+using namespace std;
+
+string WithdrawalLimits::toString() const {
+    return daily.toString() + " " + single.toString() + " " + to_string(perHour);
+}
+
+bool WithdrawalLimits::parse(const string& dailyText, const string& singleText, const string& perHourText,
+                             WithdrawalLimits& out) {
+    WithdrawalLimits limits;
+    char* end;
+    unsigned long count = strtoul(perHourText.c_str(), &end, 10);
+    if (perHourText.empty() || *end != '\0' || perHourText[0] == '-') return false;
+    if (!Money::parse(dailyText, limits.daily) || limits.daily < Money()) return false;
+    if (!Money::parse(singleText, limits.single) || limits.single < Money()) return false;
+    limits.perHour = (unsigned int)count;
+    out = limits;
+    return true;
+}
+
+string WithdrawalLimits::describe() const {
+    if (!any()) return "no limits";
+    string text;
+    if (daily > Money()) text += "Rs" + daily.toString() + " a day";
+    if (single > Money()) text += (text.empty() ? "" : ", ") + ("Rs" + single.toString() + " at once");
+    if (perHour > 0) text += (text.empty() ? "" : ", ") + to_string(perHour) + " an hour";
+    return text;
+}
+
+const char* limitCheckText(LimitCheck check) {
+    switch (check) {
+        case LIMIT_OK: return "within limits";
+        case LIMIT_SINGLE: return "more than the largest single withdrawal allowed";
+        case LIMIT_DAILY: return "over the daily withdrawal limit";
+        case LIMIT_HOURLY: return "too many withdrawals in the last hour";
+    }
+    return "";
+}
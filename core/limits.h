@@ -0,0 +1,100 @@
+#ifndef ATM_LIMITS_H
+#define ATM_LIMITS_H
+
+#include <string>
+
+#include "money.h"
+
+// Withdrawal limits of one account. Zero means no limit.
+struct WithdrawalLimits {
+    Money daily;            // total over any rolling 24 hours
+    Money single;           // one withdrawal
+    unsigned int perHour;   // number of withdrawals in any rolling hour
+
+    WithdrawalLimits() : perHour(0) {}
+
+    bool any() const { return daily > Money() || single > Money() || perHour > 0; }
+
+    // "daily single perHour", as kept in the journal
+    std::string toString() const;
+    static bool parse(const std::string& daily, const std::string& single, const std::string& perHour,
+                      WithdrawalLimits& out);
+
+    // For people: "Rs5000.00 a day, Rs2000.00 at once, 3 an hour"
+    std::string describe() const;
+};
+
+enum LimitCheck {
+    LIMIT_OK,
+    LIMIT_SINGLE,   // more than one withdrawal may be
+    LIMIT_DAILY,    // would take the last 24 hours over the daily total
+    LIMIT_HOURLY    // too many withdrawals in the last hour
+};
+
+const char* limitCheckText(LimitCheck check);
+
+// Sum of values added over the last BUCKETS * SECONDS seconds, in a ring
+// of BUCKETS buckets of SECONDS each. Adding and reading cost O(1): the
+// buckets that fell out of the window since the last call are cleared
+// (never more than BUCKETS of them) and the total is kept as it goes.
+// The window moves a bucket at a time, so a value leaves it between
+// (BUCKETS - 1) * SECONDS and BUCKETS * SECONDS after it was added.
+template <int BUCKETS, int SECONDS, class T>
+class RollingSum {
+private:
+    T buckets[BUCKETS];
+    T total;
+    long long slot;   // bucket number (time / SECONDS) of the newest bucket
+
+    void advance(long long now) {
+        long long current = now / SECONDS;
+        if (current <= slot) return; // same bucket, or the clock went back
+        long long stale = current - slot < BUCKETS ? current - slot : BUCKETS;
+        for (long long s = current - stale + 1; s <= current; s++) {
+            T& bucket = buckets[s % BUCKETS];
+            total -= bucket;
+            bucket = T();
+        }
+        slot = current;
+    }
+
+public:
+    RollingSum() : buckets(), total(), slot(0) {}
+
+    void add(long long now, T value) {
+        advance(now);
+        buckets[slot % BUCKETS] += value;
+        total += value;
+    }
+
+    T sum(long long now) {
+        advance(now);
+        return total;
+    }
+};
+
+// Recent withdrawals of one account: amounts by the hour over a day and
+// counts by the minute over an hour (about 500 bytes)
+class WithdrawalWindow {
+private:
+    RollingSum<24, 3600, long long> dayAmounts;   // paise
+    RollingSum<60, 60, unsigned int> hourCounts;
+
+public:
+    void add(long long now, Money amount) {
+        dayAmounts.add(now, amount.getPaise());
+        hourCounts.add(now, 1);
+    }
+
+    // Whether a withdrawal of 'amount' now stays within the limits
+    LimitCheck check(const WithdrawalLimits& limits, long long now, Money amount) {
+        if (limits.single > Money() && amount > limits.single) return LIMIT_SINGLE;
+        if (limits.daily > Money() && Money::fromPaise(dayAmounts.sum(now)) + amount > limits.daily) {
+            return LIMIT_DAILY;
+        }
+        if (limits.perHour > 0 && hourCounts.sum(now) >= limits.perHour) return LIMIT_HOURLY;
+        return LIMIT_OK;
+    }
+};
+
+#endif
@@ -0,0 +1,192 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <mutex>
+
+#include "platform.h"
+
+using namespace std;
+
+namespace metrics {
+
+static const char* OP_NAMES[METRIC_OPS] = {
+    "login", "register", "deposit", "withdraw", "transfer", "balance", "history", "batch", "set_password",
+    "freeze", "journal_sync", "txlog_flush", "snapshot_write", "snapshot_load",
+    "command_wait"
+};
+
+static const char* COUNTER_NAMES[METRIC_COUNTERS] = {
+    "login_failures", "session_hits", "session_misses", "dedup_hits", "tx_records", "journal_records",
+    "journal_bytes", "journal_fsyncs", "txlog_bytes", "txlog_fsyncs", "snapshot_bytes", "snapshot_fsyncs"
+};
+
+// 4 buckets per power of two; bucket b covers nanoseconds from
+// lowerBound(b) up to lowerBound(b + 1)
+static const int SUB_BUCKETS = 4;
+static const int BUCKETS = 64 * SUB_BUCKETS;
+
+// Own cache lines, so threads timing different operations do not slow
+// each other down
+struct alignas(64) Histogram {
+    atomic<unsigned long long> count;
+    atomic<unsigned long long> totalNanos;
+    atomic<unsigned long long> maxNanos;
+    atomic<unsigned long long> buckets[BUCKETS];
+};
+
+static Histogram histograms[METRIC_OPS];
+static atomic<unsigned long long> counters[METRIC_COUNTERS];
+
+static mutex dumpLock;
+static string dumpPath;
+static int dumpInterval = 0;
+static time_t lastDump = 0;
+
+static int highestBit(unsigned long long n) {
+#if defined(__GNUC__)
+    return 63 - __builtin_clzll(n);
+#else
+    int bit = 0;
+    while (n >>= 1) bit++;
+    return bit;
+#endif
+}
+
+static int bucketOf(unsigned long long nanos) {
+    if (nanos < SUB_BUCKETS) return (int)nanos;
+    int log = highestBit(nanos);
+    int sub = (int)((nanos >> (log - 2)) & (SUB_BUCKETS - 1));
+    return (log - 1) * SUB_BUCKETS + sub;
+}
+
+static unsigned long long lowerBound(int bucket) {
+    if (bucket < SUB_BUCKETS) return bucket;
+    int log = bucket / SUB_BUCKETS + 1;
+    int sub = bucket % SUB_BUCKETS;
+    return (1ULL << log) + ((unsigned long long)sub << (log - 2));
+}
+
+void recordLatency(MetricOp op, long long nanos) {
+    if (!ENABLED) return;
+    unsigned long long n = nanos > 0 ? (unsigned long long)nanos : 0;
+    Histogram& h = histograms[op];
+    h.count.fetch_add(1, memory_order_relaxed);
+    h.totalNanos.fetch_add(n, memory_order_relaxed);
+    h.buckets[bucketOf(n)].fetch_add(1, memory_order_relaxed);
+    unsigned long long seen = h.maxNanos.load(memory_order_relaxed);
+    while (n > seen && !h.maxNanos.compare_exchange_weak(seen, n, memory_order_relaxed)) {}
+}
+
+void add(MetricCounter counter, unsigned long long n) {
+    if (ENABLED) counters[counter].fetch_add(n, memory_order_relaxed);
+}
+
+struct Summary {
+    unsigned long long count, maxNanos;
+    double meanMicros, p50Micros, p99Micros;
+};
+
+// Percentiles are read as the middle of the bucket they fall in (at most
+// the largest value seen)
+static Summary summarize(const Histogram& h) {
+    Summary s = {h.count.load(memory_order_relaxed), h.maxNanos.load(memory_order_relaxed), 0, 0, 0};
+    if (s.count == 0) return s;
+    s.meanMicros = h.totalNanos.load(memory_order_relaxed) / 1000.0 / s.count;
+    unsigned long long p50 = (s.count + 1) / 2, p99 = s.count - s.count / 100, seen = 0;
+    bool have50 = false;
+    for (int b = 0; b < BUCKETS; b++) {
+        seen += h.buckets[b].load(memory_order_relaxed);
+        double middle = (lowerBound(b) + (b + 1 < BUCKETS ? lowerBound(b + 1) : lowerBound(b))) / 2000.0;
+        middle = min(middle, s.maxNanos / 1000.0);
+        if (!have50 && seen >= p50) {
+            s.p50Micros = middle;
+            have50 = true;
+        }
+        if (seen >= p99) {
+            s.p99Micros = middle;
+            break;
+        }
+    }
+    return s;
+}
+
+string dumpText() {
+    if (!ENABLED) return "Metrics disabled (built with ATM_METRICS=0)";
+    string text;
+    char line[160];
+    for (int op = 0; op < METRIC_OPS; op++) {
+        Summary s = summarize(histograms[op]);
+        if (s.count == 0) continue;
+        snprintf(line, sizeof(line), "%-15s %10llu  mean %9.1f us  p50 %9.1f us  p99 %9.1f us  max %9.1f us\r\n",
+                 OP_NAMES[op], s.count, s.meanMicros, s.p50Micros, s.p99Micros, s.maxNanos / 1000.0);
+        text += line;
+    }
+    for (int c = 0; c < METRIC_COUNTERS; c++) {
+        snprintf(line, sizeof(line), "%-15s %10llu\r\n", COUNTER_NAMES[c], counters[c].load(memory_order_relaxed));
+        text += line;
+    }
+    return text;
+}
+
+string dumpJson() {
+    if (!ENABLED) return "{\"enabled\": false}\n";
+    string json = "{\n  \"enabled\": true,\n  \"time\": " + to_string((long long)time(0)) + ",\n  \"operations\": {";
+    char entry[256];
+    for (int op = 0; op < METRIC_OPS; op++) {
+        Summary s = summarize(histograms[op]);
+        snprintf(entry, sizeof(entry),
+                 "%s\n    \"%s\": {\"count\": %llu, \"mean_us\": %.2f, \"p50_us\": %.2f, \"p99_us\": %.2f, \"max_us\": %.2f}",
+                 op == 0 ? "" : ",", OP_NAMES[op], s.count, s.meanMicros, s.p50Micros, s.p99Micros, s.maxNanos / 1000.0);
+        json += entry;
+    }
+    json += "\n  },\n  \"counters\": {";
+    for (int c = 0; c < METRIC_COUNTERS; c++) {
+        snprintf(entry, sizeof(entry), "%s\n    \"%s\": %llu", c == 0 ? "" : ",", COUNTER_NAMES[c],
+                 counters[c].load(memory_order_relaxed));
+        json += entry;
+    }
+    json += "\n  }\n}\n";
+    return json;
+}
+
+bool writeFile(const string& path) {
+    string json = dumpJson();
+    string tmpPath = path + ".tmp";
+    FILE* file = fopen(tmpPath.c_str(), "wb");
+    if (!file) return false;
+    bool ok = fwrite(json.data(), 1, json.size(), file) == json.size();
+    ok = fclose(file) == 0 && ok;
+    return ok && replaceFile(tmpPath, path);
+}
+
+void setDumpFile(const string& path, int intervalSeconds) {
+    lock_guard<mutex> guard(dumpLock);
+    dumpPath = path;
+    dumpInterval = intervalSeconds > 0 ? intervalSeconds : 1;
+    lastDump = time(0);
+}
+
+void dumpIfDue() {
+    string path;
+    {
+        lock_guard<mutex> guard(dumpLock);
+        if (dumpPath.empty() || time(0) - lastDump < dumpInterval) return;
+        lastDump = time(0);
+        path = dumpPath;
+    }
+    writeFile(path);
+}
+
+void reset() {
+    for (auto& h : histograms) {
+        h.count = 0;
+        h.totalNanos = 0;
+        h.maxNanos = 0;
+        for (auto& b : h.buckets) b = 0;
+    }
+    for (auto& c : counters) c = 0;
+}
+
+}
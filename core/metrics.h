@@ -0,0 +1,104 @@
+#ifndef ATM_METRICS_H
+#define ATM_METRICS_H
+
+// Operation counters, latency histograms and I/O counts.
+//
+// Everything is a relaxed atomic, so recording never takes a lock and
+// costs a couple of clock reads and atomic adds. Build with
+// -DATM_METRICS=0 to compile every ATM_TIME / ATM_COUNT out entirely;
+// the dump functions then report that metrics are disabled.
+//
+// Latencies go into log-linear histograms: four buckets per power of two
+// of nanoseconds, so percentiles are reported within about 19%.
+
+#ifndef ATM_METRICS
+#define ATM_METRICS 1
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+enum MetricOp {
+    TIME_LOGIN,
+    TIME_REGISTER,
+    TIME_DEPOSIT,
+    TIME_WITHDRAW,
+    TIME_TRANSFER,
+    TIME_BALANCE,
+    TIME_HISTORY,
+    TIME_BATCH,
+    TIME_SET_PASSWORD,
+    TIME_FREEZE,
+    TIME_JOURNAL_SYNC,
+    TIME_TXLOG_FLUSH,
+    TIME_SNAPSHOT_WRITE,
+    TIME_SNAPSHOT_LOAD,
+    TIME_COMMAND_WAIT,
+    METRIC_OPS
+};
+
+enum MetricCounter {
+    COUNT_LOGIN_FAILURES,
+    COUNT_SESSION_HITS,
+    COUNT_SESSION_MISSES,
+    COUNT_DEDUP_HITS,
+    COUNT_TX_RECORDS,
+    COUNT_JOURNAL_RECORDS,
+    COUNT_JOURNAL_BYTES,
+    COUNT_JOURNAL_FSYNCS,
+    COUNT_TXLOG_BYTES,
+    COUNT_TXLOG_FSYNCS,
+    COUNT_SNAPSHOT_BYTES,
+    COUNT_SNAPSHOT_FSYNCS,
+    METRIC_COUNTERS
+};
+
+namespace metrics {
+
+const bool ENABLED = ATM_METRICS != 0;
+
+void recordLatency(MetricOp op, long long nanos);
+void add(MetricCounter counter, unsigned long long n = 1);
+
+// Current values as text (one line per metric) or as a JSON object
+std::string dumpText();
+std::string dumpJson();
+
+// Write dumpJson() to a file (atomically, via a temporary file)
+bool writeFile(const std::string& path);
+
+// Dump to 'path' every intervalSeconds from dumpIfDue(), which the Bank
+// calls from its periodic tick. An empty path stops it.
+void setDumpFile(const std::string& path, int intervalSeconds);
+void dumpIfDue();
+
+void reset();
+
+// Times the enclosing scope
+class ScopedTimer {
+private:
+    MetricOp op;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    explicit ScopedTimer(MetricOp o) : op(o), start(std::chrono::steady_clock::now()) {}
+    ~ScopedTimer() {
+        recordLatency(op, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              std::chrono::steady_clock::now() - start).count());
+    }
+};
+
+}
+
+#if ATM_METRICS
+#define ATM_METRICS_CONCAT2(a, b) a##b
+#define ATM_METRICS_CONCAT(a, b) ATM_METRICS_CONCAT2(a, b)
+#define ATM_TIME(op) metrics::ScopedTimer ATM_METRICS_CONCAT(atmTimer, __LINE__)(op)
+#define ATM_COUNT(counter, n) metrics::add(counter, n)
+#else
+#define ATM_TIME(op) ((void)0)
+#define ATM_COUNT(counter, n) ((void)0)
+#endif
+
+#endif
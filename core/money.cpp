@@ -0,0 +1,47 @@
+#include "money.h"
+
+#include <cctype>
+#include <cstdio>
+
+using namespace std;
+
+bool Money::parse(const string& text, Money& out, bool roundExtraDigits) {
+    size_t i = 0;
+    bool negative = false;
+    if (i < text.size() && (text[i] == '-' || text[i] == '+')) negative = text[i++] == '-';
+
+    const long long limit = 9000000000000000000LL / 100;
+    long long rupees = 0;
+    size_t digits = 0;
+    for (; i < text.size() && isdigit((unsigned char)text[i]); i++, digits++) {
+        rupees = rupees * 10 + (text[i] - '0');
+        if (rupees >= limit) return false;
+    }
+
+    long long fraction = 0;
+    size_t decimals = 0;
+    if (i < text.size() && text[i] == '.') {
+        for (i++; i < text.size() && isdigit((unsigned char)text[i]); i++, decimals++) {
+            if (decimals < 2) {
+                fraction = fraction * 10 + (text[i] - '0');
+            } else if (!roundExtraDigits) {
+                return false;
+            } else if (decimals == 2 && text[i] >= '5') {
+                fraction++; // round half up on the first dropped digit
+            }
+        }
+    }
+    if (i != text.size() || digits + decimals == 0) return false;
+    if (decimals == 1) fraction *= 10;
+
+    long long total = rupees * 100 + fraction;
+    out = Money(negative ? -total : total);
+    return true;
+}
+
+string Money::toString() const {
+    char buffer[32];
+    unsigned long long magnitude = paise < 0 ? 0ULL - (unsigned long long)paise : (unsigned long long)paise;
+    snprintf(buffer, sizeof(buffer), "%s%llu.%02llu", paise < 0 ? "-" : "", magnitude / 100, magnitude % 100);
+    return buffer;
+}
@@ -0,0 +1,51 @@
+#ifndef ATM_MONEY_H
+#define ATM_MONEY_H
+
+#include <climits>
+#include <cmath>
+#include <string>
+
+// An amount of money in paise (1/100 of a rupee). Kept as a 64-bit integer
+// so sums and comparisons are exact, unlike the double it replaces.
+class Money {
+private:
+    long long paise;
+
+    explicit Money(long long p) : paise(p) {}
+
+public:
+    Money() : paise(0) {}
+
+    static Money fromPaise(long long p) { return Money(p); }
+
+    // Only for reading data written as floating-point rupees
+    static Money fromRupees(double rupees) { return Money(std::llround(rupees * 100.0)); }
+
+    long long getPaise() const { return paise; }
+
+    // Parse "1234", "1234.5" or "-1234.50". Extra decimal places are an
+    // error unless roundExtraDigits is set (used for files written with
+    // doubles), in which case the amount is rounded to the nearest paisa.
+    static bool parse(const std::string& text, Money& out, bool roundExtraDigits = false);
+
+    // "1234.50", with a leading '-' for negative amounts
+    std::string toString() const;
+
+    // Whether adding 'other' keeps the amount within 64 bits. Every credit
+    // checks this first: two large deposits must not wrap a balance round.
+    bool canAdd(Money other) const { return other.paise <= 0 || paise <= LLONG_MAX - other.paise; }
+
+    Money operator-() const { return Money(-paise); }
+    Money operator+(Money other) const { return Money(paise + other.paise); }
+    Money operator-(Money other) const { return Money(paise - other.paise); }
+    Money& operator+=(Money other) { paise += other.paise; return *this; }
+    Money& operator-=(Money other) { paise -= other.paise; return *this; }
+    bool operator==(Money other) const { return paise == other.paise; }
+    bool operator!=(Money other) const { return paise != other.paise; }
+    bool operator<(Money other) const { return paise < other.paise; }
+    bool operator<=(Money other) const { return paise <= other.paise; }
+    bool operator>(Money other) const { return paise > other.paise; }
+    bool operator>=(Money other) const { return paise >= other.paise; }
+};
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef ATM_NAME_ARENA_H
+#define ATM_NAME_ARENA_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Append-only store of names packed end to end in one buffer. Name n is
+// bytes offsets[n] .. offsets[n + 1] of it, so each name costs its
+// characters plus 4 bytes and no allocation of its own, and its id never
+// changes. Up to 4 GB of names in all.
+class NameArena {
+private:
+    std::string bytes;
+    std::vector<unsigned int> offsets;  // one more than there are names
+
+public:
+    NameArena() : offsets(1, 0) {}
+
+    size_t size() const { return offsets.size() - 1; }
+
+    // Valid until the next add() (the buffer may move when it grows)
+    std::string_view get(size_t id) const {
+        return std::string_view(bytes.data() + offsets[id], offsets[id + 1] - offsets[id]);
+    }
+
+    // Where a name starts in the buffer, and the name at such a place
+    // (for callers that keep the position next to something else)
+    unsigned int offsetOf(size_t id) const { return offsets[id]; }
+    std::string_view at(unsigned int offset, size_t length) const {
+        return std::string_view(bytes.data() + offset, length);
+    }
+
+    size_t add(std::string_view name) {
+        bytes.append(name.data(), name.size());
+        offsets.push_back((unsigned int)bytes.size());
+        return size() - 1;
+    }
+
+    void reserve(size_t names, size_t characters) {
+        offsets.reserve(names + 1);
+        bytes.reserve(characters);
+    }
+
+    void clear() {
+        bytes.clear();
+        offsets.assign(1, 0);
+    }
+};
+
+#endif
@@ -0,0 +1,236 @@
+#include "name_search.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+using namespace std;
+
+const size_t MAX_FUZZY_LENGTH = 64;
+
+static inline unsigned char fold(char c) {
+    return (c >= 'A' && c <= 'Z') ? (unsigned char)(c - 'A' + 'a') : (unsigned char)c;
+}
+
+// Order of the index: case ignored, then by the bytes so it is total
+static int compareNames(string_view a, string_view b) {
+    size_t n = min(a.size(), b.size());
+    for (size_t i = 0; i < n; i++) {
+        if (fold(a[i]) != fold(b[i])) return fold(a[i]) < fold(b[i]) ? -1 : 1;
+    }
+    if (a.size() != b.size()) return a.size() < b.size() ? -1 : 1;
+    return a.compare(b);
+}
+
+static bool startsWith(string_view name, string_view prefix) {
+    if (name.size() < prefix.size()) return false;
+    for (size_t i = 0; i < prefix.size(); i++) {
+        if (fold(name[i]) != fold(prefix[i])) return false;
+    }
+    return true;
+}
+
+// The first eight folded bytes as one number, zero padded: heads are in
+// the same order as their names, so most comparisons stop at them
+static unsigned long long headOf(string_view name) {
+    unsigned long long head = 0;
+    for (size_t i = 0; i < 8; i++) head = (head << 8) | (i < name.size() ? fold(name[i]) : 0);
+    return head;
+}
+
+void NameSearch::add(int id, const NameArena& names) {
+    auto at = upper_bound(sorted.begin(), sorted.end(), id, [&](int a, int b) {
+        return compareNames(names.get(a), names.get(b)) < 0;
+    });
+    size_t position = at - sorted.begin();
+    unsigned long long head = headOf(names.get(id));
+    heads.insert(heads.begin() + position, head);
+    sorted.insert(at, id);
+
+    // Its branch (new if it is the first with these letters), and every
+    // branch after it starts one later
+    unsigned int letters = (unsigned int)(head >> 40);
+    auto branch = lower_bound(branches.begin(), branches.end(), letters,
+                              [](const Branch& a, unsigned int b) { return a.letters < b; });
+    if (branch == branches.end() || branch->letters != letters) {
+        branch = branches.insert(branch, Branch{letters, (unsigned int)position});
+    }
+    for (++branch; branch != branches.end(); ++branch) branch->start++;
+}
+
+void NameSearch::rebuild(const NameArena& names) {
+    clear();
+    vector<pair<unsigned long long, int>> keyed(names.size());
+    for (size_t id = 0; id < names.size(); id++) keyed[id] = make_pair(headOf(names.get(id)), (int)id);
+    sort(keyed.begin(), keyed.end(), [&](const pair<unsigned long long, int>& a, const pair<unsigned long long, int>& b) {
+        if (a.first != b.first) return a.first < b.first;
+        return compareNames(names.get(a.second), names.get(b.second)) < 0;
+    });
+    sorted.reserve(keyed.size());
+    heads.reserve(keyed.size());
+    for (const auto& entry : keyed) {
+        unsigned int letters = (unsigned int)(entry.first >> 40);
+        if (branches.empty() || branches.back().letters != letters) {
+            branches.push_back(Branch{letters, (unsigned int)sorted.size()});
+        }
+        heads.push_back(entry.first);
+        sorted.push_back(entry.second);
+    }
+}
+
+void NameSearch::clear() {
+    sorted.clear();
+    heads.clear();
+    branches.clear();
+}
+
+void NameSearch::withPrefix(string_view prefix, const NameArena& names, size_t limit, vector<int>& out) const {
+    auto at = lower_bound(sorted.begin(), sorted.end(), prefix, [&](int id, string_view text) {
+        string_view name = names.get(id);
+        size_t n = min(name.size(), text.size());
+        for (size_t i = 0; i < n; i++) {
+            if (fold(name[i]) != fold(text[i])) return fold(name[i]) < fold(text[i]);
+        }
+        return name.size() < text.size();
+    });
+    for (; at != sorted.end() && limit > 0 && startsWith(names.get(*at), prefix); ++at, limit--) {
+        out.push_back(*at);
+    }
+}
+
+// The first entry after 'i' whose name does not start with the first
+// 'depth' letters of the name at i, which are 'path'. 'branch' follows i
+// along the branches. Up to three letters, the run ends where a branch
+// does; past them, runs are mostly short, so the search gallops forward
+// from i before halving.
+size_t NameSearch::endOfRun(size_t i, size_t& branch, const vector<int>& path, int depth,
+                            const NameArena& names) const {
+    while (branch + 1 < branches.size() && branches[branch + 1].start <= i) branch++;
+    if (depth <= 3) {
+        unsigned int mask = (0xFFFFFFu << (24 - 8 * depth)) & 0xFFFFFF;
+        unsigned int letters = branches[branch].letters & mask;
+        while (++branch < branches.size() && (branches[branch].letters & mask) == letters) {}
+        return branch < branches.size() ? branches[branch].start : sorted.size();
+    }
+
+    unsigned long long mask = depth >= 8 ? ~0ULL : ~0ULL << (64 - 8 * depth);
+    unsigned long long head = heads[i] & mask;
+    auto inRun = [&](size_t k) {
+        if ((heads[k] & mask) != head) return false;
+        if (depth <= 8) return true;
+        string_view name = names.get(sorted[k]);
+        if ((int)name.size() < depth) return false;
+        for (int p = 8; p < depth; p++) {
+            if (fold(name[p]) != path[p]) return false;
+        }
+        return true;
+    };
+    size_t n = sorted.size(), inside = i, outside = i + 1, step = 1;
+    while (outside < n && inRun(outside)) {
+        inside = outside;
+        step *= 2;
+        outside = min(n, inside + step);
+    }
+    while (outside - inside > 1) {
+        size_t middle = inside + (outside - inside) / 2;
+        if (inRun(middle)) inside = middle;
+        else outside = middle;
+    }
+    return outside;
+}
+
+void NameSearch::similar(string_view text, const NameArena& names, size_t limit, vector<Match>& out) const {
+    if (text.size() < MIN_FUZZY_LENGTH || text.size() > MAX_FUZZY_LENGTH || limit == 0) return;
+    int most = maxDistance(text);
+    int m = (int)text.size();
+    int deepest = m + most;   // no close name is longer
+    vector<int> query(m);
+    for (int j = 0; j < m; j++) query[j] = fold(text[j]);
+
+    // Row k of the table is for the first k letters of 'path', the name
+    // being walked; the next name reuses the rows of the letters it shares
+    vector<int> rows((size_t)(deepest + 1) * (m + 1));
+    vector<int> path(deepest);
+    for (int j = 0; j <= m; j++) rows[j] = j;
+    int depth = 0;
+    size_t branch = 0;
+
+    size_t first = out.size();
+    for (size_t i = 0; i < sorted.size();) {
+        // Letter p of name i (folded), or -1 past its end. The head has
+        // the first 8; the name is only read past them, or for a zero
+        // byte, which may be its end.
+        string_view name;
+        bool loaded = false;
+        auto letter = [&](int p) {
+            if (p < 8) {
+                int c = (int)(heads[i] >> (56 - 8 * p)) & 0xFF;
+                if (c != 0) return c;
+            }
+            if (!loaded) {
+                name = names.get(sorted[i]);
+                loaded = true;
+            }
+            return p < (int)name.size() ? (int)fold(name[p]) : -1;
+        };
+
+        int shared = 0;
+        while (shared < depth && letter(shared) == path[shared]) shared++;
+        depth = shared;
+        bool tooFar = false;
+        for (int c; depth < deepest && (c = letter(depth)) >= 0;) {
+            const int* above = &rows[(size_t)depth * (m + 1)];
+            int* row = &rows[(size_t)(depth + 1) * (m + 1)];
+            row[0] = depth + 1;
+            int best = row[0];
+            for (int j = 1; j <= m; j++) {
+                int value = min(min(above[j] + 1, row[j - 1] + 1), above[j - 1] + (query[j - 1] == c ? 0 : 1));
+                if (depth > 0 && j > 1 && query[j - 1] == path[depth - 1] && query[j - 2] == c) {
+                    value = min(value, above[j - 2 - (m + 1)] + 1);
+                }
+                row[j] = value;
+                best = min(best, value);
+            }
+            path[depth++] = c;
+            if (best > most) {
+                tooFar = true;
+                break;
+            }
+        }
+        if (!tooFar && letter(depth) < 0) {
+            int edits = rows[(size_t)depth * (m + 1) + m];
+            if (edits <= most) out.push_back({sorted[i], edits});
+            i++;
+        } else {
+            // Every name under this prefix is as far, or longer than any
+            // close name
+            i = endOfRun(i, branch, path, depth, names);
+        }
+    }
+
+    auto closer = [&](const Match& a, const Match& b) {
+        if (a.distance != b.distance) return a.distance < b.distance;
+        long long gapA = llabs((long long)names.get(a.id).size() - (long long)text.size());
+        long long gapB = llabs((long long)names.get(b.id).size() - (long long)text.size());
+        if (gapA != gapB) return gapA < gapB;
+        return compareNames(names.get(a.id), names.get(b.id)) < 0;
+    };
+    size_t keep = min(limit, out.size() - first);
+    partial_sort(out.begin() + first, out.begin() + first + keep, out.end(), closer);
+    out.resize(first + keep);
+}
+
+void NameSearch::search(string_view text, const NameArena& names, size_t limit, vector<Match>& out) const {
+    vector<int> ids;
+    withPrefix(text, names, limit, ids);
+    for (int id : ids) out.push_back({id, 0});
+    if (ids.size() >= limit) return;
+
+    // Close names that were not listed already: those starting with text
+    // (all of which are in ids, as it was not cut short)
+    vector<Match> close;
+    similar(text, names, limit + ids.size(), close);
+    for (const Match& match : close) {
+        if (out.size() >= limit) break;
+        if (!startsWith(names.get(match.id), text)) out.push_back(match);
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef ATM_NAME_SEARCH_H
+#define ATM_NAME_SEARCH_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "name_arena.h"
+
+// Search index over the usernames of an AccountTable, for the admin's
+// lookups. Case is ignored. The account ids are kept sorted by name, next
+// to the first 8 (folded) bytes of each name, which makes the array a trie
+// without nodes: the names under any prefix are one run of it. Where each
+// three-letter prefix starts is kept as well, as the top of that trie.
+//  - names starting with a prefix: one binary search, then a walk
+//  - names within a few edits of a query: a walk down that trie keeping a
+//    row of the edit table for each letter of the path; once every entry
+//    of a row is over the limit, the whole run under that prefix is
+//    skipped (a step along the three-letter prefixes, or a search along
+//    the 8-byte heads, which rarely touches the names themselves)
+// 12 bytes per account. Adding a name costs a binary search and moving the
+// entries after it. The names stay in the NameArena, which every call is
+// given. Not thread safe; the Bank locks around it.
+class NameSearch {
+public:
+    struct Match {
+        int id;
+        int distance;   // edits from the query (0 for a prefix match)
+    };
+
+private:
+    // The names starting with the same three letters
+    struct Branch {
+        unsigned int letters;   // top three bytes of their heads
+        unsigned int start;     // the first of them in 'sorted'
+    };
+
+    std::vector<int> sorted;                  // ids by name
+    std::vector<unsigned long long> heads;    // first 8 folded bytes of each, zero padded
+    std::vector<Branch> branches;             // in name order, a few thousand
+
+    size_t endOfRun(size_t i, size_t& branch, const std::vector<int>& path, int depth, const NameArena& names) const;
+
+public:
+    // Names shorter than this are only matched by prefix
+    static const size_t MIN_FUZZY_LENGTH = 3;
+
+    // Name 'id' of 'names' was just added
+    void add(int id, const NameArena& names);
+
+    // Index every name of 'names' from scratch (after a load or import)
+    void rebuild(const NameArena& names);
+    void clear();
+
+    // Up to 'limit' names starting with 'prefix', in name order
+    void withPrefix(std::string_view prefix, const NameArena& names, size_t limit, std::vector<int>& out) const;
+
+    // Up to 'limit' names within maxDistance(text) edits of 'text' (a
+    // swap of two neighbours counts as one), closest first, then nearest
+    // in length, then in name order
+    void similar(std::string_view text, const NameArena& names, size_t limit, std::vector<Match>& out) const;
+
+    // The search box: names starting with 'text', then names close to it
+    // that do not, at most 'limit' in all
+    void search(std::string_view text, const NameArena& names, size_t limit, std::vector<Match>& out) const;
+
+    // One typo allowed up to 6 characters, two from 7
+    static int maxDistance(std::string_view text) { return text.size() < 7 ? 1 : 2; }
+
+    size_t size() const { return sorted.size(); }
+
+    // Bytes held by the index (not counting the names)
+    size_t memoryBytes() const {
+        return sorted.capacity() * sizeof(int) + heads.capacity() * sizeof(heads[0]) +
+               branches.capacity() * sizeof(Branch);
+    }
+};
+
+#endif
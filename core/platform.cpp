@@ -0,0 +1,205 @@
+#include "platform.h"
+
+#include <cerrno>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#include <fcntl.h>
+#include <io.h>
+
+// RtlGenRandom, exported by advapi32 under this name (every MinGW and
+// Windows since XP has it, unlike bcrypt)
+extern "C" BOOLEAN NTAPI SystemFunction036(PVOID buffer, ULONG length);
+#pragma comment(lib, "advapi32.lib")
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+
+bool syncFile(FILE* f) {
+    if (fflush(f) != 0) return false;
+#ifdef _WIN32
+    return _commit(_fileno(f)) == 0;
+#else
+    return fsync(fileno(f)) == 0;
+#endif
+}
+
+bool replaceFile(const string& from, const string& to) {
+#ifdef _WIN32
+    return MoveFileEx(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+bool fileExists(const string& path) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) return false;
+    fclose(f);
+    return true;
+}
+
+bool truncateFile(const string& path, unsigned long long size) {
+#ifdef _WIN32
+    int fd = _open(path.c_str(), _O_RDWR | _O_BINARY);
+    if (fd < 0) return false;
+    bool ok = _chsize_s(fd, (long long)size) == 0 && _commit(fd) == 0;
+    _close(fd);
+    return ok;
+#else
+    int fd = ::open(path.c_str(), O_RDWR);
+    if (fd < 0) return false;
+    bool ok = ftruncate(fd, (off_t)size) == 0 && fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+#endif
+}
+
+bool makeDirectory(const string& path) {
+#ifdef _WIN32
+    return _mkdir(path.c_str()) == 0 || errno == EEXIST;
+#else
+    return mkdir(path.c_str(), 0777) == 0 || errno == EEXIST;
+#endif
+}
+
+string joinPath(const string& dir, const string& name) {
+    if (dir.empty()) return name;
+    char last = dir[dir.size() - 1];
+    if (last == '/' || last == '\\') return dir + name;
+    return dir + "/" + name;
+}
+
+bool localTime(long long when, struct tm& out) {
+    time_t t = (time_t)when;
+#ifdef _WIN32
+    return localtime_s(&out, &t) == 0;
+#else
+    return localtime_r(&t, &out) != nullptr;
+#endif
+}
+
+bool randomBytes(void* out, size_t length) {
+    unsigned char* p = (unsigned char*)out;
+#ifdef _WIN32
+    while (length > 0) {
+        ULONG part = length > 0x10000 ? 0x10000 : (ULONG)length;
+        if (!SystemFunction036(p, part)) return false;
+        p += part;
+        length -= part;
+    }
+    return true;
+#else
+    int fd = ::open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    while (length > 0) {
+        ssize_t got = ::read(fd, p, length);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) break;
+        p += got;
+        length -= (size_t)got;
+    }
+    ::close(fd);
+    return length == 0;
+#endif
+}
+
+unsigned int crc32(const void* data, size_t length, unsigned int crc) {
+    // Built once, safely even when the first calls come from several threads.
+    // entries[k][b] is the CRC of byte b followed by k zero bytes, so eight
+    // lookups advance the CRC by eight bytes at once.
+    struct Table {
+        unsigned int entries[8][256];
+        Table() {
+            for (unsigned int i = 0; i < 256; i++) {
+                unsigned int c = i;
+                for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                entries[0][i] = c;
+            }
+            for (unsigned int i = 0; i < 256; i++) {
+                for (int k = 1; k < 8; k++) {
+                    unsigned int c = entries[k - 1][i];
+                    entries[k][i] = entries[0][c & 0xFF] ^ (c >> 8);
+                }
+            }
+        }
+    };
+    static const Table crcTable;
+    const unsigned int (*table)[256] = crcTable.entries;
+    const unsigned char* p = (const unsigned char*)data;
+    crc = ~crc;
+    for (; length >= 8; length -= 8, p += 8) {
+        unsigned int low = crc ^ (p[0] | (unsigned int)p[1] << 8 | (unsigned int)p[2] << 16 | (unsigned int)p[3] << 24);
+        crc = table[7][low & 0xFF] ^ table[6][(low >> 8) & 0xFF] ^ table[5][(low >> 16) & 0xFF]
+              ^ table[4][low >> 24] ^ table[3][p[4]] ^ table[2][p[5]] ^ table[1][p[6]] ^ table[0][p[7]];
+    }
+    for (; length > 0; length--, p++) crc = table[0][(crc ^ *p) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+MappedFile::MappedFile() : data(nullptr), length(0), fileHandle(nullptr), mapping(nullptr) {}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const string& path) {
+    close();
+#ifdef _WIN32
+    HANDLE file = CreateFile(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                             OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    fileHandle = file;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        close();
+        return false;
+    }
+    mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping) {
+        close();
+        return false;
+    }
+    data = (const char*)MapViewOfFile((HANDLE)mapping, FILE_MAP_READ, 0, 0, 0);
+    length = (size_t)fileSize.QuadPart;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    void* p = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) return false;
+    madvise(p, (size_t)info.st_size, MADV_SEQUENTIAL);
+    data = (const char*)p;
+    length = (size_t)info.st_size;
+#endif
+    if (!data) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::close() {
+#ifdef _WIN32
+    if (data) UnmapViewOfFile(data);
+    if (mapping) CloseHandle((HANDLE)mapping);
+    if (fileHandle) CloseHandle((HANDLE)fileHandle);
+#else
+    if (data) munmap((void*)data, length);
+#endif
+    data = nullptr;
+    length = 0;
+    fileHandle = nullptr;
+    mapping = nullptr;
+}
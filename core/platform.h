@@ -0,0 +1,59 @@
+#ifndef ATM_PLATFORM_H
+#define ATM_PLATFORM_H
+
+// Small portability layer for the file operations the engine depends on.
+// Everything else in core/ is plain standard C++.
+
+#include <cstdio>
+#include <cstddef>
+#include <ctime>
+#include <string>
+
+// Push everything written to a stdio stream through to the disk
+bool syncFile(FILE* f);
+
+// Move 'from' over 'to', replacing it in a single step
+bool replaceFile(const std::string& from, const std::string& to);
+
+bool fileExists(const std::string& path);
+
+// Cut a file down to its first 'size' bytes
+bool truncateFile(const std::string& path, unsigned long long size);
+
+// Create a directory; true if it exists afterwards
+bool makeDirectory(const std::string& path);
+
+// "dir/name", or just name when dir is empty
+std::string joinPath(const std::string& dir, const std::string& name);
+
+// localtime() that is safe to call from several threads
+bool localTime(long long when, struct tm& out);
+
+// Fill 'out' from the operating system's cryptographic random source
+// (RtlGenRandom on Windows, /dev/urandom elsewhere)
+bool randomBytes(void* out, size_t length);
+
+// CRC-32 (IEEE), chained through 'crc' for data written in pieces.
+// Table driven, eight bytes per step (slicing-by-8).
+unsigned int crc32(const void* data, size_t length, unsigned int crc = 0);
+
+// Read-only view of a whole file mapped into memory
+class MappedFile {
+private:
+    const char* data;
+    size_t length;
+    void* fileHandle;   // Windows only
+    void* mapping;      // Windows only
+
+public:
+    MappedFile();
+    ~MappedFile();
+
+    bool open(const std::string& path);
+    void close();
+
+    const char* begin() const { return data; }
+    size_t size() const { return length; }
+};
+
+#endif
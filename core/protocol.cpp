@@ -0,0 +1,203 @@
+#include "protocol.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+const char* wireStatusText(WireStatus status) {
+    switch (status) {
+        case WIRE_OK: return "ok";
+        case WIRE_DENIED: return "denied";
+        case WIRE_REFUSED: return "refused";
+        case WIRE_BAD_REQUEST: return "bad request";
+    }
+    return "unknown";
+}
+
+WireWriter::WireWriter(string& buffer, unsigned int tag, unsigned char code) : out(buffer), start(buffer.size()) {
+    u32(0);
+    u32(tag);
+    u8(code);
+}
+
+void WireWriter::str(const string& text) {
+    size_t size = min<size_t>(text.size(), 0xFFFF);
+    u16((unsigned short)size);
+    out.append(text, 0, size);
+}
+
+void WireWriter::finish() {
+    unsigned int length = (unsigned int)(out.size() - start - 4);
+    memcpy(&out[start], &length, 4);
+}
+
+bool WireReader::take(void* to, size_t size) {
+    if (!good || (size_t)(end - next) < size) {
+        good = false;
+        memset(to, 0, size);
+        return false;
+    }
+    memcpy(to, next, size);
+    next += size;
+    return true;
+}
+
+unsigned char WireReader::u8() {
+    unsigned char value;
+    take(&value, 1);
+    return value;
+}
+
+unsigned short WireReader::u16() {
+    unsigned short value;
+    take(&value, 2);
+    return value;
+}
+
+unsigned int WireReader::u32() {
+    unsigned int value;
+    take(&value, 4);
+    return value;
+}
+
+long long WireReader::i64() {
+    long long value;
+    take(&value, 8);
+    return value;
+}
+
+string WireReader::str() {
+    size_t size = u16();
+    const char* text = bytes(size);
+    return text ? string(text, size) : string();
+}
+
+const char* WireReader::bytes(size_t size) {
+    if (!good || (size_t)(end - next) < size) {
+        good = false;
+        return nullptr;
+    }
+    const char* at = next;
+    next += size;
+    return at;
+}
+
+long wireFrameSize(const char* data, size_t size) {
+    if (size < 4) return 0;
+    unsigned int length;
+    memcpy(&length, data, 4);
+    if (length < WIRE_HEADER_SIZE - 4 || length > WIRE_MAX_FRAME - 4) return -1;
+    return size < 4 + (size_t)length ? 0 : 4 + (long)length;
+}
+
+unsigned int wireTag(const char* frame) {
+    unsigned int tag;
+    memcpy(&tag, frame + 4, 4);
+    return tag;
+}
+
+unsigned char wireCode(const char* frame) {
+    return (unsigned char)frame[8];
+}
+
+static void reply(string& out, unsigned int tag, WireStatus status) {
+    WireWriter(out, tag, (unsigned char)status).finish();
+}
+
+static void replyBalance(string& out, unsigned int tag, Money balance) {
+    WireWriter response(out, tag, WIRE_OK);
+    response.i64(balance.getPaise());
+    response.finish();
+}
+
+void serveRequest(ATM& atm, const char* frame, size_t size, string& out) {
+    unsigned int tag = wireTag(frame);
+    WireReader in(frame + WIRE_HEADER_SIZE, size - WIRE_HEADER_SIZE);
+    switch (wireCode(frame)) {
+        case OP_REGISTER: {
+            string username = in.str();
+            string password = in.str();
+            if (!in.atEnd()) break;
+            reply(out, tag, atm.registerUser(username, password) ? WIRE_OK : WIRE_REFUSED);
+            return;
+        }
+        case OP_LOGIN: {
+            string username = in.str();
+            string password = in.str();
+            if (!in.atEnd()) break;
+            if (!atm.login(username, password)) {
+                reply(out, tag, WIRE_DENIED);
+                return;
+            }
+            WireWriter response(out, tag, WIRE_OK);
+            response.str(atm.getSessionToken());
+            response.finish();
+            return;
+        }
+        case OP_RESUME: {
+            string token = in.str();
+            if (!in.atEnd()) break;
+            reply(out, tag, atm.resume(token) ? WIRE_OK : WIRE_DENIED);
+            return;
+        }
+        case OP_LOGOUT:
+            if (!in.atEnd()) break;
+            atm.logout();
+            reply(out, tag, WIRE_OK);
+            return;
+        case OP_BALANCE: {
+            if (!in.atEnd()) break;
+            Money balance = atm.getBalanceAmount();
+            // A session dropped by the bank (frozen, password reset) logs out
+            if (!atm.isUserLoggedIn()) {
+                reply(out, tag, WIRE_DENIED);
+                return;
+            }
+            replyBalance(out, tag, balance);
+            return;
+        }
+        case OP_DEPOSIT:
+        case OP_WITHDRAW: {
+            Money amount = Money::fromPaise(in.i64());
+            string key;
+            if (in.ok() && !in.atEnd()) key = in.str();
+            if (!in.atEnd()) break;
+            bool deposit = wireCode(frame) == OP_DEPOSIT;
+            Money balance;
+            if (atm.isUserLoggedIn() && amount > Money()
+                && (deposit ? atm.deposit(amount, &balance, key) : atm.withdraw(amount, &balance, key))) {
+                replyBalance(out, tag, balance);
+                return;
+            }
+            // A session dropped by the bank (frozen, password reset) logs out
+            if (!atm.isUserLoggedIn()) {
+                reply(out, tag, WIRE_DENIED);
+                return;
+            }
+            // A bad amount never reached withdraw(), so its last limit
+            // check belongs to an earlier request
+            WireWriter response(out, tag, WIRE_REFUSED);
+            response.u8(deposit || amount <= Money() ? (unsigned char)LIMIT_OK
+                                                     : (unsigned char)atm.getLastLimitCheck());
+            response.finish();
+            return;
+        }
+        case OP_HISTORY: {
+            size_t count = min<size_t>(in.u16(), WIRE_MAX_HISTORY);
+            if (!in.atEnd()) break;
+            vector<TxRecord> records;
+            if (!atm.getRecentTransactions(count, records)) {
+                reply(out, tag, WIRE_DENIED);
+                return;
+            }
+            WireWriter response(out, tag, WIRE_OK);
+            response.u16((unsigned short)records.size());
+            response.bytes(records.data(), records.size() * sizeof(TxRecord));
+            response.finish();
+            return;
+        }
+    }
+    reply(out, tag, WIRE_BAD_REQUEST);
+}
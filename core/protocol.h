@@ -0,0 +1,115 @@
+#ifndef ATM_PROTOCOL_H
+#define ATM_PROTOCOL_H
+
+#include <string>
+
+#include "atm.h"
+
+// Binary request/response protocol of atm_server, for terminals that
+// talk to the bank over a socket. Every message is one frame:
+//   u32 length    bytes after this field
+//   u32 tag       chosen by the client, sent back in the response
+//   u8  op        in a request, the status in a response
+//   payload
+// Integers are little-endian (like the data files), amounts are i64
+// paise and strings are a u16 length then the bytes.
+//
+// DEPOSIT and WITHDRAW may carry an idempotency key (a string, see
+// DedupCache::validKey): a request sent again with the same key, say on a
+// new connection after a timeout, gets the first answer back instead of
+// moving the money again.
+//
+// A client may send any number of requests without waiting for the
+// responses (pipelining). The responses come back in the order the
+// requests were sent, and each connection is one terminal: a login on it
+// holds for the requests after it.
+//
+//   request                       OK response
+//   REGISTER  user, password      -               (REFUSED: taken, or not Bank::validUsername)
+//   LOGIN     user, password      session token
+//   RESUME    token               -               (session of a dropped connection)
+//   LOGOUT                        -
+//   BALANCE                       balance
+//   DEPOSIT   amount [, key]      new balance
+//   WITHDRAW  amount [, key]      new balance     (REFUSED carries a u8 LimitCheck)
+//   HISTORY   u16 count           u16 n, n TxRecords of 32 bytes, oldest first
+
+enum WireOp {
+    OP_REGISTER = 1,
+    OP_LOGIN,
+    OP_RESUME,
+    OP_LOGOUT,
+    OP_BALANCE,
+    OP_DEPOSIT,
+    OP_WITHDRAW,
+    OP_HISTORY
+};
+
+enum WireStatus {
+    WIRE_OK,
+    WIRE_DENIED,        // not logged in, wrong password or frozen account
+    WIRE_REFUSED,       // the bank said no (funds, limits, name taken, amount)
+    WIRE_BAD_REQUEST    // unknown op or a payload that does not fit it
+};
+
+const char* wireStatusText(WireStatus status);
+
+const size_t WIRE_HEADER_SIZE = 9;         // length, tag, op
+const size_t WIRE_MAX_FRAME = 64 * 1024;   // a longer frame ends the connection
+const size_t WIRE_MAX_HISTORY = 1000;      // records in one HISTORY response
+
+// Builds one frame at the end of a buffer; finish() fills in its length
+class WireWriter {
+private:
+    std::string& out;
+    size_t start;
+
+public:
+    WireWriter(std::string& buffer, unsigned int tag, unsigned char code);
+
+    void u8(unsigned char value) { out += (char)value; }
+    void u16(unsigned short value) { out.append((const char*)&value, 2); }
+    void u32(unsigned int value) { out.append((const char*)&value, 4); }
+    void i64(long long value) { out.append((const char*)&value, 8); }
+    void bytes(const void* data, size_t size) { out.append((const char*)data, size); }
+    void str(const std::string& text);
+    void finish();
+};
+
+// Reads the fields of one frame's payload. A read past its end sets
+// 'good' to false and returns zeroes.
+class WireReader {
+private:
+    const char* next;
+    const char* end;
+    bool good;
+
+    bool take(void* to, size_t size);
+
+public:
+    WireReader(const char* payload, size_t size) : next(payload), end(payload + size), good(true) {}
+
+    unsigned char u8();
+    unsigned short u16();
+    unsigned int u32();
+    long long i64();
+    std::string str();
+    const char* bytes(size_t size);   // nullptr if there are not that many
+
+    bool ok() const { return good; }
+    bool atEnd() const { return good && next == end; }
+};
+
+// Size of the whole frame at the start of 'data': 0 if it has not all
+// arrived yet, -1 if it is not a frame (too short or too long)
+long wireFrameSize(const char* data, size_t size);
+
+// The tag and op (or status) of a whole frame
+unsigned int wireTag(const char* frame);
+unsigned char wireCode(const char* frame);
+
+// Run one request frame on a terminal's session and append the response
+// frame to 'out'
+void serveRequest(ATM& atm, const char* frame, size_t size, std::string& out);
+
+#endif
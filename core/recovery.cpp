@@ -0,0 +1,285 @@
+#include "recovery.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+
+#include "journal.h"
+#include "platform.h"
+#include "shard.h"
+#include "snapshot.h"
+#include "transaction_log.h"
+#include "tx_archive.h"
+
+using namespace std;
+
+VerifyReport::VerifyReport()
+    : snapshots(0), journalRecords(0), logs(0), archives(0), records(0), bytes(0), problems(0), repaired(0),
+      seconds(0) {}
+
+string VerifyReport::describe() const {
+    char summary[256];
+    snprintf(summary, sizeof(summary),
+             "Checked %llu snapshots, %llu journal records, %llu logs and %llu archives (%llu records, %.1f MB)"
+             " in %.2f s: ",
+             (unsigned long long)snapshots, (unsigned long long)journalRecords, (unsigned long long)logs,
+             (unsigned long long)archives, records, bytes / 1e6, seconds);
+    string text = summary;
+    if (problems == 0) return text + "no problems found";
+    text += to_string(problems) + (problems == 1 ? " problem, " : " problems, ") + to_string(repaired) + " repaired";
+    for (const auto& note : notes) text += "\r\n  " + note;
+    return text;
+}
+
+static void addProblem(VerifyReport& report, const string& note, bool repaired = false) {
+    report.problems++;
+    if (repaired) report.repaired++;
+    report.notes.push_back(note + (repaired ? " (repaired)" : ""));
+}
+
+static string records(long long n) {
+    return to_string(n) + (n == 1 ? " record" : " records");
+}
+
+static bool writeIndex(const string& path, const vector<TxIndexEntry>& index) {
+    string tmpPath = path + ".tmp";
+    FILE* file = fopen(tmpPath.c_str(), "wb");
+    if (!file) return false;
+    bool ok = fwrite(index.data(), sizeof(TxIndexEntry), index.size(), file) == index.size();
+    ok = syncFile(file) && ok;
+    fclose(file);
+    return ok && replaceFile(tmpPath, path);
+}
+
+// Every line must pass its checksum. A bad last line is a write the
+// process did not finish; replay skips it either way.
+static void verifyJournal(const string& path, VerifyReport& report) {
+    ifstream in(path, ios::binary);
+    if (!in) return;
+    bool checksummed = false;
+    size_t lines = 0, bad = 0, firstBad = 0;
+    string line;
+    while (getline(in, line)) {
+        lines++;
+        report.bytes += line.size() + 1;
+        if (Journal::checkLine(line, checksummed)) continue;
+        if (bad++ == 0) firstBad = lines;
+    }
+    report.journalRecords += lines;
+    if (bad == 0) return;
+    string note = path + ": line " + to_string(firstBad) + " of " + to_string(lines) + " fails its checksum";
+    if (bad > 1) note += " (" + to_string(bad) + " bad lines in all)";
+    addProblem(report, note);
+}
+
+// One account's log, then its index against what the log says it
+// should hold
+static void verifyLog(const string& dataDir, const string& username, bool repair, VerifyReport& report) {
+    string path = txLogPath(dataDir, username);
+    vector<TxIndexEntry> index;
+    long long keep = 0;         // records to keep
+    vector<string> endNotes;    // problems fixed by cutting off what follows them
+    long long damaged = 0;      // bad records before 'keep'
+    {
+        MappedFile file;
+        if (!file.open(path)) return;  // no transactions yet
+        report.logs++;
+        report.bytes += file.size();
+        unsigned int version = 0;
+        if (file.size() >= (size_t)TX_HEADER_SIZE) memcpy(&version, file.begin() + 8, 4);
+        if (file.size() < (size_t)TX_HEADER_SIZE || memcmp(file.begin(), TX_MAGIC, 8) != 0) {
+            addProblem(report, path + ": not a transaction log");
+            return;
+        }
+        if (version < 1 || version > TX_VERSION) {
+            addProblem(report, path + ": unknown version " + to_string(version));
+            return;
+        }
+        long long count = (long long)((file.size() - TX_HEADER_SIZE) / sizeof(TxRecord));
+        bool partial = (file.size() - TX_HEADER_SIZE) % sizeof(TxRecord) != 0;
+        report.records += count;
+        if (version == 1) return;  // double amounts, upgraded on the next write
+
+        // Index entries are collected for every record; the ones past a
+        // cut are dropped below
+        const char* data = file.begin() + TX_HEADER_SIZE;
+        long long bad = 0, firstBad = -1, lastGood = -1, backwards = -1;
+        long long previous = 0, totalIn = 0, totalOut = 0;
+        index.reserve((size_t)((count + TX_INDEX_INTERVAL - 1) / TX_INDEX_INTERVAL));
+        for (long long n = 0; n < count; n++) {
+            TxRecord record;
+            memcpy(&record, data + n * sizeof(TxRecord), sizeof(record));
+            if (n % TX_INDEX_INTERVAL == 0) index.push_back({record.timestamp, n, totalIn, totalOut});
+            if (record.amount > 0) totalIn += record.amount;
+            else totalOut -= record.amount;
+            if (version >= 3 && record.checksum != txRecordChecksum(record)) {
+                if (bad++ == 0) firstBad = n;
+                continue;
+            }
+            lastGood = n;
+            if (record.timestamp < previous && backwards == -1) backwards = n;
+            previous = record.timestamp;
+        }
+
+        // Bad records after the last good one are the end of a write that
+        // was cut short; any others are damage
+        keep = lastGood + 1;
+        long long badEnd = count - keep;
+        damaged = bad - badEnd;
+        if (badEnd > 0) endNotes.push_back(path + ": bad checksum on the last " + records(badEnd));
+        if (damaged > 0) {
+            addProblem(report, path + ": bad checksum on " + records(damaged) + ", the first is record "
+                                   + to_string(firstBad));
+        }
+        if (partial) endNotes.push_back(path + ": part of a record at the end");
+        if (backwards != -1) {
+            addProblem(report, path + ": timestamps go back at record " + to_string(backwards));
+        }
+    }
+
+    // (after the mapping is closed, which Windows needs before a file shrinks)
+    if (!endNotes.empty()) {
+        bool cut = repair && truncateFile(path, TX_HEADER_SIZE + (unsigned long long)keep * sizeof(TxRecord));
+        if (cut) {
+            while (!index.empty() && index.back().record >= keep) index.pop_back();
+        }
+        for (const auto& note : endNotes) addProblem(report, note, cut);
+    }
+
+    // With damaged records the expected totals are unknown, so the index
+    // is left as it is
+    if (damaged > 0) return;
+    string indexPath = txIndexPath(dataDir, username);
+    bool matches;
+    {
+        MappedFile indexFile;
+        if (!indexFile.open(indexPath)) {
+            matches = index.empty();
+        } else {
+            report.bytes += indexFile.size();
+            matches = indexFile.size() == index.size() * sizeof(TxIndexEntry)
+                      && memcmp(indexFile.begin(), index.data(), indexFile.size()) == 0;
+        }
+    }
+    if (!matches) {
+        bool fixed = repair && writeIndex(indexPath, index);
+        addProblem(report, indexPath + ": does not match its log", fixed);
+    }
+}
+
+// An account's archive: every block must unpack, pass its checksum and
+// follow on from the one before. Then the log must not still start with
+// archived records.
+static void verifyArchive(const string& dataDir, const string& username, bool repair, VerifyReport& report) {
+    string path = txArchivePath(dataDir, username);
+    long long pending = 0;
+    {
+        TxArchive archive;
+        if (!archive.open(path)) {
+            if (fileExists(path)) addProblem(report, path + ": not a transaction archive");
+            return;
+        }
+        report.archives++;
+        report.bytes += archive.wholeSize() + archive.tornBytes();
+        report.records += archive.size();
+
+        vector<TxRecord> records;
+        long long balance = 0, previous = 0, totalIn = 0, totalOut = 0;
+        size_t bad = 0, firstBad = 0;
+        for (size_t i = 0; i < archive.blockCount(); i++) {
+            const TxArchiveBlock& block = archive.block(i);
+            records.clear();
+            bool ok = archive.readBlock(i, records, true) && block.openingBalance == balance;
+            for (const auto& record : records) {
+                ok = ok && record.timestamp >= previous;
+                previous = record.timestamp;
+                if (record.amount > 0) totalIn += record.amount;
+                else totalOut -= record.amount;
+            }
+            ok = ok && !records.empty() && records.back().balance == block.closingBalance
+                 && totalIn == block.totalIn && totalOut == block.totalOut
+                 && records.front().timestamp == block.firstTimestamp;
+            // Carry on from what the header says, so one bad block is one problem
+            balance = block.closingBalance;
+            previous = block.lastTimestamp;
+            totalIn = block.totalIn;
+            totalOut = block.totalOut;
+            if (!ok && bad++ == 0) firstBad = i;
+        }
+        if (bad > 0) {
+            addProblem(report, path + ": " + to_string(bad) + (bad == 1 ? " block" : " blocks")
+                                   + " damaged, the first is block " + to_string(firstBad));
+        }
+
+        if (archive.tornBytes() > 0) {
+            long keep = archive.wholeSize();
+            archive.close();
+            bool cut = repair && truncateFile(path, (unsigned long long)keep);
+            addProblem(report, path + ": part of a block at the end", cut);
+        }
+
+        FILE* log = fopen(txLogPath(dataDir, username).c_str(), "rb");
+        if (log) {
+            fseek(log, 0, SEEK_END);
+            long long count = (ftell(log) - TX_HEADER_SIZE) / (long)sizeof(TxRecord);
+            pending = archive.blockCount() > 0 ? archivedPrefix(archive, log, count) : 0;
+            fclose(log);
+        }
+    }
+    if (pending > 0) {
+        bool fixed = repair && dropTxLogPrefix(dataDir, username, pending);
+        addProblem(report, txLogPath(dataDir, username) + ": starts with " + records(pending)
+                               + " that were already archived", fixed);
+    }
+}
+
+void verifyJournals(const string& dataDir, VerifyReport& report) {
+    verifyJournal(joinPath(dataDir, "users.wal.1"), report);
+    verifyJournal(joinPath(dataDir, "users.wal"), report);
+}
+
+void verifyAccounts(const string& dataDir, const vector<string>& usernames, bool repair, TransactionLog* log,
+                    VerifyReport& report) {
+    vector<vector<const string*>> shards(SHARD_COUNT);
+    for (const auto& username : usernames) shards[shardOf(username)].push_back(&username);
+
+    mutex reportLock;
+    runParallel(SHARD_COUNT, [&](size_t s) {
+        VerifyReport part;
+        string path = joinPath(shardDir(dataDir, (unsigned int)s), "users.snap");
+        string problem;
+        if (fileExists(path)) part.snapshots++;
+        if (!SnapshotFile::verify(path, problem)) addProblem(part, path + ": " + problem);
+        for (const string* username : shards[s]) {
+            auto check = [&] {
+                verifyLog(dataDir, *username, repair, part);
+                verifyArchive(dataDir, *username, repair, part);
+                return true;
+            };
+            if (log) log->rewrite(*username, check);
+            else check();
+        }
+
+        lock_guard<mutex> guard(reportLock);
+        report.snapshots += part.snapshots;
+        report.logs += part.logs;
+        report.archives += part.archives;
+        report.records += part.records;
+        report.bytes += part.bytes;
+        report.problems += part.problems;
+        report.repaired += part.repaired;
+        report.notes.insert(report.notes.end(), part.notes.begin(), part.notes.end());
+    });
+    sort(report.notes.begin(), report.notes.end());
+}
+
+VerifyReport verifyDataDir(const string& dataDir, const vector<string>& usernames, bool repair) {
+    auto start = chrono::steady_clock::now();
+    VerifyReport report;
+    verifyJournals(dataDir, report);
+    verifyAccounts(dataDir, usernames, repair, nullptr, report);
+    report.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return report;
+}
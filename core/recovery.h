@@ -0,0 +1,54 @@
+#ifndef ATM_RECOVERY_H
+#define ATM_RECOVERY_H
+
+#include <string>
+#include <vector>
+
+// Integrity check of a data directory: the shard snapshots, the journal
+// and the transaction log, index and archive of every account. Each
+// shard's files are mapped and checked on their own thread (see
+// runParallel), checking every CRC on the way.
+//
+// With repair set, damage that can be fixed without losing records that
+// were ever completely written is fixed:
+//  - a torn end of a transaction log (part of a record, or records at
+//    the very end that fail their checksum) is cut off
+//  - an index that does not match its log is rebuilt
+//  - a torn block at the end of an archive is cut off
+//  - records left at the start of a log after they were archived (the
+//    move was stopped half way) are cut off the log
+// Anything else (a damaged snapshot, journal line, archive block or
+// record in the middle of a log) is only reported. The bank already sets aside damaged
+// snapshots and journals as .bad files when it starts.
+struct VerifyReport {
+    size_t snapshots;            // shard snapshots checked
+    size_t journalRecords;       // journal lines checked
+    size_t logs;                 // transaction logs checked
+    size_t archives;             // archives of older records checked
+    unsigned long long records;  // log and archive records checked
+    unsigned long long bytes;    // read, over all files
+    size_t problems;
+    size_t repaired;
+    std::vector<std::string> notes;  // one per problem
+    double seconds;
+
+    VerifyReport();
+    std::string describe() const;
+};
+
+class TransactionLog;
+
+// Check the data directory of the accounts named in 'usernames'. Nothing
+// may write to it meanwhile.
+VerifyReport verifyDataDir(const std::string& dataDir, const std::vector<std::string>& usernames, bool repair);
+
+// The two parts of verifyDataDir, adding to 'report':
+//  - the journal files, which nothing may append to meanwhile
+//  - the shard snapshots and each account's log, index and archive. With
+//    'log', each account's files are checked while its log is held back
+//    (TransactionLog::rewrite), so the bank can keep running.
+void verifyJournals(const std::string& dataDir, VerifyReport& report);
+void verifyAccounts(const std::string& dataDir, const std::vector<std::string>& usernames, bool repair,
+                    TransactionLog* log, VerifyReport& report);
+
+#endif
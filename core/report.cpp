@@ -0,0 +1,338 @@
+#include "report.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+#include "account_table.h"
+#include "platform.h"
+#include "shard.h"
+#include "transaction_log.h"
+#include "tx_archive.h"
+
+using namespace std;
+
+BankReport::BankReport()
+    : from(0), to(0), accounts(0), frozenAccounts(0), records(0), logs(0), bytes(0), seconds(0) {}
+
+static string formatDay(long long day) {
+    char text[16] = "";
+    struct tm parts;
+    if (localTime(day, parts)) strftime(text, sizeof(text), "%Y-%m-%d", &parts);
+    return text;
+}
+
+static void describeTop(string& text, const char* title, const vector<ReportEntry>& entries) {
+    if (entries.empty()) return;
+    text += string("\r\n") + title + ":\r\n";
+    for (size_t i = 0; i < entries.size(); i++) {
+        text += "  " + to_string(i + 1) + ". " + entries[i].username + "  Rs" + entries[i].value.toString() + "\r\n";
+    }
+}
+
+string BankReport::describe() const {
+    char line[160];
+    string text = "Bank report, " + (from > 0 ? formatDay(from) : string("start")) + " to " + formatDay(to) + "\r\n";
+    snprintf(line, sizeof(line), "Read %zu logs (%llu records in the period, %.1f MB) in %.2f s\r\n", logs, records,
+             bytes / 1e6, seconds);
+    text += line;
+    text += "Accounts: " + to_string(accounts) + ", " + to_string(frozenAccounts) + " frozen\r\n";
+    text += "Liabilities (all balances): Rs" + liabilities.toString() + "\r\n";
+    text += "Held in frozen accounts: Rs" + frozenExposure.toString() + "\r\n";
+    text += "Deposits: Rs" + deposits.toString() + "  Withdrawals: Rs" + withdrawals.toString()
+            + "  Transfers: Rs" + transfers.toString() + "\r\n";
+
+    if (!days.empty()) {
+        snprintf(line, sizeof(line), "\r\n%-10s %9s %14s %14s %14s %16s\r\n", "Day", "Records", "Deposits",
+                 "Withdrawals", "Transfers", "Liabilities");
+        text += line;
+        for (const auto& day : days) {
+            snprintf(line, sizeof(line), "%-10s %9llu %14s %14s %14s %16s\r\n", formatDay(day.day).c_str(),
+                     day.records, day.deposits.toString().c_str(), day.withdrawals.toString().c_str(),
+                     day.transfers.toString().c_str(), day.liabilities.toString().c_str());
+            text += line;
+        }
+    }
+    describeTop(text, "Largest balances", topBalances);
+    describeTop(text, "Most money moved in the period", topFlows);
+    describeTop(text, "Largest frozen balances", topFrozen);
+    return text;
+}
+
+// Every local calendar day from the earliest to the latest one a thread
+// has seen, with its totals. Day i starts at starts[i] and ends where day
+// i + 1 starts, so finding a record's day is a division and at most a
+// step either way (days are 23 to 25 hours); the time zone is consulted
+// once per day added.
+class DayTable {
+private:
+    std::vector<long long> starts;   // one more than there are days
+    std::vector<DayTotals> totals;   // liabilities hold the change over the day
+
+    // Local midnight of the day 'shift' days after the one holding 'when'
+    static long long midnight(long long when, int shift) {
+        struct tm parts;
+        if (!localTime(when, parts)) return when - when % 86400 + shift * 86400LL;
+        parts.tm_hour = parts.tm_min = parts.tm_sec = 0;
+        parts.tm_mday += shift;
+        parts.tm_isdst = -1;
+        return (long long)mktime(&parts);
+    }
+
+public:
+    // Index of the day holding 'when', adding days as needed
+    size_t find(long long when) {
+        if (starts.empty()) {
+            starts.push_back(midnight(when, 0));
+            starts.push_back(midnight(when, 1));
+            totals.resize(1);
+        }
+        while (when < starts.front()) {
+            starts.insert(starts.begin(), midnight(starts.front() - 1, 0));
+            totals.insert(totals.begin(), DayTotals());
+        }
+        while (when >= starts.back()) {
+            starts.push_back(midnight(starts.back(), 1));
+            totals.emplace_back();
+        }
+        size_t i = min((size_t)((when - starts.front()) / 86400), totals.size() - 1);
+        while (when < starts[i]) i--;
+        while (when >= starts[i + 1]) i++;
+        return i;
+    }
+
+    long long startOf(size_t i) const { return starts[i]; }
+    long long endOf(size_t i) const { return starts[i + 1]; }
+    DayTotals& operator[](size_t i) { return totals[i]; }
+    size_t size() const { return totals.size(); }
+};
+
+// What one thread found in the logs of its shard
+struct ShardTotals {
+    DayTable days;
+    long long opening;                // balances logged before the period
+    unsigned long long records;
+    unsigned long long bytes;
+    size_t logs;
+    std::vector<TxRecord> buffer;     // the log being read
+    std::vector<TxRecord> merged;     // its archived records in the period, then it
+
+    ShardTotals() : opening(0), records(0), bytes(0), logs(0) {}
+};
+
+// Totals of n records by type, in paise. No branches, so the loop can be
+// unrolled and vectorised.
+struct RunTotals {
+    long long deposits, withdrawals, transfers, moved;
+};
+
+static RunTotals sumRecords(const TxRecord* records, size_t n) {
+    long long deposits = 0, withdrawals = 0, transfers = 0, moved = 0;
+    for (size_t i = 0; i < n; i++) {
+        long long amount = records[i].amount;
+        unsigned int type = records[i].type;
+        deposits += amount & -(long long)(type == TX_DEPOSIT);
+        withdrawals -= amount & -(long long)(type == TX_WITHDRAWAL);
+        transfers -= amount & -(long long)(type == TX_TRANSFER_OUT);
+        moved += amount < 0 ? -amount : amount;
+    }
+    return RunTotals{deposits, withdrawals, transfers, moved};
+}
+
+// First of records[first .. end) with timestamp >= when (they are in
+// time order). Steps out 1, 2, 4 ... records before the binary search,
+// as most days of one account hold only a few of its records.
+static size_t firstAtOrAfter(const TxRecord* records, size_t first, size_t end, long long when) {
+    size_t low = first, step = 1;
+    while (low + step < end && records[low + step].timestamp < when) {
+        low += step;
+        step *= 2;
+    }
+    size_t high = min(end, low + step + 1);
+    return (size_t)(lower_bound(records + low, records + high, when,
+                                [](const TxRecord& record, long long t) { return record.timestamp < t; })
+                    - records);
+}
+
+// Read a whole log into 'records' (most are a few KB, so one read beats
+// mapping them). False if there is none or it is not a log.
+static bool readLog(const string& path, vector<TxRecord>& records, unsigned long long& bytes) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) return false;
+    char header[TX_HEADER_SIZE];
+    unsigned int version = 0;
+    bool ok = fread(header, 1, TX_HEADER_SIZE, file) == (size_t)TX_HEADER_SIZE
+              && memcmp(header, TX_MAGIC, 8) == 0;
+    if (ok) memcpy(&version, header + 8, 4);
+    ok = ok && version >= 1 && version <= TX_VERSION;
+    // Read into the buffer as it is, growing it until the log ends
+    size_t count = 0;
+    records.resize(max<size_t>(64, records.capacity()));
+    while (ok) {
+        count += fread(records.data() + count, sizeof(TxRecord), records.size() - count, file);
+        if (count < records.size()) break;
+        records.resize(records.size() * 2);
+    }
+    records.resize(count);
+    if (ok) bytes += TX_HEADER_SIZE + count * sizeof(TxRecord);
+    fclose(file);
+    if (ok && version == 1) {
+        for (auto& record : records) {
+            TxRecordV1 old;
+            memcpy(&old, &record, sizeof(old));
+            record = upgradeTxRecord(old);
+        }
+    }
+    return ok;
+}
+
+// The archive blocks from the first that reaches 'from' to the last that
+// starts by 'to', then the log's records (less any it shares with the
+// archive, see TxArchive::holdsPrefix), into out.merged. 'opening' is set
+// to the balance before them. False if there is no archive.
+static bool mergeArchive(const string& path, long long from, long long to, const TxRecord* log, size_t count,
+                         ShardTotals& out, long long& opening) {
+    TxArchive archive;
+    if (!archive.open(path)) return false;
+    size_t skip = 0, moved = archive.lastMoved();
+    if (moved > 0 && count >= moved && archive.holdsPrefix(log[0], log[moved - 1])) skip = moved;
+
+    size_t block = archive.firstBlockUntil(from);
+    opening = block < archive.blockCount() ? archive.block(block).openingBalance : archive.closingBalance();
+    out.merged.clear();
+    for (; block < archive.blockCount() && archive.block(block).firstTimestamp <= to; block++) {
+        archive.readBlock(block, out.merged);
+        out.bytes += sizeof(TxArchiveBlock) + archive.block(block).size;
+    }
+    out.merged.insert(out.merged.end(), log + skip, log + count);
+    return true;
+}
+
+// One account's log and archive. 'moved' is set to the money in and out
+// of the account over the period.
+static void scanLog(const string& dataDir, const string& username, long long from, long long to,
+                    ShardTotals& out, long long& moved) {
+    moved = 0;
+    bool found = readLog(txLogPath(dataDir, username), out.buffer, out.bytes);
+    const TxRecord* records = out.buffer.data();
+    size_t count = found ? out.buffer.size() : 0;
+    long long opening = 0;
+
+    // Archived records can only be in the period if the log starts in it
+    if ((count == 0 || records[0].timestamp >= from)
+        && mergeArchive(txArchivePath(dataDir, username), from, to, records, count, out, opening)) {
+        records = out.merged.data();
+        count = out.merged.size();
+        found = true;
+    }
+    if (!found) return;  // no transactions yet
+    out.logs++;
+
+    size_t first = firstAtOrAfter(records, 0, count, from);
+    size_t end = to == LLONG_MAX ? count : firstAtOrAfter(records, first, count, to + 1);
+    long long balance = first > 0 ? records[first - 1].balance : opening;
+    out.opening += balance;
+    out.records += end - first;
+
+    // One day of records at a time
+    for (size_t i = first; i < end;) {
+        size_t d = out.days.find(records[i].timestamp);
+        size_t j = firstAtOrAfter(records, i, end, out.days.endOf(d));
+        RunTotals run = sumRecords(records + i, j - i);
+        DayTotals& day = out.days[d];
+        day.records += j - i;
+        day.deposits += Money::fromPaise(run.deposits);
+        day.withdrawals += Money::fromPaise(run.withdrawals);
+        day.transfers += Money::fromPaise(run.transfers);
+        day.liabilities += Money::fromPaise(records[j - 1].balance - balance);
+        balance = records[j - 1].balance;
+        moved += run.moved;
+        i = j;
+    }
+}
+
+// Up to 'top' ids with the largest values, largest first ('keep' picks
+// which ids may be listed)
+template <class Value, class Keep>
+static vector<ReportEntry> topAccounts(const NameArena& names, size_t n, size_t top, Value value, Keep keep) {
+    vector<int> ids;
+    for (size_t i = 0; i < n; i++) {
+        if (keep((int)i)) ids.push_back((int)i);
+    }
+    size_t shown = min(top, ids.size());
+    partial_sort(ids.begin(), ids.begin() + shown, ids.end(), [&](int a, int b) {
+        return value(a) != value(b) ? value(a) > value(b) : a < b;
+    });
+    vector<ReportEntry> entries;
+    for (size_t i = 0; i < shown; i++) entries.push_back({string(names.get(ids[i])), Money::fromPaise(value(ids[i]))});
+    return entries;
+}
+
+BankReport buildReport(const string& dataDir, const NameArena& names, const vector<Money>& balances,
+                       const vector<unsigned char>& frozen, long long from, long long to, size_t top) {
+    auto started = chrono::steady_clock::now();
+    BankReport report;
+    report.from = from;
+    report.to = to;
+    size_t n = min(balances.size(), frozen.size());
+    report.accounts = n;
+    report.frozenAccounts = countFlags(frozen);
+    report.liabilities = sumBalances(balances);
+    report.frozenExposure = sumFlagged(balances, frozen);
+
+    vector<vector<int>> shards(SHARD_COUNT);
+    for (size_t i = 0; i < n; i++) shards[shardOf(names.get(i))].push_back((int)i);
+
+    // Each id is written by one thread only
+    vector<long long> moved(n, 0);
+    ShardTotals total;
+    map<long long, DayTotals> days;   // by the local midnight they start at
+    mutex totalLock;
+    runParallel(SHARD_COUNT, [&](size_t s) {
+        ShardTotals part;
+        for (int id : shards[s]) scanLog(dataDir, string(names.get(id)), from, to, part, moved[id]);
+
+        lock_guard<mutex> guard(totalLock);
+        total.opening += part.opening;
+        total.records += part.records;
+        total.bytes += part.bytes;
+        total.logs += part.logs;
+        for (size_t d = 0; d < part.days.size(); d++) {
+            const DayTotals& found = part.days[d];
+            if (found.records == 0) continue;
+            DayTotals& day = days[part.days.startOf(d)];
+            day.day = part.days.startOf(d);
+            day.records += found.records;
+            day.deposits += found.deposits;
+            day.withdrawals += found.withdrawals;
+            day.transfers += found.transfers;
+            day.liabilities += found.liabilities;
+        }
+    });
+
+    report.records = total.records;
+    report.bytes = total.bytes;
+    report.logs = total.logs;
+    Money liabilities = Money::fromPaise(total.opening);
+    for (auto& entry : days) {
+        DayTotals day = entry.second;
+        liabilities += day.liabilities;
+        day.liabilities = liabilities;
+        report.deposits += day.deposits;
+        report.withdrawals += day.withdrawals;
+        report.transfers += day.transfers;
+        report.days.push_back(day);
+    }
+
+    auto balance = [&](int id) { return balances[id].getPaise(); };
+    report.topBalances = topAccounts(names, n, top, balance, [&](int id) { return balances[id] > Money(); });
+    report.topFrozen = topAccounts(names, n, top, balance, [&](int id) { return frozen[id] != 0; });
+    report.topFlows = topAccounts(names, n, top, [&](int id) { return moved[id]; },
+                                  [&](int id) { return moved[id] > 0; });
+
+    report.seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    return report;
+}
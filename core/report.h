@@ -0,0 +1,65 @@
+#ifndef ATM_REPORT_H
+#define ATM_REPORT_H
+
+#include <string>
+#include <vector>
+
+#include "money.h"
+#include "name_arena.h"
+
+// Bank-wide report: where the money is now (from the account table) and
+// how it moved over a period (from every account's transaction log).
+// The logs are split by shard and each shard is read on its own thread
+// (see runParallel). Within a log the records of one day are found by
+// binary search on their timestamps and summed in one branch-free loop;
+// the balance columns are summed four lanes at a time (see account_table.h).
+// Archived records (tx_archive.h) are only unpacked for the blocks that
+// reach into the period.
+
+// One local calendar day of the period
+struct DayTotals {
+    long long day;              // the local midnight it starts at
+    unsigned long long records;
+    Money deposits;
+    Money withdrawals;          // positive
+    Money transfers;            // between accounts, counted once
+    Money liabilities;          // balances logged by the end of the day, all accounts
+};
+
+// One account of a top list
+struct ReportEntry {
+    std::string username;
+    Money value;
+};
+
+struct BankReport {
+    long long from, to;             // the period
+    size_t accounts;
+    size_t frozenAccounts;
+    Money liabilities;              // all balances, as the report started
+    Money frozenExposure;           // the balances of frozen accounts
+    Money deposits, withdrawals, transfers;  // over the period
+    unsigned long long records;     // log records in the period
+    size_t logs;                    // logs read
+    unsigned long long bytes;       // of them
+    std::vector<DayTotals> days;    // days with records, oldest first
+    std::vector<ReportEntry> topBalances;
+    std::vector<ReportEntry> topFlows;   // money in plus out over the period
+    std::vector<ReportEntry> topFrozen;  // frozen accounts by balance
+    double seconds;
+
+    BankReport();
+    std::string describe() const;
+};
+
+// Report over accounts by id: their names, balances and frozen flags
+// (copies of the account table's columns), counting the log records with
+// from <= timestamp <= to. Top lists hold up to 'top' accounts. Records
+// appended to the logs meanwhile may or may not be counted.
+// The liabilities of a day are the last logged balance of every account
+// by its end, so balances set without a record (an import) only show up
+// from the account's next record on.
+BankReport buildReport(const std::string& dataDir, const NameArena& names, const std::vector<Money>& balances,
+                       const std::vector<unsigned char>& frozen, long long from, long long to, size_t top);
+
+#endif
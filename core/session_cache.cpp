@@ -0,0 +1,67 @@
+#include "session_cache.h"
+
+#include "crypto.h"
+#include "metrics.h"
+
+using namespace std;
+
+// 128 bits, so tokens cannot be guessed
+static const size_t TOKEN_BYTES = 16;
+
+SessionCache::SessionCache(size_t c) : capacity(c > 0 ? c : 1) {}
+
+string SessionCache::open(int accountId) {
+    string token = randomHex(TOKEN_BYTES);
+    lock_guard<mutex> guard(lock);
+    if (sessions.size() >= capacity) {
+        sessions.erase(recent.back());
+        recent.pop_back();
+    }
+    recent.push_front(token);
+    sessions[token] = {accountId, recent.begin()};
+    return token;
+}
+
+int SessionCache::resolve(const string& token) {
+    lock_guard<mutex> guard(lock);
+    auto it = sessions.find(token);
+    if (it == sessions.end()) {
+        ATM_COUNT(COUNT_SESSION_MISSES, 1);
+        return -1;
+    }
+    ATM_COUNT(COUNT_SESSION_HITS, 1);
+    recent.splice(recent.begin(), recent, it->second.position);
+    return it->second.accountId;
+}
+
+void SessionCache::close(const string& token) {
+    lock_guard<mutex> guard(lock);
+    auto it = sessions.find(token);
+    if (it == sessions.end()) return;
+    recent.erase(it->second.position);
+    sessions.erase(it);
+}
+
+// Only on password resets and freezes, so a scan is fine
+void SessionCache::closeAccount(int accountId) {
+    lock_guard<mutex> guard(lock);
+    for (auto it = sessions.begin(); it != sessions.end();) {
+        if (it->second.accountId == accountId) {
+            recent.erase(it->second.position);
+            it = sessions.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void SessionCache::clear() {
+    lock_guard<mutex> guard(lock);
+    sessions.clear();
+    recent.clear();
+}
+
+size_t SessionCache::size() const {
+    lock_guard<mutex> guard(lock);
+    return sessions.size();
+}
@@ -0,0 +1,43 @@
+#ifndef ATM_SESSION_CACHE_H
+#define ATM_SESSION_CACHE_H
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Bounded cache of verified logins. A successful password check opens a
+// session with a random token; later requests present the token and are
+// resolved with one hash lookup instead of another (deliberately slow)
+// password check. When the cache is full the least recently used session
+// is dropped, and all sessions of an account are dropped when its
+// password changes or it is frozen.
+class SessionCache {
+private:
+    struct Session {
+        int accountId;
+        std::list<std::string>::iterator position;  // in 'recent'
+    };
+
+    std::unordered_map<std::string, Session> sessions;
+    std::list<std::string> recent;   // tokens, most recently used first
+    size_t capacity;
+    mutable std::mutex lock;
+
+public:
+    static const size_t DEFAULT_CAPACITY = 4096;
+
+    explicit SessionCache(size_t capacity = DEFAULT_CAPACITY);
+
+    std::string open(int accountId);
+
+    // Account of a live session, -1 if the token is unknown or was dropped
+    int resolve(const std::string& token);
+
+    void close(const std::string& token);
+    void closeAccount(int accountId);
+    void clear();
+    size_t size() const;
+};
+
+#endif
@@ -0,0 +1,45 @@
+#include "shard.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "platform.h"
+
+using namespace std;
+
+unsigned int shardOf(string_view username) {
+    return crc32(username.data(), username.size()) % SHARD_COUNT;
+}
+
+string shardDir(const string& dataDir, unsigned int shard) {
+    char name[16];
+    snprintf(name, sizeof(name), "shard-%02u", shard);
+    return joinPath(dataDir, name);
+}
+
+bool makeShardDirs(const string& dataDir) {
+    bool ok = true;
+    for (unsigned int s = 0; s < SHARD_COUNT; s++) ok = makeDirectory(shardDir(dataDir, s)) && ok;
+    return ok;
+}
+
+void runParallel(size_t tasks, const function<void(size_t)>& task) {
+    size_t threads = min<size_t>(tasks, max(1u, thread::hardware_concurrency()));
+    if (threads <= 1) {
+        for (size_t i = 0; i < tasks; i++) task(i);
+        return;
+    }
+    // Threads take the next task as they finish one, so a large shard
+    // does not hold up the rest
+    atomic<size_t> next(0);
+    vector<thread> workers;
+    for (size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&] {
+            for (size_t i; (i = next.fetch_add(1)) < tasks;) task(i);
+        });
+    }
+    for (auto& worker : workers) worker.join();
+}
@@ -0,0 +1,30 @@
+#ifndef ATM_SHARD_H
+#define ATM_SHARD_H
+
+#include <functional>
+#include <string>
+#include <string_view>
+
+// The data directory is split into SHARD_COUNT shards by a hash of the
+// username. Shard s is the folder <dataDir>/shard-<s> and holds the
+// snapshot of its accounts (users.snap) and their transaction logs, so
+// loading and checkpointing can work on all shards at once and no single
+// folder collects every log file.
+// The count is part of the file layout: changing it needs an export and
+// import of the accounts (logs of moved accounts would not be found).
+const unsigned int SHARD_COUNT = 16;
+
+// Stable across runs and platforms (CRC-32 of the name)
+unsigned int shardOf(std::string_view username);
+
+// <dataDir>/shard-<s>
+std::string shardDir(const std::string& dataDir, unsigned int shard);
+
+// Create every shard folder; false if one is missing afterwards
+bool makeShardDirs(const std::string& dataDir);
+
+// Run task(0) .. task(tasks - 1) on up to one thread per core and wait
+// for all of them
+void runParallel(size_t tasks, const std::function<void(size_t)>& task);
+
+#endif
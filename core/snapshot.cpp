@@ -0,0 +1,215 @@
+#include "snapshot.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include "metrics.h"
+#include "platform.h"
+
+using namespace std;
+
+// Header and checksum of a mapped snapshot. Null if they are sound,
+// otherwise what is wrong.
+static const char* checkSnapshot(const MappedFile& file, SnapshotHeader& header) {
+    if (file.size() < sizeof(SnapshotHeader)) return "too short for a header";
+    memcpy(&header, file.begin(), sizeof(header));
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, 8) != 0) return "not a snapshot";
+    if (header.version < 1 || header.version > SNAPSHOT_VERSION) return "unknown version";
+    if (header.recordSize != sizeof(SnapshotRecord)) return "wrong record size";
+    unsigned long long limitCount = header.version >= 3 ? header.limitCount : 0;
+
+    unsigned long long body = header.count * sizeof(SnapshotRecord) + header.stringBytes
+                            + limitCount * sizeof(SnapshotLimits);
+    if (body != file.size() - sizeof(SnapshotHeader)) return "size does not match its header";
+    if (crc32(file.begin() + sizeof(SnapshotHeader), (size_t)body) != header.checksum) return "checksum mismatch";
+    return nullptr;
+}
+
+bool SnapshotFile::read(const string& path, vector<User>& out) {
+    ATM_TIME(TIME_SNAPSHOT_LOAD);
+    MappedFile file;
+    if (!file.open(path)) return false;
+    SnapshotHeader header;
+    if (checkSnapshot(file, header)) return false;
+    unsigned long long limitCount = header.version >= 3 ? header.limitCount : 0;
+
+    const char* records = file.begin() + sizeof(SnapshotHeader);
+    const char* pool = records + header.count * sizeof(SnapshotRecord);
+    size_t first = out.size();
+    out.reserve(out.size() + (size_t)header.count);
+    for (unsigned long long i = 0; i < header.count; i++) {
+        SnapshotRecord record;
+        memcpy(&record, records + i * sizeof(SnapshotRecord), sizeof(record));
+        if ((unsigned long long)record.nameOffset + record.nameLength > header.stringBytes
+            || (unsigned long long)record.passwordOffset + record.passwordLength > header.stringBytes) {
+            return false;
+        }
+        Money balance = Money::fromPaise(record.balance);
+        if (header.version == 1) {
+            double rupees;
+            memcpy(&rupees, &record.balance, sizeof(rupees));
+            balance = Money::fromRupees(rupees);
+        }
+        out.emplace_back(string(pool + record.nameOffset, record.nameLength),
+                         string(pool + record.passwordOffset, record.passwordLength),
+                         balance);
+        out.back().setFrozen(record.frozen != 0);
+    }
+
+    const char* limitRecords = pool + header.stringBytes;
+    for (unsigned long long i = 0; i < limitCount; i++) {
+        SnapshotLimits entry;
+        memcpy(&entry, limitRecords + i * sizeof(SnapshotLimits), sizeof(entry));
+        if (entry.record >= header.count) return false;
+        WithdrawalLimits limits;
+        limits.daily = Money::fromPaise(entry.daily);
+        limits.single = Money::fromPaise(entry.single);
+        limits.perHour = entry.perHour;
+        out[first + entry.record].setLimits(limits);
+    }
+    return true;
+}
+
+bool SnapshotFile::verify(const string& path, string& problem) {
+    MappedFile file;
+    if (!file.open(path)) {
+        problem = fileExists(path) ? "empty or unreadable" : "";
+        return problem.empty();
+    }
+    SnapshotHeader header;
+    const char* wrong = checkSnapshot(file, header);
+    problem = wrong ? wrong : "";
+    return !wrong;
+}
+
+// The accounts a snapshot is written from, by position: a list of Users,
+// or some of the accounts of a table
+struct UserList {
+    const vector<User>& users;
+    size_t size() const { return users.size(); }
+    string_view name(size_t i) const { return users[i].getUsername(); }
+    const string& credential(size_t i) const { return users[i].getPassword(); }
+    bool isFrozen(size_t i) const { return users[i].isFrozen(); }
+    Money balance(size_t i) const { return users[i].getBalance(); }
+    const WithdrawalLimits& limits(size_t i) const { return users[i].getLimits(); }
+};
+
+struct TableRows {
+    const AccountTable& table;
+    const vector<int>& ids;
+    size_t size() const { return ids.size(); }
+    string_view name(size_t i) const { return table.name(ids[i]); }
+    const string& credential(size_t i) const { return table.credential(ids[i]); }
+    bool isFrozen(size_t i) const { return table.isFrozen(ids[i]); }
+    Money balance(size_t i) const { return table.balance(ids[i]); }
+    const WithdrawalLimits& limits(size_t i) const { return table.getLimits(ids[i]); }
+};
+
+template <class Accounts>
+static bool writeSnapshot(const Accounts& accounts, const string& path) {
+    ATM_TIME(TIME_SNAPSHOT_WRITE);
+    string pool;
+    vector<SnapshotRecord> records(accounts.size());
+    vector<SnapshotLimits> limitRecords;
+    for (size_t i = 0; i < accounts.size(); i++) {
+        string_view name = accounts.name(i);
+        const string& password = accounts.credential(i);
+        SnapshotRecord& record = records[i];
+        memset(&record, 0, sizeof(record));
+        record.nameOffset = (unsigned int)pool.size();
+        record.nameLength = (unsigned short)name.size();
+        pool += name;
+        record.passwordOffset = (unsigned int)pool.size();
+        record.passwordLength = (unsigned short)password.size();
+        pool += password;
+        record.frozen = accounts.isFrozen(i) ? 1 : 0;
+        record.balance = accounts.balance(i).getPaise();
+
+        const WithdrawalLimits& limits = accounts.limits(i);
+        if (limits.any()) {
+            SnapshotLimits entry = {(unsigned int)i, limits.perHour, limits.daily.getPaise(), limits.single.getPaise()};
+            limitRecords.push_back(entry);
+        }
+    }
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, 8);
+    header.version = SNAPSHOT_VERSION;
+    header.recordSize = sizeof(SnapshotRecord);
+    header.count = records.size();
+    header.stringBytes = pool.size();
+    header.limitCount = (unsigned int)limitRecords.size();
+    unsigned int crc = crc32(records.data(), records.size() * sizeof(SnapshotRecord));
+    crc = crc32(pool.data(), pool.size(), crc);
+    header.checksum = crc32(limitRecords.data(), limitRecords.size() * sizeof(SnapshotLimits), crc);
+
+    string tmpPath = path + ".tmp";
+    FILE* file = fopen(tmpPath.c_str(), "wb");
+    if (!file) return false;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    if (!records.empty()) ok = fwrite(records.data(), sizeof(SnapshotRecord), records.size(), file) == records.size() && ok;
+    ok = fwrite(pool.data(), 1, pool.size(), file) == pool.size() && ok;
+    if (!limitRecords.empty()) {
+        ok = fwrite(limitRecords.data(), sizeof(SnapshotLimits), limitRecords.size(), file) == limitRecords.size() && ok;
+    }
+    ok = syncFile(file) && ok;
+    fclose(file);
+    ATM_COUNT(COUNT_SNAPSHOT_BYTES, sizeof(header) + records.size() * sizeof(SnapshotRecord) + pool.size()
+                                    + limitRecords.size() * sizeof(SnapshotLimits));
+    ATM_COUNT(COUNT_SNAPSHOT_FSYNCS, 1);
+    return ok && replaceFile(tmpPath, path);
+}
+
+bool SnapshotFile::write(const vector<User>& users, const string& path) {
+    return writeSnapshot(UserList{users}, path);
+}
+
+bool SnapshotFile::write(const AccountTable& table, const vector<int>& ids, const string& path) {
+    return writeSnapshot(TableRows{table, ids}, path);
+}
+
+bool SnapshotFile::readText(const string& path, vector<User>& out, string* problem) {
+    ifstream file(path);
+    if (!file) {
+        if (problem) *problem = "cannot be opened";
+        return false;
+    }
+    vector<User> users;
+    string line;
+    for (size_t number = 1; getline(file, line); number++) {
+        istringstream fields(line);
+        string username, password, amount, extra;
+        if (!(fields >> username)) continue;   // blank line
+        Money balance;
+        if (!(fields >> password >> amount) || (fields >> extra) || !Money::parse(amount, balance, true)) {
+            if (problem) *problem = "line " + to_string(number) + " is not \"username password balance\"";
+            return false;
+        }
+        users.emplace_back(username, password, balance);
+    }
+    out.insert(out.end(), users.begin(), users.end());
+    return true;
+}
+
+bool SnapshotFile::writeText(const vector<User>& users, const string& path) {
+    ofstream file(path);
+    if (!file) return false;
+    for (const auto& user : users) {
+        file << user.getUsername() << " " << user.getPassword()
+             << " " << user.getBalance().toString() << "\n";
+    }
+    return (bool)file;
+}
+
+bool SnapshotFile::textToSnapshot(const string& textPath, const string& snapshotPath) {
+    vector<User> users;
+    return readText(textPath, users) && write(users, snapshotPath);
+}
+
+bool SnapshotFile::snapshotToText(const string& snapshotPath, const string& textPath) {
+    vector<User> users;
+    return read(snapshotPath, users) && writeText(users, textPath);
+}
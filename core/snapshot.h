@@ -0,0 +1,79 @@
+#ifndef ATM_SNAPSHOT_H
+#define ATM_SNAPSHOT_H
+
+#include <string>
+#include <vector>
+
+#include "account_table.h"
+#include "user.h"
+
+// Binary snapshot of all accounts (users.snap):
+//   SnapshotHeader
+//   SnapshotRecord[count]
+//   string pool (usernames and passwords, not NUL-terminated)
+//   SnapshotLimits[limitCount] (version 3; only accounts that have limits)
+// The checksum is a CRC-32 of everything after the header. Loading maps
+// the file, checks it and builds the accounts straight from the records.
+struct SnapshotHeader {
+    char magic[8];
+    unsigned int version;
+    unsigned int recordSize;
+    unsigned long long count;
+    unsigned long long stringBytes;
+    unsigned int checksum;
+    unsigned int limitCount;   // version 3 (earlier versions wrote 0)
+};
+static_assert(sizeof(SnapshotHeader) == 40, "SnapshotHeader must stay 40 bytes");
+
+struct SnapshotRecord {
+    unsigned int nameOffset;
+    unsigned int passwordOffset;
+    unsigned short nameLength;
+    unsigned short passwordLength;
+    unsigned char frozen;
+    unsigned char padding[3];
+    long long balance;   // paise (version 1: double rupees)
+};
+static_assert(sizeof(SnapshotRecord) == 24, "SnapshotRecord must stay 24 bytes");
+
+// Withdrawal limits of the account in record 'record'
+struct SnapshotLimits {
+    unsigned int record;
+    unsigned int perHour;
+    long long daily;    // paise
+    long long single;   // paise
+};
+static_assert(sizeof(SnapshotLimits) == 24, "SnapshotLimits must stay 24 bytes");
+
+const char SNAPSHOT_MAGIC[8] = {'A', 'T', 'M', 'S', 'N', 'A', 'P', 0};
+const unsigned int SNAPSHOT_VERSION = 3;
+
+class SnapshotFile {
+public:
+    // Load a binary snapshot into 'out'. False if it is missing or damaged.
+    static bool read(const std::string& path, std::vector<User>& out);
+
+    // Check the header and checksum without loading the accounts. A
+    // missing file passes; otherwise 'problem' says what is wrong.
+    static bool verify(const std::string& path, std::string& problem);
+
+    // Write to a temporary file and swap it in, so the snapshot on disk is
+    // always either the old one or the complete new one
+    static bool write(const std::vector<User>& users, const std::string& path);
+
+    // The same, of the accounts 'ids' of a table (in that order)
+    static bool write(const AccountTable& table, const std::vector<int>& ids, const std::string& path);
+
+    // The original users.dat format: "username password balance" per line
+    // (it has no room for limits). Blank lines are skipped; any other line
+    // that does not parse fails the whole read, nothing is added to 'out'
+    // and 'problem' names the line.
+    static bool readText(const std::string& path, std::vector<User>& out, std::string* problem = nullptr);
+    static bool writeText(const std::vector<User>& users, const std::string& path);
+
+    // Converters between the two formats
+    static bool textToSnapshot(const std::string& textPath, const std::string& snapshotPath);
+    static bool snapshotToText(const std::string& snapshotPath, const std::string& textPath);
+};
+
+#endif
@@ -0,0 +1,688 @@
+#include "transaction_log.h"
+
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+
+#include "metrics.h"
+#include "platform.h"
+#include "shard.h"
+#include "tx_archive.h"
+
+using namespace std;
+
+TxRecord upgradeTxRecord(const TxRecordV1& old) {
+    TxRecord record;
+    record.timestamp = old.timestamp;
+    record.type = old.type;
+    record.checksum = 0;
+    record.amount = Money::fromRupees(old.amount).getPaise();
+    record.balance = Money::fromRupees(old.balance).getPaise();
+    record.checksum = txRecordChecksum(record);
+    return record;
+}
+
+unsigned int txRecordChecksum(const TxRecord& record) {
+    TxRecord copy = record;
+    copy.checksum = 0;
+    return crc32(&copy, sizeof(copy));
+}
+
+string txLogPath(const string& dataDir, const string& username) {
+    return joinPath(shardDir(dataDir, shardOf(username)), username + "_transactions.bin");
+}
+
+string txIndexPath(const string& dataDir, const string& username) {
+    return joinPath(shardDir(dataDir, shardOf(username)), username + "_transactions.idx");
+}
+
+bool adoptLegacyTxLog(const string& dataDir, const string& username) {
+    string oldPath = joinPath(dataDir, username + "_transactions.bin");
+    if (!replaceFile(oldPath, txLogPath(dataDir, username))) return false;
+    // The index is rebuilt when missing
+    replaceFile(joinPath(dataDir, username + "_transactions.idx"), txIndexPath(dataDir, username));
+    return true;
+}
+
+// ---- TransactionReader ----
+
+// The log is opened before the archive: records are added to the archive
+// before they are cut from the log, so whatever happens in between, the
+// archive holds every record missing from the start of the log
+TransactionReader::TransactionReader(const string& dataDir, const string& username)
+    : indexPath(txIndexPath(dataDir, username)), file(nullptr), count(0), version(0),
+      archived(0), skip(0), cachedBlock((size_t)-1) {
+    file = fopen(txLogPath(dataDir, username).c_str(), "rb");
+    if (!file) {
+        // Another thread may have moved the old log in first, so retry either way
+        adoptLegacyTxLog(dataDir, username);
+        file = fopen(txLogPath(dataDir, username).c_str(), "rb");
+    }
+    if (file) {
+        char header[TX_HEADER_SIZE];
+        if (fread(header, 1, TX_HEADER_SIZE, file) == (size_t)TX_HEADER_SIZE
+            && memcmp(header, TX_MAGIC, 8) == 0) {
+            memcpy(&version, header + 8, 4);
+        }
+        if (version < 1 || version > TX_VERSION) {
+            fclose(file);
+            file = nullptr;
+        }
+    }
+    if (file) {
+        fseek(file, 0, SEEK_END);
+        count = (ftell(file) - TX_HEADER_SIZE) / (long)sizeof(TxRecord);
+    }
+
+    archive.reset(new TxArchive());
+    if (!archive->open(txArchivePath(dataDir, username))) {
+        archive.reset();
+        return;
+    }
+    archived = archive->size();
+    if (file && version == TX_VERSION) skip = archivedPrefix(*archive, file, count);
+}
+
+TransactionReader::~TransactionReader() {
+    if (file) fclose(file);
+}
+
+size_t TransactionReader::readLog(long long first, size_t n, vector<TxRecord>& out) {
+    if (!file || first >= count) return 0;
+    if (first + (long long)n > count) n = (size_t)(count - first);
+    size_t old = out.size();
+    out.resize(old + n);
+    fseek(file, TX_HEADER_SIZE + (long)(first * sizeof(TxRecord)), SEEK_SET);
+    size_t got = fread(&out[old], sizeof(TxRecord), n, file);
+    out.resize(old + got);
+    if (version == 1) {
+        for (size_t i = old; i < out.size(); i++) {
+            TxRecordV1 legacy;
+            memcpy(&legacy, &out[i], sizeof(legacy));
+            out[i] = upgradeTxRecord(legacy);
+        }
+    }
+    return got;
+}
+
+// Archive blocks are unpacked whole, and pages are read a few records at
+// a time, so the last one is kept
+bool TransactionReader::loadBlock(size_t block) {
+    if (block == cachedBlock) return true;
+    cachedBlock = (size_t)-1;
+    blockRecords.clear();
+    if (!archive->readBlock(block, blockRecords)) return false;
+    cachedBlock = block;
+    return true;
+}
+
+size_t TransactionReader::read(long long first, size_t n, vector<TxRecord>& out) {
+    size_t got = 0;
+    while (got < n && first < archived) {
+        size_t block = archive->blockOf(first);
+        if (!loadBlock(block)) return got;  // unreadable (verify reports it)
+        size_t from = (size_t)(first - archive->block(block).firstRecord);
+        size_t take = min(n - got, blockRecords.size() - from);
+        out.insert(out.end(), blockRecords.begin() + from, blockRecords.begin() + from + take);
+        got += take;
+        first += take;
+    }
+    if (got < n && first >= archived) got += readLog(first - archived + skip, n - got, out);
+    return got;
+}
+
+size_t TransactionReader::readLast(size_t n, vector<TxRecord>& out) {
+    long long first = size() > (long long)n ? size() - (long long)n : 0;
+    return read(first, n, out);
+}
+
+size_t TransactionReader::readRange(long long from, long long to, size_t offset, size_t limit,
+                                    vector<TxRecord>& out) {
+    long long position = findFirstBlock(from);
+
+    size_t added = 0;
+    vector<TxRecord> block;
+    while (position < size() && added < limit) {
+        block.clear();
+        read(position, (size_t)TX_INDEX_INTERVAL, block);
+        if (block.empty()) break;
+        for (const auto& record : block) {
+            if (record.timestamp > to) return added;
+            if (record.timestamp < from) continue;
+            if (offset > 0) {
+                offset--;
+                continue;
+            }
+            out.push_back(record);
+            if (++added == limit) break;
+        }
+        position += block.size();
+    }
+    return added;
+}
+
+// Index entries number the records of the log file, so it is no use
+// while the log still starts with archived records
+bool TransactionReader::loadIndex(vector<TxIndexEntry>& index) {
+    if (skip > 0) return false;
+    FILE* indexFile = fopen(indexPath.c_str(), "rb");
+    if (!indexFile) return false;
+    fseek(indexFile, 0, SEEK_END);
+    long size = ftell(indexFile);
+    long long expected = (count + TX_INDEX_INTERVAL - 1) / TX_INDEX_INTERVAL;
+    if (size != (long)(expected * sizeof(TxIndexEntry))) {
+        fclose(indexFile);
+        return false;
+    }
+    index.resize((size_t)expected);
+    fseek(indexFile, 0, SEEK_SET);
+    size_t got = fread(index.data(), sizeof(TxIndexEntry), index.size(), indexFile);
+    fclose(indexFile);
+    return got == index.size();
+}
+
+long long TransactionReader::findFirstBlock(long long from) {
+    // Archive blocks carry their timestamps
+    if (archived > 0) {
+        size_t block = archive->firstBlockUntil(from);
+        if (block < archive->blockCount()) return archive->block(block).firstRecord;
+    }
+
+    vector<TxIndexEntry> index;
+    if (!loadIndex(index)) return archived;
+    long long entries = (long long)index.size();
+
+    long long lo = 0, hi = entries; // first entry with timestamp >= from
+    while (lo < hi) {
+        long long mid = (lo + hi) / 2;
+        if (index[(size_t)mid].timestamp < from) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == 0) return archived;
+    long long start = index[(size_t)(lo - 1)].record;
+    return archived + (start < count ? start : 0); // stale index, fall back to a scan
+}
+
+TransactionReader::Position TransactionReader::positionBefore(long long when) {
+    Position position = {0, 0, 0, 0};
+
+    // Start at the last block that begins before 'when'. Timestamps never
+    // decrease, so the records with timestamp < when end inside it.
+    size_t block = archived > 0 ? archive->firstBlockUntil(when) : 0;
+    if (archived > 0 && block < archive->blockCount()) {
+        // They end in the archive: its block headers hold the totals
+        position.records = archive->block(block).firstRecord;
+        position.balance = archive->block(block).openingBalance;
+        archive->totalsBefore(block, position.totalIn, position.totalOut);
+    } else {
+        if (archived > 0) {
+            position.records = archived;
+            position.balance = archive->closingBalance();
+            archive->totals(position.totalIn, position.totalOut);
+        }
+        vector<TxIndexEntry> index;
+        if (loadIndex(index)) {
+            size_t lo = 0, hi = index.size();
+            while (lo < hi) {
+                size_t mid = (lo + hi) / 2;
+                if (index[mid].timestamp < when) lo = mid + 1;
+                else hi = mid;
+            }
+            if (lo == 0) return position;
+            const TxIndexEntry& entry = index[lo - 1];
+            position.records += entry.record;
+            position.totalIn += entry.totalIn;
+            position.totalOut += entry.totalOut;
+        }
+        // Without an index this is a scan from the start of the log
+    }
+
+    vector<TxRecord> records;
+    for (;;) {
+        records.clear();
+        if (read(position.records, (size_t)TX_INDEX_INTERVAL, records) == 0) break;
+        for (const auto& record : records) {
+            if (record.timestamp >= when) return position;
+            position.records++;
+            if (record.amount > 0) position.totalIn += record.amount;
+            else position.totalOut -= record.amount;
+            position.balance = record.balance;
+        }
+    }
+    return position;
+}
+
+bool TransactionReader::balanceAt(long long when, Money& balance) {
+    Position position = positionBefore(when + 1);
+    if (position.records == 0) return false;
+    balance = Money::fromPaise(position.balance);
+    return true;
+}
+
+void TransactionReader::flowBetween(long long from, long long to, Money& in, Money& out) {
+    in = out = Money();
+    if (to < from) return;
+    Position start = positionBefore(from);
+    Position end = positionBefore(to + 1);
+    in = Money::fromPaise(end.totalIn - start.totalIn);
+    out = Money::fromPaise(end.totalOut - start.totalOut);
+}
+
+// ---- TransactionLog ----
+
+TransactionLog::TransactionLog(const string& dir, Durability p, size_t group, int interval)
+    : dataDir(dir), policy(p), groupSize(group), intervalMs(interval), pendingRecords(0),
+      useCounter(0), retiredCount(0), appendSequence(0), writtenSequence(0), writing(false),
+      groupWanted(false), stats() {}
+
+TransactionLog::~TransactionLog() {
+    flushAll();
+    for (auto& entry : writers) closeWriter(entry.second);
+}
+
+TransactionLog::Writer* TransactionLog::writerFor(const string& username) {
+    auto it = writers.find(username);
+    if (it == writers.end()) {
+        if (writers.size() - retiredCount >= MAX_OPEN_FILES) retireLeastRecentlyUsed();
+        Writer writer = {nullptr, nullptr, string(), string(), 0, 0, 0, 0, 0, false, false};
+        if (!openWriter(username, writer)) return nullptr;
+        it = writers.emplace(username, writer).first;
+    } else if (it->second.retired) {
+        // Wanted again before a group closed it
+        it->second.retired = false;
+        retiredCount--;
+    }
+    it->second.lastUse = ++useCounter;
+    return &it->second;
+}
+
+// Open (or create) the log, position it after the last whole record
+// and make sure the index matches it
+bool TransactionLog::openWriter(const string& username, Writer& writer) {
+    string path = txLogPath(dataDir, username);
+    FILE* file = fopen(path.c_str(), "r+b");
+    if (!file) {
+        adoptLegacyTxLog(dataDir, username);
+        file = fopen(path.c_str(), "r+b");
+    }
+    char header[TX_HEADER_SIZE];
+    if (file && (fread(header, 1, TX_HEADER_SIZE, file) != (size_t)TX_HEADER_SIZE
+                 || memcmp(header, TX_MAGIC, 8) != 0)) {
+        // Not a log we can append to; keep it aside and start over
+        fclose(file);
+        file = nullptr;
+        replaceFile(path, path + ".bad");
+    }
+    if (file) {
+        unsigned int version;
+        memcpy(&version, header + 8, 4);
+        if (version != TX_VERSION) {
+            fclose(file);
+            if (!upgradeLog(path, version)) return false;
+            file = fopen(path.c_str(), "r+b");
+            if (!file) return false;
+        }
+    }
+    if (!file) {
+        file = fopen(path.c_str(), "w+b");
+        if (!file) return false;
+        unsigned int recordSize = sizeof(TxRecord);
+        memcpy(header, TX_MAGIC, 8);
+        memcpy(header + 8, &TX_VERSION, 4);
+        memcpy(header + 12, &recordSize, 4);
+        fwrite(header, 1, TX_HEADER_SIZE, file);
+    }
+    stats.opens++;
+
+    fseek(file, 0, SEEK_END);
+    writer.records = (ftell(file) - TX_HEADER_SIZE) / (long)sizeof(TxRecord);
+    if (writer.records > 0) {
+        TxRecord last;
+        fseek(file, TX_HEADER_SIZE + (long)((writer.records - 1) * sizeof(TxRecord)), SEEK_SET);
+        if (fread(&last, sizeof(last), 1, file) == 1) writer.lastTimestamp = last.timestamp;
+    }
+    writer.file = file;
+    writer.indexFile = openIndex(username, writer);
+
+    // A torn record at the end gets overwritten by the next one
+    fseek(file, TX_HEADER_SIZE + (long)(writer.records * sizeof(TxRecord)), SEEK_SET);
+    return true;
+}
+
+// Rewrite a version 1 log (double amounts) or version 2 log (no record
+// checksums) in the current format
+bool TransactionLog::upgradeLog(const string& path, unsigned int version) {
+    if (version != 1 && version != 2) return false;
+    FILE* in = fopen(path.c_str(), "rb");
+    if (!in) return false;
+    string tmpPath = path + ".tmp";
+    FILE* out = fopen(tmpPath.c_str(), "wb");
+    if (!out) {
+        fclose(in);
+        return false;
+    }
+
+    char header[TX_HEADER_SIZE];
+    size_t got = fread(header, 1, TX_HEADER_SIZE, in);
+    memcpy(header + 8, &TX_VERSION, 4);
+    bool ok = got == (size_t)TX_HEADER_SIZE && fwrite(header, 1, TX_HEADER_SIZE, out) == (size_t)TX_HEADER_SIZE;
+    TxRecord record;
+    while (ok && fread(&record, sizeof(record), 1, in) == 1) {
+        if (version == 1) {
+            TxRecordV1 legacy;
+            memcpy(&legacy, &record, sizeof(legacy));
+            record = upgradeTxRecord(legacy);
+        }
+        record.checksum = txRecordChecksum(record);
+        ok = fwrite(&record, sizeof(record), 1, out) == 1;
+    }
+    fclose(in);
+    ok = syncFile(out) && ok;
+    fclose(out);
+    return ok && replaceFile(tmpPath, path);
+}
+
+// Add the records from 'first' to the end of the log to the running totals
+static void addTotals(FILE* log, long long first, long long records, long long& totalIn, long long& totalOut,
+                      FILE* indexFile = nullptr) {
+    TxRecord block[TX_INDEX_INTERVAL];
+    fseek(log, TX_HEADER_SIZE + (long)(first * sizeof(TxRecord)), SEEK_SET);
+    for (long long n = first; n < records;) {
+        size_t want = (size_t)min<long long>(TX_INDEX_INTERVAL, records - n);
+        size_t got = fread(block, sizeof(TxRecord), want, log);
+        if (got == 0) break;
+        for (size_t i = 0; i < got; i++, n++) {
+            if (indexFile && n % TX_INDEX_INTERVAL == 0) {
+                TxIndexEntry entry = {block[i].timestamp, n, totalIn, totalOut};
+                fwrite(&entry, sizeof(entry), 1, indexFile);
+            }
+            if (block[i].amount > 0) totalIn += block[i].amount;
+            else totalOut -= block[i].amount;
+        }
+    }
+}
+
+// The index is only a hint, so if it does not match the log (crash
+// between the two writes, or an index from before the running totals)
+// it is rebuilt from the log. Either way the writer's totals are set.
+FILE* TransactionLog::openIndex(const string& username, Writer& writer) {
+    string path = txIndexPath(dataDir, username);
+    long long records = writer.records;
+    long long expected = (records + TX_INDEX_INTERVAL - 1) / TX_INDEX_INTERVAL;
+    writer.totalIn = writer.totalOut = 0;
+    FILE* indexFile = fopen(path.c_str(), "r+b");
+    if (indexFile) {
+        fseek(indexFile, 0, SEEK_END);
+        if (ftell(indexFile) == (long)(expected * sizeof(TxIndexEntry))) {
+            // Totals at the last block, plus that block's records
+            TxIndexEntry last = {0, 0, 0, 0};
+            if (expected > 0) {
+                fseek(indexFile, (long)((expected - 1) * sizeof(TxIndexEntry)), SEEK_SET);
+                if (fread(&last, sizeof(last), 1, indexFile) != 1) last = TxIndexEntry();
+                fseek(indexFile, 0, SEEK_END);
+            }
+            writer.totalIn = last.totalIn;
+            writer.totalOut = last.totalOut;
+            addTotals(writer.file, last.record, records, writer.totalIn, writer.totalOut);
+            return indexFile;
+        }
+        fclose(indexFile);
+    }
+
+    indexFile = fopen(path.c_str(), "w+b");
+    addTotals(writer.file, 0, records, writer.totalIn, writer.totalOut, indexFile);
+    if (indexFile) fflush(indexFile);
+    return indexFile;
+}
+
+void TransactionLog::closeWriter(Writer& writer) {
+    if (writer.file) fclose(writer.file);
+    if (writer.indexFile) fclose(writer.indexFile);
+    writer.file = nullptr;
+    writer.indexFile = nullptr;
+}
+
+// A writer with nothing left to write is closed at once. One with
+// pending records is only marked, and the group that writes them closes
+// it, so appending never waits for an fsync here.
+void TransactionLog::retireLeastRecentlyUsed() {
+    auto oldest = writers.end();
+    for (auto it = writers.begin(); it != writers.end(); ++it) {
+        if (it->second.retired) continue;
+        if (oldest == writers.end() || it->second.lastUse < oldest->second.lastUse) oldest = it;
+    }
+    if (oldest == writers.end()) return;
+    if (oldest->second.pending.empty() && !oldest->second.inFlight) {
+        closeWriter(oldest->second);
+        writers.erase(oldest);
+        return;
+    }
+    oldest->second.retired = true;
+    // Keep the number of files held open for retired writers in bounds
+    if (++retiredCount >= MAX_OPEN_FILES) groupWanted = true;
+}
+
+void TransactionLog::closeRetired() {
+    for (auto it = writers.begin(); it != writers.end();) {
+        if (it->second.retired && !it->second.inFlight && it->second.pending.empty()) {
+            closeWriter(it->second);
+            it = writers.erase(it);
+            retiredCount--;
+        } else {
+            ++it;
+        }
+    }
+}
+
+// Whatever writes to or closes a writer without a group has to wait for
+// the one being written to finish
+void TransactionLog::waitForGroup(unique_lock<mutex>& guard) {
+    while (writing) groupWritten.wait(guard);
+}
+
+// Write buffered records and fsync them. Index entries go out after
+// their records and are not fsync'd (they can be rebuilt).
+static void writeRecords(FILE* file, FILE* indexFile, const string& records, const string& index,
+                         TransactionLog::Stats& stats) {
+    if (records.empty()) return;
+    ATM_TIME(TIME_TXLOG_FLUSH);
+    auto start = chrono::steady_clock::now();
+    fwrite(records.data(), 1, records.size(), file);
+    syncFile(file);
+    stats.bytes += records.size();
+    stats.flushes++;
+    stats.fsyncs++;
+    ATM_COUNT(COUNT_TXLOG_BYTES, records.size());
+    ATM_COUNT(COUNT_TXLOG_FSYNCS, 1);
+
+    if (indexFile && !index.empty()) {
+        fwrite(index.data(), 1, index.size(), indexFile);
+        fflush(indexFile);
+        stats.bytes += index.size();
+        ATM_COUNT(COUNT_TXLOG_BYTES, index.size());
+    }
+    stats.ioMicros += chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+}
+
+// Take every writer's pending records and write them with the lock let
+// go, so appends to any account carry on meanwhile. The writers stay open
+// until the group is done, and one group is written at a time, which
+// keeps each log's records in order.
+void TransactionLog::writeGroup(unique_lock<mutex>& guard) {
+    waitForGroup(guard);
+    struct Batch {
+        Writer* writer;
+        string records;
+        string index;
+    };
+    vector<Batch> group;
+    for (auto& entry : writers) {
+        Writer& writer = entry.second;
+        if (writer.pending.empty()) continue;
+        group.push_back({&writer, string(), string()});
+        group.back().records.swap(writer.pending);
+        group.back().index.swap(writer.pendingIndex);
+        writer.inFlight = true;
+    }
+    unsigned long long sequence = appendSequence;
+    pendingRecords = 0;
+    groupWanted = false;
+    writing = true;
+
+    guard.unlock();
+    Stats written = {};
+    for (const auto& batch : group) {
+        writeRecords(batch.writer->file, batch.writer->indexFile, batch.records, batch.index, written);
+    }
+    guard.lock();
+
+    for (auto& batch : group) batch.writer->inFlight = false;
+    stats.bytes += written.bytes;
+    stats.flushes += written.flushes;
+    stats.fsyncs += written.fsyncs;
+    stats.ioMicros += written.ioMicros;
+    writtenSequence = sequence;
+    writing = false;
+    closeRetired();
+    groupWritten.notify_all();
+}
+
+// Writes with the lock held; only for the rare callers that need the
+// logs settled before they go on (callers wait for any group first)
+void TransactionLog::flushAllLocked() {
+    for (auto& entry : writers) writeOut(entry.second);
+    pendingRecords = 0;
+    groupWanted = false;
+    writtenSequence = appendSequence;
+    closeRetired();
+}
+
+void TransactionLog::writeOut(Writer& writer) {
+    writeRecords(writer.file, writer.indexFile, writer.pending, writer.pendingIndex, stats);
+    writer.pending.clear();
+    writer.pendingIndex.clear();
+}
+
+void TransactionLog::setDurability(Durability p, size_t group, int interval) {
+    unique_lock<mutex> guard(lock);
+    waitForGroup(guard);
+    flushAllLocked();
+    policy = p;
+    groupSize = group > 0 ? group : 1;
+    intervalMs = interval;
+}
+
+void TransactionLog::addRecord(Writer& writer, TxType type, Money amount, Money balance) {
+    TxRecord record = {};
+    record.timestamp = (long long)time(0);
+    if (record.timestamp < writer.lastTimestamp) record.timestamp = writer.lastTimestamp; // clock went back
+    record.type = type;
+    record.amount = amount.getPaise();
+    record.balance = balance.getPaise();
+    record.checksum = txRecordChecksum(record);
+
+    if (writer.records % TX_INDEX_INTERVAL == 0) {
+        TxIndexEntry entry = {record.timestamp, writer.records, writer.totalIn, writer.totalOut};
+        writer.pendingIndex.append((const char*)&entry, sizeof(entry));
+    }
+    writer.pending.append((const char*)&record, sizeof(record));
+    writer.records++;
+    if (record.amount > 0) writer.totalIn += record.amount;
+    else writer.totalOut -= record.amount;
+    writer.lastTimestamp = record.timestamp;
+    appendSequence++;
+    stats.records++;
+    ATM_COUNT(COUNT_TX_RECORDS, 1);
+}
+
+void TransactionLog::append(const string& username, TxType type, Money amount, Money balance) {
+    lock_guard<mutex> guard(lock);
+    Writer* writer = writerFor(username);
+    if (!writer) return;
+    addRecord(*writer, type, amount, balance);
+
+    if (pendingRecords++ == 0) firstPending = chrono::steady_clock::now();
+    if (policy == GROUP_COMMIT && pendingRecords >= groupSize) groupWanted = true;
+}
+
+// Under SYNC_EVERY_RECORD every caller waits for its own records, but
+// callers arriving while a group is written share the next one
+void TransactionLog::commit() {
+    unique_lock<mutex> guard(lock);
+    if (policy == SYNC_EVERY_RECORD) {
+        unsigned long long wanted = appendSequence;
+        while (writtenSequence < wanted) {
+            if (writing) groupWritten.wait(guard);
+            else writeGroup(guard);
+        }
+        return;
+    }
+    if (groupWanted && !writing) writeGroup(guard);
+}
+
+void TransactionLog::appendBatch(const vector<Entry>& entries) {
+    unique_lock<mutex> guard(lock);
+    waitForGroup(guard);
+    for (const auto& entry : entries) {
+        Writer* writer = writerFor(entry.username);
+        if (writer) addRecord(*writer, entry.type, entry.amount, entry.balance);
+    }
+    flushAllLocked();
+}
+
+void TransactionLog::flush(const string& username) {
+    unique_lock<mutex> guard(lock);
+    waitForGroup(guard);
+    auto it = writers.find(username);
+    if (it != writers.end()) writeOut(it->second);
+}
+
+void TransactionLog::flushAll() {
+    unique_lock<mutex> guard(lock);
+    writeGroup(guard);
+}
+
+void TransactionLog::closeAll() {
+    unique_lock<mutex> guard(lock);
+    waitForGroup(guard);
+    flushAllLocked();
+    for (auto& entry : writers) closeWriter(entry.second);
+    writers.clear();
+    retiredCount = 0;
+}
+
+bool TransactionLog::rewrite(const string& username, const function<bool()>& change) {
+    unique_lock<mutex> guard(lock);
+    waitForGroup(guard);
+    auto it = writers.find(username);
+    if (it != writers.end()) {
+        writeOut(it->second);
+        closeWriter(it->second);
+        if (it->second.retired) retiredCount--;
+        writers.erase(it);
+    }
+    return change();
+}
+
+void TransactionLog::flushIfDue() {
+    unique_lock<mutex> guard(lock);
+    if (pendingRecords == 0 || writing) return;
+    auto age = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - firstPending);
+    if (age.count() >= intervalMs) writeGroup(guard);
+}
+
+TransactionLog::Stats TransactionLog::getStats() const {
+    lock_guard<mutex> guard(lock);
+    return stats;
+}
+
+string TransactionLog::describeStats() const {
+    lock_guard<mutex> guard(lock);
+    char buffer[256];
+    double seconds = stats.ioMicros / 1e6;
+    snprintf(buffer, sizeof(buffer),
+             "Log writer: %llu records, %llu batches, %llu fsyncs, %llu opens, %.0f records/s of I/O time",
+             stats.records, stats.flushes, stats.fsyncs, stats.opens,
+             seconds > 0 ? stats.records / seconds : 0.0);
+    return buffer;
+}
@@ -0,0 +1,255 @@
+#ifndef ATM_TRANSACTION_LOG_H
+#define ATM_TRANSACTION_LOG_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "money.h"
+
+// Transaction types stored in the log
+enum TxType {
+    TX_DEPOSIT = 1,
+    TX_WITHDRAWAL = 2,
+    TX_TRANSFER_IN = 3,
+    TX_TRANSFER_OUT = 4
+};
+
+// One entry of a transaction log. Fixed width, so record n lives at
+// TX_HEADER_SIZE + n * sizeof(TxRecord) and pages can be read directly.
+struct TxRecord {
+    long long timestamp;   // seconds since the epoch, never decreasing
+    unsigned int type;     // TxType
+    unsigned int checksum; // txRecordChecksum() (version 3; 0 before)
+    long long amount;      // paise, signed: withdrawals are negative
+    long long balance;     // paise, balance after the transaction
+};
+static_assert(sizeof(TxRecord) == 32, "TxRecord must stay 32 bytes");
+
+// Version 1 logs stored the amounts as double rupees
+struct TxRecordV1 {
+    long long timestamp;
+    unsigned int type;
+    unsigned int reserved;
+    double amount;
+    double balance;
+};
+static_assert(sizeof(TxRecordV1) == 32, "TxRecordV1 must stay 32 bytes");
+
+TxRecord upgradeTxRecord(const TxRecordV1& old);
+
+// CRC-32 of the record with its checksum field taken as 0
+unsigned int txRecordChecksum(const TxRecord& record);
+
+// Sparse time index: one entry for every TX_INDEX_INTERVAL-th record,
+// with the running totals of the records before it, so the balance at a
+// time or the money moved between two times needs one binary search and
+// a replay of at most one block
+struct TxIndexEntry {
+    long long timestamp;  // of record 'record'
+    long long record;
+    long long totalIn;    // paise deposited by records 0 .. record - 1
+    long long totalOut;   // paise withdrawn (positive) by the same records
+};
+static_assert(sizeof(TxIndexEntry) == 32, "TxIndexEntry must stay 32 bytes");
+
+const char TX_MAGIC[8] = {'A', 'T', 'M', 'T', 'X', 'L', 'O', 'G'};
+const unsigned int TX_VERSION = 3;  // 2: no record checksums, 1: double amounts
+const long TX_HEADER_SIZE = 16;
+const long long TX_INDEX_INTERVAL = 64;
+
+// <dataDir>/shard-<s>/<username>_transactions.bin and .idx (see shard.h)
+std::string txLogPath(const std::string& dataDir, const std::string& username);
+std::string txIndexPath(const std::string& dataDir, const std::string& username);
+
+// Move a log written before the shard folders existed (directly in the
+// data directory) into its shard. False if there was none.
+bool adoptLegacyTxLog(const std::string& dataDir, const std::string& username);
+
+class TxArchive;
+
+// Reads pages of a user's history without scanning it: the archived
+// records (tx_archive.h) followed by the binary transaction log. Records
+// are numbered from the first archived one.
+class TransactionReader {
+private:
+    std::string indexPath;
+    FILE* file;
+    long long count;      // records in the log file
+    unsigned int version;
+    std::unique_ptr<TxArchive> archive;
+    long long archived;   // records in the archive
+    long long skip;       // records at the start of the log that are archived too
+    std::vector<TxRecord> blockRecords;  // the archive block read last
+    size_t cachedBlock;
+
+    // Up to n records of the log file from its record 'first'
+    size_t readLog(long long first, size_t n, std::vector<TxRecord>& out);
+    bool loadBlock(size_t block);
+
+    // The index, if it matches the log (false for a missing, stale or
+    // older format index; the next write to the log rebuilds it)
+    bool loadIndex(std::vector<TxIndexEntry>& index);
+
+    // Start of the last indexed block whose first record is before 'from'
+    long long findFirstBlock(long long from);
+
+    // Where the records with timestamp < 'when' end
+    struct Position {
+        long long records;   // how many there are
+        long long totalIn;   // their deposits, paise
+        long long totalOut;  // their withdrawals, paise
+        long long balance;   // after the last of them (if records > 0)
+    };
+    Position positionBefore(long long when);
+
+public:
+    TransactionReader(const std::string& dataDir, const std::string& username);
+    ~TransactionReader();
+
+    bool isOpen() const { return file != nullptr || archived > 0; }
+    long long size() const { return archived + count - skip; }
+
+    // Read up to n records starting at record 'first'
+    size_t read(long long first, size_t n, std::vector<TxRecord>& out);
+
+    // The most recent n records, oldest first
+    size_t readLast(size_t n, std::vector<TxRecord>& out);
+
+    // Records with from <= timestamp <= to, skipping the first 'offset'
+    // matches and returning at most 'limit'. The index narrows the start
+    // down to one block of TX_INDEX_INTERVAL records.
+    size_t readRange(long long from, long long to, size_t offset, size_t limit,
+                     std::vector<TxRecord>& out);
+
+    // Balance after the last record with timestamp <= when; false if
+    // there is none that early
+    bool balanceAt(long long when, Money& balance);
+
+    // Deposited and withdrawn by the records with from <= timestamp <= to
+    void flowBetween(long long from, long long to, Money& in, Money& out);
+};
+
+// Writes the per-user transaction logs (<username>_transactions.bin plus
+// the sparse time index <username>_transactions.idx).
+// Instead of opening and closing the file for every record, up to
+// MAX_OPEN_FILES writers stay open (least recently used one is closed
+// first) and records are buffered in memory until the durability policy
+// says to write them out:
+//   SYNC_EVERY_RECORD - write and fsync before commit() returns
+//   GROUP_COMMIT      - once groupSize records are pending, or on the timer
+//   TIMED             - only from flushIfDue(), every intervalMs
+// append() only buffers, so callers can hold their account locks around
+// it. The write and fsync happen in commit(), called once those locks are
+// let go, and run without the log's own lock: one thread writes a group
+// while the others go on appending to the next.
+class TransactionLog {
+public:
+    enum Durability { SYNC_EVERY_RECORD, GROUP_COMMIT, TIMED };
+
+    struct Stats {
+        unsigned long long records;  // records appended
+        unsigned long long bytes;    // bytes written to disk
+        unsigned long long flushes;  // batches written
+        unsigned long long fsyncs;
+        unsigned long long opens;    // files opened
+        unsigned long long ioMicros; // time spent writing and syncing
+    };
+
+    static const size_t MAX_OPEN_FILES = 64;
+
+private:
+    struct Writer {
+        FILE* file;
+        FILE* indexFile;
+        std::string pending;       // encoded records not yet written
+        std::string pendingIndex;  // encoded index entries not yet written
+        long long records;         // records in the log, including pending ones
+        long long totalIn;         // running totals of those records (paise)
+        long long totalOut;
+        long long lastTimestamp;
+        unsigned long long lastUse;
+        bool inFlight;             // its records are being written by a group
+        bool retired;              // to be closed once its records are written
+    };
+
+    std::string dataDir;
+    std::unordered_map<std::string, Writer> writers;
+    Durability policy;
+    size_t groupSize;
+    int intervalMs;
+    size_t pendingRecords;
+    std::chrono::steady_clock::time_point firstPending;
+    unsigned long long useCounter;
+    size_t retiredCount;
+    unsigned long long appendSequence;   // records appended so far
+    unsigned long long writtenSequence;  // of those, the ones written out
+    bool writing;                        // a group is being written
+    bool groupWanted;                    // commit() should write one
+    Stats stats;
+    mutable std::mutex lock;  // one log is shared by every thread using the Bank
+    std::condition_variable groupWritten;
+
+    Writer* writerFor(const std::string& username);
+    bool openWriter(const std::string& username, Writer& writer);
+    bool upgradeLog(const std::string& path, unsigned int version);
+    FILE* openIndex(const std::string& username, Writer& writer);
+    void closeWriter(Writer& writer);
+    void retireLeastRecentlyUsed();
+    void closeRetired();
+    void waitForGroup(std::unique_lock<std::mutex>& guard);
+    void writeGroup(std::unique_lock<std::mutex>& guard);
+    void flushAllLocked();
+    void writeOut(Writer& writer);
+    void addRecord(Writer& writer, TxType type, Money amount, Money balance);
+
+public:
+    explicit TransactionLog(const std::string& dir = ".", Durability p = GROUP_COMMIT,
+                            size_t group = 32, int interval = 1000);
+    ~TransactionLog();
+
+    void setDurability(Durability p, size_t group, int interval);
+
+    struct Entry {
+        std::string username;
+        TxType type;
+        Money amount;
+        Money balance;
+    };
+
+    // Buffer a record. It is written out by a later commit() or flush.
+    void append(const std::string& username, TxType type, Money amount, Money balance);
+
+    // Write out the pending records if the policy says they are due. Call
+    // it after append() once no account lock is held: the fsync can take
+    // milliseconds and must not hold up other accounts.
+    void commit();
+
+    // Append many records and write them out together at the end (one
+    // write and fsync per file), whatever the durability policy
+    void appendBatch(const std::vector<Entry>& entries);
+
+    // Make one user's records readable on disk (before reading history)
+    void flush(const std::string& username);
+    void flushAll();
+    void flushIfDue();
+
+    // Write everything out and close every file (the next append opens
+    // them again), so the logs can be checked or repaired on disk
+    void closeAll();
+
+    // Write out and close one user's log, then run 'change' (which may
+    // rewrite its files) while nothing can be appended to it
+    bool rewrite(const std::string& username, const std::function<bool()>& change);
+
+    Stats getStats() const;
+    std::string describeStats() const;
+};
+
+#endif
@@ -0,0 +1,430 @@
+#include "tx_archive.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "platform.h"
+#include "shard.h"
+
+using namespace std;
+
+string txArchivePath(const string& dataDir, const string& username) {
+    return joinPath(shardDir(dataDir, shardOf(username)), username + "_transactions.arc");
+}
+
+// ---- Packing ----
+
+static void putVarint(string& out, unsigned long long value) {
+    while (value >= 0x80) {
+        out += (char)(value | 0x80);
+        value >>= 7;
+    }
+    out += (char)value;
+}
+
+static inline bool getVarint(const unsigned char*& p, const unsigned char* end, unsigned long long& value) {
+    if (p < end && *p < 0x80) {
+        value = *p++;
+        return true;
+    }
+    value = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        unsigned char byte = *p++;
+        value |= (unsigned long long)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+// Small negative numbers as small unsigned ones: 0, -1, 1, -2 ... -> 0, 1, 2, 3 ...
+static unsigned long long zigzag(long long value) {
+    return ((unsigned long long)value << 1) ^ (unsigned long long)(value >> 63);
+}
+
+static long long unzigzag(unsigned long long value) {
+    return (long long)(value >> 1) ^ -(long long)(value & 1);
+}
+
+static unsigned int blockChecksum(const TxArchiveBlock& header, const char* packed) {
+    TxArchiveBlock copy = header;
+    copy.checksum = 0;
+    return crc32(packed, header.size, crc32(&copy, sizeof(copy)));
+}
+
+// Per record: time since the previous one; the amount with the type in
+// bits 0-2 and bit 3 set when it is in rupees; the balance less the
+// previous balance plus the amount
+void encodeTxBlock(const TxRecord* records, size_t n, long long firstRecord, long long opening,
+                   long long totalIn, long long totalOut, unsigned int moved,
+                   TxArchiveBlock& header, string& packed) {
+    packed.clear();
+    long long time = n > 0 ? records[0].timestamp : 0;
+    long long balance = opening;
+    for (size_t i = 0; i < n; i++) {
+        const TxRecord& record = records[i];
+        if (record.amount > 0) totalIn += record.amount;
+        else totalOut -= record.amount;
+        putVarint(packed, zigzag(record.timestamp - time));
+        bool rupees = record.amount % 100 == 0;
+        unsigned long long amount = zigzag(rupees ? record.amount / 100 : record.amount);
+        putVarint(packed, amount << 4 | (rupees ? 8u : 0u) | (record.type & 7));
+        putVarint(packed, zigzag(record.balance - balance - record.amount));
+        time = record.timestamp;
+        balance = record.balance;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.firstRecord = firstRecord;
+    header.firstTimestamp = n > 0 ? records[0].timestamp : 0;
+    header.lastTimestamp = time;
+    header.openingBalance = opening;
+    header.closingBalance = balance;
+    header.totalIn = totalIn;
+    header.totalOut = totalOut;
+    header.count = (unsigned int)n;
+    header.size = (unsigned int)packed.size();
+    header.moved = moved;
+    header.firstCheck = n > 0 ? txRecordChecksum(records[0]) : 0;
+    header.lastCheck = n > 0 ? txRecordChecksum(records[n - 1]) : 0;
+    header.checksum = blockChecksum(header, packed.data());
+}
+
+bool decodeTxBlock(const TxArchiveBlock& header, const char* packed, vector<TxRecord>& out, bool check) {
+    if (check && blockChecksum(header, packed) != header.checksum) return false;
+    const unsigned char* p = (const unsigned char*)packed;
+    const unsigned char* end = p + header.size;
+    size_t old = out.size();
+    out.resize(old + header.count);
+    long long time = header.firstTimestamp;
+    long long balance = header.openingBalance;
+    for (size_t i = old; i < out.size(); i++) {
+        unsigned long long delta, amount, drift;
+        if (!getVarint(p, end, delta) || !getVarint(p, end, amount) || !getVarint(p, end, drift)) {
+            out.resize(old);
+            return false;
+        }
+        TxRecord& record = out[i];
+        record.timestamp = time + unzigzag(delta);
+        record.type = (unsigned int)(amount & 7);
+        record.amount = unzigzag(amount >> 4) * (amount & 8 ? 100 : 1);
+        record.balance = balance + record.amount + unzigzag(drift);
+        record.checksum = 0;
+        time = record.timestamp;
+        balance = record.balance;
+    }
+    return true;
+}
+
+// ---- TxArchive ----
+
+TxArchive::TxArchive() : file(nullptr), end(0), fileSize(0) {}
+
+TxArchive::~TxArchive() {
+    close();
+}
+
+void TxArchive::close() {
+    if (file) fclose(file);
+    file = nullptr;
+    blocks.clear();
+    offsets.clear();
+    head.clear();
+    end = fileSize = 0;
+}
+
+bool TxArchive::open(const string& path) {
+    close();
+    file = fopen(path.c_str(), "rb");
+    if (!file) return false;
+    head.resize(HEAD_BYTES);
+    head.resize(fread(&head[0], 1, head.size(), file));
+    unsigned int version = 0;
+    if (head.size() >= (size_t)TX_ARCHIVE_HEADER_SIZE && memcmp(head.data(), TX_ARCHIVE_MAGIC, 8) == 0) {
+        memcpy(&version, head.data() + 8, 4);
+    }
+    if (version != TX_ARCHIVE_VERSION) {
+        close();
+        return false;
+    }
+    fileSize = (long)head.size();
+    if (fileSize == HEAD_BYTES) {
+        fseek(file, 0, SEEK_END);
+        fileSize = ftell(file);
+    }
+
+    // Walk the block headers. A block must follow on from the one before
+    // and fit in the file, otherwise it (and anything after it) is the
+    // torn end of an append.
+    end = TX_ARCHIVE_HEADER_SIZE;
+    long long next = 0;
+    for (;;) {
+        TxArchiveBlock block;
+        if (end + (long)sizeof(block) <= (long)head.size()) {
+            memcpy(&block, head.data() + end, sizeof(block));
+        } else {
+            fseek(file, end, SEEK_SET);
+            if (fread(&block, sizeof(block), 1, file) != 1) break;
+        }
+        if (block.firstRecord != next || block.count == 0
+            || block.size > (unsigned long)(fileSize - end - (long)sizeof(block))) {
+            break;
+        }
+        blocks.push_back(block);
+        offsets.push_back(end);
+        end += (long)sizeof(block) + (long)block.size;
+        next += block.count;
+    }
+    return true;
+}
+
+long long TxArchive::size() const {
+    return blocks.empty() ? 0 : blocks.back().firstRecord + blocks.back().count;
+}
+
+bool TxArchive::readBlock(size_t i, vector<TxRecord>& out, bool check) const {
+    if (!file || i >= blocks.size()) return false;
+    long start = offsets[i] + (long)sizeof(TxArchiveBlock);
+    if (start + (long)blocks[i].size <= (long)head.size()) return decodeTxBlock(blocks[i], head.data() + start, out, check);
+    packed.resize(blocks[i].size);
+    fseek(file, start, SEEK_SET);
+    if (fread(&packed[0], 1, packed.size(), file) != packed.size()) return false;
+    return decodeTxBlock(blocks[i], packed.data(), out, check);
+}
+
+size_t TxArchive::blockOf(long long record) const {
+    auto it = upper_bound(blocks.begin(), blocks.end(), record,
+                          [](long long n, const TxArchiveBlock& block) { return n < block.firstRecord; });
+    return it == blocks.begin() ? 0 : (size_t)(it - blocks.begin() - 1);
+}
+
+size_t TxArchive::firstBlockUntil(long long when) const {
+    return (size_t)(lower_bound(blocks.begin(), blocks.end(), when,
+                                [](const TxArchiveBlock& block, long long t) { return block.lastTimestamp < t; })
+                    - blocks.begin());
+}
+
+void TxArchive::totalsBefore(size_t i, long long& in, long long& out) const {
+    in = i > 0 ? blocks[i - 1].totalIn : 0;
+    out = i > 0 ? blocks[i - 1].totalOut : 0;
+}
+
+bool TxArchive::holdsPrefix(const TxRecord& first, const TxRecord& last) const {
+    unsigned int moved = lastMoved();
+    if (moved == 0) return false;
+    const TxArchiveBlock& start = blocks[blockOf(size() - moved)];
+    const TxArchiveBlock& final = blocks.back();
+    return start.firstRecord == size() - moved
+           && first.timestamp == start.firstTimestamp && txRecordChecksum(first) == start.firstCheck
+           && last.timestamp == final.lastTimestamp && txRecordChecksum(last) == final.lastCheck;
+}
+
+// ---- Writing ----
+
+ArchiveReport::ArchiveReport()
+    : before(0), logs(0), archived(0), records(0), bytesBefore(0), bytesAfter(0), failed(0), seconds(0) {}
+
+string ArchiveReport::describe() const {
+    char when[16] = "";
+    struct tm parts;
+    if (localTime(before, parts)) strftime(when, sizeof(when), "%Y-%m-%d", &parts);
+    char text[256];
+    snprintf(text, sizeof(text), "Archived %llu records from before %s out of %zu of %zu logs in %.2f s",
+             records, when, archived, logs, seconds);
+    string result = text;
+    if (archived > 0) {
+        snprintf(text, sizeof(text), "\r\nThose accounts' history files: %.2f MB before, %.2f MB after (%.0f%% saved)",
+                 bytesBefore / 1e6, bytesAfter / 1e6,
+                 bytesBefore > 0 ? 100.0 * (1.0 - (double)bytesAfter / bytesBefore) : 0.0);
+        result += text;
+    }
+    if (failed > 0) result += "\r\n" + to_string(failed) + " logs could not be archived (run verify)";
+    return result;
+}
+
+static long fileLength(const string& path) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) return 0;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+bool appendTxArchive(const string& path, const TxRecord* records, size_t n) {
+    long long next, opening, totalIn, totalOut;
+    long keep;
+    {
+        TxArchive archive;
+        if (!archive.open(path)) {
+            // Not an archive: keep it aside, unless it is only a header
+            // cut short when the archive was created
+            if (fileLength(path) >= TX_ARCHIVE_HEADER_SIZE) replaceFile(path, path + ".bad");
+            remove(path.c_str());
+        }
+        next = archive.size();
+        opening = archive.closingBalance();
+        archive.totals(totalIn, totalOut);
+        keep = archive.wholeSize();
+        if (archive.tornBytes() > 0) {
+            archive.close();
+            if (!truncateFile(path, (unsigned long long)keep)) return false;
+        }
+    }
+
+    FILE* file = keep > 0 ? fopen(path.c_str(), "r+b") : fopen(path.c_str(), "wb");
+    if (!file) return false;
+    bool ok = true;
+    if (keep > 0) {
+        fseek(file, keep, SEEK_SET);
+    } else {
+        char header[TX_ARCHIVE_HEADER_SIZE];
+        unsigned int blockRecords = TX_ARCHIVE_BLOCK;
+        memcpy(header, TX_ARCHIVE_MAGIC, 8);
+        memcpy(header + 8, &TX_ARCHIVE_VERSION, 4);
+        memcpy(header + 12, &blockRecords, 4);
+        ok = fwrite(header, 1, TX_ARCHIVE_HEADER_SIZE, file) == (size_t)TX_ARCHIVE_HEADER_SIZE;
+    }
+
+    string packed;
+    for (size_t i = 0; ok && i < n; i += TX_ARCHIVE_BLOCK) {
+        size_t count = min<size_t>(TX_ARCHIVE_BLOCK, n - i);
+        TxArchiveBlock block;
+        encodeTxBlock(records + i, count, next, opening, totalIn, totalOut, (unsigned int)n, block, packed);
+        ok = fwrite(&block, sizeof(block), 1, file) == 1 && fwrite(packed.data(), 1, packed.size(), file) == packed.size();
+        next += count;
+        opening = block.closingBalance;
+        totalIn = block.totalIn;
+        totalOut = block.totalOut;
+    }
+    ok = syncFile(file) && ok;
+    fclose(file);
+    return ok;
+}
+
+long long archivedPrefix(const TxArchive& archive, FILE* log, long long count) {
+    long long moved = archive.lastMoved();
+    if (moved == 0 || count < moved) return 0;
+    TxRecord first, last;
+    fseek(log, TX_HEADER_SIZE, SEEK_SET);
+    if (fread(&first, sizeof(first), 1, log) != 1) return 0;
+    fseek(log, TX_HEADER_SIZE + (long)((moved - 1) * sizeof(TxRecord)), SEEK_SET);
+    if (fread(&last, sizeof(last), 1, log) != 1) return 0;
+    return archive.holdsPrefix(first, last) ? moved : 0;
+}
+
+bool dropTxLogPrefix(const string& dataDir, const string& username, long long records) {
+    string path = txLogPath(dataDir, username);
+    FILE* in = fopen(path.c_str(), "rb");
+    if (!in) return false;
+    string tmpPath = path + ".tmp";
+    FILE* out = fopen(tmpPath.c_str(), "wb");
+    if (!out) {
+        fclose(in);
+        return false;
+    }
+    // The index is rebuilt on the way, as it numbers the log's records
+    vector<TxIndexEntry> index;
+    long long n = 0, totalIn = 0, totalOut = 0;
+    TxRecord buffer[2048];
+    char header[TX_HEADER_SIZE];
+    bool ok = fread(header, 1, TX_HEADER_SIZE, in) == (size_t)TX_HEADER_SIZE
+              && fwrite(header, 1, TX_HEADER_SIZE, out) == (size_t)TX_HEADER_SIZE;
+    fseek(in, TX_HEADER_SIZE + (long)(records * sizeof(TxRecord)), SEEK_SET);
+    size_t got;
+    while (ok && (got = fread(buffer, sizeof(TxRecord), 2048, in)) > 0) {
+        for (size_t i = 0; i < got; i++, n++) {
+            if (n % TX_INDEX_INTERVAL == 0) index.push_back({buffer[i].timestamp, n, totalIn, totalOut});
+            if (buffer[i].amount > 0) totalIn += buffer[i].amount;
+            else totalOut -= buffer[i].amount;
+        }
+        ok = fwrite(buffer, sizeof(TxRecord), got, out) == got;
+    }
+    fclose(in);
+    ok = syncFile(out) && ok;
+    fclose(out);
+    if (!ok || !replaceFile(tmpPath, path)) {
+        remove(tmpPath.c_str());
+        return false;
+    }
+    // Not flushed to disk: like any index it is rebuilt if it is wrong
+    string indexPath = txIndexPath(dataDir, username);
+    FILE* indexFile = fopen(indexPath.c_str(), "wb");
+    if (indexFile) {
+        bool written = fwrite(index.data(), sizeof(TxIndexEntry), index.size(), indexFile) == index.size();
+        if (fclose(indexFile) != 0 || !written) remove(indexPath.c_str());
+    }
+    return true;
+}
+
+// The whole log, or false if there is none in the current format
+static bool readWholeLog(const string& path, vector<TxRecord>& records) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) return false;
+    char header[TX_HEADER_SIZE];
+    unsigned int version = 0;
+    if (fread(header, 1, TX_HEADER_SIZE, file) == (size_t)TX_HEADER_SIZE && memcmp(header, TX_MAGIC, 8) == 0) {
+        memcpy(&version, header + 8, 4);
+    }
+    if (version == TX_VERSION) {
+        fseek(file, 0, SEEK_END);
+        size_t count = (size_t)(ftell(file) - TX_HEADER_SIZE) / sizeof(TxRecord);
+        fseek(file, TX_HEADER_SIZE, SEEK_SET);
+        records.resize(count);
+        records.resize(fread(records.data(), sizeof(TxRecord), count, file));
+    }
+    fclose(file);
+    return version == TX_VERSION;
+}
+
+bool archiveTxLog(TransactionLog& log, const string& dataDir, const string& username, long long before,
+                  ArchiveReport& report) {
+    string path = txLogPath(dataDir, username);
+    string archivePath = txArchivePath(dataDir, username);
+    string indexPath = txIndexPath(dataDir, username);
+
+    // Records only ever get added to the end, so once written out the
+    // ones to move can be read and archived while others are appended
+    log.flush(username);
+    vector<TxRecord> records;
+    if (!readWholeLog(path, records)) return true;  // none, or upgraded by its next write
+    report.logs++;
+    unsigned long long bytesBefore = fileLength(path) + fileLength(indexPath) + fileLength(archivePath);
+
+    long long cut = 0;
+    {
+        TxArchive archive;
+        long long moved = archive.open(archivePath) ? archive.lastMoved() : 0;
+        if (moved > 0 && (long long)records.size() >= moved
+            && archive.holdsPrefix(records[0], records[(size_t)moved - 1])) {
+            cut = moved;  // left over from last time
+        }
+    }
+    if (cut == 0) {
+        size_t n = (size_t)(lower_bound(records.begin(), records.end(), before,
+                                        [](const TxRecord& record, long long t) { return record.timestamp < t; })
+                            - records.begin());
+        n -= n % TX_ARCHIVE_BLOCK;
+        if (n == 0) return true;
+        for (size_t i = 0; i < n; i++) {
+            if (records[i].checksum != txRecordChecksum(records[i]) || records[i].type > 7) {
+                report.failed++;
+                return false;
+            }
+        }
+        if (!appendTxArchive(archivePath, records.data(), n)) {
+            report.failed++;
+            return false;
+        }
+        report.records += n;
+        cut = (long long)n;
+    }
+
+    if (!log.rewrite(username, [&] { return dropTxLogPrefix(dataDir, username, cut); })) {
+        report.failed++;
+        return false;
+    }
+    report.archived++;
+    report.bytesBefore += bytesBefore;
+    report.bytesAfter += fileLength(path) + fileLength(indexPath) + fileLength(archivePath);
+    return true;
+}
@@ -0,0 +1,162 @@
+#ifndef ATM_TX_ARCHIVE_H
+#define ATM_TX_ARCHIVE_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "transaction_log.h"
+
+// Archive of the older records of one account's transaction log:
+// <dataDir>/shard-<s>/<username>_transactions.arc. Records are moved out
+// of the log in whole blocks of TX_ARCHIVE_BLOCK (see archiveTxLog),
+// oldest first, so the archive and what is left of the log together hold
+// the account's history in order.
+//
+// Each block is a TxArchiveBlock followed by its records packed as
+// varints: the time since the previous record, the amount (in rupees
+// when it is a whole number of them) with the type in its low bits, and
+// how far the balance is from the previous balance plus the amount
+// (nearly always 0). A record takes 4 to 8 bytes instead of 32. Blocks
+// are decoded one at a time, and their headers carry the timestamps and
+// running totals, so a range is read without decoding the blocks
+// before it.
+
+struct TxArchiveBlock {
+    long long firstRecord;      // number of its first record in the history
+    long long firstTimestamp;
+    long long lastTimestamp;
+    long long openingBalance;   // paise, before its first record
+    long long closingBalance;   // after its last record
+    long long totalIn;          // paise deposited by it and the records before it
+    long long totalOut;         // paise withdrawn (positive) by the same records
+    unsigned int count;         // records in it
+    unsigned int size;          // bytes of packed records after the header
+    unsigned int moved;         // records moved by the archiveTxLog() call that wrote it
+    unsigned int firstCheck;    // txRecordChecksum() of its first record
+    unsigned int lastCheck;     // and of its last
+    unsigned int checksum;      // CRC-32 of the header (this field as 0) and records
+};
+static_assert(sizeof(TxArchiveBlock) == 80, "TxArchiveBlock must stay 80 bytes");
+
+const char TX_ARCHIVE_MAGIC[8] = {'A', 'T', 'M', 'T', 'X', 'A', 'R', 'C'};
+const unsigned int TX_ARCHIVE_VERSION = 1;
+const long TX_ARCHIVE_HEADER_SIZE = 16;  // magic, version, records per block
+const unsigned int TX_ARCHIVE_BLOCK = 64;
+
+std::string txArchivePath(const std::string& dataDir, const std::string& username);
+
+// Pack n records into one block. The records are numbered from
+// 'firstRecord'; opening, totalIn and totalOut are those of the records
+// before them.
+void encodeTxBlock(const TxRecord* records, size_t n, long long firstRecord, long long opening,
+                   long long totalIn, long long totalOut, unsigned int moved,
+                   TxArchiveBlock& header, std::string& packed);
+
+// Unpack a block's records, appending them to 'out'. The block's
+// checksum covers them, so their own checksum fields are left 0 (as in
+// logs from before record checksums). With 'check' set the checksum is
+// checked first (like record checksums in a log, only verify and
+// archiving do). False if the block is damaged.
+bool decodeTxBlock(const TxArchiveBlock& header, const char* packed, std::vector<TxRecord>& out, bool check);
+
+// Reads an archive. Opening it reads the block headers only (most
+// archives are small enough to be read in one go with them); records are
+// unpacked a block at a time as they are asked for.
+class TxArchive {
+private:
+    FILE* file;
+    std::vector<TxArchiveBlock> blocks;
+    std::vector<long> offsets;   // of each block's header
+    long end;                    // after the last whole block
+    long fileSize;
+    std::string head;            // the start of the file (all of a small one)
+    mutable std::string packed;  // a block read from further on
+
+    static const long HEAD_BYTES = 64 * 1024;
+
+public:
+    TxArchive();
+    ~TxArchive();
+    TxArchive(const TxArchive&) = delete;
+    TxArchive& operator=(const TxArchive&) = delete;
+
+    // False if there is no archive (or it is not one). A block cut off
+    // by a crash at the end is left out.
+    bool open(const std::string& path);
+    void close();
+
+    long long size() const;                      // records
+    size_t blockCount() const { return blocks.size(); }
+    const TxArchiveBlock& block(size_t i) const { return blocks[i]; }
+
+    // Bytes after the last whole block (a torn append), and the length
+    // of the file without them
+    long tornBytes() const { return fileSize - end; }
+    long wholeSize() const { return end; }
+
+    // Append block i's records to 'out' (see decodeTxBlock)
+    bool readBlock(size_t i, std::vector<TxRecord>& out, bool check = false) const;
+
+    // The block holding record 'record' of the history
+    size_t blockOf(long long record) const;
+
+    // The first block whose last record has timestamp >= when
+    // (blockCount() if none)
+    size_t firstBlockUntil(long long when) const;
+
+    // Balance and running totals after the last archived record
+    long long closingBalance() const { return blocks.empty() ? 0 : blocks.back().closingBalance; }
+    void totals(long long& in, long long& out) const { totalsBefore(blocks.size(), in, out); }
+
+    // Running totals of the records before block i
+    void totalsBefore(size_t i, long long& in, long long& out) const;
+
+    // How many records at the start of a log are already in the archive:
+    // the records moved by the last archiveTxLog() call, if the log still
+    // starts with them (it was stopped before it could cut them off).
+    // 'first' and 'last' are the log's records 0 and lastMoved() - 1.
+    unsigned int lastMoved() const { return blocks.empty() ? 0 : blocks.back().moved; }
+    bool holdsPrefix(const TxRecord& first, const TxRecord& last) const;
+};
+
+// What archiving the logs did (see Bank::archiveLogs)
+struct ArchiveReport {
+    long long before;                 // records older than this were moved
+    size_t logs;                      // logs looked at
+    size_t archived;                  // logs that had records moved
+    unsigned long long records;       // records moved
+    unsigned long long bytesBefore;   // log, index and archive of those accounts
+    unsigned long long bytesAfter;
+    size_t failed;                    // logs that could not be archived
+    double seconds;
+
+    ArchiveReport();
+    std::string describe() const;
+};
+
+// Add records to the end of an archive (creating it), cutting off a
+// torn block first, and flush them to disk. The records must follow on
+// from the archived ones.
+bool appendTxArchive(const std::string& path, const TxRecord* records, size_t n);
+
+// Records at the start of an open log (of 'count' records) that the
+// archive already holds (see TxArchive::holdsPrefix); usually 0
+long long archivedPrefix(const TxArchive& archive, FILE* log, long long count);
+
+// Rewrite an account's log without its first 'records' records, and
+// its index to match. Nothing may write to the log meanwhile.
+bool dropTxLogPrefix(const std::string& dataDir, const std::string& username, long long records);
+
+// Move the account's records older than 'before' from its log to its
+// archive, in whole blocks, adding what was done to 'report': first the
+// blocks are appended to the archive and flushed, then the log is
+// rewritten without them (with its writer closed, see
+// TransactionLog::rewrite). If that second step does not happen, readers
+// skip the records the log and archive both hold, and the next call
+// finishes it. A log with a damaged record among the old ones is left
+// alone (verify reports it).
+bool archiveTxLog(TransactionLog& log, const std::string& dataDir, const std::string& username,
+                  long long before, ArchiveReport& report);
+
+#endif
@@ -0,0 +1,18 @@
+#include "user.h"
+
+#include <fstream>
+
+#include "platform.h"
+
+using namespace std;
+
+string User::getLegacyTransactionHistory(const string& dataDir, const string& username) {
+    ifstream logFile(joinPath(dataDir, username + "_transactions.txt"));
+    if (!logFile) return "No transactions found.";
+
+    string transactions, line;
+    while (getline(logFile, line)) {
+        transactions += line + "\r\n";
+    }
+    return transactions.empty() ? "No transactions found." : transactions;
+}
@@ -0,0 +1,53 @@
+#ifndef ATM_USER_H
+#define ATM_USER_H
+
+#include <string>
+
+#include "limits.h"
+#include "money.h"
+
+class User {
+private:
+    std::string username;
+    std::string password;
+    Money balance;
+    bool frozen;
+    WithdrawalLimits limits;
+
+public:
+    // Constructor
+    User() : frozen(false) {}
+    User(std::string u, std::string p, Money b) : username(u), password(p), balance(b), frozen(false) {}
+
+    // Getters
+    const std::string& getUsername() const { return username; }
+    const std::string& getPassword() const { return password; }
+    Money getBalance() const { return balance; }
+    bool isFrozen() const { return frozen; }
+    const WithdrawalLimits& getLimits() const { return limits; }
+
+    // Setters
+    void setPassword(const std::string& newPass) { password = newPass; }
+    void setFrozen(bool status) { frozen = status; }
+    void setBalance(Money b) { balance = b; }
+    void setLimits(const WithdrawalLimits& l) { limits = l; }
+
+    // Transaction methods (logging is done by the caller, see TransactionLog)
+    bool deposit(Money amount) {
+        if (amount <= Money() || !balance.canAdd(amount)) return false;
+        balance += amount;
+        return true;
+    }
+
+    bool withdraw(Money amount) {
+        if (amount <= Money() || amount > balance) return false;
+        balance -= amount;
+        return true;
+    }
+
+    // History written to <dataDir>/<username>_transactions.txt before the
+    // binary log format existed
+    static std::string getLegacyTransactionHistory(const std::string& dataDir, const std::string& username);
+};
+
+#endif
@@ -0,0 +1,116 @@
+#include "user_view.h"
+
+#include <algorithm>
+#include <cctype>
+
+using namespace std;
+
+static string lowerCase(string text) {
+    for (auto& c : text) c = (char)tolower((unsigned char)c);
+    return text;
+}
+
+AdminUserView::AdminUserView(const Bank& b)
+    : bank(b), seq(0), loaded(false), sortKey(BY_NAME), descending(false), frozenOnly(false) {}
+
+void AdminUserView::render(int id, const AccountRow& account) {
+    Row& row = rows[id];
+    row.username = account.username;
+    row.balance = account.balance;
+    row.balanceText = account.balance.toString();
+    row.frozen = account.frozen;
+    row.listed = account.username != "admin";
+}
+
+bool AdminUserView::matches(int id) const {
+    const Row& row = rows[id];
+    if (!row.listed || (frozenOnly && !row.frozen)) return false;
+    return filter.empty() || lowerCase(row.username).find(filter) != string::npos;
+}
+
+// Strict order over ids: the sort key, then the username, then the id,
+// so every row has exactly one place and can be found by binary search
+bool AdminUserView::before(int a, int b) const {
+    const Row& x = rows[a];
+    const Row& y = rows[b];
+    int order = 0;
+    if (sortKey == BY_BALANCE && x.balance != y.balance) {
+        order = x.balance < y.balance ? -1 : 1;
+    } else if (sortKey == BY_STATUS && x.frozen != y.frozen) {
+        order = x.frozen ? -1 : 1;
+    }
+    if (order == 0) {
+        int byName = x.username.compare(y.username);
+        order = byName != 0 ? byName : (a < b ? -1 : (a > b ? 1 : 0));
+    }
+    return descending ? order > 0 : order < 0;
+}
+
+void AdminUserView::rebuildVisible() {
+    visible.clear();
+    for (int id = 0; id < (int)rows.size(); id++) {
+        if (matches(id)) visible.push_back(id);
+    }
+    sort(visible.begin(), visible.end(), [this](int a, int b) { return before(a, b); });
+}
+
+void AdminUserView::place(int id) {
+    if (!matches(id)) return;
+    auto it = lower_bound(visible.begin(), visible.end(), id, [this](int a, int b) { return before(a, b); });
+    visible.insert(it, id);
+}
+
+// Must run before the row changes, while it still sorts where it was put
+void AdminUserView::unplace(int id) {
+    auto it = lower_bound(visible.begin(), visible.end(), id, [this](int a, int b) { return before(a, b); });
+    if (it != visible.end() && *it == id) visible.erase(it);
+}
+
+bool AdminUserView::refresh() {
+    vector<int> changed;
+    if (!bank.changesSince(seq, changed) || !loaded) {
+        vector<AccountRow> accounts;
+        bank.listAccounts(accounts);
+        rows.assign(accounts.size(), Row());
+        for (int id = 0; id < (int)accounts.size(); id++) render(id, accounts[id]);
+        rebuildVisible();
+        loaded = true;
+        return true;
+    }
+
+    AccountRow account;
+    for (int id : changed) {
+        if (!bank.getAccountRow(id, account)) continue;
+        if (id >= (int)rows.size()) {
+            rows.resize(id + 1, Row());
+        } else {
+            unplace(id);
+        }
+        render(id, account);
+        place(id);
+    }
+    return !changed.empty();
+}
+
+void AdminUserView::sortBy(SortKey key) {
+    descending = key == sortKey ? !descending : false;
+    sortKey = key;
+    sort(visible.begin(), visible.end(), [this](int a, int b) { return before(a, b); });
+}
+
+void AdminUserView::setFilter(const string& text, bool onlyFrozen) {
+    filter = lowerCase(text);
+    frozenOnly = onlyFrozen;
+    rebuildVisible();
+}
+
+string AdminUserView::page(size_t first, size_t n) const {
+    string text;
+    for (size_t i = first; i < first + n && i < visible.size(); i++) {
+        const Row& row = rows[visible[i]];
+        text += "User: " + row.username + " | Balance: Rs" + row.balanceText;
+        if (row.frozen) text += " (FROZEN)";
+        text += "\r\n";
+    }
+    return text;
+}
@@ -0,0 +1,66 @@
+#ifndef ATM_USER_VIEW_H
+#define ATM_USER_VIEW_H
+
+#include <string>
+#include <vector>
+
+#include "bank.h"
+
+// Cached, sorted and filtered account list for the admin screens.
+// refresh() asks the Bank which accounts changed since the last call and
+// only re-reads and re-renders those rows, moving them to their new place
+// in the sorted order; the whole list is rebuilt only on the first call,
+// after an import, or when more changes piled up than the Bank remembers.
+// Front ends read the visible rows by position (a virtual list or pages)
+// instead of receiving one big string.
+class AdminUserView {
+public:
+    enum SortKey { BY_NAME, BY_BALANCE, BY_STATUS };
+
+    struct Row {
+        std::string username;
+        std::string balanceText;   // rendered once per change
+        Money balance;
+        bool frozen;
+        bool listed;               // false for the admin account
+    };
+
+private:
+    const Bank& bank;
+    std::vector<Row> rows;         // by account id
+    std::vector<int> visible;      // ids passing the filter, in sort order
+    unsigned long long seq;
+    bool loaded;
+    SortKey sortKey;
+    bool descending;
+    std::string filter;            // lower case username substring
+    bool frozenOnly;
+
+    void render(int id, const AccountRow& account);
+    bool matches(int id) const;
+    bool before(int a, int b) const;
+    void rebuildVisible();
+    void place(int id);
+    void unplace(int id);
+
+public:
+    explicit AdminUserView(const Bank& b);
+
+    // Pick up account changes; returns true if anything changed
+    bool refresh();
+
+    // Sorting by the same key again flips the direction
+    void sortBy(SortKey key);
+    void setFilter(const std::string& text, bool onlyFrozen = false);
+
+    SortKey getSortKey() const { return sortKey; }
+    bool isDescending() const { return descending; }
+    size_t count() const { return visible.size(); }
+    const Row& at(size_t i) const { return rows[visible[i]]; }
+    static const char* statusText(const Row& row) { return row.frozen ? "FROZEN" : "Active"; }
+
+    // Rows [first, first + n) as text, for front ends without a list control
+    std::string page(size_t first, size_t n) const;
+};
+
+#endif
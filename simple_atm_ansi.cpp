@@ -1,19 +1,25 @@
 #include <windows.h>
 #include <commctrl.h>
+#include <commdlg.h>
 #include <string>
-#include <fstream>
 #include <vector>
-#include <sstream>
 #include <ctime>
-#include <cstdlib> // for atof
+#include <cstdlib>
+#include <mutex>
+
+#include "core/atm.h"
+#include "core/command_queue.h"
+#include "core/metrics.h"
 
 #pragma comment(lib, "comctl32.lib")
+#pragma comment(lib, "comdlg32.lib")
 
 using namespace std;
 
 // Global variables
 HWND hMainWnd, hUsername, hPassword, hDisplay, hLoginBtn, hRegisterBtn, 
-     hDepositBtn, hWithdrawBtn, hBalanceBtn, hLogoutBtn, hAmount, hAmountLabel;
+     hDepositBtn, hWithdrawBtn, hBalanceBtn, hLogoutBtn, hAmount, hAmountLabel,
+     hTransferLabel, hTransferTo, hTransferBtn;
      
 // Admin controls
 HWND hAdminUser = NULL;
@@ -25,245 +31,56 @@ HWND hAdminBackBtn = NULL;
 HWND hAdminDepositBtn = NULL;
 HWND hAdminWithdrawBtn = NULL;
 HWND hAdminViewTransBtn = NULL;
+HWND hAdminBatchBtn = NULL;
+HWND hAdminReportBtn = NULL;
+HWND hAdminVerifyBtn = NULL;
+HWND hUserFilterLabel = NULL;
+HWND hUserFilter = NULL;
+HWND hUserList = NULL;     // virtual list, rows come from userView
+HWND hLimitsLabel = NULL;
+HWND hLimitDaily = NULL;
+HWND hLimitSingle = NULL;
+HWND hLimitHourly = NULL;
+HWND hSetLimitsBtn = NULL;
 
 // Function prototypes
 void HideAllControls();
 
-class User {
-private:
+// Global account store and the session of this window
+Bank bank;
+ATM atm(bank);
+
+// Cached account listing behind the admin list. The worker refreshes it
+// through the ATM (which checks the admin's session) while the list reads
+// its rows here, so both hold userViewLock.
+AdminUserView userView(bank);
+mutex userViewLock;
+bool userListQueued = false;   // a refresh is waiting on the worker
+
+// Posted by the command worker when results are waiting
+const UINT WM_COMMAND_DONE = WM_APP + 1;
+
+// Everything that touches the disk (and so every use of 'atm') runs on
+// this worker; the window only gets the results, and never freezes
+// while a password is checked or a log is written or read
+CommandQueue commands([] { PostMessage(hMainWnd, WM_COMMAND_DONE, 0, 0); });
+typedef CommandQueue::Continuation Continuation;
+
+// The session as the last finished command left it. The window reads
+// this instead of the ATM, which belongs to the worker.
+struct SessionView {
+    bool loggedIn;
+    bool admin;
     string username;
-    string password;
-    double balance;
-    bool frozen;
-
-public:
-    // Constructor
-    User() : balance(0.0), frozen(false) {}
-    User(string u, string p, double b) : username(u), password(p), balance(b), frozen(false) {}
-
-    // Getters
-    string getUsername() const { return username; }
-    string getPassword() const { return password; }
-    double getBalance() const { return balance; }
-    bool isFrozen() const { return frozen; }
-
-    // Setters
-    void setPassword(const string& newPass) { password = newPass; }
-    void setFrozen(bool status) { frozen = status; }
-
-    // Transaction methods
-    bool deposit(double amount) {
-        if (amount <= 0) return false;
-        balance += amount;
-        logTransaction("Deposit", amount);
-        return true;
-    }
-
-    bool withdraw(double amount) {
-        if (amount <= 0 || amount > balance) return false;
-        balance -= amount;
-        logTransaction("Withdrawal", -amount);
-        return true;
-    }
-
-    void logTransaction(const string& type, double amount) {
-        time_t now = time(0);
-        char* dt = ctime(&now);
-        
-        ofstream logFile(username + "_transactions.txt", ios::app);
-        if (logFile.is_open()) {
-            logFile << "[" << dt << "] " << type << ": " << (amount >= 0 ? "+" : "") 
-                   << amount << " | Balance: " << balance << "\n";
-        }
-    }
-
-    string getTransactionHistory() const {
-        ifstream logFile(username + "_transactions.txt");
-        if (!logFile) return "No transactions found.";
-        
-        string transactions, line;
-        while (getline(logFile, line)) {
-            transactions += line + "\r\n";
-        }
-        return transactions.empty() ? "No transactions found." : transactions;
-    }
-};
-
-class ATM {
-private:
-    vector<User> users;
-    User* currentUser;
-    bool isAdmin;
-    bool isLoggedIn;
-
-public:
-    ATM() : currentUser(nullptr), isAdmin(false), isLoggedIn(false) {
-        loadUsers();
-    }
-
-    ~ATM() {
-        saveUsers();
-    }
-
-    // User management
-    bool login(const string& username, const string& password) {
-        for (auto& user : users) {
-            if (user.getUsername() == username && user.getPassword() == password) {
-                if (user.isFrozen()) {
-                    return false; // Account is frozen
-                }
-                currentUser = &user;
-                isLoggedIn = true;
-                isAdmin = (username == "admin");
-                return true;
-            }
-        }
-        return false;
-    }
-
-    void logout() {
-        currentUser = nullptr;
-        isLoggedIn = false;
-        isAdmin = false;
-    }
-
-    bool registerUser(const string& username, const string& password) {
-        if (findUser(username) != -1) return false; // User already exists
-        users.emplace_back(username, password, 0.0);
-        saveUsers();
-        return true;
-    }
-
-    // Account operations
-    bool deposit(double amount) {
-        if (!isLoggedIn || !currentUser) return false;
-        return currentUser->deposit(amount);
-    }
-
-    bool withdraw(double amount) {
-        if (!isLoggedIn || !currentUser) return false;
-        return currentUser->withdraw(amount);
-    }
-
-    string getBalance() const {
-        if (!isLoggedIn || !currentUser) return "Not logged in";
-        char buffer[100];
-        sprintf(buffer, "Current balance: Rs%.2f", currentUser->getBalance());
-        return string(buffer);
-    }
-
-    // Admin functions
-    bool resetPassword(const string& username, const string& newPassword) {
-        if (!isAdmin) return false;
-        int index = findUser(username);
-        if (index == -1) return false;
-        users[index].setPassword(newPassword);
-        saveUsers();
-        return true;
-    }
-
-    bool toggleFreezeAccount(const string& username) {
-        if (!isAdmin) return false;
-        int index = findUser(username);
-        if (index == -1) return false;
-        users[index].setFrozen(!users[index].isFrozen());
-        saveUsers();
-        return true;
-    }
-
-    string getAllUsers() const {
-        if (!isAdmin) return "Access denied";
-        string userList = "All Users:\r\n-----------\r\n";
-        for (const auto& user : users) {
-            if (user.getUsername() != "admin") {
-                userList += "User: " + user.getUsername() + " | Balance: Rs" + 
-                           to_string(user.getBalance());
-                if (user.isFrozen()) userList += " (FROZEN)";
-                userList += "\r\n";
-            }
-        }
-        return userList;
-    }
-
-    // Getters
-    bool isUserLoggedIn() const { return isLoggedIn; }
-    bool isUserAdmin() const { return isAdmin; }
-    string getCurrentUsername() const { 
-        return currentUser ? currentUser->getUsername() : ""; 
-    }
-    string getTransactionHistory() const {
-        return currentUser ? currentUser->getTransactionHistory() : "Not logged in";
-    }
-    
-    // Admin methods
-    bool adminDeposit(const string& username, double amount) {
-        if (!isAdmin) return false;
-        int index = findUser(username);
-        if (index == -1 || amount <= 0) return false;
-        
-        users[index].deposit(amount);
-        saveUsers();
-        return true;
-    }
-    
-    bool adminWithdraw(const string& username, double amount) {
-        if (!isAdmin) return false;
-        int index = findUser(username);
-        if (index == -1 || amount <= 0) return false;
-        
-        bool success = users[index].withdraw(amount);
-        if (success) saveUsers();
-        return success;
-    }
-    
-    string getUserTransactionHistory(const string& username) const {
-        if (!isAdmin) return "Access denied";
-        int index = findUser(username);
-        if (index == -1) return "User not found";
-        
-        return users[index].getTransactionHistory();
-    }
-    
-    bool isUserFrozen(const string& username) const {
-        if (!isAdmin) return false;
-        int index = findUser(username);
-        return index != -1 && users[index].isFrozen();
-    }
-
-private:
-    int findUser(const string& username) const {
-        for (int i = 0; i < users.size(); i++) {
-            if (users[i].getUsername() == username) {
-                return i;
-            }
-        }
-        return -1;
-    }
-
-    void loadUsers() {
-        ifstream file("users.dat");
-        if (!file) return;
-        
-        users.clear();
-        string username, password;
-        double balance;
-        while (file >> username >> password >> balance) {
-            User user(username, password, balance);
-            users.push_back(user);
-        }
-    }
-
-    void saveUsers() {
-        ofstream file("users.dat");
-        for (const auto& user : users) {
-            file << user.getUsername() << " " << user.getPassword() 
-                 << " " << user.getBalance() << "\n";
-        }
-    }
+    string token; // to check the session from the UI thread
 };
+SessionView session = {false, false, "", ""};
 
-// Global ATM instance
-ATM atm;
+// Run on the worker at the end of a command
+SessionView CurrentSession() {
+    SessionView now = {atm.isUserLoggedIn(), atm.isUserAdmin(), atm.getCurrentUsername(), atm.getSessionToken()};
+    return now;
+}
 
 // Function to display text in the display area
 void DisplayText(const string& text) {
@@ -289,13 +106,19 @@ void ShowLoginScreen() {
     DisplayText("Welcome to ATM\r\nPlease login or register.");
 }
 
+// The Bank ended the session (password reset or account frozen)
+void ShowSessionEnded() {
+    ShowLoginScreen();
+    DisplayText("Your session has ended.\r\nPlease login again.");
+}
+
 // Function to create admin controls
 void CreateAdminControls() {
     if (hAdminUser) return; // Already created
     
     // Create admin controls
     CreateWindow("STATIC", "Username:", WS_CHILD, 50, 50, 100, 25, hMainWnd, NULL, NULL, NULL);
-    hAdminUser = CreateWindow("EDIT", "", WS_CHILD | WS_BORDER, 150, 50, 200, 25, hMainWnd, NULL, NULL, NULL);
+    hAdminUser = CreateWindow("EDIT", "", WS_CHILD | WS_BORDER | ES_AUTOHSCROLL, 150, 50, 200, 25, hMainWnd, (HMENU)20, NULL, NULL);
     
     CreateWindow("STATIC", "Amount:", WS_CHILD, 50, 90, 100, 25, hMainWnd, NULL, NULL, NULL);
     hAdminAmount = CreateWindow("EDIT", "", WS_CHILD | WS_BORDER, 150, 90, 200, 25, hMainWnd, NULL, NULL, NULL);
@@ -309,14 +132,83 @@ void CreateAdminControls() {
     hAdminDepositBtn = CreateWindow("BUTTON", "Deposit", WS_CHILD | BS_PUSHBUTTON, 50, 210, 140, 30, hMainWnd, (HMENU)10, NULL, NULL);
     hAdminWithdrawBtn = CreateWindow("BUTTON", "Withdraw", WS_CHILD | BS_PUSHBUTTON, 200, 210, 140, 30, hMainWnd, (HMENU)11, NULL, NULL);
     
-    hAdminViewTransBtn = CreateWindow("BUTTON", "View Transactions", WS_CHILD | BS_PUSHBUTTON, 50, 250, 290, 30, hMainWnd, (HMENU)12, NULL, NULL);
+    hAdminViewTransBtn = CreateWindow("BUTTON", "View Transactions", WS_CHILD | BS_PUSHBUTTON, 50, 250, 140, 30, hMainWnd, (HMENU)12, NULL, NULL);
+    hAdminBatchBtn = CreateWindow("BUTTON", "Run Batch File...", WS_CHILD | BS_PUSHBUTTON, 200, 250, 140, 30, hMainWnd, (HMENU)14, NULL, NULL);
     
-    hAdminBackBtn = CreateWindow("BUTTON", "Back to Menu", WS_CHILD | BS_PUSHBUTTON, 50, 300, 290, 30, hMainWnd, (HMENU)13, NULL, NULL);
+    // Withdrawal limits of the user in the Username box (0 or empty = none)
+    hLimitsLabel = CreateWindow("STATIC", "Limits: per day / at once / per hour", WS_CHILD, 50, 290, 290, 20, hMainWnd, NULL, NULL, NULL);
+    hLimitDaily = CreateWindow("EDIT", "", WS_CHILD | WS_BORDER, 50, 312, 90, 25, hMainWnd, NULL, NULL, NULL);
+    hLimitSingle = CreateWindow("EDIT", "", WS_CHILD | WS_BORDER, 145, 312, 90, 25, hMainWnd, NULL, NULL, NULL);
+    hLimitHourly = CreateWindow("EDIT", "", WS_CHILD | WS_BORDER | ES_NUMBER, 240, 312, 40, 25, hMainWnd, NULL, NULL, NULL);
+    hSetLimitsBtn = CreateWindow("BUTTON", "Set", WS_CHILD | BS_PUSHBUTTON, 285, 312, 55, 25, hMainWnd, (HMENU)17, NULL, NULL);
+
+    hAdminReportBtn = CreateWindow("BUTTON", "Bank Report", WS_CHILD | BS_PUSHBUTTON, 50, 350, 95, 30, hMainWnd, (HMENU)19, NULL, NULL);
+    hAdminVerifyBtn = CreateWindow("BUTTON", "Check Data", WS_CHILD | BS_PUSHBUTTON, 150, 350, 90, 30, hMainWnd, (HMENU)21, NULL, NULL);
+    hAdminBackBtn = CreateWindow("BUTTON", "Back to Menu", WS_CHILD | BS_PUSHBUTTON, 245, 350, 95, 30, hMainWnd, (HMENU)13, NULL, NULL);
+
+    // Account list: owner-data list view, so only the rows on screen are
+    // ever asked for (LVN_GETDISPINFO) however many accounts there are
+    hUserFilterLabel = CreateWindow("STATIC", "Filter:", WS_CHILD, 370, 120, 50, 25, hMainWnd, NULL, NULL, NULL);
+    hUserFilter = CreateWindow("EDIT", "", WS_CHILD | WS_BORDER | ES_AUTOHSCROLL, 420, 120, 370, 25, hMainWnd, (HMENU)15, NULL, NULL);
+    hUserList = CreateWindowEx(0, WC_LISTVIEW, "",
+        WS_CHILD | WS_BORDER | LVS_REPORT | LVS_OWNERDATA | LVS_SINGLESEL | LVS_SHOWSELALWAYS,
+        370, 150, 420, 190, hMainWnd, (HMENU)16, NULL, NULL);
+    ListView_SetExtendedListViewStyle(hUserList, LVS_EX_FULLROWSELECT);
+
+    const char* titles[] = {"Username", "Balance (Rs)", "Status"};
+    int widths[] = {200, 120, 80};
+    for (int i = 0; i < 3; i++) {
+        LVCOLUMN column = { };
+        column.mask = LVCF_TEXT | LVCF_WIDTH | LVCF_SUBITEM;
+        column.pszText = (LPSTR)titles[i];
+        column.cx = widths[i];
+        column.iSubItem = i;
+        ListView_InsertColumn(hUserList, i, &column);
+    }
+}
+
+// Repaint the admin list from the rows userView holds now
+void ShowUserListRows() {
+    size_t count;
+    {
+        lock_guard<mutex> rows(userViewLock);
+        count = userView.count();
+    }
+    ListView_SetItemCountEx(hUserList, (int)count, LVSICF_NOSCROLL);
+    InvalidateRect(hUserList, NULL, FALSE);
+}
+
+// Bring the admin list up to date. Only accounts changed since the last
+// refresh are re-read, on the worker; the list is repainted at once if
+// redraw is set (sort or filter changed) and again if the refresh found
+// changes. A refresh refused by the ATM means the Bank ended the admin's
+// session, which logs the window out like any other admin command.
+void RefreshUserList(bool redraw = true) {
+    if (!hUserList || !session.admin) return;
+    if (redraw) ShowUserListRows();
+    if (userListQueued) return;
+    userListQueued = true;
+    commands.submit("list", []() -> Continuation {
+        bool changed;
+        {
+            lock_guard<mutex> rows(userViewLock);
+            changed = atm.refreshUserView(userView);
+        }
+        SessionView now = CurrentSession();
+        return [changed, now] {
+            userListQueued = false;
+            // Not if the admin logged out meanwhile (already shown)
+            bool ended = session.admin && !now.loggedIn;
+            session = now;
+            if (ended) ShowSessionEnded();
+            else if (now.admin && changed) ShowUserListRows();
+        };
+    });
 }
 
 // Function to show admin menu
 void ShowAdminMenu() {
-    if (!atm.isUserAdmin()) return;
+    if (!session.admin) return;
     
     // First hide all controls
     HideAllControls();
@@ -333,16 +225,34 @@ void ShowAdminMenu() {
     ShowWindow(hAdminDepositBtn, SW_SHOW);
     ShowWindow(hAdminWithdrawBtn, SW_SHOW);
     ShowWindow(hAdminViewTransBtn, SW_SHOW);
+    ShowWindow(hAdminBatchBtn, SW_SHOW);
+    ShowWindow(hAdminReportBtn, SW_SHOW);
+    ShowWindow(hAdminVerifyBtn, SW_SHOW);
     ShowWindow(hAdminBackBtn, SW_SHOW);
+    ShowWindow(hLimitsLabel, SW_SHOW);
+    ShowWindow(hLimitDaily, SW_SHOW);
+    ShowWindow(hLimitSingle, SW_SHOW);
+    ShowWindow(hLimitHourly, SW_SHOW);
+    ShowWindow(hSetLimitsBtn, SW_SHOW);
+    ShowWindow(hUserFilterLabel, SW_SHOW);
+    ShowWindow(hUserFilter, SW_SHOW);
+    ShowWindow(hUserList, SW_SHOW);
+
+    // Messages share the right-hand side with the account list
+    MoveWindow(hDisplay, 370, 50, 420, 60, TRUE);
     
     // Clear input fields
     SetWindowText(hAdminUser, "");
     SetWindowText(hAdminAmount, "");
     SetWindowText(hAdminNewPass, "");
     
+    SetWindowText(hUserFilter, "");
+    
     // Display user list
+    RefreshUserList();
     string adminText = "=== ADMIN MENU ===\r\n";
-    adminText += atm.getAllUsers();
+    adminText += "Click a column to sort, a row to pick the user.\r\n";
+    adminText += bank.getTransactionLog().describeStats();
     
     DisplayText(adminText);
 }
@@ -361,6 +271,9 @@ void HideAllControls() {
     ShowWindow(hDepositBtn, SW_HIDE);
     ShowWindow(hWithdrawBtn, SW_HIDE);
     ShowWindow(hBalanceBtn, SW_HIDE);
+    ShowWindow(hTransferLabel, SW_HIDE);
+    ShowWindow(hTransferTo, SW_HIDE);
+    ShowWindow(hTransferBtn, SW_HIDE);
     ShowWindow(hLogoutBtn, SW_HIDE);
     
     // Admin controls - only hide if they exist
@@ -373,29 +286,42 @@ void HideAllControls() {
         ShowWindow(hAdminDepositBtn, SW_HIDE);
         ShowWindow(hAdminWithdrawBtn, SW_HIDE);
         ShowWindow(hAdminViewTransBtn, SW_HIDE);
+        ShowWindow(hAdminBatchBtn, SW_HIDE);
+        ShowWindow(hAdminReportBtn, SW_HIDE);
+        ShowWindow(hAdminVerifyBtn, SW_HIDE);
         ShowWindow(hAdminBackBtn, SW_HIDE);
+        ShowWindow(hLimitsLabel, SW_HIDE);
+        ShowWindow(hLimitDaily, SW_HIDE);
+        ShowWindow(hLimitSingle, SW_HIDE);
+        ShowWindow(hLimitHourly, SW_HIDE);
+        ShowWindow(hSetLimitsBtn, SW_HIDE);
+        ShowWindow(hUserFilterLabel, SW_HIDE);
+        ShowWindow(hUserFilter, SW_HIDE);
+        ShowWindow(hUserList, SW_HIDE);
+        MoveWindow(hDisplay, 370, 50, 420, 250, TRUE);
     }
 }
 
-// Function to show main menu
-void ShowMainMenu(bool fromAdminMenu = false) {
+// Function to show main menu (balanceText as read by the login command)
+void ShowMainMenu(bool fromAdminMenu = false, const string& balanceText = "") {
     // First hide all controls
     HideAllControls();
     
     // Show appropriate controls based on user type
-    if (atm.isUserAdmin() && !fromAdminMenu) {
+    if (session.admin && !fromAdminMenu) {
         // Show admin menu if user is admin and not coming from admin menu
         ShowAdminMenu();
     } else {
         // Show regular user menu or admin's main menu
-        if (atm.isUserAdmin()) {
+        if (session.admin) {
             // For admin, show admin-specific main menu
             string adminMenu = "=== ADMIN MAIN MENU ===\r\n";
             adminMenu += "1. Deposit\r\n";
             adminMenu += "2. Withdraw\r\n";
             adminMenu += "3. Check Balance\r\n";
             adminMenu += "4. Admin Panel\r\n";
-            adminMenu += "5. Logout\r\n";
+            adminMenu += "5. Logout\r\n\r\n";
+            adminMenu += commands.describeStats();
             DisplayText(adminMenu);
         } else {
             // For regular users
@@ -404,9 +330,12 @@ void ShowMainMenu(bool fromAdminMenu = false) {
             ShowWindow(hDepositBtn, SW_SHOW);
             ShowWindow(hWithdrawBtn, SW_SHOW);
             ShowWindow(hBalanceBtn, SW_SHOW);
+            ShowWindow(hTransferLabel, SW_SHOW);
+            ShowWindow(hTransferTo, SW_SHOW);
+            ShowWindow(hTransferBtn, SW_SHOW);
             
-            string welcome = "Welcome, " + atm.getCurrentUsername() + "!\r\n"
-                          + atm.getBalance() + "\r\n"
+            string welcome = "Welcome, " + session.username + "!\r\n"
+                          + balanceText + "\r\n"
                           + "Please select an option.";
             DisplayText(welcome);
         }
@@ -416,6 +345,25 @@ void ShowMainMenu(bool fromAdminMenu = false) {
     }
 }
 
+// End of an admin command: show its message, refresh the list if it
+// changed an account, and leave if the admin's own session was ended
+void FinishAdminCommand(const SessionView& now, const string& message, bool accountsChanged) {
+    session = now;
+    if (!now.loggedIn) {
+        ShowSessionEnded();
+        return;
+    }
+    if (!message.empty()) DisplayText(message);
+    if (accountsChanged) RefreshUserList();
+}
+
+// Put an account's withdrawal limits in the limit boxes
+void ShowLimits(const WithdrawalLimits& limits) {
+    SetWindowText(hLimitDaily, limits.daily > Money() ? limits.daily.toString().c_str() : "");
+    SetWindowText(hLimitSingle, limits.single > Money() ? limits.single.toString().c_str() : "");
+    SetWindowText(hLimitHourly, limits.perHour > 0 ? to_string(limits.perHour).c_str() : "");
+}
+
 // Window procedure
 LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
     switch(msg) {
@@ -465,16 +413,89 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
                 WS_CHILD | BS_PUSHBUTTON,
                 50, 190, 220, 30, hwnd, (HMENU)5, NULL, NULL);
                 
+            hTransferLabel = CreateWindow("STATIC", "To user:",
+                WS_CHILD,
+                50, 240, 100, 25, hwnd, NULL, NULL, NULL);
+
+            hTransferTo = CreateWindow("EDIT", "",
+                WS_CHILD | WS_BORDER | ES_AUTOHSCROLL,
+                150, 240, 200, 25, hwnd, NULL, NULL, NULL);
+
+            hTransferBtn = CreateWindow("BUTTON", "Transfer Amount",
+                WS_CHILD | BS_PUSHBUTTON,
+                50, 280, 220, 30, hwnd, (HMENU)18, NULL, NULL);
+
             hLogoutBtn = CreateWindow("BUTTON", "Logout", 
                 WS_CHILD | BS_PUSHBUTTON,
-                50, 240, 220, 30, hwnd, (HMENU)6, NULL, NULL);
+                50, 330, 220, 30, hwnd, (HMENU)6, NULL, NULL);
                 
             hDisplay = CreateWindow("EDIT", "", 
                 WS_VISIBLE | WS_CHILD | WS_BORDER | ES_MULTILINE | ES_READONLY | WS_VSCROLL | ES_AUTOVSCROLL,
-                370, 50, 200, 250, hwnd, NULL, NULL, NULL);
+                370, 50, 420, 250, hwnd, NULL, NULL, NULL);
             
             // Show login screen
             ShowLoginScreen();
+
+            // Damage found while loading (nothing more is read); checking
+            // every file is the admin's "Check Data" button
+            string problems = bank.describeStartupProblems();
+            if (!problems.empty()) DisplayText("Data check:\r\n" + problems);
+
+            // Housekeeping timer (journal and transaction log group commit)
+            SetTimer(hwnd, 1, 1000, NULL);
+            break;
+        }
+
+        case WM_TIMER:
+            // Group commit deadlines; skipped while commands are queued,
+            // they reach the disk anyway
+            if (commands.pending() == 0) {
+                commands.submit("tick", [] { atm.tick(); return Continuation(); });
+            }
+
+            // Pick up changes made by other terminals or threads
+            if (hUserList && IsWindowVisible(hUserList)) RefreshUserList(false);
+            break;
+
+        case WM_NOTIFY: {
+            NMHDR* header = (NMHDR*)lParam;
+            if (!hUserList || header->hwndFrom != hUserList) break;
+
+            if (header->code == LVN_GETDISPINFO) { // List asks for the text of a visible row
+                NMLVDISPINFO* info = (NMLVDISPINFO*)lParam;
+                lock_guard<mutex> rows(userViewLock);
+                if ((info->item.mask & LVIF_TEXT) && info->item.iItem < (int)userView.count()) {
+                    const AdminUserView::Row& row = userView.at(info->item.iItem);
+                    const char* text = info->item.iSubItem == 0 ? row.username.c_str()
+                                     : info->item.iSubItem == 1 ? row.balanceText.c_str()
+                                     : AdminUserView::statusText(row);
+                    lstrcpyn(info->item.pszText, text, info->item.cchTextMax);
+                }
+            } else if (header->code == LVN_COLUMNCLICK) { // Sort, again to reverse
+                NMLISTVIEW* click = (NMLISTVIEW*)lParam;
+                {
+                    lock_guard<mutex> rows(userViewLock);
+                    userView.sortBy(click->iSubItem == 1 ? AdminUserView::BY_BALANCE
+                                  : click->iSubItem == 2 ? AdminUserView::BY_STATUS
+                                  : AdminUserView::BY_NAME);
+                }
+                RefreshUserList();
+            } else if (header->code == LVN_ITEMCHANGED) { // Selected row fills in the username and limits
+                NMLISTVIEW* change = (NMLISTVIEW*)lParam;
+                string user;
+                if ((change->uNewState & LVIS_SELECTED) && change->iItem >= 0) {
+                    lock_guard<mutex> rows(userViewLock);
+                    if (change->iItem < (int)userView.count()) user = userView.at(change->iItem).username;
+                }
+                if (!user.empty()) {
+                    SetWindowText(hAdminUser, user.c_str());
+                    commands.submit("limits", [user]() -> Continuation {
+                        WithdrawalLimits limits;
+                        if (!atm.getUserLimits(user, limits)) return nullptr;
+                        return [limits] { ShowLimits(limits); };
+                    });
+                }
+            }
             break;
         }
         
@@ -483,181 +504,355 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
                 char username[100], password[100];
                 GetWindowText(hUsername, username, 100);
                 GetWindowText(hPassword, password, 100);
-                
+
                 if (strlen(username) == 0 || strlen(password) == 0) {
                     DisplayText("Error: Please enter both username and password.");
                     break;
                 }
-                
-                if (atm.login(username, password)) {
-                    DisplayText("Welcome, " + string(username) + "!");
-                    ShowMainMenu();
-                } else {
-                    DisplayText("Error: Invalid username or password, or account is frozen.");
-                }
+
+                DisplayText("Checking password...");
+                string user(username), pass(password);
+                commands.submit("login", [user, pass]() -> Continuation {
+                    bool ok = atm.login(user, pass);
+                    SessionView now = CurrentSession();
+                    string balance = atm.getBalance();
+                    return [ok, now, user, balance] {
+                        session = now;
+                        if (ok) {
+                            DisplayText("Welcome, " + user + "!");
+                            ShowMainMenu(false, balance);
+                        } else {
+                            DisplayText("Error: Invalid username or password, or account is frozen.");
+                        }
+                    };
+                });
                 break;
             }
-            
+
             else if (LOWORD(wParam) == 2) { // Register
                 char username[100], password[100];
                 GetWindowText(hUsername, username, 100);
                 GetWindowText(hPassword, password, 100);
-                
+
                 if (strlen(username) == 0 || strlen(password) == 0) {
                     DisplayText("Error: Please enter both username and password.");
                     break;
                 }
-                
-                if (atm.registerUser(username, password)) {
-                    DisplayText("Registration successful! Please login with your new account.");
-                } else {
-                    DisplayText("Error: Username already exists.");
+
+                string user(username), pass(password);
+                if (!Bank::validUsername(user)) {
+                    DisplayText("Error: Usernames are 1 to 32 letters, digits, '_', '.' or '-' (and not \"admin\").");
+                    break;
                 }
+                commands.submit("register", [user, pass]() -> Continuation {
+                    bool ok = atm.registerUser(user, pass);
+                    return [ok] {
+                        if (ok) {
+                            DisplayText("Registration successful! Please login with your new account.");
+                        } else {
+                            DisplayText("Error: Username already exists.");
+                        }
+                    };
+                });
                 break;
             }
-            
-            else if (LOWORD(wParam) == 3) { // Deposit
+
+            else if (LOWORD(wParam) == 3 || LOWORD(wParam) == 4) { // Deposit, Withdraw
+                bool isDeposit = LOWORD(wParam) == 3;
                 char amountStr[100];
                 GetWindowText(hAmount, amountStr, 100);
-                double amount = atof(amountStr);
-                
-                if (amount <= 0) {
+                Money amount;
+
+                if (!Money::parse(amountStr, amount) || amount <= Money()) {
                     DisplayText("Error: Please enter a valid amount.");
                     break;
                 }
-                
-                if (atm.deposit(amount)) {
-                    string balanceText;
-                    double balance = atof(atm.getBalance().c_str());
-                    char buffer[100];
-                    sprintf(buffer, "Deposit successful!\r\nNew Balance: Rs%.2f", balance);
-                    DisplayText(buffer);
-                } else {
-                    DisplayText("Error: Deposit failed. Please try again.");
-                }
+
+                commands.submit(isDeposit ? "deposit" : "withdraw", [isDeposit, amount]() -> Continuation {
+                    bool ok = isDeposit ? atm.deposit(amount) : atm.withdraw(amount);
+                    LimitCheck refused = isDeposit ? LIMIT_OK : atm.getLastLimitCheck();
+                    Money balance = atm.getBalanceAmount();
+                    SessionView now = CurrentSession();
+                    return [isDeposit, ok, refused, balance, now] {
+                        session = now;
+                        if (ok) {
+                            DisplayText(string(isDeposit ? "Deposit" : "Withdrawal")
+                                        + " successful!\r\nNew Balance: Rs" + balance.toString());
+                        } else if (!now.loggedIn) {
+                            ShowSessionEnded();
+                        } else if (isDeposit) {
+                            DisplayText("Error: Deposit failed. Please try again.");
+                        } else if (refused != LIMIT_OK) {
+                            DisplayText(string("Error: Withdrawal refused, ") + limitCheckText(refused) + ".");
+                        } else {
+                            DisplayText("Error: Withdrawal failed. Insufficient funds or invalid amount.");
+                        }
+                    };
+                });
                 break;
             }
-            
-            else if (LOWORD(wParam) == 4) { // Withdraw
-                char amountStr[100];
+
+            else if (LOWORD(wParam) == 18) { // Transfer
+                char amountStr[100], toUser[100];
                 GetWindowText(hAmount, amountStr, 100);
-                double amount = atof(amountStr);
-                
-                if (amount <= 0) {
-                    DisplayText("Error: Please enter a valid amount.");
+                GetWindowText(hTransferTo, toUser, 100);
+                Money amount;
+
+                if (strlen(toUser) == 0) {
+                    DisplayText("Error: Please enter the user to transfer to.");
                     break;
                 }
-                
-                if (atm.withdraw(amount)) {
-                    string balanceText;
-                    double balance = atof(atm.getBalance().c_str());
-                    char buffer[100];
-                    sprintf(buffer, "Withdrawal successful!\r\nNew Balance: Rs%.2f", balance);
-                    DisplayText(buffer);
-                } else {
-                    DisplayText("Error: Withdrawal failed. Insufficient funds or invalid amount.");
+                if (!Money::parse(amountStr, amount) || amount <= Money()) {
+                    DisplayText("Error: Please enter a valid amount.");
+                    break;
                 }
+
+                string to(toUser);
+                commands.submit("transfer", [to, amount]() -> Continuation {
+                    bool ok = atm.transfer(to, amount);
+                    LimitCheck refused = atm.getLastLimitCheck();
+                    Money balance = atm.getBalanceAmount();
+                    SessionView now = CurrentSession();
+                    return [to, amount, ok, refused, balance, now] {
+                        session = now;
+                        if (ok) {
+                            SetWindowText(hTransferTo, "");
+                            DisplayText("Transferred Rs" + amount.toString() + " to " + to
+                                        + ".\r\nNew Balance: Rs" + balance.toString());
+                        } else if (!now.loggedIn) {
+                            ShowSessionEnded();
+                        } else if (refused != LIMIT_OK) {
+                            DisplayText(string("Error: Transfer refused, ") + limitCheckText(refused) + ".");
+                        } else {
+                            DisplayText("Error: Transfer failed. Unknown user or insufficient funds.");
+                        }
+                    };
+                });
                 break;
             }
-            
+
             else if (LOWORD(wParam) == 5) { // Check Balance
-                string balanceInfo = "Account Balance\r\n----------------\r\n"
-                      "Username: " + atm.getCurrentUsername() + "\r\n"
-                      + atm.getBalance();
-                DisplayText(balanceInfo);
+                commands.submit("balance", []() -> Continuation {
+                    string balanceInfo = "Account Balance\r\n----------------\r\n"
+                          "Username: " + atm.getCurrentUsername() + "\r\n"
+                          + atm.getBalance();
+                    return [balanceInfo] { DisplayText(balanceInfo); };
+                });
                 break;
             }
-            
+
             else if (LOWORD(wParam) == 6) { // Logout
-                atm.logout();
                 SetWindowText(hUsername, "");
                 SetWindowText(hPassword, "");
                 SetWindowText(hAmount, "");
-                ShowLoginScreen();
+                SetWindowText(hTransferTo, "");
+                // Queued behind anything still running, so its result is
+                // the last word on the session
+                commands.submit("logout", []() -> Continuation {
+                    atm.logout();
+                    SessionView now = CurrentSession();
+                    return [now] {
+                        session = now;
+                        ShowLoginScreen();
+                    };
+                });
                 break;
             }
-            
+
             else if (LOWORD(wParam) == 7) { // Admin Menu
-                if (atm.isUserAdmin()) {
+                if (session.admin) {
                     ShowAdminMenu();
                 }
                 break;
             }
-            
-            else if (LOWORD(wParam) >= 8 && LOWORD(wParam) <= 13) { // Admin actions
-                if (!atm.isUserAdmin()) {
+
+            else if (LOWORD(wParam) == 15) { // Admin list filter
+                if (HIWORD(wParam) == EN_CHANGE) {
+                    char filter[100] = {0};
+                    GetWindowText(hUserFilter, filter, 100);
+                    {
+                        lock_guard<mutex> rows(userViewLock);
+                        userView.setFilter(filter);
+                    }
+                    RefreshUserList();
+                }
+                break;
+            }
+
+            else if (LOWORD(wParam) == 20) { // Admin username: suggest matching accounts
+                // Read straight from the bank's index (under a millisecond),
+                // like the list view, rather than queued behind slow commands,
+                // as long as the admin's session is still open
+                if (HIWORD(wParam) == EN_CHANGE && session.admin && bank.resumeSession(session.token) != -1) {
+                    char text[100] = {0};
+                    GetWindowText(hAdminUser, text, 100);
+                    if (text[0] == 0) break;
+                    vector<string> names;
+                    bank.searchUsers(text, 10, names);
+                    string matches;
+                    for (const auto& name : names) matches += (matches.empty() ? "" : ", ") + name;
+                    DisplayText(names.empty() ? string("No users match \"") + text + "\""
+                                              : "Matching users: " + matches);
+                }
+                break;
+            }
+
+            else if (LOWORD(wParam) == 17) { // Set Limits
+                if (!session.admin) return 0;
+                char username[100] = {0}, daily[100] = {0}, single[100] = {0}, hourly[100] = {0};
+                GetWindowText(hAdminUser, username, 100);
+                GetWindowText(hLimitDaily, daily, 100);
+                GetWindowText(hLimitSingle, single, 100);
+                GetWindowText(hLimitHourly, hourly, 100);
+                string userStr(username);
+                WithdrawalLimits limits;
+                if (userStr.empty()
+                    || !WithdrawalLimits::parse(daily[0] ? daily : "0", single[0] ? single : "0",
+                                                hourly[0] ? hourly : "0", limits)) {
+                    DisplayText("Error: Enter a username and the limits (amounts, and a count per hour).");
+                    break;
+                }
+                commands.submit("set-limits", [userStr, limits]() -> Continuation {
+                    bool ok = atm.setUserLimits(userStr, limits);
+                    string message = ok ? "Limits for " + userStr + ": " + limits.describe()
+                        : "Error: Failed to set limits. User may not exist or insufficient permissions.";
+                    SessionView now = CurrentSession();
+                    return [now, message] { FinishAdminCommand(now, message, false); };
+                });
+                break;
+            }
+
+            else if (LOWORD(wParam) == 19) { // Bank Report, over all time
+                if (!session.admin) return 0;
+                DisplayText("Reading every account's transactions...");
+                commands.submit("report", []() -> Continuation {
+                    string message = atm.bankReport(0, (long long)time(0));
+                    SessionView now = CurrentSession();
+                    return [now, message] { FinishAdminCommand(now, message, false); };
+                });
+                break;
+            }
+
+            else if (LOWORD(wParam) == 21) { // Check Data: every file, repairing what can be
+                if (!session.admin) return 0;
+                DisplayText("Checking every data file...");
+                commands.submit("verify", []() -> Continuation {
+                    string message = "Data check:\r\n" + atm.verifyData(true);
+                    SessionView now = CurrentSession();
+                    return [now, message] { FinishAdminCommand(now, message, false); };
+                });
+                break;
+            }
+
+            else if (LOWORD(wParam) == 13) { // Back to Menu from Admin
+                ShowMainMenu(true);
+                break;
+            }
+
+            else if (LOWORD(wParam) >= 8 && LOWORD(wParam) <= 14) { // Admin actions
+                if (!session.admin) {
                     return 0;
                 }
-                
+
                 char username[100] = {0};
                 char amountStr[100] = {0};
                 char newPass[100] = {0};
-                
+
                 GetWindowText(hAdminUser, username, 100);
                 GetWindowText(hAdminAmount, amountStr, 100);
                 GetWindowText(hAdminNewPass, newPass, 100);
-                
+
                 string userStr(username);
-                double amount = atof(amountStr);
+                Money amount;
+                if (!Money::parse(amountStr, amount)) amount = Money();
                 string newPassStr(newPass);
-                
+
+                // Each command reports its message (empty for none) and
+                // whether the account list needs a refresh
+                CommandQueue::Work work;
+                const char* name = "";
                 switch (LOWORD(wParam)) {
                     case 8: // Reset Password
-                        if (!userStr.empty() && !newPassStr.empty()) {
-                            if (atm.resetPassword(userStr, newPassStr)) {
-                                DisplayText("Password for " + userStr + " has been reset.");
-                            } else {
-                                DisplayText("Error: Failed to reset password. User may not exist or insufficient permissions.");
-                            }
-                        }
+                        if (userStr.empty() || newPassStr.empty()) break;
+                        name = "reset";
+                        work = [userStr, newPassStr]() -> Continuation {
+                            bool ok = atm.resetPassword(userStr, newPassStr);
+                            string message = ok ? "Password for " + userStr + " has been reset."
+                                : "Error: Failed to reset password. User may not exist or insufficient permissions.";
+                            SessionView now = CurrentSession();
+                            return [now, message] { FinishAdminCommand(now, message, false); };
+                        };
                         break;
-                        
+
                     case 9: // Toggle Freeze
-                        if (!userStr.empty()) {
-                            if (atm.toggleFreezeAccount(userStr)) {
-                                string status = atm.isUserFrozen(userStr) ? "frozen" : "unfrozen";
-                                DisplayText("Account " + userStr + " has been " + status + ".");
-                                ShowAdminMenu(); // Refresh the display
-                            } else {
-                                DisplayText("Error: Failed to toggle account status. User may not exist or insufficient permissions.");
-                            }
-                        }
+                        if (userStr.empty()) break;
+                        name = "freeze";
+                        work = [userStr]() -> Continuation {
+                            bool ok = atm.toggleFreezeAccount(userStr);
+                            string message = ok ? "Account " + userStr + " has been "
+                                                  + (atm.isUserFrozen(userStr) ? "frozen." : "unfrozen.")
+                                : "Error: Failed to toggle account status. User may not exist or insufficient permissions.";
+                            SessionView now = CurrentSession();
+                            return [now, message, ok] { FinishAdminCommand(now, message, ok); };
+                        };
                         break;
-                        
+
                     case 10: // Admin Deposit
-                        if (!userStr.empty() && amount > 0) {
-                            if (atm.adminDeposit(userStr, amount)) {
-                                DisplayText("Deposited Rs." + to_string(amount) + " to " + userStr);
-                                ShowAdminMenu();
+                    case 11: { // Admin Withdraw
+                        if (userStr.empty() || amount <= Money()) break;
+                        bool isDeposit = LOWORD(wParam) == 10;
+                        name = isDeposit ? "adm-deposit" : "adm-withdraw";
+                        work = [isDeposit, userStr, amount]() -> Continuation {
+                            bool ok = isDeposit ? atm.adminDeposit(userStr, amount) : atm.adminWithdraw(userStr, amount);
+                            string message;
+                            if (isDeposit) {
+                                message = ok ? "Deposited Rs." + amount.toString() + " to " + userStr
+                                    : "Error: Deposit failed. User may not exist or insufficient permissions.";
                             } else {
-                                DisplayText("Error: Deposit failed. User may not exist or insufficient permissions.");
+                                message = ok ? "Withdrawn Rs." + amount.toString() + " from " + userStr
+                                    : "Error: Withdrawal failed. Insufficient funds or invalid user/permissions.";
                             }
-                        }
+                            SessionView now = CurrentSession();
+                            return [now, message, ok] { FinishAdminCommand(now, message, ok); };
+                        };
                         break;
-                        
-                    case 11: // Admin Withdraw
-                        if (!userStr.empty() && amount > 0) {
-                            if (atm.adminWithdraw(userStr, amount)) {
-                                DisplayText("Withdrawn Rs." + to_string(amount) + " from " + userStr);
-                                ShowAdminMenu();
-                            } else {
-                                DisplayText("Error: Withdrawal failed. Insufficient funds or invalid user/permissions.");
-                            }
-                        }
-                        break;
-                        
+                    }
+
                     case 12: // View Transactions
-                        if (!userStr.empty()) {
-                            string transactions = atm.getUserTransactionHistory(userStr);
-                            DisplayText("Transactions for " + userStr + ":\r\n" + transactions);
-                        }
+                        if (userStr.empty()) break;
+                        name = "history";
+                        DisplayText("Reading transactions...");
+                        work = [userStr]() -> Continuation {
+                            string message = "Transactions for " + userStr + ":\r\n"
+                                           + atm.getUserTransactionHistory(userStr);
+                            SessionView now = CurrentSession();
+                            return [now, message] { FinishAdminCommand(now, message, false); };
+                        };
                         break;
-                        
-                    case 13: // Back to Menu from Admin
-                        ShowMainMenu(true);
+
+                    case 14: { // Run Batch File ("username amount D|W" per line)
+                        char path[MAX_PATH] = {0};
+                        OPENFILENAME ofn = { };
+                        ofn.lStructSize = sizeof(ofn);
+                        ofn.hwndOwner = hwnd;
+                        ofn.lpstrFilter = "Batch files (*.txt)\0*.txt\0All files\0*.*\0";
+                        ofn.lpstrFile = path;
+                        ofn.nMaxFile = MAX_PATH;
+                        ofn.Flags = OFN_FILEMUSTEXIST | OFN_PATHMUSTEXIST;
+                        if (!GetOpenFileName(&ofn)) break;
+                        name = "batch";
+                        DisplayText("Running batch file...");
+                        string file(path);
+                        work = [file]() -> Continuation {
+                            string message = atm.runBatchFile(file);
+                            SessionView now = CurrentSession();
+                            return [now, message] { FinishAdminCommand(now, message, true); };
+                        };
                         break;
+                    }
                 }
-                
+                if (work) commands.submit(name, work);
+
                 // Clear input fields
                 SetWindowText(hAdminUser, "");
                 SetWindowText(hAdminAmount, "");
@@ -665,8 +860,18 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
             }
             break;
         }
-        
+
+        case WM_COMMAND_DONE: { // Finish commands on this thread, in order
+            CommandQueue::Result result;
+            while (commands.takeResult(result)) {
+                if (result.done) result.done();
+            }
+            break;
+        }
+
         case WM_DESTROY:
+            commands.stop();
+            KillTimer(hwnd, 1);
             PostQuitMessage(0);
             return 0;
             
@@ -678,6 +883,28 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
 
 // Entry point
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow) {
+    // Format conversion: /export <file> or /import <file>, then exit
+    string commandLine(lpCmdLine ? lpCmdLine : "");
+    if (commandLine.compare(0, 8, "/export ") == 0 || commandLine.compare(0, 8, "/import ") == 0) {
+        string path = commandLine.substr(8);
+        bool exporting = commandLine[1] == 'e';
+        string problem;
+        bool ok = exporting ? atm.exportText(path) : atm.importText(path, &problem);
+        string message = ok ? "Conversion finished." : "Conversion failed.";
+        if (!problem.empty()) message += "\n" + path + ": " + problem + " (nothing was imported)";
+        MessageBox(NULL, message.c_str(), "ATM System", ok ? MB_OK : MB_OK | MB_ICONERROR);
+        return ok ? 0 : 1;
+    }
+
+    // /metrics <file>: keep writing timings and I/O counts to the file
+    if (commandLine.compare(0, 9, "/metrics ") == 0) {
+        metrics::setDumpFile(commandLine.substr(9), 10);
+    }
+
+    // List view control for the admin account list
+    INITCOMMONCONTROLSEX controls = { sizeof(controls), ICC_LISTVIEW_CLASSES };
+    InitCommonControlsEx(&controls);
+
     // Register window class
     const char CLASS_NAME[] = "ATMClass";
     
@@ -693,7 +920,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     hMainWnd = CreateWindowEx(
         0, CLASS_NAME, "ATM System",
         WS_OVERLAPPED | WS_CAPTION | WS_SYSMENU | WS_MINIMIZEBOX,
-        CW_USEDEFAULT, CW_USEDEFAULT, 600, 400,
+        CW_USEDEFAULT, CW_USEDEFAULT, 820, 440,
         NULL, NULL, hInstance, NULL
     );
     